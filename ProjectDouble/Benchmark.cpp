@@ -0,0 +1,404 @@
+//--------------------------------------------------------------------------------------
+// Benchmark - runs the scene for a fixed number of frames along a scripted camera path
+//--------------------------------------------------------------------------------------
+
+#include "Benchmark.h"
+#include "Scene.h"
+#include "ModelManager.h"
+#include "Camera.h"
+#include "RecordingRenderDevice.h"
+#include "StateCacheRenderDevice.h"
+#include "Profiler.h"
+#include "Common.h"
+#include <windows.h>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+
+
+//--------------------------------------------------------------------------------------
+// Allocation counting
+//--------------------------------------------------------------------------------------
+
+#ifdef PROJECTDOUBLE_COUNT_ALLOCATIONS
+
+namespace
+{
+	std::atomic<uint64_t> sAllocationCount(0);
+	std::atomic<uint64_t> sAllocatedBytes(0);
+
+	void CountAllocation(size_t size)
+	{
+		sAllocationCount.fetch_add(1, std::memory_order_relaxed);
+		sAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+}
+
+// The other forms of new and delete (arrays, nothrow, sized) call these by default
+void* operator new(size_t size)
+{
+	CountAllocation(size);
+	void* p = std::malloc(size > 0 ? size : 1);
+	if (!p)  throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	CountAllocation(size);
+	void* p = _aligned_malloc(size > 0 ? size : 1, static_cast<size_t>(alignment));
+	if (!p)  throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+	_aligned_free(p);
+}
+
+
+uint64_t AllocationCount()
+{
+	return sAllocationCount.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocatedBytes()
+{
+	return sAllocatedBytes.load(std::memory_order_relaxed);
+}
+
+bool AllocationCountingEnabled()
+{
+	return true;
+}
+
+#else
+
+// Built without the replacement operators, nothing is counted
+uint64_t AllocationCount()
+{
+	return 0;
+}
+
+uint64_t AllocatedBytes()
+{
+	return 0;
+}
+
+bool AllocationCountingEnabled()
+{
+	return false;
+}
+
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Camera path
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// Points the camera passes through and what it looks at there. The path is a closed loop around the scene, passing
+	// over the water, past the portal and near the lights, with the camera kept above the water
+	struct PathPoint
+	{
+		CVector3 position;
+		CVector3 target;
+	};
+	const PathPoint kCameraPath[] =
+	{
+		{ { -60, 45,  -60 }, {  60, 20,   0 } },
+		{ { -60, 35,  100 }, {  60, 20,  40 } },
+		{ {  60, 30,  180 }, {  80, 20,  60 } },
+		{ { 200, 40,  170 }, { 120, 20,  50 } },
+		{ { 250, 50,    0 }, { 100, 20,   0 } },
+		{ { 200, 35, -150 }, { 120, 20, -60 } },
+		{ {  60, 30, -160 }, {  40, 20, -60 } },
+		{ {   0, 25,  -80 }, {  50, 25,  40 } },
+	};
+	const unsigned int kNumPathPoints = sizeof(kCameraPath) / sizeof(kCameraPath[0]);
+
+	// Seconds to go once round the path, i.e. 1200 frames at 60 frames per second
+	const float kPathDuration = 20.0f;
+
+	// Catmull-Rom spline through p1 and p2, t from 0 at p1 to 1 at p2
+	CVector3 CatmullRom(const CVector3& p0, const CVector3& p1, const CVector3& p2, const CVector3& p3, float t)
+	{
+		float t2 = t * t;
+		float t3 = t2 * t;
+		return 0.5f * (2.0f * p1 + t * (p2 - p0) + t2 * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) +
+		               t3 * (3.0f * p1 - p0 - 3.0f * p2 + p3));
+	}
+
+	// Place the camera on the path at the given time, facing its target. Each section between points takes the same time
+	void PlaceCamera(Camera* camera, float time)
+	{
+		float pathTime = std::fmod(time, kPathDuration) / kPathDuration * kNumPathPoints;
+		unsigned int section = static_cast<unsigned int>(pathTime) % kNumPathPoints;
+		float t = pathTime - std::floor(pathTime);
+
+		const PathPoint& p0 = kCameraPath[(section + kNumPathPoints - 1) % kNumPathPoints];
+		const PathPoint& p1 = kCameraPath[section];
+		const PathPoint& p2 = kCameraPath[(section + 1) % kNumPathPoints];
+		const PathPoint& p3 = kCameraPath[(section + 2) % kNumPathPoints];
+		camera->SetPosition(CatmullRom(p0.position, p1.position, p2.position, p3.position, t));
+		camera->WorldMatrix().FaceTarget(CatmullRom(p0.target, p1.target, p2.target, p3.target, t));
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Results
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// Measurements of one frame
+	struct FrameStats
+	{
+		float              time;          // CPU time of the update and render in milliseconds
+		unsigned int       drawCalls;
+		unsigned int       stateChanges;
+		unsigned long long bytesUploaded;
+		uint64_t           allocations;
+		uint64_t           allocatedBytes;
+	};
+
+	// Value at the given fraction through a sorted list (nearest rank), as in the profiler summary
+	float Percentile(const std::vector<float>& sortedValues, float fraction)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(fraction * sortedValues.size()));
+		return sortedValues[rank > 0 ? rank - 1 : 0];
+	}
+
+	// Write a string as a JSON string literal
+	void WriteJSONString(std::ostream& out, const std::string& text)
+	{
+		out << '"';
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')  out << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20)  out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+			else out << c;
+		}
+		out << '"';
+	}
+
+	// Write the mean, maximum and total of one count over the frames as a JSON object member, or null if the count
+	// isn't available in this build
+	template <typename T>
+	void WriteCount(std::ostream& out, const char* name, const std::vector<FrameStats>& frames, T FrameStats::* count,
+	                bool available = true)
+	{
+		if (!available)
+		{
+			out << "    \"" << name << "\": null";
+			return;
+		}
+		uint64_t total = 0, max = 0;
+		for (auto& frame : frames)
+		{
+			total += frame.*count;
+			max = std::max<uint64_t>(max, frame.*count);
+		}
+		out << "    \"" << name << "\": { \"mean\": " << static_cast<double>(total) / frames.size()
+		    << ", \"max\": " << max << ", \"total\": " << total << " }";
+	}
+
+	// Write the results as JSON. Returns false if the file can't be written
+	bool WriteResults(const BenchmarkSettings& settings, const std::vector<FrameStats>& frames)
+	{
+		std::ofstream file(settings.outputFile);
+		if (!file)  return false;
+
+		std::vector<float> times;
+		double totalTime = 0;
+		for (auto& frame : frames)
+		{
+			times.push_back(frame.time);
+			totalTime += frame.time;
+		}
+		std::sort(times.begin(), times.end());
+
+		file << std::fixed << std::setprecision(4);
+		file << "{\n";
+		file << "  \"frames\": " << frames.size() << ",\n";
+		file << "  \"warmupFrames\": " << settings.warmupFrames << ",\n";
+		file << "  \"timeStep\": " << settings.timeStep << ",\n";
+		file << "  \"viewport\": [" << gViewportWidth << ", " << gViewportHeight << "],\n";
+		file << "  \"allocationCounting\": " << (AllocationCountingEnabled() ? "true" : "false") << ",\n";
+		file << "  \"frameTimeMs\": { \"mean\": " << totalTime / frames.size() << ", \"median\": " << Percentile(times, 0.5f)
+		     << ", \"p95\": " << Percentile(times, 0.95f) << ", \"p99\": " << Percentile(times, 0.99f)
+		     << ", \"max\": " << times.back() << " },\n";
+
+		file << "  \"perFrame\": {\n";
+		WriteCount(file, "drawCalls", frames, &FrameStats::drawCalls);         file << ",\n";
+		WriteCount(file, "stateChanges", frames, &FrameStats::stateChanges);   file << ",\n";
+		WriteCount(file, "bytesUploaded", frames, &FrameStats::bytesUploaded); file << ",\n";
+		WriteCount(file, "allocations", frames, &FrameStats::allocations, AllocationCountingEnabled()); file << ",\n";
+		WriteCount(file, "allocatedBytes", frames, &FrameStats::allocatedBytes, AllocationCountingEnabled());
+		file << "\n  },\n";
+
+		// The profiler keeps the last kSummaryFrames frames, so the zones only cover the end of a long run
+		file << "  \"zones\": [";
+		bool first = true;
+		for (auto& zone : gProfiler.Summary())
+		{
+			file << (first ? "\n" : ",\n") << "    { \"name\": ";
+			WriteJSONString(file, zone.name);
+			file << ", \"depth\": " << zone.depth << ", \"frames\": " << zone.frames << ", \"calls\": " << zone.calls
+			     << ", \"median\": " << zone.median << ", \"p95\": " << zone.p95 << ", \"p99\": " << zone.p99
+			     << ", \"max\": " << zone.max << " }";
+			first = false;
+		}
+		file << "\n  ],\n";
+		file << "  \"droppedZones\": " << gProfiler.DroppedZones() << "\n";
+		file << "}\n";
+		return static_cast<bool>(file);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// Read an option's value as a whole number. Returns false if the value is missing, isn't a number or is too large
+	bool ReadNumber(std::istream& options, unsigned int& value)
+	{
+		std::string text;
+		if (!(options >> text) || text.size() > 9 || text.find_first_not_of("0123456789") != std::string::npos)  return false;
+		value = static_cast<unsigned int>(std::stoul(text));
+		return true;
+	}
+}
+
+// Read the benchmark options from the command line into the settings. Returns true if -benchmark was given. Sets
+// error for the first malformed option, the rest are still read so the error goes to the requested output file
+bool ParseBenchmarkCommandLine(const std::string& commandLine, BenchmarkSettings& settings, std::string& error)
+{
+	bool benchmark = false;
+	error.clear();
+	std::istringstream options(commandLine);
+	std::string option;
+	while (options >> option)
+	{
+		std::string optionError;
+		if (option == "-benchmark")  benchmark = true;
+		else if (option == "-frames")
+		{
+			if (!ReadNumber(options, settings.frames) || settings.frames == 0)  optionError = "-frames needs a number of at least 1";
+		}
+		else if (option == "-warmup")
+		{
+			if (!ReadNumber(options, settings.warmupFrames))  optionError = "-warmup needs a number";
+		}
+		else if (option == "-output")
+		{
+			if (!(options >> settings.outputFile))  optionError = "-output needs a file name";
+		}
+		else if (option == "-trace")
+		{
+			if (!(options >> settings.traceFile))  optionError = "-trace needs a file name";
+		}
+		if (error.empty())  error = optionError;
+	}
+	return benchmark;
+}
+
+
+// Run the benchmark and write the results. Returns false if the results can't be written or the window is closed
+bool RunBenchmark(const BenchmarkSettings& settings)
+{
+	// Render through a null device under the state cache, so the counts are of the commands that would reach DirectX
+	RecordingRenderDevice* recordingDevice = new RecordingRenderDevice(false);
+	delete gRenderDevice;
+	gRenderDevice = new StateCacheRenderDevice(recordingDevice);
+
+	Camera* camera = ModelCreator->gCamera;
+	std::vector<FrameStats> frames;
+	frames.reserve(settings.frames);
+	bool traceWritten = true;
+
+	unsigned int totalFrames = settings.warmupFrames + settings.frames;
+	for (unsigned int frame = 0; frame < totalFrames; ++frame)
+	{
+		bool measured = (frame >= settings.warmupFrames);
+		if (frame == settings.warmupFrames && !settings.traceFile.empty())
+		{
+			gProfiler.CaptureFrames(settings.frames, settings.traceFile);
+		}
+
+		// Warmup frames stay at the start of the path, so the measured frames start from a scene that has settled there
+		float pathTime = measured ? (frame - settings.warmupFrames) * settings.timeStep : 0.0f;
+
+		recordingDevice->Reset();
+		uint64_t allocations = AllocationCount();
+		uint64_t allocatedBytes = AllocatedBytes();
+		int64_t start = Profiler::Now();
+
+		// Place the camera after the update, which may move it with the camera controls
+		UpdateScene(settings.timeStep);
+		PlaceCamera(camera, pathTime);
+		RenderScene();
+
+		int64_t end = Profiler::Now();
+		if (measured)
+		{
+			frames.push_back({ (end - start) * 1e-6f, recordingDevice->NumDrawCalls(), recordingDevice->NumStateChanges(),
+			                   recordingDevice->BytesUploaded(), AllocationCount() - allocations, AllocatedBytes() - allocatedBytes });
+		}
+		if (!gProfiler.EndFrame())  traceWritten = false;
+
+		// Keep the hidden window responding. Stop if it has been closed
+		MSG msg = {};
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+		{
+			if (msg.message == WM_QUIT)
+			{
+				gLastError = "Window closed before the benchmark finished";
+				return false;
+			}
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+	}
+
+	if (!WriteResults(settings, frames))
+	{
+		gLastError = "Error writing benchmark results to " + settings.outputFile;
+		return false;
+	}
+	if (!traceWritten)
+	{
+		gLastError = "Error writing benchmark trace to " + settings.traceFile;
+		return false;
+	}
+	return true;
+}
+
+
+// Write a JSON file holding only the given error. Returns false if the file can't be written
+bool WriteBenchmarkError(const BenchmarkSettings& settings, const std::string& error)
+{
+	std::ofstream file(settings.outputFile);
+	if (!file)  return false;
+	file << "{\n  \"error\": ";
+	WriteJSONString(file, error);
+	file << "\n}\n";
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// Benchmark - runs the scene for a fixed number of frames along a scripted camera path
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Start the app with -benchmark on the command line to run the benchmark instead of the interactive loop. The window
+// is never shown and the scene is rendered through a null device (RecordingRenderDevice with logging off under the
+// state cache), so nothing is drawn on the GPU but every draw, state change and buffer upload is counted. DirectX is
+// still used to create the scene's resources, so a D3D11 device is needed.
+//
+// Each frame is updated by the same fixed time step and the camera follows a closed spline through the scene, so
+// every run renders exactly the same frames. The CPU time of each frame's update and render, the counts from the
+// device and the number of heap allocations are written to a JSON file along with the profiler's zone summary, to be
+// compared between builds. Command line options:
+//   -benchmark          Run the benchmark
+//   -frames N           Frames measured (default 1200, one loop of the camera path)
+//   -warmup N           Frames run before measuring, not included in the results (default 60)
+//   -output File        JSON file written (default Benchmark.json)
+//   -trace File         Also write the measured frames as a Chrome trace (see Profiler.h)
+// File names can't contain spaces. A malformed option stops the benchmark before it starts, with the error written to
+// the JSON file.
+//
+// Allocations are only counted in builds with PROJECTDOUBLE_COUNT_ALLOCATIONS defined, which replaces global operator
+// new and delete in the .cpp file (two relaxed atomic additions per allocation). Build the benchmark with
+// msbuild RenderTexture.sln /p:Configuration=Release /p:Platform=x64 /p:CountAllocations=true to define it. In other
+// builds the JSON file has "allocationCounting": false and null allocation counts
+
+#ifndef _BENCHMARK_H_INCLUDED_
+#define _BENCHMARK_H_INCLUDED_
+
+#include <string>
+#include <cstdint>
+
+
+struct BenchmarkSettings
+{
+	unsigned int frames = 1200;
+	unsigned int warmupFrames = 60;
+	float        timeStep = 1.0f / 60.0f;
+	std::string  outputFile = "Benchmark.json";
+	std::string  traceFile;  // No trace if empty
+};
+
+
+// Read the benchmark options from the command line into the settings. Returns true if -benchmark was given. Sets error
+// to a description of the first malformed option (a missing value, or a -frames or -warmup value that isn't a whole
+// number, or -frames 0), or to an empty string if there are none. Unknown options are ignored
+bool ParseBenchmarkCommandLine(const std::string& commandLine, BenchmarkSettings& settings, std::string& error);
+
+// Run the benchmark and write the results, call after InitGeometry and InitScene. Replaces gRenderDevice with a null
+// device, so the interactive loop can't be used afterwards. Returns false if the results can't be written or the
+// window is closed before the end
+bool RunBenchmark(const BenchmarkSettings& settings);
+
+// Write a JSON file holding only the given error, for failures before the benchmark starts. Returns false if the file
+// can't be written
+bool WriteBenchmarkError(const BenchmarkSettings& settings, const std::string& error);
+
+
+// Heap allocations made with operator new since the program started, and their total size in bytes. Always 0 unless
+// AllocationCountingEnabled, i.e. the program was built with PROJECTDOUBLE_COUNT_ALLOCATIONS
+uint64_t AllocationCount();
+uint64_t AllocatedBytes();
+bool AllocationCountingEnabled();
+
+
+#endif //_BENCHMARK_H_INCLUDED_
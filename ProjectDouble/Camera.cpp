@@ -116,6 +116,20 @@ CVector3 Camera::PixelFromWorldPt(CVector3 worldPoint, unsigned int viewportWidt
 	return { x, y, cameraPt.z };
 }
 
+// Get the ray from the camera through the given pixel, e.g. the mouse position, for picking. Pass the viewport width
+// and height. The origin is the camera position and the direction has unit length
+void Camera::RayFromPixel(CVector2 pixel, unsigned int viewportWidth, unsigned int viewportHeight, CVector3& origin, CVector3& direction)
+{
+	// Find the point on the near clip plane under the pixel using the pixel size there, the ray goes from the camera through it
+	CVector2 pixelSize = PixelSizeInWorldSpace(mNearClip, viewportWidth, viewportHeight);
+	float x = (pixel.x - viewportWidth  * 0.5f) * pixelSize.x;
+	float y = (viewportHeight * 0.5f - pixel.y) * pixelSize.y;
+	CVector3 nearPoint = ZAxis() * mNearClip + XAxis() * x + YAxis() * y;
+
+	origin = Position();
+	direction = Normalise(nearPoint);
+}
+
 
 // Return the size of a pixel in world space at the given Z distance. Allows us to convert the 2D size of areas on the screen to actualy sizes in the world
 // Pass the viewport width and height
@@ -79,7 +79,11 @@ public:
 	// is less than the camera near clip (use NearClip() member function), then the world
 	// point is behind the camera and the 2D x and y coordinates are to be ignored.
 	CVector3 PixelFromWorldPt(CVector3 worldPoint, unsigned int viewportWidth, unsigned int viewportHeight);
-	
+
+	// Get the ray from the camera through the given pixel, e.g. the mouse position, for picking. Pass the viewport width
+	// and height. The origin is the camera position and the direction has unit length
+	void RayFromPixel(CVector2 pixel, unsigned int viewportWidth, unsigned int viewportHeight, CVector3& origin, CVector3& direction);
+
 	// Return the size of a pixel in world space at the given Z distance. Allows us to convert the 2D size of areas on the screen to actualy sizes in the world
 	// Pass the viewport width and height
 	CVector2 PixelSizeInWorldSpace(float Z, unsigned int viewportWidth, unsigned int viewportHeight);
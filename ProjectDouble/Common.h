@@ -47,6 +47,35 @@ extern const float ROTATION_SPEED;
 extern const float MOVEMENT_SPEED;
 
 
+// Frame counter, incremented at the start of each RenderScene. Used to stamp data that is cached across the
+// rendering passes of a frame (e.g. the occlusion buffer's last render)
+extern unsigned int gFrameNumber;
+
+// Counts of model hierarchy updates made by Model::UpdateAbsoluteMatrices since the statistics were last shown
+struct TransformCacheStats
+{
+	unsigned int recalculated = 0; // Models whose absolute matrices were recalculated because they had changed
+	unsigned int skipped      = 0; // Models whose absolute matrices were up to date at their first use in a frame
+};
+extern TransformCacheStats gTransformCacheStats;
+
+// Data sent to the GPU by UpdateConstantBuffer since the statistics were last shown
+struct ConstantBufferStats
+{
+	unsigned long long bytesUploaded = 0;
+	unsigned int       uploads       = 0;
+};
+extern ConstantBufferStats gConstantBufferStats;
+
+// Binds made through the StateCacheRenderDevice since the statistics were last shown
+struct RenderStateCacheStats
+{
+	unsigned int issued = 0; // Binds that changed the pipeline state and were passed on to DirectX
+	unsigned int elided = 0; // Binds that matched the state already set and were dropped
+};
+extern RenderStateCacheStats gRenderStateCacheStats;
+
+
 // A global error message to help track down fatal errors - set it to a useful message
 // when a serious error occurs
 extern std::string gLastError;
@@ -69,19 +98,13 @@ struct PerFrameConstants
     CMatrix4x4 projectionMatrix;
     CMatrix4x4 viewProjectionMatrix; // The above two matrices multiplied together to combine their effects
 
-    CVector3   light1Position; // 3 floats: x, y z
-    float      viewportWidth;      // IMPORTANT technical point: shaders work with float4 values. If constant buffer variables don't align
-                              // to the size of a float4 then HLSL (GPU) will insert padding, which can cause problems matching 
-                              // structure between C++ and GPU. So add these unused padding variables to both HLSL and C++ structures.
-    CVector3   light1Colour;
+    // IMPORTANT technical point: shaders work with float4 values. If constant buffer variables don't align to the size
+    // of a float4 then HLSL (GPU) will insert padding, which can cause problems matching structure between C++ and GPU.
+    // So variables are kept in groups of four floats, with unused padding variables in both HLSL and C++ structures
+    float      viewportWidth;
     float      viewportHeight;
-	
-
-    CVector3   light2Position;
     float      alphaValue;
-    CVector3   light2Colour;
     float      blurIncrement;
-	 
 
     CVector3   ambientColour;
     float      specularPower;  // In this case we actually have a useful float variable that we can use to pad to a float4
@@ -89,37 +112,27 @@ struct PerFrameConstants
     CVector3   cameraPosition;
     float      padding5;
 
-	CVector3   light3Position;
-	float      padding7;
-	CVector3   light3Colour;
-	float      padding8;
-
-	CVector3   light4Position;
-	float      padding9;
-	CVector3   light4Colour;
-	float      padding10;
-
-	
-
-	CVector3   light5Position;
+	// The scene's lights are in the light buffer (see LightBuffer.h), these are the spotlights that have shadow maps,
+	// for the shaders that use them
+	CVector3   shadowLight1Position;
 	float      padding11;
-	CVector3   light5Colour;
+	CVector3   shadowLight1Colour;
 	float      padding12;
 
-	CVector3   light5Facing;
-	float      light5CosHalfAngle;
-	CMatrix4x4 light5ViewMatrix;
-	CMatrix4x4 light5ProjectionMatrix;
+	CVector3   shadowLight1Facing;
+	float      shadowLight1CosHalfAngle;
+	CMatrix4x4 shadowLight1ViewMatrix;
+	CMatrix4x4 shadowLight1ProjectionMatrix;
 
-	CVector3   light6Position;
+	CVector3   shadowLight2Position;
 	float      padding13;
-	CVector3   light6Colour;
+	CVector3   shadowLight2Colour;
 	float      padding14;
 
-	CVector3   light6Facing;
-	float      light6CosHalfAngle;
-	CMatrix4x4 light6ViewMatrix;
-	CMatrix4x4 light6ProjectionMatrix;
+	CVector3   shadowLight2Facing;
+	float      shadowLight2CosHalfAngle;
+	CMatrix4x4 shadowLight2ViewMatrix;
+	CMatrix4x4 shadowLight2ProjectionMatrix;
 
 	float	  wiggle;
 	float	 lerpCount;
@@ -141,19 +154,28 @@ extern PerFrameConstants gPerFrameConstants;      // This variable holds the CPU
 extern ID3D11Buffer*     gPerFrameConstantBuffer; // This variable controls the GPU-side constant buffer matching to the above structure
 
 
-static const int MAX_BONES = 64;
 // This is the matrix that positions the next thing to be rendered in the scene. Unlike the structure above this data can be
 // updated and sent to the GPU several times every frame (once per model). However, apart from that it works in the same way.
+// Kept small because it is sent for every node of every rigid model, the bone matrices are in a separate buffer below
 struct PerModelConstants
 {
     CMatrix4x4 worldMatrix;
     CVector3   objectColour; // Allows each light model to be tinted to match the light colour they cast
     float      padding6;
-	CMatrix4x4 boneMatrices[MAX_BONES];
 };
 extern PerModelConstants gPerModelConstants;      // This variable holds the CPU-side constant buffer described above
 extern ID3D11Buffer*     gPerModelConstantBuffer; // This variable controls the GPU-side constant buffer related to the above structure
 
+static const int MAX_BONES = 64;
+// Bone matrices for a skinned model, sent once per skinned model. Only the bones the mesh uses are sent (see Mesh::Render)
+// Must match the PerSkeletonConstants buffer in the Common.hlsli shader file
+struct PerSkeletonConstants
+{
+	CMatrix4x4 boneMatrices[MAX_BONES];
+};
+extern PerSkeletonConstants gPerSkeletonConstants;      // This variable holds the CPU-side constant buffer described above
+extern ID3D11Buffer*        gPerSkeletonConstantBuffer; // This variable controls the GPU-side constant buffer related to the above structure
+
 // Settings used by post-processes - must match the similar structure in the Common.hlsli shader file
 struct PostProcessingConstants
 {
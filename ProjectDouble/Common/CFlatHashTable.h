@@ -0,0 +1,397 @@
+/**************************************************************************************************
+	Module:       CFlatHashTable.h
+
+	Open-addressing hash table with the same interface as CHashTable (see CHashTable.h). Key/value
+	pairs are stored directly in a single array rather than in a list per bucket, so there is no
+	memory allocation per entry and a look-up reads neighbouring memory rather than following
+	pointers.
+
+	Collisions are resolved with Robin Hood linear probing: when inserting, an entry that is
+	further from its ideal position than the entry in a slot takes that slot, and the displaced
+	entry continues along the table. This keeps all probe sequences short and similar in length.
+	Deletion shifts the following entries back one slot, so no "tombstone" markers are needed.
+**************************************************************************************************/
+
+#ifndef GEN_C_FLAT_HASH_TABLE_H_INCLUDED
+#define GEN_C_FLAT_HASH_TABLE_H_INCLUDED
+
+#include <iostream>
+#include <utility>
+using namespace std;
+
+#include "Defines.h"
+#include "Error.h"
+#include "CHashTable.h" // For hashing functions and CKeyHash
+
+namespace gen
+{
+
+/*---------------------------------------------------------------------------------------------
+	CFlatHashTable class
+---------------------------------------------------------------------------------------------*/
+
+// Template class, see CHashTable for the general notes on the key and value types. In addition
+// both types must have a default constructor, since the table holds an array of key/value pairs
+template <class TKeyType, class TValueType>
+class CFlatHashTable
+{
+
+/*---------------------------------------------------------------------------------------------
+	Constructors / Destructore
+---------------------------------------------------------------------------------------------*/
+public:
+	// Constructor takes initial table size, a hashing function, and the maximum load factor
+	// before the table is resized - see data section at end. The size is rounded up to a power
+	// of two so hash values can be converted to slots with a mask rather than a modulus.
+	// Robin Hood probing copes well with a fuller table than CHashTable, hence the higher default
+	CFlatHashTable
+	(
+		const TUInt32  iInitialSize,            // Initial size for the hash table
+		THashFunction  pfHashFunction = XXHash, // Hashing function to use
+		const TFloat32 fMaxLoadFactor = 0.875f  // Maximum load factor
+	) : m_kpfHashFunction( pfHashFunction ), m_kfMaxLoadFactor( fMaxLoadFactor )
+	{
+		GEN_GUARD;
+
+		// Allocate initial hash table arrays
+		m_iSize = kiMinSize;
+		while (m_iSize < iInitialSize)
+		{
+			m_iSize *= 2;
+		}
+		m_aEntries = new TKeyValuePair[m_iSize];
+		m_aDistances = new TUInt16[m_iSize]();
+		GEN_ASSERT( m_aEntries && m_aDistances, "Fatal memory error reserving hash table memory" );
+
+		// Starting with no hash table entries
+		m_iNumEntries = 0;
+
+		GEN_ENDGUARD;
+	}
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CFlatHashTable( const CFlatHashTable& );
+	CFlatHashTable& operator=( const CFlatHashTable& );
+
+public:
+	// Destructor to free hash table memory
+	~CFlatHashTable()
+	{
+		delete[] m_aEntries;
+		delete[] m_aDistances;
+	}
+
+
+/*---------------------------------------------------------------------------------------------
+	Public interface
+---------------------------------------------------------------------------------------------*/
+public:
+	// Looks up value associated with given key and puts in in given pointer. Returns true if
+	// the key was found
+	bool LookUpKey
+	(
+		const TKeyType& key,
+		TValueType*     pValue
+	) const
+	{
+		TUInt32 iSlot;
+		if (!FindSlot( key, &iSlot ))
+		{
+			return false;
+		}
+
+		// Found key, copy its value out and return true
+		*pValue = m_aEntries[iSlot].value;
+		return true;
+	}
+
+	// Version of LookUpKey for a different type of key that has the same CKeyHash look-up class,
+	// e.g. a string table can be searched with a C-string or string_view without creating a string
+	template <class TLookUpType,
+	          class = typename enable_if<!is_same<typename decay<TLookUpType>::type, TKeyType>::value &&
+	                                     CCanLookUpKey<TKeyType, TLookUpType>::value>::type>
+	bool LookUpKey
+	(
+		const TLookUpType& key,
+		TValueType*        pValue
+	) const
+	{
+		TUInt32 iSlot;
+		if (!FindSlot( key, &iSlot ))
+		{
+			return false;
+		}
+		*pValue = m_aEntries[iSlot].value;
+		return true;
+	}
+
+
+	// Add the given key-value pair to the table, if the key already exists, just update its value
+	void SetKeyValue
+	(
+		const TKeyType&   key,
+		const TValueType& value
+	)
+	{
+		// If key already exists, simply update the value associated with it
+		TUInt32 iSlot;
+		if (FindSlot( key, &iSlot ))
+		{
+			m_aEntries[iSlot].value = value;
+			return;
+		}
+
+		// Check loading of table - if too full, then double it in size
+		if (m_iNumEntries + 1 > m_iSize * m_kfMaxLoadFactor)
+		{
+			Resize( m_iSize * 2 );
+		}
+
+		TKeyValuePair newPair;
+		newPair.key = key;
+		newPair.value = value;
+		InsertNewPair( newPair );
+	}
+
+
+	// Remove the given key (and associated value) from the table, returns false if not found
+	bool RemoveKey( const TKeyType& key )
+	{
+		TUInt32 iSlot;
+		if (!FindSlot( key, &iSlot ))
+		{
+			return false;
+		}
+
+		// Backward shift deletion: move each following entry back one slot, until reaching an
+		// empty slot or an entry already in its ideal slot. This leaves the table exactly as if
+		// the removed key had never been inserted, so no tombstones are needed
+		TUInt32 iNext = (iSlot + 1) & (m_iSize - 1);
+		while (m_aDistances[iNext] > 1)
+		{
+			m_aEntries[iSlot] = m_aEntries[iNext];
+			m_aDistances[iSlot] = m_aDistances[iNext] - 1;
+			iSlot = iNext;
+			iNext = (iNext + 1) & (m_iSize - 1);
+		}
+		m_aEntries[iSlot] = TKeyValuePair(); // Release anything held by the key/value (e.g. strings)
+		m_aDistances[iSlot] = 0;
+
+		// Decrease number of table entries - note that table is never resized downwards
+		--m_iNumEntries;
+
+		return true;
+	}
+
+
+	// Remove all keys and associated values
+	void RemoveAllKeys()
+	{
+		for (TUInt32 iSlot = 0; iSlot < m_iSize; ++iSlot)
+		{
+			if (m_aDistances[iSlot] != 0)
+			{
+				m_aEntries[iSlot] = TKeyValuePair();
+				m_aDistances[iSlot] = 0;
+			}
+		}
+		m_iNumEntries = 0;
+	}
+
+
+	// Output a table illustrating how far each entry is from the slot its hash selected (0 for
+	// an entry in its ideal slot, '.' for an empty slot). This is the number of extra slots that
+	// must be read to find the key, so shows up good / bad hash functions in the same way as
+	// CHashTable::OutputDistribution
+	void OutputDistribution() const
+	{
+		cout << "Hash Table Distribution:" << endl << endl;
+
+		TUInt32 iTotalDistance = 0;
+		TUInt32 iMaxDistance = 0;
+		for (TUInt32 iSlot = 0; iSlot < m_iSize; ++iSlot)
+		{
+			if (m_aDistances[iSlot] == 0)
+			{
+				cout << '.';
+				continue;
+			}
+
+			TUInt32 iDistance = m_aDistances[iSlot] - 1;
+			if (iDistance < 10)
+			{
+				cout << iDistance;
+			}
+			else
+			{
+				cout << '+'; // Output '+' for 10 or more
+			}
+			iTotalDistance += iDistance;
+			if (iDistance > iMaxDistance)  iMaxDistance = iDistance;
+		}
+		cout << endl << "% used slots: " << 100.0f * static_cast<float>(m_iNumEntries) / m_iSize;
+		cout << endl << "Average probe distance: "
+		     << (m_iNumEntries ? static_cast<float>(iTotalDistance) / m_iNumEntries : 0.0f);
+		cout << endl << "Maximum probe distance: " << iMaxDistance << endl;
+		cout << endl;
+	}
+
+/*-----------------------------------------------------------------------------------------
+	Private interface
+-----------------------------------------------------------------------------------------*/
+private:
+
+	/*---------------------------------------------------------------------------------------------
+		Types
+	---------------------------------------------------------------------------------------------*/
+
+	// A key/value pair held by the hash table
+	struct TKeyValuePair
+	{
+		TKeyType         key;
+		TValueType       value;
+	};
+
+	// Smallest table size, must be a power of two
+	static const TUInt32 kiMinSize = 8;
+
+	// Probe distances are stored in 16 bits, if an insertion would go further than this then the
+	// table is resized instead. Only happens with a very poor hash function, so if the table is
+	// already mostly empty then resizing won't help and it is treated as a fatal error
+	static const TUInt32 kiMaxDistance = 0xffff;
+
+
+	/*---------------------------------------------------------------------------------------------
+		Support functions
+	---------------------------------------------------------------------------------------------*/
+
+	// Find the ideal slot for the given key - the slot selected by its hash value. Templated to
+	// support look-ups with other key types, see CKeyHash
+	template <class TLookUpType>
+	TUInt32 IdealSlot( const TLookUpType& key ) const
+	{
+		// Table size is a power of two, so can use bitwise and rather than modulus
+		return CKeyHash<typename decay<TLookUpType>::type>::Hash( key, m_kpfHashFunction ) & (m_iSize - 1);
+	}
+
+
+	// Find the slot holding the given key, returns false if not found
+	template <class TLookUpType>
+	bool FindSlot
+	(
+		const TLookUpType& key,
+		TUInt32*           piSlot
+	) const
+	{
+		// Step along the table from the ideal slot. In a Robin Hood table entries are ordered by
+		// distance from their ideal slot, so can stop as soon as an entry is closer to its ideal
+		// slot than the key would be (this includes reaching an empty slot, distance 0)
+		TUInt32 iSlot = IdealSlot( key );
+		TUInt32 iDistance = 1;
+		while (m_aDistances[iSlot] >= iDistance)
+		{
+			if (m_aDistances[iSlot] == iDistance && key == m_aEntries[iSlot].key)
+			{
+				*piSlot = iSlot;
+				return true;
+			}
+			iSlot = (iSlot + 1) & (m_iSize - 1);
+			++iDistance;
+		}
+		return false;
+	}
+
+
+	// Insert a key/value pair that is known not to be in the table, table must have space for it
+	void InsertNewPair( TKeyValuePair pair )
+	{
+		TUInt32 iSlot = IdealSlot( pair.key );
+		TUInt32 iDistance = 1;
+		while (m_aDistances[iSlot] != 0)
+		{
+			// Robin Hood - take the slot from an entry that is closer to its ideal slot, then
+			// continue along the table to find a place for the entry that was displaced
+			if (m_aDistances[iSlot] < iDistance)
+			{
+				swap( pair, m_aEntries[iSlot] );
+				TUInt32 iSwap = m_aDistances[iSlot];
+				m_aDistances[iSlot] = static_cast<TUInt16>(iDistance);
+				iDistance = iSwap;
+			}
+			iSlot = (iSlot + 1) & (m_iSize - 1);
+			++iDistance;
+
+			if (iDistance > kiMaxDistance)
+			{
+				// Probe sequence too long to record - grow the table and insert the entry being carried
+				GEN_ASSERT( m_iNumEntries * 4 > m_iSize, "Too many hash collisions, use a better hashing function" );
+				Resize( m_iSize * 2 );
+				InsertNewPair( pair );
+				return;
+			}
+		}
+
+		m_aEntries[iSlot] = pair;
+		m_aDistances[iSlot] = static_cast<TUInt16>(iDistance);
+		++m_iNumEntries;
+	}
+
+
+	// Resize the hash table - reinserts all keys directly, without checking for existing keys
+	void Resize( const TUInt32 iNewSize )
+	{
+		GEN_GUARD;
+
+		// Store old arrays and size
+		TUInt32 iOldSize = m_iSize;
+		TKeyValuePair* aOldEntries = m_aEntries;
+		TUInt16* aOldDistances = m_aDistances;
+
+		// Update size and create new arrays
+		m_iSize = iNewSize;
+		m_aEntries = new TKeyValuePair[m_iSize];
+		m_aDistances = new TUInt16[m_iSize]();
+		GEN_ASSERT( m_aEntries && m_aDistances, "Fatal memory error reserving hash table memory" );
+
+		// Go through old slots and insert each key/value pair into the new table
+		m_iNumEntries = 0;
+		for (TUInt32 iSlot = 0; iSlot < iOldSize; ++iSlot)
+		{
+			if (aOldDistances[iSlot] != 0)
+			{
+				InsertNewPair( aOldEntries[iSlot] );
+			}
+		}
+
+		delete[] aOldEntries;
+		delete[] aOldDistances;
+
+		GEN_ENDGUARD;
+	}
+
+
+	/*---------------------------------------------------------------------------------------------
+		Data
+	---------------------------------------------------------------------------------------------*/
+
+	TKeyValuePair* m_aEntries;    // Dynamically allocated array of key/value pairs
+	TUInt16*       m_aDistances;  // For each slot, 1 + distance of its entry from the ideal slot, 0 if empty.
+	                              // Kept separate from the entries so probing reads as little memory as possible
+	TUInt32        m_iSize;       // Size (capacity) of the table - number of slots, always a power of two
+	TUInt32        m_iNumEntries; // Number of key/value pairs in the table
+
+	// Hash function to use is stored as a function pointer - converts a key given as a
+	// sequence of bytes into a 4-byte unsigned integer
+	const THashFunction m_kpfHashFunction;
+
+	// If table becomes too full, then it is increased in size to keep probe sequences short. The
+	// max load factor defines how full it needs to be before this happens. In this implementation,
+	// the table is never decreased in size
+	const TFloat32 m_kfMaxLoadFactor;
+};
+
+
+} // namespace gen
+
+#endif // GEN_C_FLAT_HASH_TABLE_H_INCLUDED
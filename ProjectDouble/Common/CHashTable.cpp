@@ -56,4 +56,123 @@ TUInt32 JOneAtATimeHash( const TUInt8* pKey, const TUInt32 iKeyLen )
 }
 
 
+// xxHash64 primes and helper functions
+namespace
+{
+	const TUInt64 kiXXPrime1 = 11400714785074694791ULL;
+	const TUInt64 kiXXPrime2 = 14029467366897019727ULL;
+	const TUInt64 kiXXPrime3 =  1609587929392839161ULL;
+	const TUInt64 kiXXPrime4 =  9650029242287828579ULL;
+	const TUInt64 kiXXPrime5 =  2870177450012600261ULL;
+
+	inline TUInt64 RotateLeft( const TUInt64 iValue, const TUInt32 iBits )
+	{
+		return (iValue << iBits) | (iValue >> (64 - iBits));
+	}
+
+	// Read 8 or 4 bytes from a key - memcpy handles unaligned keys and compiles to a single load
+	inline TUInt64 Read64( const TUInt8* pData )
+	{
+		TUInt64 iValue;
+		memcpy( &iValue, pData, sizeof(iValue) );
+		return iValue;
+	}
+	inline TUInt32 Read32( const TUInt8* pData )
+	{
+		TUInt32 iValue;
+		memcpy( &iValue, pData, sizeof(iValue) );
+		return iValue;
+	}
+
+	// Mix 8 bytes of key data into an accumulator
+	inline TUInt64 XXRound( TUInt64 iAccumulator, const TUInt64 iInput )
+	{
+		iAccumulator += iInput * kiXXPrime2;
+		return RotateLeft( iAccumulator, 31 ) * kiXXPrime1;
+	}
+
+	inline TUInt64 XXMergeRound( TUInt64 iHash, const TUInt64 iAccumulator )
+	{
+		iHash ^= XXRound( 0, iAccumulator );
+		return iHash * kiXXPrime1 + kiXXPrime4;
+	}
+}
+
+// xxHash64 hashing function - reads the key 8 bytes at a time (32 bytes for long keys) rather than
+// one byte at a time, so is much faster than the functions above for anything but tiny keys, and
+// has an excellent distribution. Returns a 64-bit hash, the seed gives a different set of hashes
+TUInt64 XXHash64( const TUInt8* pKey, const TUInt32 iKeyLen, const TUInt64 iSeed /*= 0*/ )
+{
+	const TUInt8* pEnd = pKey + iKeyLen;
+	TUInt64 iHash;
+
+	if (iKeyLen >= 32)
+	{
+		// Long keys are processed in 32 byte blocks using four independent accumulators, which
+		// allows the processor to work on them in parallel
+		TUInt64 v1 = iSeed + kiXXPrime1 + kiXXPrime2;
+		TUInt64 v2 = iSeed + kiXXPrime2;
+		TUInt64 v3 = iSeed;
+		TUInt64 v4 = iSeed - kiXXPrime1;
+		const TUInt8* pLimit = pEnd - 32;
+		do
+		{
+			v1 = XXRound( v1, Read64( pKey ) );
+			v2 = XXRound( v2, Read64( pKey + 8 ) );
+			v3 = XXRound( v3, Read64( pKey + 16 ) );
+			v4 = XXRound( v4, Read64( pKey + 24 ) );
+			pKey += 32;
+		} while (pKey <= pLimit);
+
+		iHash = RotateLeft( v1, 1 ) + RotateLeft( v2, 7 ) + RotateLeft( v3, 12 ) + RotateLeft( v4, 18 );
+		iHash = XXMergeRound( iHash, v1 );
+		iHash = XXMergeRound( iHash, v2 );
+		iHash = XXMergeRound( iHash, v3 );
+		iHash = XXMergeRound( iHash, v4 );
+	}
+	else
+	{
+		iHash = iSeed + kiXXPrime5;
+	}
+	iHash += iKeyLen;
+
+	// Remaining bytes, 8 then 4 then 1 at a time
+	while (pKey + 8 <= pEnd)
+	{
+		iHash ^= XXRound( 0, Read64( pKey ) );
+		iHash = RotateLeft( iHash, 27 ) * kiXXPrime1 + kiXXPrime4;
+		pKey += 8;
+	}
+	if (pKey + 4 <= pEnd)
+	{
+		iHash ^= static_cast<TUInt64>(Read32( pKey )) * kiXXPrime1;
+		iHash = RotateLeft( iHash, 23 ) * kiXXPrime2 + kiXXPrime3;
+		pKey += 4;
+	}
+	while (pKey < pEnd)
+	{
+		iHash ^= (*pKey) * kiXXPrime5;
+		iHash = RotateLeft( iHash, 11 ) * kiXXPrime1;
+		++pKey;
+	}
+
+	// Final mixing so every bit of the key affects every bit of the hash
+	iHash ^= iHash >> 33;
+	iHash *= kiXXPrime2;
+	iHash ^= iHash >> 29;
+	iHash *= kiXXPrime3;
+	iHash ^= iHash >> 32;
+	return iHash;
+}
+
+
+// xxHash64 with the THashFunction prototype for use in hash tables - the 64-bit hash is folded
+// into 32 bits. This is the default hashing function for the hash table classes
+TUInt32 XXHash( const TUInt8* pKey, const TUInt32 iKeyLen )
+{
+	TUInt64 iHash = XXHash64( pKey, iKeyLen );
+	return static_cast<TUInt32>(iHash ^ (iHash >> 32));
+}
+
+
 } // namespace gen
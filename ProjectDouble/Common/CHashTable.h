@@ -3,7 +3,8 @@
 	Author:       Laurent Noel
 
 	Hash table class storing keys and associated values, supporting quick lookup of a value for a
-	given a key. A hashing function is needed for the mapping and is specified for the constructor
+	given a key. A hashing function is needed for the mapping and is specified for the constructor.
+	How a key is passed to the hashing function depends on its type, see CKeyHash below
 	
 	This is a template class, which allows any types for keys and values. E.g. to implement entity
 	UIDs the key is an integer (the UID), and the value is an entity pointer. For a phonebook, the
@@ -20,6 +21,14 @@
 #include <math.h>
 #include <iostream>
 #include <list>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <type_traits>
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L
+	#include <string_view>
+	#define GEN_HASH_STRING_VIEW // string_view keys supported when compiling for C++17
+#endif
 using namespace std;
 
 #include "Defines.h"
@@ -46,6 +55,115 @@ TUInt32 AddUpHash( const TUInt8* pKey, const TUInt32 iKeyLen );
 // distribution of indexes (few collisions)
 TUInt32 JOneAtATimeHash( const TUInt8* pKey, const TUInt32 iKeyLen );
 
+// xxHash64 hashing function - reads the key 8 bytes at a time (32 bytes for long keys) rather than
+// one byte at a time, so is much faster than the functions above for anything but tiny keys, and
+// has an excellent distribution. Returns a 64-bit hash, the seed gives a different set of hashes
+TUInt64 XXHash64( const TUInt8* pKey, const TUInt32 iKeyLen, const TUInt64 iSeed = 0 );
+
+// xxHash64 with the THashFunction prototype for use in hash tables - the 64-bit hash is folded
+// into 32 bits. This is the default hashing function for the hash table classes
+TUInt32 XXHash( const TUInt8* pKey, const TUInt32 iKeyLen );
+
+// Combine two hash values into one, e.g. to hash a composite key from the hashes of its members.
+// The order matters: HashCombine( a, b ) != HashCombine( b, a )
+inline TUInt32 HashCombine( const TUInt32 iHash1, const TUInt32 iHash2 )
+{
+	return iHash1 ^ (iHash2 + 0x9e3779b9 + (iHash1 << 6) + (iHash1 >> 2));
+}
+
+
+/*------------------------------------------------------------------------------------------------
+	Key hashing
+ ------------------------------------------------------------------------------------------------*/
+
+// The hash tables don't pass keys directly to the hashing function, instead they call
+// CKeyHash<TKeyType>::Hash, which selects the bytes that represent the key. By default this is the
+// key's own memory, which is correct for integers, pointers, enums and simple structs. This is not
+// correct for types that hold pointers to their data such as strings - the pointer would be hashed
+// rather than the data, so equal keys would not find each other. Such types need a specialisation
+// of this template. Specialisations for strings are below, and other types can be added in the
+// same way. E.g. for a composite key:
+//
+//   struct SMaterialKey { string texture; TUInt32 flags; };
+//   template <> struct CKeyHash<SMaterialKey>
+//   {
+//       typedef SMaterialKey TLookUpClass;
+//       static TUInt32 Hash( const SMaterialKey& key, THashFunction pfHashFunction )
+//       {
+//           return HashCombine( CKeyHash<string>::Hash( key.texture, pfHashFunction ),
+//                               CKeyHash<TUInt32>::Hash( key.flags, pfHashFunction ) );
+//       }
+//   };
+//
+// TLookUpClass allows a table to be searched with a different type of key than it stores, e.g. a
+// table with string keys can be searched with a string literal without creating a string. Types
+// with the same TLookUpClass must give the same hash for equal values, and must be comparable
+// with ==. By default a type can only look up keys of its own type
+template <class TKeyType>
+struct CKeyHash
+{
+	typedef TKeyType TLookUpClass;
+
+	static TUInt32 Hash( const TKeyType& key, THashFunction pfHashFunction )
+	{
+		// Keys hashed as raw bytes must be plain data. Note that padding bytes are also hashed, so
+		// structs used as keys should have no padding or be zeroed before being filled in
+		static_assert( is_trivially_copyable<TKeyType>::value,
+		               "Key type holds pointers to its data - specialise CKeyHash for this type" );
+
+		// Get a pointer to the key as raw bytes - this cast is OK for this kind of purpose
+		return pfHashFunction( reinterpret_cast<const TUInt8*>(&key), sizeof(TKeyType) );
+	}
+};
+
+// String keys are hashed on their characters. All string types share the same look-up class so a
+// table with string keys can be searched with a C-string (or string_view) without any allocation.
+// Don't use C-strings as the stored key type though, the table would compare the pointers
+struct SStringLookUp {};
+
+template <>
+struct CKeyHash<string>
+{
+	typedef SStringLookUp TLookUpClass;
+
+	static TUInt32 Hash( const string& key, THashFunction pfHashFunction )
+	{
+		return pfHashFunction( reinterpret_cast<const TUInt8*>(key.data()), static_cast<TUInt32>(key.length()) );
+	}
+};
+
+template <>
+struct CKeyHash<const char*>
+{
+	typedef SStringLookUp TLookUpClass;
+
+	static TUInt32 Hash( const char* key, THashFunction pfHashFunction )
+	{
+		return pfHashFunction( reinterpret_cast<const TUInt8*>(key), static_cast<TUInt32>(strlen( key )) );
+	}
+};
+
+template <>
+struct CKeyHash<char*> : CKeyHash<const char*> {};
+
+#ifdef GEN_HASH_STRING_VIEW
+template <>
+struct CKeyHash<string_view>
+{
+	typedef SStringLookUp TLookUpClass;
+
+	static TUInt32 Hash( const string_view& key, THashFunction pfHashFunction )
+	{
+		return pfHashFunction( reinterpret_cast<const TUInt8*>(key.data()), static_cast<TUInt32>(key.length()) );
+	}
+};
+#endif
+
+// Compile-time test whether a table with keys of type TKeyType can be searched with a TLookUpType
+template <class TKeyType, class TLookUpType>
+struct CCanLookUpKey : is_same<typename CKeyHash<TKeyType>::TLookUpClass,
+                               typename CKeyHash<typename decay<TLookUpType>::type>::TLookUpClass> {};
+
 
 /*---------------------------------------------------------------------------------------------
 	CHashTable class
@@ -63,8 +181,9 @@ TUInt32 JOneAtATimeHash( const TUInt8* pKey, const TUInt32 iKeyLen );
 // (keys and values are STL strings) - these are standard types have both == and = defined.
 // However, in other cases we may need to implement/overload the == and = operators or the
 // class would not compile.
-// A further restriction is that keys must not contain pointers (although values can). This is
-// because the hash function treats keys as a sequence of raw bytes, pointers are not followed
+// A further restriction is that keys must not contain pointers (although values can), unless
+// there is a CKeyHash specialisation for the key type (strings have one). This is because by
+// default the hash function treats keys as a sequence of raw bytes, pointers are not followed
 // and the data pointed at will not be hashed
 template <class TKeyType, class TValueType>
 class CHashTable
@@ -78,10 +197,10 @@ public:
 	// before the table is resized - see data section at end
 	CHashTable
 	(
-		const TUInt32  iInitialSize,         // Initial size for the hash table
-		THashFunction  pfHashFunction,       // Hashing function to use
-		const TFloat32 fMaxLoadFactor = 0.7f // Maximum load factor
-	) : m_kfMaxLoadFactor( fMaxLoadFactor ), m_kpfHashFunction( pfHashFunction )
+		const TUInt32  iInitialSize,             // Initial size for the hash table
+		THashFunction  pfHashFunction = XXHash,  // Hashing function to use
+		const TFloat32 fMaxLoadFactor = 0.7f     // Maximum load factor
+	) : m_kpfHashFunction( pfHashFunction ), m_kfMaxLoadFactor( fMaxLoadFactor )
 	{
 		GEN_GUARD;
 
@@ -141,6 +260,27 @@ public:
 		return true;
 	}
 
+	// Version of LookUpKey for a different type of key that has the same CKeyHash look-up class,
+	// e.g. a string table can be searched with a C-string or string_view without creating a string
+	template <class TLookUpType,
+	          class = typename enable_if<!is_same<typename decay<TLookUpType>::type, TKeyType>::value &&
+	                                     CCanLookUpKey<TKeyType, TLookUpType>::value>::type>
+	bool LookUpKey
+	(
+		const TLookUpType& key,
+		TValueType*        pValue
+	)
+	{
+		TUInt32 iBucket = FindBucket( key );
+		TKeyValuePairIter itKeyValuePair = FindKeyValuePair( iBucket, key );
+		if (itKeyValuePair == m_aBuckets[iBucket].end())
+		{
+			return false;
+		}
+		*pValue = itKeyValuePair->value;
+		return true;
+	}
+
 
 	// Add the given key-value pair to the table, if the key already exists, just update its value
 	void SetKeyValue
@@ -287,14 +427,13 @@ private:
 		Support functions
 	---------------------------------------------------------------------------------------------*/
 
-	// Find the index of the bucket that should contain the given key
-	TUInt32 FindBucket(	const TKeyType& key	) const
+	// Find the index of the bucket that should contain the given key. Templated to support
+	// look-ups with other key types, see CKeyHash
+	template <class TLookUpType>
+	TUInt32 FindBucket(	const TLookUpType& key ) const
 	{
-		// Get a pointer to the key as raw bytes - this cast is OK for this kind of purpose
-		const TUInt8* pKeyData = reinterpret_cast<const TUInt8*>(&key);
-
 		// Use hashing function to convert key data to a single 4-byte integer
-		TUInt32 iIndex = m_kpfHashFunction( pKeyData, sizeof(TKeyType) );
+		TUInt32 iIndex = CKeyHash<typename decay<TLookUpType>::type>::Hash( key, m_kpfHashFunction );
 		
 		// Convert this 4-byte hash value to a bucket index. We have m_iSize buckets, so just
 		// use the integer modulus operator. Could use faster bitwise operator if number of
@@ -307,10 +446,11 @@ private:
 
 	// Find the key/value pair associated with the given key in the given bucket
 	// Returns the end of list iterator if not found
+	template <class TLookUpType>
 	TKeyValuePairIter FindKeyValuePair
 	(
-		const int       iBucket,
-		const TKeyType& key
+		const int          iBucket,
+		const TLookUpType& key
 	) const
 	{
 		// Start at beginning of bucket and step through each key/value pair
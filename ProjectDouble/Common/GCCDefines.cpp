@@ -0,0 +1,32 @@
+/**************************************************************************************************
+	Module:       GCCDefines.cpp
+
+	Utility functions for GCC and Clang - see header file
+**************************************************************************************************/
+
+#include <iostream>
+
+#include "Defines.h"
+#include "GCCDefines.h"
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	OS-specific GUI support
+ ------------------------------------------------------------------------------------------------*/
+
+// There is no message box, the message is written to stderr instead. Returns true (i.e. OK or Yes)
+bool SystemMessageBox
+(
+	const string& sMessage, // Main message to display
+	const string& sCaption, // Caption to display at top of message
+	const bool    /*bYesNo*/
+)
+{
+	cerr << sCaption << ": " << sMessage << endl;
+	return true;
+}
+
+
+} // namespace gen
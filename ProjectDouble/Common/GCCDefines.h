@@ -0,0 +1,89 @@
+/**************************************************************************************************
+	Module:       GCCDefines.h
+
+	Utility functions for GCC and Clang, used to build the portable parts of the code (the maths
+	classes and their tests) on Linux. The app itself still needs Windows and Visual Studio
+
+	Mirrors MSDefines.h - see there for notes
+**************************************************************************************************/
+
+#ifndef GEN_GCC_DEFINES_H_INCLUDED
+#define GEN_GCC_DEFINES_H_INCLUDED
+
+#include <string>
+#include <cstdint>
+using namespace std;
+
+namespace gen
+{
+
+/*------------------------------------------------------------------------------------------------
+	Compiler settings
+ ------------------------------------------------------------------------------------------------*/
+
+// Check compiler options
+#if !defined(__EXCEPTIONS) && !defined(__cpp_exceptions)
+	#error "Bad compiler option: C++ exception handling must be enabled"
+#endif
+
+
+/*------------------------------------------------------------------------------------------------
+	Macros
+ ------------------------------------------------------------------------------------------------*/
+
+// Prefix to align a structure or class in memory to a multiple of the given amount
+#define GEN_ALIGN(a) __attribute__((aligned(a)))
+
+
+/*------------------------------------------------------------------------------------------------
+	Constants
+ ------------------------------------------------------------------------------------------------*/
+
+// Define compiler name
+#if defined(__clang__)
+	static const string ksCompiler = "Clang";
+#else
+	static const string ksCompiler = "GCC";
+#endif
+
+
+// String locale
+const string ksPathSeparator = "/";
+const string ksNewline = "\n";
+
+
+/*------------------------------------------------------------------------------------------------
+	Types
+ ------------------------------------------------------------------------------------------------*/
+
+// Typedefs for fixed size types
+typedef int8_t           TInt8;
+typedef int16_t          TInt16;
+typedef int32_t          TInt32;
+typedef int64_t          TInt64;
+
+typedef uint8_t          TUInt8;
+typedef uint16_t         TUInt16;
+typedef uint32_t         TUInt32;
+typedef uint64_t         TUInt64;
+
+typedef float            TFloat32;
+typedef double           TFloat64;
+
+
+/*------------------------------------------------------------------------------------------------
+	GUI support
+ ------------------------------------------------------------------------------------------------*/
+
+// There is no message box, the message is written to stderr instead. Returns true (i.e. OK or Yes)
+bool SystemMessageBox
+(
+	const string& sMessage,                       // Main message to display
+	const string& sCaption = "TL-Engine Extreme", // Caption to display at top of message
+	const bool    bYesNo = false                  // Ignored
+);
+
+
+} // namespace gen
+
+#endif // GEN_GCC_DEFINES_H_INCLUDED
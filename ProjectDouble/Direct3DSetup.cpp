@@ -5,6 +5,7 @@
 #include "Direct3DSetup.h"
 #include "Shader.h"
 #include "Common.h"
+#include "StateCacheRenderDevice.h"
 #include <d3d11.h>
 #include <vector>
 
@@ -117,6 +118,11 @@ bool InitDirect3D()
         gLastError = "Error creating depth buffer view";
         return false;
     }
+
+
+    // All rendering goes through the render device, which passes it on to the context created above. Binds that
+    // wouldn't change anything are dropped by the state cache first
+    gRenderDevice = new StateCacheRenderDevice(new D3D11RenderDevice(gD3DContext, gSwapChain));
     
     return true;
 }
@@ -128,6 +134,8 @@ void ShutdownDirect3D()
     // Release each Direct3D object to return resources to the system. Missing these out will cause memory
     // leaks. Check documentation to see which objects need to be released when adding new features in your
     // own projects.
+    delete gRenderDevice;
+    gRenderDevice = nullptr;
     if (gD3DContext)
     {
         gD3DContext->ClearState(); // This line is also needed to reset the GPU before shutting down DirectX
@@ -0,0 +1,205 @@
+//--------------------------------------------------------------------------------------
+// Geometry arena - shared vertex / index buffers for all mesh geometry
+//--------------------------------------------------------------------------------------
+
+#include "GeometryArena.h"
+#include "Shader.h" // Needed for helper function CreateSignatureForVertexLayout
+#include "RenderDevice.h"
+#include "Common.h"
+
+#include <stdexcept>
+
+
+// The arena used by all meshes
+GeometryArena gGeometryArena;
+
+// Smallest buffer allocations, in elements, so adding many small meshes doesn't cause many reallocations
+static const unsigned int kMinVertexCapacity = 16 * 1024;
+static const unsigned int kMinIndexCapacity = 64 * 1024;
+
+
+// Add geometry to the arena and return where it was put. The layout key identifies the vertex layout, geometry with
+// the same key, vertex size and index size (2 or 4 bytes) shares a pool. The vertex elements are used to create the
+// pool's input layout. Indices are relative to the given vertices. Must be used on the main thread (uses the DirectX
+// context). Will throw a std::runtime_error exception on failure
+GeometryArena::Allocation GeometryArena::Add(unsigned int layoutKey, const std::vector<D3D11_INPUT_ELEMENT_DESC>& vertexElements,
+                                             unsigned int vertexSize, const void* vertices, unsigned int numVertices,
+                                             unsigned int indexSize, const void* indices, unsigned int numIndices)
+{
+	// Find the pool for this layout, or create a new one
+	unsigned int poolIndex = 0;
+	while (poolIndex < mPools.size() &&
+	       (mPools[poolIndex].layoutKey != layoutKey || mPools[poolIndex].vertexSize != vertexSize || mPools[poolIndex].indexSize != indexSize))
+	{
+		++poolIndex;
+	}
+	if (poolIndex == mPools.size())
+	{
+		Pool newPool;
+		newPool.layoutKey = layoutKey;
+		newPool.vertexSize = vertexSize;
+		newPool.indexSize = indexSize;
+
+		// Create a "vertex layout" to describe to DirectX what is data in each vertex of this pool
+		auto shaderSignature = CreateSignatureForVertexLayout(vertexElements.data(), static_cast<int>(vertexElements.size()));
+		HRESULT hr = gD3DDevice->CreateInputLayout(vertexElements.data(), static_cast<UINT>(vertexElements.size()),
+			shaderSignature->GetBufferPointer(), shaderSignature->GetBufferSize(),
+			&newPool.inputLayout);
+		if (shaderSignature)  shaderSignature->Release();
+		if (FAILED(hr))  throw std::runtime_error("Failure creating input layout for geometry arena");
+
+		mPools.push_back(newPool);
+	}
+	Pool& pool = mPools[poolIndex];
+
+	// Grow the buffers if needed, doubling in size each time so there are few reallocations
+	if (pool.numVertices + numVertices > pool.vertexCapacity)
+	{
+		unsigned int newCapacity = pool.vertexCapacity * 2;
+		if (newCapacity < kMinVertexCapacity)                 newCapacity = kMinVertexCapacity;
+		if (newCapacity < pool.numVertices + numVertices)    newCapacity = pool.numVertices + numVertices;
+		GrowBuffer(pool.vertexBuffer, D3D11_BIND_VERTEX_BUFFER, vertexSize, pool.numVertices, pool.vertexCapacity, newCapacity);
+	}
+	if (pool.numIndices + numIndices > pool.indexCapacity)
+	{
+		unsigned int newCapacity = pool.indexCapacity * 2;
+		if (newCapacity < kMinIndexCapacity)                  newCapacity = kMinIndexCapacity;
+		if (newCapacity < pool.numIndices + numIndices)       newCapacity = pool.numIndices + numIndices;
+		GrowBuffer(pool.indexBuffer, D3D11_BIND_INDEX_BUFFER, indexSize, pool.numIndices, pool.indexCapacity, newCapacity);
+	}
+
+	// Copy the new data to the end of the used part of each buffer
+	D3D11_BOX box = { pool.numVertices * vertexSize, 0, 0, (pool.numVertices + numVertices) * vertexSize, 1, 1 };
+	gD3DContext->UpdateSubresource(pool.vertexBuffer, 0, &box, vertices, 0, 0);
+	box = { pool.numIndices * indexSize, 0, 0, (pool.numIndices + numIndices) * indexSize, 1, 1 };
+	gD3DContext->UpdateSubresource(pool.indexBuffer, 0, &box, indices, 0, 0);
+
+	Allocation allocation;
+	allocation.pool = poolIndex;
+	allocation.startIndex = pool.numIndices;
+	allocation.baseVertex = static_cast<int>(pool.numVertices);
+	allocation.numIndices = numIndices;
+
+	pool.numVertices += numVertices;
+	pool.numIndices += numIndices;
+	return allocation;
+}
+
+
+// Reallocate the given buffer to hold newCapacity elements, keeping the first usedElements of data
+void GeometryArena::GrowBuffer(ID3D11Buffer*& buffer, UINT bindFlags, unsigned int elementSize,
+                               unsigned int usedElements, unsigned int& capacity, unsigned int newCapacity)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = bindFlags;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT; // GPU memory, filled with UpdateSubresource
+	bufferDesc.ByteWidth = newCapacity * elementSize;
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+
+	ID3D11Buffer* newBuffer = nullptr;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &newBuffer)))
+	{
+		throw std::runtime_error("Failure creating buffer for geometry arena");
+	}
+
+	// Copy the existing data across on the GPU
+	if (buffer != nullptr)
+	{
+		if (usedElements > 0)
+		{
+			D3D11_BOX box = { 0, 0, 0, usedElements * elementSize, 1, 1 };
+			gD3DContext->CopySubresourceRegion(newBuffer, 0, 0, 0, 0, buffer, 0, &box);
+		}
+		buffer->Release();
+	}
+	buffer = newBuffer;
+	capacity = newCapacity;
+}
+
+
+// Draw the given geometry as a triangle list. The pool's buffers, input layout and topology are only set if they are
+// not already the current ones
+void GeometryArena::Draw(const Allocation& allocation)
+{
+	BindPool(allocation.pool);
+	gRenderDevice->DrawIndexed(allocation.numIndices, allocation.startIndex, allocation.baseVertex);
+	++mNumDraws;
+}
+
+// Draw several instances of the given geometry, as Draw above. The vertex shader picks the data for each instance
+// using SV_InstanceID (see InstanceBuffer.h)
+void GeometryArena::DrawInstanced(const Allocation& allocation, unsigned int numInstances)
+{
+	BindPool(allocation.pool);
+	gRenderDevice->DrawIndexedInstanced(allocation.numIndices, numInstances, allocation.startIndex, allocation.baseVertex, 0);
+	++mNumDraws;
+}
+
+// Set the given pool's buffers, input layout and topology if they are not already the current ones
+void GeometryArena::BindPool(unsigned int poolIndex)
+{
+	if (poolIndex != mBoundPool)
+	{
+		const Pool& pool = mPools[poolIndex];
+		UINT stride = pool.vertexSize;
+		UINT offset = 0;
+		gRenderDevice->IASetVertexBuffers(0, 1, &pool.vertexBuffer, &stride, &offset);
+		gRenderDevice->IASetInputLayout(pool.inputLayout);
+		gRenderDevice->IASetIndexBuffer(pool.indexBuffer, (pool.indexSize == 2) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+		gRenderDevice->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		mBoundPool = poolIndex;
+		++mNumPoolBinds;
+	}
+}
+
+
+// Shrink each pool's buffers to the size of the data in them. Call when loading is finished
+void GeometryArena::Trim()
+{
+	for (auto& pool : mPools)
+	{
+		if (pool.numVertices < pool.vertexCapacity)
+		{
+			GrowBuffer(pool.vertexBuffer, D3D11_BIND_VERTEX_BUFFER, pool.vertexSize, pool.numVertices, pool.vertexCapacity, pool.numVertices);
+		}
+		if (pool.numIndices < pool.indexCapacity)
+		{
+			GrowBuffer(pool.indexBuffer, D3D11_BIND_INDEX_BUFFER, pool.indexSize, pool.numIndices, pool.indexCapacity, pool.numIndices);
+		}
+	}
+	InvalidateBindings(); // Buffers have changed
+}
+
+
+// Release all buffers and layouts, all allocations become invalid
+void GeometryArena::Release()
+{
+	for (auto& pool : mPools)
+	{
+		if (pool.vertexBuffer)  pool.vertexBuffer->Release();
+		if (pool.indexBuffer)   pool.indexBuffer->Release();
+		if (pool.inputLayout)   pool.inputLayout->Release();
+	}
+	mPools.clear();
+	InvalidateBindings();
+}
+
+
+// Number of DirectX buffer objects in use
+unsigned int GeometryArena::NumBuffers() const
+{
+	return static_cast<unsigned int>(mPools.size()) * 2;
+}
+
+// Total size of the data in the arena
+size_t GeometryArena::NumBytes() const
+{
+	size_t bytes = 0;
+	for (auto& pool : mPools)
+	{
+		bytes += static_cast<size_t>(pool.numVertices) * pool.vertexSize + static_cast<size_t>(pool.numIndices) * pool.indexSize;
+	}
+	return bytes;
+}
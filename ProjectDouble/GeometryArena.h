@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// Geometry arena - shared vertex / index buffers for all mesh geometry
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Rather than each sub-mesh having its own vertex and index buffer, all sub-meshes with the same vertex layout (and
+// index size) are packed into a single "pool": one vertex buffer, one index buffer and one input layout. Each
+// sub-mesh is drawn using offsets into its pool (the start index and base vertex of DrawIndexed). So there are only
+// a handful of buffer objects, and consecutive draws from the same pool need no buffer, layout or topology changes.
+//
+// Pools grow as geometry is added (the buffers are reallocated and the existing data copied on the GPU), call Trim
+// when loading is finished to release the unused space. Space is not reclaimed when a mesh is deleted - meshes are
+// loaded at start-up and last for the whole app
+
+#ifndef _GEOMETRY_ARENA_H_INCLUDED_
+#define _GEOMETRY_ARENA_H_INCLUDED_
+
+#include <d3d11.h>
+#include <vector>
+
+class GeometryArena
+{
+public:
+	// Location of a sub-mesh's geometry in the arena
+	struct Allocation
+	{
+		unsigned int pool = 0;
+		unsigned int startIndex = 0;  // First index of this geometry in the pool's index buffer
+		int          baseVertex = 0;  // Added to each index - the first vertex of this geometry in the pool's vertex buffer
+		unsigned int numIndices = 0;
+	};
+
+	~GeometryArena()  { Release(); }
+
+	// Add geometry to the arena and return where it was put. The layout key identifies the vertex layout, geometry with
+	// the same key, vertex size and index size (2 or 4 bytes) shares a pool. The vertex elements are used to create the
+	// pool's input layout. Indices are relative to the given vertices. Must be used on the main thread (uses the DirectX
+	// context). Will throw a std::runtime_error exception on failure
+	Allocation Add(unsigned int layoutKey, const std::vector<D3D11_INPUT_ELEMENT_DESC>& vertexElements,
+	               unsigned int vertexSize, const void* vertices, unsigned int numVertices,
+	               unsigned int indexSize, const void* indices, unsigned int numIndices);
+
+	// Draw the given geometry as a triangle list. The pool's buffers, input layout and topology are only set if they are
+	// not already the current ones
+	void Draw(const Allocation& allocation);
+
+	// Draw several instances of the given geometry, as above. The vertex shader picks the data for each instance
+	// using SV_InstanceID (see InstanceBuffer.h)
+	void DrawInstanced(const Allocation& allocation, unsigned int numInstances);
+
+	// Call after other code changes the vertex / index buffers, input layout or topology, so the next Draw sets them again
+	void InvalidateBindings()  { mBoundPool = kNoPool; }
+
+	// Shrink each pool's buffers to the size of the data in them. Call when loading is finished
+	void Trim();
+
+	// Release all buffers and layouts, all allocations become invalid
+	void Release();
+
+	// Statistics
+	unsigned int NumPools() const  { return static_cast<unsigned int>(mPools.size()); }
+	unsigned int NumBuffers() const;      // Number of DirectX buffer objects in use
+	size_t       NumBytes() const;        // Total size of the data in the arena
+	unsigned int NumPoolBinds() const  { return mNumPoolBinds; } // Times Draw had to set a pool's buffers, and times
+	unsigned int NumDraws() const      { return mNumDraws; }     // Draw or DrawInstanced was called, since the last ResetStats
+	void         ResetStats()  { mNumPoolBinds = mNumDraws = 0; }
+
+
+private:
+	struct Pool
+	{
+		unsigned int       layoutKey;
+		unsigned int       vertexSize;
+		unsigned int       indexSize;
+		ID3D11InputLayout* inputLayout = nullptr;
+
+		ID3D11Buffer*      vertexBuffer = nullptr;
+		unsigned int       numVertices = 0;      // Used / allocated space, in vertices
+		unsigned int       vertexCapacity = 0;
+
+		ID3D11Buffer*      indexBuffer = nullptr;
+		unsigned int       numIndices = 0;       // Used / allocated space, in indices
+		unsigned int       indexCapacity = 0;
+	};
+
+	// Set the given pool's buffers, input layout and topology if they are not already the current ones
+	void BindPool(unsigned int poolIndex);
+
+	// Reallocate the given buffer to hold newCapacity elements, keeping the first usedElements of data
+	static void GrowBuffer(ID3D11Buffer*& buffer, UINT bindFlags, unsigned int elementSize,
+	                       unsigned int usedElements, unsigned int& capacity, unsigned int newCapacity);
+
+	static const unsigned int kNoPool = ~0u;
+
+	std::vector<Pool> mPools;
+	unsigned int      mBoundPool = kNoPool;
+	unsigned int      mNumPoolBinds = 0;
+	unsigned int      mNumDraws = 0;
+};
+
+
+// The arena used by all meshes
+extern GeometryArena gGeometryArena;
+
+
+#endif //_GEOMETRY_ARENA_H_INCLUDED_
@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// Instance buffer - per-instance world matrices and colours for instanced rendering
+//--------------------------------------------------------------------------------------
+
+#include "InstanceBuffer.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "RenderDevice.h"
+#include "Shader.h" // CreateConstantBuffer
+#include "GraphicsHelpers.h"
+#include "Common.h"
+
+
+// The instance buffer used by all instanced rendering
+InstanceBuffer gInstanceBuffer;
+
+
+// Create the GPU buffers. Returns false on failure
+bool InstanceBuffer::Create()
+{
+	// Structured buffer read by the vertex shader, rewritten by the CPU each time it is uploaded
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.ByteWidth = kMaxInstances * sizeof(InstanceData);
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = sizeof(InstanceData);
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &mBuffer)))  return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = kMaxInstances;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(mBuffer, &srvDesc, &mBufferSRV)))  return false;
+
+	mConstantBuffer = CreateConstantBuffer(sizeof(BatchConstants));
+	if (mConstantBuffer == nullptr)  return false;
+
+	mInstances.reserve(kMaxInstances);
+	return true;
+}
+
+// Release the GPU buffers
+void InstanceBuffer::Release()
+{
+	if (mConstantBuffer)  mConstantBuffer->Release();
+	if (mBufferSRV)       mBufferSRV->Release();
+	if (mBuffer)          mBuffer->Release();
+	mConstantBuffer = nullptr;
+	mBufferSRV = nullptr;
+	mBuffer = nullptr;
+}
+
+
+// Add instances for models sharing the same rigid mesh, laid out node by node (see InstanceBuffer.h). Returns the index
+// of the batch's first instance, or kNoRoom if the buffer doesn't have space for them all (nothing is added)
+unsigned int InstanceBuffer::AddBatch(Model* const* models, unsigned int numModels, const CVector3* colours /*= nullptr*/)
+{
+	if (numModels == 0)  return kNoRoom;
+	unsigned int numNodes = models[0]->GetMesh()->NumberNodes();
+	unsigned int firstInstance = static_cast<unsigned int>(mInstances.size());
+	if (firstInstance + numNodes * numModels > kMaxInstances)  return kNoRoom;
+
+	mInstances.resize(firstInstance + numNodes * numModels);
+	InstanceData* instance = &mInstances[firstInstance];
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		for (unsigned int i = 0; i < numModels; ++i)
+		{
+			instance->worldMatrix = models[i]->AbsoluteMatrix(node);
+			instance->objectColour = colours ? colours[i] : gPerModelConstants.objectColour;
+			instance->padding = 0;
+			++instance;
+		}
+	}
+
+	++mNumBatches;
+	mNumInstanced += numModels;
+	return firstInstance;
+}
+
+
+// Send the instances to the GPU if any have been added since the last upload, and bind the buffers for the vertex
+// shader. The whole buffer is replaced each time (a dynamic buffer can only be discarded) so earlier draws this frame
+// keep the data they were given
+void InstanceBuffer::Upload()
+{
+	if (mInstances.size() > mNumUploaded)
+	{
+		gRenderDevice->UpdateBuffer(mBuffer, mInstances.data(), mInstances.size() * sizeof(InstanceData));
+		mNumUploaded = static_cast<unsigned int>(mInstances.size());
+	}
+	gRenderDevice->VSSetShaderResources(kShaderResourceSlot, 1, &mBufferSRV);
+	gRenderDevice->VSSetConstantBuffers(kConstantBufferSlot, 1, &mConstantBuffer);
+}
+
+
+// Set the first instance for the following instanced draws
+void InstanceBuffer::SetFirstInstance(unsigned int firstInstance)
+{
+	mBatchConstants.firstInstance = firstInstance;
+	UpdateConstantBuffer(mConstantBuffer, mBatchConstants);
+	gRenderDevice->VSSetConstantBuffers(kConstantBufferSlot, 1, &mConstantBuffer);
+}
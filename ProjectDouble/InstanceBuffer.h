@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// Instance buffer - per-instance world matrices and colours for instanced rendering
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Models that share a rigid (non-skinned) mesh can be drawn together in one draw call per sub-mesh rather than one per
+// model. The world matrix and colour of each model are written into this buffer, and an instanced vertex shader (e.g.
+// PixelLightingInstanced_vs) reads them with SV_InstanceID instead of using the per-model constant buffer.
+//
+// The buffer is built on the CPU during the frame: call Clear at the start of the frame, then AddBatch for each group
+// of models, writing their instances one after another in a single linear pass. Upload sends the instances added so
+// far to the GPU and must be called before drawing any of them. SV_InstanceID starts at 0 for every draw, so the
+// position of a draw's first instance is passed in a small constant buffer (SetFirstInstance, see Mesh::RenderInstanced)
+//
+// Instances for a batch are stored node by node: for a batch starting at "first" with n models, the instance for node
+// "node" of model i is at first + node * n + i. So each node's sub-meshes can be drawn for all the models at once
+
+#ifndef _INSTANCE_BUFFER_H_INCLUDED_
+#define _INSTANCE_BUFFER_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include <d3d11.h>
+#include <vector>
+
+class Model;
+
+// Data for one instance. Must match exactly the InstanceData structure in Common.hlsli
+struct InstanceData
+{
+	CMatrix4x4 worldMatrix;
+	CVector3   objectColour;
+	float      padding;
+};
+
+// Position of the current draw's first instance in the buffer. Must match the PerBatchConstants buffer in Common.hlsli
+struct BatchConstants
+{
+	unsigned int firstInstance;
+	unsigned int padding[3];
+};
+
+
+class InstanceBuffer
+{
+public:
+	// Most instances that can be added in a frame. When the buffer is full AddBatch fails and the caller should render
+	// the models one at a time instead
+	static const unsigned int kMaxInstances = 4096;
+
+	// Vertex shader slots used, must match Common.hlsli
+	static const UINT kShaderResourceSlot = 15;
+	static const UINT kConstantBufferSlot = 3;
+
+	// Value returned by AddBatch when there is no room
+	static const unsigned int kNoRoom = ~0u;
+
+	~InstanceBuffer()  { Release(); }
+
+	// Create the GPU buffers. Returns false on failure
+	bool Create();
+
+	// Release the GPU buffers
+	void Release();
+
+
+	// Remove all instances, call at the start of each frame
+	void Clear()  { mInstances.clear(); mNumUploaded = 0; }
+
+	// Add instances for models sharing the same rigid mesh, laid out as described at the top of the file. Each model's
+	// colour is taken from the given array, or from gPerModelConstants.objectColour if it is null. Returns the index of
+	// the batch's first instance, or kNoRoom if the buffer doesn't have space for them all (nothing is added)
+	unsigned int AddBatch(Model* const* models, unsigned int numModels, const CVector3* colours = nullptr);
+
+	// Send the instances to the GPU if any have been added since the last upload, and bind the buffers for the vertex
+	// shader. Instances must be uploaded before they are drawn
+	void Upload();
+
+	// Set the first instance for the following instanced draws
+	void SetFirstInstance(unsigned int firstInstance);
+
+
+	// The instances built this frame, can be used to check the data without a GPU
+	const std::vector<InstanceData>& Instances() const  { return mInstances; }
+
+	// Statistics since the last ResetStats
+	unsigned int NumBatches() const    { return mNumBatches; }
+	unsigned int NumInstanced() const  { return mNumInstanced; } // Models rendered through the buffer
+	void         ResetStats()  { mNumBatches = mNumInstanced = 0; }
+
+
+private:
+	std::vector<InstanceData>  mInstances;
+	unsigned int               mNumUploaded = 0;
+
+	ID3D11Buffer*              mBuffer = nullptr;
+	ID3D11ShaderResourceView*  mBufferSRV = nullptr;
+	ID3D11Buffer*              mConstantBuffer = nullptr;
+	BatchConstants             mBatchConstants = {};
+
+	unsigned int               mNumBatches = 0;
+	unsigned int               mNumInstanced = 0;
+};
+
+
+// The instance buffer used by all instanced rendering
+extern InstanceBuffer gInstanceBuffer;
+
+
+#endif //_INSTANCE_BUFFER_H_INCLUDED_
@@ -0,0 +1,238 @@
+//--------------------------------------------------------------------------------------
+// Instancing test - checks instanced rendering of the scene without drawing anything
+//--------------------------------------------------------------------------------------
+
+#include "InstancingTest.h"
+#include "ModelManager.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "Camera.h"
+#include "InstanceBuffer.h"
+#include "RecordingRenderDevice.h"
+#include "StateCacheRenderDevice.h"
+#include "Shader.h"
+#include "State.h"
+#include "Common.h"
+#include "Tests/TestCommon.h"
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <sstream>
+#include <fstream>
+
+
+namespace
+{
+	// Colour set before rendering the trees, which the render queue's batches take for every instance
+	const CVector3 kTestColour = { 0.25f, 0.5f, 0.75f };
+
+	bool SameMatrix(const CMatrix4x4& a, const CMatrix4x4& b)  { return std::memcmp(&a, &b, sizeof(CMatrix4x4)) == 0; }
+	bool SameColour(const CVector3& a, const CVector3& b)      { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+	// Find the batch holding the instances of the given models, which share a mesh, and check it against them. The
+	// models are found from the first node's instances and may be in any order (the render queue sorts them) unless
+	// ordered is true, but every node must have them in the same order. Each instance's colour must be the model's
+	// colour from the given array, or the given colour if the array is null. Returns false if there is no such batch
+	bool CheckBatch(const std::vector<InstanceData>& instances, Model* const* models, unsigned int numModels,
+	        const CVector3* colours, const CVector3& colour, bool ordered)
+	{
+		unsigned int numNodes = models[0]->GetMesh()->NumberNodes();
+		size_t batchSize = static_cast<size_t>(numNodes) * numModels;
+		std::vector<unsigned int> order(numModels);
+		std::vector<bool> matched(numModels);
+		for (size_t first = 0; first + batchSize <= instances.size(); ++first)
+		{
+			// Model of each of the first node's instances, matched by its root matrix
+			std::fill(matched.begin(), matched.end(), false);
+			bool found = true;
+			for (unsigned int i = 0; i < numModels && found; ++i)
+			{
+				found = false;
+				for (unsigned int model = 0; model < numModels && !found; ++model)
+				{
+					if (!matched[model] && (!ordered || model == i) &&
+					    SameMatrix(instances[first + i].worldMatrix, models[model]->AbsoluteMatrix(0)))
+					{
+						order[i] = model;
+						matched[model] = true;
+						found = true;
+					}
+				}
+			}
+			if (!found)  continue;
+
+			// Every node of every model, node by node
+			for (unsigned int node = 0; node < numNodes; ++node)
+			{
+				for (unsigned int i = 0; i < numModels; ++i)
+				{
+					const InstanceData& instance = instances[first + node * numModels + i];
+					Model* model = models[order[i]];
+					if (!SameMatrix(instance.worldMatrix, model->AbsoluteMatrix(node)) ||
+					    !SameColour(instance.objectColour, colours ? colours[order[i]] : colour))  return false;
+				}
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// Instanced and ordinary draws made while the given pixel shader is set
+	void CountDraws(const std::vector<RenderCommand>& commands, const void* pixelShader,
+	        unsigned int& instancedDraws, unsigned int& singleDraws)
+	{
+		instancedDraws = singleDraws = 0;
+		const void* currentPixelShader = nullptr;
+		for (auto& command : commands)
+		{
+			if (command.type == RenderCommandType::SetShader && command.stage == RenderShaderStage::Pixel)
+			{
+				currentPixelShader = command.object;
+			}
+			else if (currentPixelShader == pixelShader)
+			{
+				if (command.type == RenderCommandType::DrawIndexedInstanced)  ++instancedDraws;
+				else if (command.type == RenderCommandType::Draw || command.type == RenderCommandType::DrawIndexed)  ++singleDraws;
+			}
+		}
+	}
+}
+
+
+// Read the test options from the command line. Returns true if -instancingtest was given
+bool ParseInstancingTestCommandLine(const std::string& commandLine, std::string& outputFile)
+{
+	bool test = false;
+	std::istringstream options(commandLine);
+	std::string option;
+	while (options >> option)
+	{
+		if (option == "-instancingtest")  test = true;
+		else if (option == "-output")     options >> outputFile;
+	}
+	return test;
+}
+
+
+// Run the test and write the results. Returns false if any check fails or the results can't be written
+bool RunInstancingTest(const std::string& outputFile)
+{
+	// Render through a recording device under the state cache, so the commands are those that would reach DirectX
+	RecordingRenderDevice* recordingDevice = new RecordingRenderDevice(true);
+	delete gRenderDevice;
+	gRenderDevice = new StateCacheRenderDevice(recordingDevice);
+
+	ModelManager* models = ModelCreator;
+	const unsigned int kTreeNum = ModelManager::kTreeNum;
+	std::ostringstream report; // One line per check, see Check in TestCommon.h
+	SetTestOutput(report);
+
+	// Camera looking down on the trees and lights from far enough away to see them all, so none are culled
+	CBoundingBox bounds = CBoundingBox::Empty();
+	auto addBounds = [&](Model* model)
+	{
+		const CBoundingBox& modelBounds = model->WorldBounds();
+		bounds.minimum = { std::min(bounds.minimum.x, modelBounds.minimum.x), std::min(bounds.minimum.y, modelBounds.minimum.y),
+		           std::min(bounds.minimum.z, modelBounds.minimum.z) };
+		bounds.maximum = { std::max(bounds.maximum.x, modelBounds.maximum.x), std::max(bounds.maximum.y, modelBounds.maximum.y),
+		           std::max(bounds.maximum.z, modelBounds.maximum.z) };
+	};
+	for (unsigned int i = 0; i < kTreeNum; ++i)
+	{
+		addBounds(models->gTree[i]);
+		addBounds(models->gTree2[i]);
+	}
+	for (auto& light : models->gLights)  addBounds(light.model);
+	CVector3 centre = 0.5f * (bounds.minimum + bounds.maximum);
+	float radius = 0.5f * Length(bounds.maximum - bounds.minimum);
+
+	Camera camera;
+	camera.SetPosition(centre + CVector3{ 0, 2.2f * radius, -2.2f * radius });
+	camera.WorldMatrix().FaceTarget(centre);
+	camera.SetFarClip(6.0f * radius + 1.0f);
+
+
+	//-------------------------------------
+	// Trees
+	//-------------------------------------
+
+	// Each tree mesh should be one instanced draw per sub-mesh, whatever the pass
+	unsigned int expectedTreeDraws = models->gTreeMesh->NumberSubMeshes() + models->gTree2Mesh->NumberSubMeshes();
+	struct TestPass
+	{
+		const char*             name;
+		ID3D11PixelShader*      pixelShader;
+		ID3D11RasterizerState*  rasterizerState;
+	};
+	const TestPass passes[] =
+	{
+		{ "Main",       gShadowMappingPixelShader,          gCullBackState  },
+		{ "Portal",     gShadowMappingPixelShader,          gCullBackState  },
+		{ "Reflection", gReflectedPixelLightingPixelShader, gCullFrontState },
+		{ "Refraction", gRefractedPixelLightingPixelShader, gCullBackState  },
+	};
+	for (auto& pass : passes)
+	{
+		gInstanceBuffer.Clear();
+		models->gRenderQueue.ResetStats();
+		recordingDevice->Reset();
+		gPerModelConstants.objectColour = kTestColour;
+		models->RenderDefaultModels(pass.name, &camera, pass.pixelShader, pass.rasterizerState);
+
+		std::string name = pass.name;
+		const std::vector<InstanceData>& instances = gInstanceBuffer.Instances();
+		Check(CheckBatch(instances, models->gTree, kTreeNum, nullptr, kTestColour, false),
+		      name + ": first tree mesh instances hold each tree's matrices and colour, node by node");
+		Check(CheckBatch(instances, models->gTree2, kTreeNum, nullptr, kTestColour, false),
+		      name + ": second tree mesh instances hold each tree's matrices and colour, node by node");
+
+		unsigned int instanced = 0;
+		for (auto& stats : models->gRenderQueue.Stats())  instanced += stats.instanced;
+		Check(instanced == 2 * kTreeNum, name + ": all " + std::to_string(2 * kTreeNum) + " trees rendered instanced");
+
+		unsigned int instancedDraws, singleDraws;
+		CountDraws(recordingDevice->Commands(), gTreePixelShader, instancedDraws, singleDraws);
+		Check(instancedDraws == expectedTreeDraws,
+		      name + ": " + std::to_string(instancedDraws) + " instanced vegetation draws, expected " +
+		      std::to_string(expectedTreeDraws) + " (other draws with the tree shader: " + std::to_string(singleDraws) + ")");
+	}
+
+
+	//-------------------------------------
+	// Lights
+	//-------------------------------------
+
+	// The light models are batched in the order of the lights, each with its light's colour
+	gInstanceBuffer.Clear();
+	recordingDevice->Reset();
+	models->RenderLights(gLightModelInstancedVertexShader, gTintedTextureInstancedPixelShader);
+
+	std::vector<Model*> lightModels;
+	std::vector<CVector3> lightColours;
+	for (auto& light : models->gLights)
+	{
+		lightModels.push_back(light.model);
+		lightColours.push_back(light.colour);
+	}
+	Check(CheckBatch(gInstanceBuffer.Instances(), lightModels.data(), static_cast<unsigned int>(lightModels.size()),
+	                 lightColours.data(), kTestColour, true),
+	      "Light model instances hold each light's matrices and colour, node by node in light order");
+
+	unsigned int instancedDraws, singleDraws;
+	CountDraws(recordingDevice->Commands(), gTintedTextureInstancedPixelShader, instancedDraws, singleDraws);
+	unsigned int expectedLightDraws = models->gLightMesh->NumberSubMeshes();
+	Check(instancedDraws == expectedLightDraws && singleDraws == 0,
+	      "Lights: " + std::to_string(instancedDraws) + " instanced draws, expected " + std::to_string(expectedLightDraws));
+
+
+	bool passed = TestExitCode() == 0;
+	SetTestOutput(std::cout);
+	std::ofstream file(outputFile);
+	file << report.str();
+	if (!file)
+	{
+		gLastError = "Error writing instancing test results to " + outputFile;
+		return false;
+	}
+	return passed;
+}
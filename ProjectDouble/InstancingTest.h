@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// Instancing test - checks instanced rendering of the scene without drawing anything
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Start the app with -instancingtest on the command line to run the test instead of the interactive loop. As with the
+// benchmark (see Benchmark.h) the window is never shown and the scene is rendered through RecordingRenderDevice under
+// the state cache, so nothing reaches the GPU, but a D3D11 device is still needed to create the scene's resources.
+//
+// The trees are rendered in each of the passes that use RenderDefaultModels, with a camera that sees all of them, and
+// the light models (cubes) are rendered with RenderLights. Then the instance buffer is checked against the models:
+// each instance's world matrix and colour must be those of its model, laid out node by node with the models in the
+// same order for every node (see InstanceBuffer.h). And each tree mesh must be drawn with one instanced draw per
+// sub-mesh in each pass - a couple of draws for all the trees rather than one or more for every tree.
+//
+// One line per check is written to InstancingTest.txt, or the file given after -output. The exit code is non-zero if
+// any check fails, or if the window, device or scene can't be created, so a machine that can't run it never passes.
+//
+// Windows only: the render queue, instance buffer and meshes use D3D11 types and the scene needs a device to load, so
+// this test is not part of the portable tests in Tests/CMakeLists.txt. Run it by hand or from a Windows CI job
+
+#ifndef _INSTANCING_TEST_H_INCLUDED_
+#define _INSTANCING_TEST_H_INCLUDED_
+
+#include <string>
+
+
+// Read the test options from the command line. Returns true if -instancingtest was given, and sets outputFile to the
+// file after -output if there is one
+bool ParseInstancingTestCommandLine(const std::string& commandLine, std::string& outputFile);
+
+// Run the test and write the results to the given file, call after InitGeometry and InitScene. Replaces gRenderDevice
+// with a recording device, so the interactive loop can't be used afterwards. Returns false if any check fails or the
+// results can't be written
+bool RunInstancingTest(const std::string& outputFile);
+
+
+#endif //_INSTANCING_TEST_H_INCLUDED_
@@ -0,0 +1,198 @@
+//--------------------------------------------------------------------------------------
+// Light buffer - the scene's lights and the lists of lights reaching each cluster, for the shaders
+//--------------------------------------------------------------------------------------
+
+#include "LightBuffer.h"
+#include "Camera.h"
+#include "RenderDevice.h"
+#include "Shader.h" // CreateConstantBuffer
+#include "GraphicsHelpers.h"
+#include "Profiler.h"
+#include "Common.h"
+#include <cmath>
+#include <cstring>
+
+
+namespace
+{
+	// Slice 0 of the cluster grid covers everything nearer than this, the other slices share the depth beyond it. The
+	// near clip is very close, so exponential slices starting there would be wasted on the first few units
+	const float kFirstSliceDepth = 5.0f;
+
+	// Starting sizes of the buffers that grow with the number of lights
+	const unsigned int kInitialLights = 64;
+	const unsigned int kInitialIndices = 4096;
+}
+
+const unsigned int LightBuffer::kTilesX;
+const unsigned int LightBuffer::kTilesY;
+const unsigned int LightBuffer::kSlices;
+const UINT LightBuffer::kFirstShaderResourceSlot;
+const UINT LightBuffer::kConstantBufferSlot;
+
+
+// The light buffer used by all the lit shaders
+LightBuffer gLightBuffer;
+
+
+// Create the GPU buffers. Returns false on failure
+bool LightBuffer::Create()
+{
+	if (!Reserve(mLightsBuffer, mLightsSRV, mLightsCapacity, kInitialLights, sizeof(LightData)) ||
+	    !Reserve(mClustersBuffer, mClustersSRV, mClustersCapacity, kTilesX * kTilesY * kSlices, sizeof(CLightClusters::Cluster)) ||
+	    !Reserve(mIndicesBuffer, mIndicesSRV, mIndicesCapacity, kInitialIndices, sizeof(uint32_t)))
+	{
+		return false;
+	}
+
+	mConstantBuffer = CreateConstantBuffer(sizeof(ClusterConstants));
+	return mConstantBuffer != nullptr;
+}
+
+// Release the GPU buffers
+void LightBuffer::Release()
+{
+	if (mConstantBuffer)  mConstantBuffer->Release();
+	if (mIndicesSRV)      mIndicesSRV->Release();
+	if (mIndicesBuffer)   mIndicesBuffer->Release();
+	if (mClustersSRV)     mClustersSRV->Release();
+	if (mClustersBuffer)  mClustersBuffer->Release();
+	if (mLightsSRV)       mLightsSRV->Release();
+	if (mLightsBuffer)    mLightsBuffer->Release();
+	mConstantBuffer = nullptr;
+	mIndicesSRV = nullptr;
+	mIndicesBuffer = nullptr;
+	mClustersSRV = nullptr;
+	mClustersBuffer = nullptr;
+	mLightsSRV = nullptr;
+	mLightsBuffer = nullptr;
+	mIndicesCapacity = mClustersCapacity = mLightsCapacity = 0;
+	mGridValid = false;
+}
+
+
+// Remove all lights, call at the start of each frame
+void LightBuffer::Clear()
+{
+	mLights.clear();
+	mClusterLights.clear();
+	mLightsChanged = true;
+}
+
+// Add a point light. Point lights have a cone half angle of 180 degrees, so every direction is inside
+void LightBuffer::AddPointLight(const CVector3& position, const CVector3& colour, float range,
+                                unsigned int lightSets /*= kLightSetGeneral*/)
+{
+	mLights.push_back({ position, range, colour, -2.0f, { 0, 0, 0 }, 0, lightSets, { 0, 0, 0 } });
+	mClusterLights.push_back({ position, range, { 0, 0, 0 }, 0.0f });
+	mLightsChanged = true;
+}
+
+// Add a spotlight facing the given direction with the given cone half angle in radians
+void LightBuffer::AddSpotLight(const CVector3& position, const CVector3& colour, float range, const CVector3& facing,
+                               float halfAngle, unsigned int shadowMap /*= 0*/, unsigned int lightSets /*= kLightSetGeneral*/)
+{
+	mLights.push_back({ position, range, colour, std::cos(halfAngle), facing, shadowMap, lightSets, { 0, 0, 0 } });
+	mClusterLights.push_back({ position, range, facing, halfAngle });
+	mLightsChanged = true;
+}
+
+
+// Bin the lights as seen from the given camera, send the lights and lists to the GPU and bind them for the pixel
+// shader. The grid is only set up again if the projection has changed, and the lists are only rebuilt if the lights or
+// the camera's view have changed
+void LightBuffer::Assign(Camera* camera)
+{
+	PROFILE_ZONE("Light clusters");
+
+	CMatrix4x4 projectionMatrix = camera->ProjectionMatrix();
+	CMatrix4x4 viewMatrix = camera->ViewMatrix();
+	bool projectionChanged = !mGridValid || std::memcmp(&projectionMatrix, &mProjectionMatrix, sizeof(CMatrix4x4)) != 0;
+	bool viewChanged = std::memcmp(&viewMatrix, &mViewMatrix, sizeof(CMatrix4x4)) != 0;
+
+	if (projectionChanged)
+	{
+		mClusters.SetGrid(kTilesX, kTilesY, kSlices, projectionMatrix, camera->NearClip(), camera->FarClip(), kFirstSliceDepth);
+		mConstants.tilesX = mClusters.TilesX();
+		mConstants.tilesY = mClusters.TilesY();
+		mConstants.slices = mClusters.Slices();
+		mConstants.firstSliceDepth = mClusters.FirstSliceDepth();
+		mConstants.depthScale = mClusters.DepthScale();
+		mConstants.depthBias = mClusters.DepthBias();
+		UpdateConstantBuffer(mConstantBuffer, mConstants);
+		mProjectionMatrix = projectionMatrix;
+		mGridValid = true;
+	}
+
+	if (projectionChanged || viewChanged || mLightsChanged)
+	{
+		// Threads are only used when there are enough lights to be worth it (see CLightClusters::Assign)
+		mClusters.Assign(mClusterLights.data(), static_cast<uint32_t>(mClusterLights.size()), viewMatrix, 0);
+		mViewMatrix = viewMatrix;
+
+		const std::vector<CLightClusters::Cluster>& clusters = mClusters.Clusters();
+		const std::vector<uint32_t>& indices = mClusters.LightIndices();
+		unsigned int numLights = static_cast<unsigned int>(mLights.size());
+		unsigned int numIndices = static_cast<unsigned int>(indices.size());
+
+		// Buffers that can't grow keep their old contents, the shaders then use out of date lists but nothing worse
+		if (numLights > 0 && Reserve(mLightsBuffer, mLightsSRV, mLightsCapacity, numLights, sizeof(LightData)))
+		{
+			gRenderDevice->UpdateBuffer(mLightsBuffer, mLights.data(), numLights * sizeof(LightData));
+		}
+		if (numIndices > 0 && Reserve(mIndicesBuffer, mIndicesSRV, mIndicesCapacity, numIndices, sizeof(uint32_t)))
+		{
+			gRenderDevice->UpdateBuffer(mIndicesBuffer, indices.data(), numIndices * sizeof(uint32_t));
+		}
+		gRenderDevice->UpdateBuffer(mClustersBuffer, clusters.data(), clusters.size() * sizeof(CLightClusters::Cluster));
+		mLightsChanged = false;
+	}
+	else
+	{
+		++mNumReuses;
+	}
+
+	ID3D11ShaderResourceView* views[3] = { mLightsSRV, mClustersSRV, mIndicesSRV };
+	gRenderDevice->PSSetShaderResources(kFirstShaderResourceSlot, 3, views);
+	gRenderDevice->PSSetConstantBuffers(kConstantBufferSlot, 1, &mConstantBuffer);
+}
+
+
+// Make sure a structured buffer can hold the given number of elements. A full buffer is replaced with one at least
+// twice the size, so growing to n elements takes few replacements
+bool LightBuffer::Reserve(ID3D11Buffer*& buffer, ID3D11ShaderResourceView*& bufferSRV, unsigned int& capacity,
+                          unsigned int numElements, unsigned int elementSize)
+{
+	if (numElements <= capacity)  return true;
+	unsigned int newCapacity = (numElements > capacity * 2) ? numElements : capacity * 2;
+
+	// Structured buffer read by the pixel shader, rewritten by the CPU each time it is uploaded
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.ByteWidth = newCapacity * elementSize;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = elementSize;
+	ID3D11Buffer* newBuffer = nullptr;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &newBuffer)))  return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = newCapacity;
+	ID3D11ShaderResourceView* newSRV = nullptr;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(newBuffer, &srvDesc, &newSRV)))
+	{
+		newBuffer->Release();
+		return false;
+	}
+
+	if (bufferSRV)  bufferSRV->Release();
+	if (buffer)     buffer->Release();
+	buffer = newBuffer;
+	bufferSRV = newSRV;
+	capacity = newCapacity;
+	return true;
+}
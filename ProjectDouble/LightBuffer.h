@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+// Light buffer - the scene's lights and the lists of lights reaching each cluster, for the shaders
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The lit pixel shaders used to have a fixed set of lights in the per-frame constants. Now any number of point lights
+// and spotlights can be added each frame. The lights are binned into clusters - cells of a grid over the camera's view
+// frustum - on the CPU (see CLightClusters.h), and the shaders only loop over the lights listed for the cluster each
+// pixel is in (see ClusteredLights.hlsli). A light is only listed in the clusters within its range.
+//
+// Call Clear at the start of the frame and add the lights, then Assign before rendering from each camera. Assign bins
+// the lights for that camera, uploads the lights and lists and binds them for the pixel shader. It only rebuilds the
+// lists if the camera or the lights have changed since the last call, so passes sharing a camera share the lists.
+// The GPU buffers grow as needed. As with the instance buffer, the whole of each buffer is replaced when it is
+// uploaded so draws earlier in the frame keep the lists they were given.
+//
+// Spotlights can be marked as lit with a shadow map. Shaders that have the shadow maps skip them in the light list and
+// light them from the shadow light constants instead, other shaders light them as point lights.
+//
+// Each light is in one or more light sets. Most shaders use the general set, which has all the lights, but a few were
+// written for particular lights (e.g. the water's highlights are only from the first two lights), and they only use
+// the lights in their own set
+
+#ifndef _LIGHT_BUFFER_H_INCLUDED_
+#define _LIGHT_BUFFER_H_INCLUDED_
+
+#include "CLightClusters.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include <d3d11.h>
+#include <vector>
+
+class Camera;
+
+// Light for the shaders. Must match exactly the LightData structure in ClusteredLights.hlsli
+struct LightData
+{
+	CVector3     position;
+	float        range;        // Light fades to nothing at this distance
+	CVector3     colour;       // Colour multiplied by strength
+	float        cosHalfAngle; // Cosine of a spotlight's cone half angle, below -1 for point lights
+	CVector3     facing;       // Spotlights only
+	unsigned int shadowMap;    // 1 or 2 for spotlights lit with a shadow map where there is one, else 0
+	unsigned int lightSets;    // The LightBuffer::kLightSet values for the shaders this light is used by
+	float        padding[3];
+};
+static_assert(sizeof(LightData) == 64, "LightData must match the structured buffer stride used by the shaders");
+
+// Cluster grid for the shaders. Must match the ClusterConstants buffer in ClusteredLights.hlsli
+struct ClusterConstants
+{
+	unsigned int tilesX;
+	unsigned int tilesY;
+	unsigned int slices;
+	float        firstSliceDepth;
+	float        depthScale;
+	float        depthBias;
+	float        padding[2];
+};
+
+
+class LightBuffer
+{
+public:
+	// Size of the cluster grid. Tiles are 16:9 like the screen
+	static const unsigned int kTilesX = 16;
+	static const unsigned int kTilesY = 9;
+	static const unsigned int kSlices = 24;
+
+	// Pixel shader slots used, must match ClusteredLights.hlsli. The lights, clusters and light indices are in the
+	// first shader resource slot and the two after
+	static const UINT kFirstShaderResourceSlot = 16;
+	static const UINT kConstantBufferSlot = 4;
+
+	// Light sets, see the top of the file. Must match the LIGHT_SET values in ClusteredLights.hlsli
+	static const unsigned int kLightSetGeneral           = 1; // The shaders that use all the scene's lights
+	static const unsigned int kLightSetWaterSpecular     = 2; // Reflected as highlights on the water surface
+	static const unsigned int kLightSetTransformLighting = 4; // TransformLighting_ps
+
+	~LightBuffer()  { Release(); }
+
+	// Create the GPU buffers. Returns false on failure
+	bool Create();
+
+	// Release the GPU buffers
+	void Release();
+
+
+	// Remove all lights, call at the start of each frame
+	void Clear();
+
+	// Add a point light. The colour is multiplied by the strength. The light sets are kLightSet values combined with |
+	void AddPointLight(const CVector3& position, const CVector3& colour, float range, unsigned int lightSets = kLightSetGeneral);
+
+	// Add a spotlight facing the given direction (unit length) with the given cone half angle in radians, less than 90
+	// degrees. The shadow map number is 1 or 2 if the light is lit with a shadow map where there is one, 0 if not
+	void AddSpotLight(const CVector3& position, const CVector3& colour, float range, const CVector3& facing,
+	                  float halfAngle, unsigned int shadowMap = 0, unsigned int lightSets = kLightSetGeneral);
+
+	// Bin the lights as seen from the given camera, send the lights and lists to the GPU and bind them for the pixel
+	// shader. Call before rendering lit models from a camera
+	void Assign(Camera* camera);
+
+
+	// The lights added this frame and the clusters of the last Assign, can be used to check the data without a GPU
+	const std::vector<LightData>& Lights() const  { return mLights; }
+	const CLightClusters& Clusters() const        { return mClusters; }
+
+	// Statistics since the last ResetStats. See CLightClusters::Stats for the binning counts
+	unsigned int NumReuses() const  { return mNumReuses; } // Calls to Assign that used the lists as they were
+	void         ResetStats()       { mClusters.ResetStats(); mNumReuses = 0; }
+
+
+private:
+	// Make sure a structured buffer can hold the given number of elements, replacing it with a larger one if not.
+	// Returns false on failure
+	bool Reserve(ID3D11Buffer*& buffer, ID3D11ShaderResourceView*& bufferSRV, unsigned int& capacity,
+	             unsigned int numElements, unsigned int elementSize);
+
+	std::vector<LightData>             mLights;
+	std::vector<CLightClusters::Light> mClusterLights;
+	bool                               mLightsChanged = true;
+
+	CLightClusters   mClusters;
+	ClusterConstants mConstants = {};
+	CMatrix4x4       mProjectionMatrix; // Camera matrices of the last Assign
+	CMatrix4x4       mViewMatrix;
+	bool             mGridValid = false;
+
+	ID3D11Buffer*              mLightsBuffer = nullptr;
+	ID3D11ShaderResourceView*  mLightsSRV = nullptr;
+	unsigned int               mLightsCapacity = 0;
+	ID3D11Buffer*              mClustersBuffer = nullptr;
+	ID3D11ShaderResourceView*  mClustersSRV = nullptr;
+	unsigned int               mClustersCapacity = 0;
+	ID3D11Buffer*              mIndicesBuffer = nullptr;
+	ID3D11ShaderResourceView*  mIndicesSRV = nullptr;
+	unsigned int               mIndicesCapacity = 0;
+	ID3D11Buffer*              mConstantBuffer = nullptr;
+
+	unsigned int               mNumReuses = 0;
+};
+
+
+// The light buffer used by all the lit shaders
+extern LightBuffer gLightBuffer;
+
+
+#endif //_LIGHT_BUFFER_H_INCLUDED_
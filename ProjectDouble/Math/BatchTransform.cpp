@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------------------
+// Batch transforms - push arrays of points / vectors through a CMatrix4x4 in one call
+//--------------------------------------------------------------------------------------
+
+#include "BatchTransform.h"
+#include "MathSIMD.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------------------------*/
+
+namespace
+{
+    // Scalar versions used for the fallback and for the last few elements that don't fill a SIMD register
+    inline CVector4 TransformPoint(const CMatrix4x4& m, const float x, const float y, const float z)
+    {
+        return { x * m.e00 + y * m.e10 + z * m.e20 + m.e30,
+                 x * m.e01 + y * m.e11 + z * m.e21 + m.e31,
+                 x * m.e02 + y * m.e12 + z * m.e22 + m.e32,
+                 x * m.e03 + y * m.e13 + z * m.e23 + m.e33 };
+    }
+
+    inline CVector3 TransformVector(const CMatrix4x4& m, const CVector3& v)
+    {
+        return { v.x * m.e00 + v.y * m.e10 + v.z * m.e20,
+                 v.x * m.e01 + v.y * m.e11 + v.z * m.e21,
+                 v.x * m.e02 + v.y * m.e12 + v.z * m.e22 };
+    }
+
+#if defined(MATH_SSE)
+    // Every element of a matrix broadcast to its own SIMD register, so four points held in
+    // SoA form (one register each for x, y and z) can be transformed together
+    struct SIMDMatrix
+    {
+        __m128 e[4][4];
+
+        explicit SIMDMatrix(const CMatrix4x4& m)
+        {
+            const float* elts = &m.e00;
+            for (int row = 0; row < 4; ++row)
+                for (int col = 0; col < 4; ++col)
+                    e[row][col] = _mm_set1_ps(elts[row * 4 + col]);
+        }
+
+        // Given column of the result of transforming four points (w = 1)
+        __m128 Point(const int col, const __m128 x, const __m128 y, const __m128 z) const
+        {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, e[0][col]), _mm_mul_ps(y, e[1][col])),
+                              _mm_add_ps(_mm_mul_ps(z, e[2][col]), e[3][col]));
+        }
+
+        // Given column of the result of transforming four vectors (w = 0)
+        __m128 Vector(const int col, const __m128 x, const __m128 y, const __m128 z) const
+        {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, e[0][col]), _mm_mul_ps(y, e[1][col])),
+                              _mm_mul_ps(z, e[2][col]));
+        }
+    };
+#endif
+}
+
+
+// Transform n points (w = 1) by the given affine matrix, w is dropped from the output
+void TransformPoints(const CMatrix4x4& m, const CVector3* in, CVector3* out, std::size_t n)
+{
+    std::size_t i = 0;
+#if defined(MATH_SSE)
+    SIMDMatrix sm(m);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 x, y, z;
+        SIMDLoadVector3x4(&in[i].x, x, y, z);
+        SIMDStoreVector3x4(&out[i].x, sm.Point(0, x, y, z), sm.Point(1, x, y, z), sm.Point(2, x, y, z));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        CVector4 p = TransformPoint(m, in[i].x, in[i].y, in[i].z);
+        out[i] = { p.x, p.y, p.z };
+    }
+}
+
+
+// Transform n vectors (w = 0) by the given matrix - translation is ignored
+void TransformVectors(const CMatrix4x4& m, const CVector3* in, CVector3* out, std::size_t n)
+{
+    std::size_t i = 0;
+#if defined(MATH_SSE)
+    SIMDMatrix sm(m);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 x, y, z;
+        SIMDLoadVector3x4(&in[i].x, x, y, z);
+        SIMDStoreVector3x4(&out[i].x, sm.Vector(0, x, y, z), sm.Vector(1, x, y, z), sm.Vector(2, x, y, z));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        out[i] = TransformVector(m, in[i]);
+    }
+}
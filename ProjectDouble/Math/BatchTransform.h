@@ -0,0 +1,26 @@
+//--------------------------------------------------------------------------------------
+// Batch transforms - push arrays of points / vectors through a CMatrix4x4 in one call
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The matrix is loaded once and the points are processed four at a time with SIMD where
+// available (see MathSIMD.h). Prefer these to a loop of CVector4 * CMatrix4x4 when there
+// are more than a handful of points (e.g. CLightClusters moves every light into view space
+// with them). Input and output arrays must not overlap.
+
+#ifndef _BATCH_TRANSFORM_H_DEFINED_
+#define _BATCH_TRANSFORM_H_DEFINED_
+
+#include "CVector3.h"
+#include "CVector4.h"
+#include "CMatrix4x4.h"
+#include <cstddef>
+
+
+// Transform n points (w = 1) by the given affine matrix, w is dropped from the output
+void TransformPoints(const CMatrix4x4& m, const CVector3* in, CVector3* out, std::size_t n);
+
+// Transform n vectors (w = 0) by the given matrix - translation is ignored
+void TransformVectors(const CMatrix4x4& m, const CVector3* in, CVector3* out, std::size_t n);
+
+
+#endif // _BATCH_TRANSFORM_H_DEFINED_
@@ -0,0 +1,231 @@
+//--------------------------------------------------------------------------------------
+// Bounding volumes - axis aligned boxes and spheres for culling and picking
+//--------------------------------------------------------------------------------------
+
+#include "BoundingVolumes.h"
+#include <cmath>
+
+
+/*-----------------------------------------------------------------------------------------
+    CBoundingBox
+-----------------------------------------------------------------------------------------*/
+
+// Grow the box to contain the given point
+void CBoundingBox::Include(const CVector3& point)
+{
+    if (point.x < minimum.x)  minimum.x = point.x;
+    if (point.y < minimum.y)  minimum.y = point.y;
+    if (point.z < minimum.z)  minimum.z = point.z;
+    if (point.x > maximum.x)  maximum.x = point.x;
+    if (point.y > maximum.y)  maximum.y = point.y;
+    if (point.z > maximum.z)  maximum.z = point.z;
+}
+
+// Grow the box to contain the given box
+void CBoundingBox::Include(const CBoundingBox& box)
+{
+    if (box.IsEmpty())  return;
+    Include(box.minimum);
+    Include(box.maximum);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Box enclosing n points. The points are stride bytes apart so they can be read straight from vertex data
+CBoundingBox BoundPoints(const void* points, std::size_t stride, std::size_t n)
+{
+    CBoundingBox box = CBoundingBox::Empty();
+    auto point = static_cast<const unsigned char*>(points);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        box.Include(*reinterpret_cast<const CVector3*>(point));
+        point += stride;
+    }
+    return box;
+}
+
+
+// Sphere enclosing n points, centred on the centre of their box (given). Tighter than SphereFromBox as the radius
+// is the distance to the furthest point rather than the box corner
+CBoundingSphere BoundPointsSphere(const void* points, std::size_t stride, std::size_t n, const CBoundingBox& box)
+{
+    if (box.IsEmpty())  return { { 0, 0, 0 }, -1 };
+
+    CVector3 centre = box.Centre();
+    float maxDistanceSquared = 0;
+    auto point = static_cast<const unsigned char*>(points);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        CVector3 offset = *reinterpret_cast<const CVector3*>(point) - centre;
+        float distanceSquared = Dot(offset, offset);
+        if (distanceSquared > maxDistanceSquared)  maxDistanceSquared = distanceSquared;
+        point += stride;
+    }
+    return { centre, std::sqrt(maxDistanceSquared) };
+}
+
+
+// Box enclosing the given box after it has been transformed by an affine matrix. The result is axis aligned again
+// so it will be larger than the box for most rotations. An empty box stays empty
+CBoundingBox TransformBox(const CBoundingBox& box, const CMatrix4x4& m)
+{
+    if (box.IsEmpty())  return box;
+
+    // Transform the centre, then the extent of the new box in each axis is the sum of the absolute values of the
+    // transformed half-size axes (J. Arvo, Graphics Gems 1990)
+    CVector3 c = box.Centre();
+    CVector3 h = box.HalfSize();
+    CVector3 centre = { c.x * m.e00 + c.y * m.e10 + c.z * m.e20 + m.e30,
+                        c.x * m.e01 + c.y * m.e11 + c.z * m.e21 + m.e31,
+                        c.x * m.e02 + c.y * m.e12 + c.z * m.e22 + m.e32 };
+    CVector3 halfSize = { h.x * std::abs(m.e00) + h.y * std::abs(m.e10) + h.z * std::abs(m.e20),
+                          h.x * std::abs(m.e01) + h.y * std::abs(m.e11) + h.z * std::abs(m.e21),
+                          h.x * std::abs(m.e02) + h.y * std::abs(m.e12) + h.z * std::abs(m.e22) };
+    return { centre - halfSize, centre + halfSize };
+}
+
+
+// Sphere enclosing a box
+CBoundingSphere SphereFromBox(const CBoundingBox& box)
+{
+    if (box.IsEmpty())  return { { 0, 0, 0 }, -1 };
+    return { box.Centre(), Length(box.HalfSize()) };
+}
+
+
+// Sphere enclosing the given sphere after it has been transformed by an affine matrix. The radius is scaled by the
+// largest scaling in the matrix. An empty sphere stays empty
+CBoundingSphere TransformSphere(const CBoundingSphere& sphere, const CMatrix4x4& m)
+{
+    if (sphere.IsEmpty())  return sphere;
+
+    const CVector3& c = sphere.centre;
+    CVector3 centre = { c.x * m.e00 + c.y * m.e10 + c.z * m.e20 + m.e30,
+                        c.x * m.e01 + c.y * m.e11 + c.z * m.e21 + m.e31,
+                        c.x * m.e02 + c.y * m.e12 + c.z * m.e22 + m.e32 };
+
+    // The scaling of each axis is the length of the matrix row
+    float scaleSquared = m.e00 * m.e00 + m.e01 * m.e01 + m.e02 * m.e02;
+    float rowSquared   = m.e10 * m.e10 + m.e11 * m.e11 + m.e12 * m.e12;
+    if (rowSquared > scaleSquared)  scaleSquared = rowSquared;
+    rowSquared         = m.e20 * m.e20 + m.e21 * m.e21 + m.e22 * m.e22;
+    if (rowSquared > scaleSquared)  scaleSquared = rowSquared;
+
+    return { centre, sphere.radius * std::sqrt(scaleSquared) };
+}
+
+
+// Sphere centred on the given box enclosing all the given spheres, which must be inside the box. The radius is
+// limited to the sphere around the box, so the result is never looser than SphereFromBox
+CBoundingSphere EnclosingSphere(const CBoundingSphere* spheres, std::size_t n, const CBoundingBox& box)
+{
+    CBoundingSphere result = SphereFromBox(box);
+    if (result.IsEmpty())  return result;
+
+    float radius = 0;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        if (spheres[i].IsEmpty())  continue;
+        float reach = Length(spheres[i].centre - result.centre) + spheres[i].radius;
+        if (reach > radius)  radius = reach;
+    }
+    if (radius < result.radius)  result.radius = radius;
+    return result;
+}
+
+
+// Per-component reciprocal of a ray direction, for RayHitsBox. Zero components become very large values so that
+// the box tests still work for rays parallel to an axis
+CVector3 InverseDirection(const CVector3& direction)
+{
+    const float kTiny = 1e-30f;
+    return { 1.0f / (direction.x != 0 ? direction.x : kTiny),
+             1.0f / (direction.y != 0 ? direction.y : kTiny),
+             1.0f / (direction.z != 0 ? direction.z : kTiny) };
+}
+
+
+// Whether a ray enters the box before maxDistance, giving the distance along the ray where it does so. The ray is
+// clipped against the pair of planes bounding the box in each axis, it is inside the box where all three overlap
+// (T. Kay & J. Kajiya, Ray Tracing Complex Scenes, 1986)
+bool RayHitsBox(const CBoundingBox& box, const CVector3& origin, const CVector3& inverseDirection, float maxDistance,
+                float& entryDistance)
+{
+    if (box.IsEmpty())  return false;
+
+    float entry = 0;
+    float exit = maxDistance;
+
+    float t0 = (box.minimum.x - origin.x) * inverseDirection.x;
+    float t1 = (box.maximum.x - origin.x) * inverseDirection.x;
+    if (t0 > t1)  { float t = t0; t0 = t1; t1 = t; }
+    if (t0 > entry)  entry = t0;
+    if (t1 < exit)   exit = t1;
+
+    t0 = (box.minimum.y - origin.y) * inverseDirection.y;
+    t1 = (box.maximum.y - origin.y) * inverseDirection.y;
+    if (t0 > t1)  { float t = t0; t0 = t1; t1 = t; }
+    if (t0 > entry)  entry = t0;
+    if (t1 < exit)   exit = t1;
+
+    t0 = (box.minimum.z - origin.z) * inverseDirection.z;
+    t1 = (box.maximum.z - origin.z) * inverseDirection.z;
+    if (t0 > t1)  { float t = t0; t0 = t1; t1 = t; }
+    if (t0 > entry)  entry = t0;
+    if (t1 < exit)   exit = t1;
+
+    if (entry > exit)  return false;
+    entryDistance = entry;
+    return true;
+}
+
+
+// Squared distance from a point to the nearest point in a box, 0 if the point is inside. FLT_MAX for empty boxes
+float DistanceSquared(const CBoundingBox& box, const CVector3& point)
+{
+    if (box.IsEmpty())  return FLT_MAX;
+
+    float distanceSquared = 0;
+    if      (point.x < box.minimum.x)  distanceSquared += (box.minimum.x - point.x) * (box.minimum.x - point.x);
+    else if (point.x > box.maximum.x)  distanceSquared += (point.x - box.maximum.x) * (point.x - box.maximum.x);
+    if      (point.y < box.minimum.y)  distanceSquared += (box.minimum.y - point.y) * (box.minimum.y - point.y);
+    else if (point.y > box.maximum.y)  distanceSquared += (point.y - box.maximum.y) * (point.y - box.maximum.y);
+    if      (point.z < box.minimum.z)  distanceSquared += (box.minimum.z - point.z) * (box.minimum.z - point.z);
+    else if (point.z > box.maximum.z)  distanceSquared += (point.z - box.maximum.z) * (point.z - box.maximum.z);
+    return distanceSquared;
+}
+
+
+// Fraction of the screen covered by a box's projected rectangle. Each corner is projected to normalised device
+// coordinates, where the screen is -1 to 1 in x and y, and the rectangle around them is clipped to the screen
+float ProjectedArea(const CBoundingBox& box, const CMatrix4x4& viewProjection)
+{
+    if (box.IsEmpty())  return 1.0f;
+
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        CVector3 point = { (corner & 1) ? box.maximum.x : box.minimum.x,
+                           (corner & 2) ? box.maximum.y : box.minimum.y,
+                           (corner & 4) ? box.maximum.z : box.minimum.z };
+        CVector4 clip = CVector4(point, 1) * viewProjection;
+        if (clip.z < 0 || clip.w <= 0)  return 1.0f;
+
+        float x = clip.x / clip.w;
+        float y = clip.y / clip.w;
+        if (x < minX)  minX = x;
+        if (x > maxX)  maxX = x;
+        if (y < minY)  minY = y;
+        if (y > maxY)  maxY = y;
+    }
+
+    if (minX < -1)  minX = -1;
+    if (maxX >  1)  maxX =  1;
+    if (minY < -1)  minY = -1;
+    if (maxY >  1)  maxY =  1;
+    if (minX >= maxX || minY >= maxY)  return 0.0f;
+    return (maxX - minX) * (maxY - minY) * 0.25f;
+}
@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// Bounding volumes - axis aligned boxes and spheres for culling and picking
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _BOUNDING_VOLUMES_H_DEFINED_
+#define _BOUNDING_VOLUMES_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include <cstddef>
+#include <cfloat>
+
+
+// Axis aligned bounding box. A box with minimum greater than maximum is empty (i.e. bounds nothing, or the
+// bounds are unknown) - culling code treats empty boxes as always visible
+struct CBoundingBox
+{
+    CVector3 minimum;
+    CVector3 maximum;
+
+    // An empty box, ready to have points included in it
+    static CBoundingBox Empty()  { return { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } }; }
+
+    bool IsEmpty() const  { return minimum.x > maximum.x; }
+
+    CVector3 Centre() const    { return (minimum + maximum) * 0.5f; }
+    CVector3 HalfSize() const  { return (maximum - minimum) * 0.5f; }
+
+    // Grow the box to contain the given point or box
+    void Include(const CVector3& point);
+    void Include(const CBoundingBox& box);
+};
+
+
+// Bounding sphere. A negative radius means empty, as for boxes
+struct CBoundingSphere
+{
+    CVector3 centre;
+    float    radius;
+
+    bool IsEmpty() const  { return radius < 0; }
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Box enclosing n points. The points are stride bytes apart so they can be read straight from vertex data
+CBoundingBox BoundPoints(const void* points, std::size_t stride, std::size_t n);
+
+// Sphere enclosing n points, centred on the centre of their box (given). Tighter than SphereFromBox as the radius
+// is the distance to the furthest point rather than the box corner
+CBoundingSphere BoundPointsSphere(const void* points, std::size_t stride, std::size_t n, const CBoundingBox& box);
+
+// Box enclosing the given box after it has been transformed by an affine matrix. The result is axis aligned again
+// so it will be larger than the box for most rotations. An empty box stays empty
+CBoundingBox TransformBox(const CBoundingBox& box, const CMatrix4x4& m);
+
+// Sphere enclosing a box
+CBoundingSphere SphereFromBox(const CBoundingBox& box);
+
+// Sphere enclosing the given sphere after it has been transformed by an affine matrix. The radius is scaled by the
+// largest scaling in the matrix. An empty sphere stays empty
+CBoundingSphere TransformSphere(const CBoundingSphere& sphere, const CMatrix4x4& m);
+
+// Sphere centred on the given box enclosing all the given spheres, which must be inside the box. The radius is
+// limited to the sphere around the box, so the result is never looser than SphereFromBox
+CBoundingSphere EnclosingSphere(const CBoundingSphere* spheres, std::size_t n, const CBoundingBox& box);
+
+// Per-component reciprocal of a ray direction, for RayHitsBox. Zero components become very large values so that
+// the box tests still work for rays parallel to an axis
+CVector3 InverseDirection(const CVector3& direction);
+
+// Whether a ray enters the box before maxDistance, giving the distance along the ray where it does so. Distances are
+// in units of the ray direction's length. The inverse direction is passed as it is shared by all the boxes a ray is
+// tested against. A ray starting inside the box enters at distance 0. Empty boxes are never hit
+bool RayHitsBox(const CBoundingBox& box, const CVector3& origin, const CVector3& inverseDirection, float maxDistance,
+                float& entryDistance);
+
+// Squared distance from a point to the nearest point in a box, 0 if the point is inside. FLT_MAX for empty boxes
+float DistanceSquared(const CBoundingBox& box, const CVector3& point);
+
+// Fraction of the screen (0 to 1) covered by the rectangle around a box projected with the given view-projection matrix
+// (DirectX conventions). An overestimate, as it is the corners' rectangle. 1 if the box crosses the near plane or is
+// empty, as it may then cover anything
+float ProjectedArea(const CBoundingBox& box, const CMatrix4x4& viewProjection);
+
+
+#endif // _BOUNDING_VOLUMES_H_DEFINED_
@@ -0,0 +1,377 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume tree - hierarchy of boxes for ray, frustum and nearest item queries
+//--------------------------------------------------------------------------------------
+
+#include "CBoundingVolumeTree.h"
+#include <algorithm>
+#include <cmath>
+
+
+/*-----------------------------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------------------------*/
+
+namespace
+{
+    // Number of buckets the items are sorted into along an axis when looking for the best split
+    const uint32_t kNumBins = 12;
+
+    // Cost of visiting a node relative to testing an item's box, for the surface area heuristic
+    const float kTraversalCost = 1.0f;
+
+    // NeedsRebuild reports true when refitting has made the tree this much more costly than when it was built
+    const float kRebuildCostRatio = 1.5f;
+
+    // Half the surface area of a box. The heuristic only compares areas, so the factor of two is not needed
+    inline float HalfArea(const CBoundingBox& box)
+    {
+        if (box.IsEmpty())  return 0;
+        CVector3 size = box.maximum - box.minimum;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    inline float Component(const CVector3& v, uint32_t axis)
+    {
+        return (&v.x)[axis];
+    }
+
+    inline bool SameBox(const CBoundingBox& a, const CBoundingBox& b)
+    {
+        return a.minimum.x == b.minimum.x && a.minimum.y == b.minimum.y && a.minimum.z == b.minimum.z &&
+               a.maximum.x == b.maximum.x && a.maximum.y == b.maximum.y && a.maximum.z == b.maximum.z;
+    }
+}
+
+
+const uint32_t CBoundingVolumeTree::kNoItem;
+const uint32_t CBoundingVolumeTree::kNoNode;
+
+
+/*-----------------------------------------------------------------------------------------
+    Building
+-----------------------------------------------------------------------------------------*/
+
+// Build the tree for n items with the given boxes, replacing any previous items
+void CBoundingVolumeTree::Build(const CBoundingBox* boxes, uint32_t numItems)
+{
+    mNodes.clear();
+    mLeafItems.clear();
+    mEmptyItems.clear();
+    mItemBoxes.assign(boxes, boxes + numItems);
+    mItemLeaves.assign(numItems, kNoNode);
+    mCentres.resize(numItems);
+    mDepth = 0;
+
+    for (uint32_t item = 0; item < numItems; ++item)
+    {
+        if (boxes[item].IsEmpty())
+        {
+            mEmptyItems.push_back(item);
+        }
+        else
+        {
+            mLeafItems.push_back(item);
+            mCentres[item] = boxes[item].Centre();
+        }
+    }
+
+    if (!mLeafItems.empty())
+    {
+        mNodes.reserve(2 * mLeafItems.size());
+        BuildNode(kNoNode, 0, static_cast<uint32_t>(mLeafItems.size()), 1);
+    }
+    mBuiltCost = Cost();
+    std::vector<CVector3>().swap(mCentres);
+}
+
+
+// Build a node for the items in the given range of mLeafItems, then its children. The items are split along the axis
+// where their centres are most spread out. They are put in equal sized bins along the axis and the split between
+// bins with the lowest surface area heuristic cost is chosen (I. Wald, On Fast Construction of SAH-based Bounding
+// Volume Hierarchies, 2007). If a leaf would be cheaper than any split the node becomes a leaf
+uint32_t CBoundingVolumeTree::BuildNode(uint32_t parent, uint32_t firstItem, uint32_t numItems, uint32_t depth)
+{
+    uint32_t index = static_cast<uint32_t>(mNodes.size());
+    mNodes.emplace_back();
+    if (depth > mDepth)  mDepth = depth;
+
+    uint32_t* items = &mLeafItems[firstItem];
+    CBoundingBox box = CBoundingBox::Empty();
+    CBoundingBox centreBounds = CBoundingBox::Empty();
+    for (uint32_t i = 0; i < numItems; ++i)
+    {
+        box.Include(mItemBoxes[items[i]]);
+        centreBounds.Include(mCentres[items[i]]);
+    }
+    mNodes[index] = { box, parent, kNoNode, firstItem, numItems };
+
+    // Axis of largest spread of the item centres
+    CVector3 spread = centreBounds.maximum - centreBounds.minimum;
+    uint32_t axis = 0;
+    if (spread.y > Component(spread, axis))  axis = 1;
+    if (spread.z > Component(spread, axis))  axis = 2;
+    float axisMinimum = Component(centreBounds.minimum, axis);
+    float axisSpread = Component(spread, axis);
+
+    uint32_t numLeft = 0;
+    bool leafIsCheaper = false;
+    if (numItems > 1 && axisSpread > 0 && depth <= kMaxHeuristicDepth)
+    {
+        // Bin the items by centre
+        struct Bin
+        {
+            CBoundingBox box = CBoundingBox::Empty();
+            uint32_t     count = 0;
+        };
+        Bin bins[kNumBins];
+        float binScale = kNumBins / axisSpread;
+        auto BinIndex = [&](uint32_t item)
+        {
+            uint32_t bin = static_cast<uint32_t>((Component(mCentres[item], axis) - axisMinimum) * binScale);
+            return bin < kNumBins ? bin : kNumBins - 1;
+        };
+        for (uint32_t i = 0; i < numItems; ++i)
+        {
+            Bin& bin = bins[BinIndex(items[i])];
+            bin.box.Include(mItemBoxes[items[i]]);
+            ++bin.count;
+        }
+
+        // Sweep from the right to get the area and count to the right of each split, then from the left to find the
+        // cheapest split. Costs are left multiplied by the node's area to avoid a divide
+        float    rightArea[kNumBins];
+        uint32_t rightCount[kNumBins];
+        CBoundingBox sweepBox = CBoundingBox::Empty();
+        uint32_t sweepCount = 0;
+        for (uint32_t b = kNumBins - 1; b > 0; --b)
+        {
+            sweepBox.Include(bins[b].box);
+            sweepCount += bins[b].count;
+            rightArea[b] = HalfArea(sweepBox);
+            rightCount[b] = sweepCount;
+        }
+
+        float nodeArea = HalfArea(box);
+        float bestCost = FLT_MAX;
+        uint32_t bestSplit = 0;
+        sweepBox = CBoundingBox::Empty();
+        sweepCount = 0;
+        for (uint32_t split = 1; split < kNumBins; ++split)
+        {
+            sweepBox.Include(bins[split - 1].box);
+            sweepCount += bins[split - 1].count;
+            if (sweepCount == 0 || rightCount[split] == 0)  continue;
+            float cost = kTraversalCost * nodeArea + HalfArea(sweepBox) * sweepCount + rightArea[split] * rightCount[split];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = split;
+            }
+        }
+
+        leafIsCheaper = numItems <= kMaxLeafItems && nodeArea * numItems <= bestCost;
+        if (bestSplit > 0 && !leafIsCheaper)
+        {
+            uint32_t* middle = std::partition(items, items + numItems, [&](uint32_t item) { return BinIndex(item) < bestSplit; });
+            numLeft = static_cast<uint32_t>(middle - items);
+        }
+    }
+
+    if (numLeft == 0 || numLeft == numItems)
+    {
+        // Leaf if it was cheaper than splitting, or there was no useful split from the heuristic (e.g. all centres in
+        // the same place, or the tree is getting deep) and the items fit. Otherwise split them in half along the axis
+        if (leafIsCheaper || numItems <= kMaxLeafItems)
+        {
+            for (uint32_t i = 0; i < numItems; ++i)  mItemLeaves[items[i]] = index;
+            return index;
+        }
+        numLeft = numItems / 2;
+        std::nth_element(items, items + numLeft, items + numItems, [&](uint32_t a, uint32_t b)
+        {
+            return Component(mCentres[a], axis) < Component(mCentres[b], axis);
+        });
+    }
+
+    // Left child is the next node
+    BuildNode(index, firstItem, numLeft, depth + 1);
+    uint32_t right = BuildNode(index, firstItem + numLeft, numItems - numLeft, depth + 1);
+    mNodes[index].right = right;
+    return index;
+}
+
+
+// Change the box of an item and refit the tree nodes above it. Refitting stops at the first node whose box doesn't
+// change, so small movements inside a group of items only touch a few nodes
+void CBoundingVolumeTree::Update(uint32_t item, const CBoundingBox& box)
+{
+    mItemBoxes[item] = box;
+    uint32_t node = mItemLeaves[item];
+    while (node != kNoNode && RefitNode(node))
+    {
+        node = mNodes[node].parent;
+    }
+}
+
+
+// Recalculate a node's box from its items or children. Returns false if it hasn't changed
+bool CBoundingVolumeTree::RefitNode(uint32_t index)
+{
+    Node& node = mNodes[index];
+    CBoundingBox box = CBoundingBox::Empty();
+    if (IsLeaf(node))
+    {
+        for (uint32_t i = node.firstItem; i < node.firstItem + node.numItems; ++i)
+        {
+            box.Include(mItemBoxes[mLeafItems[i]]);
+        }
+    }
+    else
+    {
+        box = mNodes[index + 1].box;
+        box.Include(mNodes[node.right].box);
+    }
+
+    if (SameBox(box, node.box))  return false;
+    node.box = box;
+    return true;
+}
+
+
+// Whether updates have made the tree enough worse than when it was built that it should be rebuilt
+bool CBoundingVolumeTree::NeedsRebuild() const
+{
+    return !mNodes.empty() && Cost() > mBuiltCost * kRebuildCostRatio;
+}
+
+
+// Surface area heuristic cost of the tree, relative to the root. A node's area relative to its parent's is the
+// chance that a ray through the parent also goes through the node
+float CBoundingVolumeTree::Cost() const
+{
+    if (mNodes.empty())  return 0;
+    float rootArea = HalfArea(mNodes[0].box);
+    if (rootArea <= 0)  return 0;
+
+    float cost = 0;
+    for (auto& node : mNodes)
+    {
+        cost += HalfArea(node.box) * (IsLeaf(node) ? static_cast<float>(node.numItems) : kTraversalCost);
+    }
+    return cost / rootArea;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Queries
+-----------------------------------------------------------------------------------------*/
+
+// Add the items whose boxes may be inside the frustum to the given list. Nodes completely inside the frustum add all
+// their items without further tests, and planes a node is completely inside are not tested again below it
+void CBoundingVolumeTree::FrustumQuery(const CFrustum& frustum, std::vector<uint32_t>& items) const
+{
+    items.insert(items.end(), mEmptyItems.begin(), mEmptyItems.end());
+    if (mNodes.empty())  return;
+
+    uint32_t stack[kStackSize];
+    uint32_t stackMask[kStackSize];
+    uint32_t stackSize = 0;
+    stack[stackSize] = 0;
+    stackMask[stackSize++] = CFrustum::kAllPlanes;
+    while (stackSize > 0)
+    {
+        --stackSize;
+        uint32_t index = stack[stackSize];
+        uint32_t planeMask = stackMask[stackSize];
+        const Node& node = mNodes[index];
+
+        CFrustum::Containment containment = frustum.Classify(node.box, planeMask);
+        if (containment == CFrustum::Containment::Outside)  continue;
+
+        if (containment == CFrustum::Containment::Inside)
+        {
+            items.insert(items.end(), mLeafItems.begin() + node.firstItem, mLeafItems.begin() + node.firstItem + node.numItems);
+        }
+        else if (IsLeaf(node))
+        {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.numItems; ++i)
+            {
+                uint32_t itemMask = planeMask;
+                uint32_t item = mLeafItems[i];
+                if (frustum.Classify(mItemBoxes[item], itemMask) != CFrustum::Containment::Outside)  items.push_back(item);
+            }
+        }
+        else
+        {
+            stack[stackSize] = node.right;
+            stackMask[stackSize++] = planeMask;
+            stack[stackSize] = index + 1;
+            stackMask[stackSize++] = planeMask;
+        }
+    }
+}
+
+
+// Nearest item whose box is hit by a ray, or kNoItem if none
+uint32_t CBoundingVolumeTree::RayCast(const CVector3& origin, const CVector3& direction, float& distance) const
+{
+    CVector3 inverseDirection = InverseDirection(direction);
+    return RayCast(origin, direction, distance, [&](uint32_t item, float maxDistance)
+    {
+        float entry;
+        return RayHitsBox(mItemBoxes[item], origin, inverseDirection, maxDistance, entry) ? entry : FLT_MAX;
+    });
+}
+
+
+// Item whose box is nearest to a point, or kNoItem if none. The nearer child of each node is visited first, and
+// nodes further away than the nearest item so far are skipped
+uint32_t CBoundingVolumeTree::Nearest(const CVector3& point, float& distance) const
+{
+    if (mNodes.empty())  return kNoItem;
+
+    uint32_t nearestItem = kNoItem;
+    float nearestSquared = distance < std::sqrt(FLT_MAX) ? distance * distance : FLT_MAX;
+
+    uint32_t stack[kStackSize];
+    float    stackDistance[kStackSize];
+    uint32_t stackSize = 0;
+    stack[stackSize] = 0;
+    stackDistance[stackSize++] = DistanceSquared(mNodes[0].box, point);
+    while (stackSize > 0)
+    {
+        --stackSize;
+        if (stackDistance[stackSize] > nearestSquared)  continue;
+        uint32_t index = stack[stackSize];
+        const Node& node = mNodes[index];
+
+        if (IsLeaf(node))
+        {
+            for (uint32_t i = node.firstItem; i < node.firstItem + node.numItems; ++i)
+            {
+                uint32_t item = mLeafItems[i];
+                float itemSquared = DistanceSquared(mItemBoxes[item], point);
+                if (itemSquared <= nearestSquared)
+                {
+                    nearestSquared = itemSquared;
+                    nearestItem = item;
+                }
+            }
+        }
+        else
+        {
+            // Push the further child first so the nearer one is visited next
+            uint32_t left = index + 1;
+            float leftSquared = DistanceSquared(mNodes[left].box, point);
+            float rightSquared = DistanceSquared(mNodes[node.right].box, point);
+            bool leftNearer = leftSquared < rightSquared;
+            stack[stackSize] = leftNearer ? node.right : left;
+            stackDistance[stackSize++] = leftNearer ? rightSquared : leftSquared;
+            stack[stackSize] = leftNearer ? left : node.right;
+            stackDistance[stackSize++] = leftNearer ? leftSquared : rightSquared;
+        }
+    }
+
+    if (nearestItem != kNoItem)  distance = std::sqrt(nearestSquared);
+    return nearestItem;
+}
@@ -0,0 +1,229 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume tree - hierarchy of boxes for ray, frustum and nearest item queries
+//--------------------------------------------------------------------------------------
+// Code in .cpp file, apart from the templated ray casts at the end of this file
+// Holds a world space box for each of a set of items (e.g. models), identified by index. The boxes are grouped into
+// a binary tree of larger boxes so a query only visits the parts of the tree near what it is looking for, rather than
+// every item. The tree is built with the surface area heuristic, which gives good trees for ray and frustum queries.
+// When items move their boxes are updated in place and the tree is refitted around them, which is much cheaper than a
+// rebuild but lets the tree's quality drift - NeedsRebuild reports when a rebuild would be worthwhile.
+// Items with empty boxes (see BoundingVolumes.h) are kept outside the tree. Frustum queries always return them, as
+// culling treats empty boxes as visible, but rays and nearest queries never find them
+
+#ifndef _CBOUNDING_VOLUME_TREE_H_DEFINED_
+#define _CBOUNDING_VOLUME_TREE_H_DEFINED_
+
+#include "BoundingVolumes.h"
+#include "CFrustum.h"
+#include "CVector3.h"
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+
+
+class CBoundingVolumeTree
+{
+public:
+    // Returned by queries that find nothing
+    static const uint32_t kNoItem = ~0u;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Building
+    -----------------------------------------------------------------------------------------*/
+
+    // Build the tree for n items with the given boxes, replacing any previous items. The items are the indexes
+    // into the array
+    void Build(const CBoundingBox* boxes, uint32_t numItems);
+
+    // Change the box of an item and refit the tree nodes above it. An item's box must stay empty or not empty
+    void Update(uint32_t item, const CBoundingBox& box);
+
+    // Whether updates have made the tree enough worse than when it was built that it should be rebuilt. Visits every
+    // node, so check occasionally rather than after every update
+    bool NeedsRebuild() const;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Queries
+    -----------------------------------------------------------------------------------------*/
+
+    // Add the items whose boxes may be inside the frustum to the given list (which is not cleared first)
+    void FrustumQuery(const CFrustum& frustum, std::vector<uint32_t>& items) const;
+
+    // Nearest item whose box is hit by a ray, or kNoItem if none. The distance passed is the maximum distance to
+    // search and is updated to the distance to the hit. Distances are in units of the direction's length
+    uint32_t RayCast(const CVector3& origin, const CVector3& direction, float& distance) const;
+
+    // As above, but for each item whose box is hit the given function decides if the item is hit itself, e.g. by
+    // testing its geometry. It is called as hitTest(item, maxDistance) and returns the distance to the hit, or any
+    // value of at least maxDistance for a miss. Items are tested roughly front to back so most are skipped
+    template <class HitTest>
+    uint32_t RayCast(const CVector3& origin, const CVector3& direction, float& distance, HitTest hitTest) const;
+
+    // Lower level ray cast where the given function tests a whole leaf. It is called as
+    // leafTest(firstPosition, numItems, maxDistance) for each leaf whose box is hit, where the leaf's items are
+    // LeafItem(firstPosition) onwards, and returns the distance to the nearest hit in the leaf or any value of at least
+    // maxDistance for a miss. Returns whether anything was hit, with the distance updated as above
+    template <class LeafTest>
+    bool RayCastLeaves(const CVector3& origin, const CVector3& direction, float& distance, LeafTest leafTest) const;
+
+    // Item whose box is nearest to a point (distance 0 if inside it), or kNoItem if none. The distance passed is the
+    // maximum distance to search and is updated to the distance to the item's box
+    uint32_t Nearest(const CVector3& point, float& distance) const;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Data access
+    -----------------------------------------------------------------------------------------*/
+
+    uint32_t            NumItems() const              { return static_cast<uint32_t>(mItemBoxes.size()); }
+    const CBoundingBox& ItemBox(uint32_t item) const  { return mItemBoxes[item]; }
+    uint32_t            NumNodes() const              { return static_cast<uint32_t>(mNodes.size()); }
+    uint32_t            NumLeafItems() const          { return static_cast<uint32_t>(mLeafItems.size()); }
+    uint32_t            LeafItem(uint32_t position) const  { return mLeafItems[position]; } // Items in leaf order
+    uint32_t            Depth() const                 { return mDepth; }
+
+    // Most items in a leaf. Leaves usually hold fewer, the build makes a leaf when that is cheaper than splitting
+    static const uint32_t kMaxLeafItems = 4;
+
+
+private:
+    static const uint32_t kNoNode = ~0u;
+
+    // Depth after which the build stops using the heuristic and just splits the items in half, which limits the
+    // depth of the tree (and so the size of the query stacks) whatever the boxes are like
+    static const uint32_t kMaxHeuristicDepth = 32;
+    static const uint32_t kStackSize = 64;
+
+    // Nodes are stored depth first, so the left child of an internal node is the next node. The items in any node
+    // are a contiguous range of mLeafItems
+    struct Node
+    {
+        CBoundingBox box;
+        uint32_t     parent;     // kNoNode for the root
+        uint32_t     right;      // Right child, kNoNode for leaves
+        uint32_t     firstItem;  // Range in mLeafItems of all the items below this node
+        uint32_t     numItems;
+    };
+
+    bool IsLeaf(const Node& node) const  { return node.right == kNoNode; }
+
+    // Build a node for the items in the given range of mLeafItems, then its children. Returns the node index
+    uint32_t BuildNode(uint32_t parent, uint32_t firstItem, uint32_t numItems, uint32_t depth);
+
+    // Recalculate a node's box from its items or children. Returns false if it hasn't changed
+    bool RefitNode(uint32_t node);
+
+    // Surface area heuristic cost of the tree, relative to the root (the expected number of boxes tested by a ray)
+    float Cost() const;
+
+
+    std::vector<Node>         mNodes;
+    std::vector<uint32_t>     mLeafItems;    // Items in leaf order
+    std::vector<CBoundingBox> mItemBoxes;
+    std::vector<uint32_t>     mItemLeaves;   // Leaf node holding each item, kNoNode for items with empty boxes
+    std::vector<uint32_t>     mEmptyItems;   // Items with empty boxes, outside the tree
+    std::vector<CVector3>     mCentres;      // Item box centres, working space for Build (released afterwards)
+    float                     mBuiltCost = 0;
+    uint32_t                  mDepth = 0;
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Templated ray casts
+-----------------------------------------------------------------------------------------*/
+
+// Nearest item hit by a ray, with the given function testing each item whose box is hit
+template <class HitTest>
+uint32_t CBoundingVolumeTree::RayCast(const CVector3& origin, const CVector3& direction, float& distance,
+                                      HitTest hitTest) const
+{
+    CVector3 inverseDirection = InverseDirection(direction);
+    uint32_t hitItem = kNoItem;
+    RayCastLeaves(origin, direction, distance, [&](uint32_t firstPosition, uint32_t numItems, float maxDistance)
+    {
+        float nearest = maxDistance;
+        for (uint32_t i = firstPosition; i < firstPosition + numItems; ++i)
+        {
+            uint32_t item = mLeafItems[i];
+            float entry;
+            if (!RayHitsBox(mItemBoxes[item], origin, inverseDirection, nearest, entry))  continue;
+            float hitDistance = hitTest(item, nearest);
+            if (hitDistance < nearest)
+            {
+                nearest = hitDistance;
+                hitItem = item;
+            }
+        }
+        return nearest;
+    });
+    return hitItem;
+}
+
+
+// Ray cast with the given function testing each leaf whose box is hit. The nearer child of each node is visited first
+// and nodes whose boxes are further than the nearest hit so far are skipped
+template <class LeafTest>
+bool CBoundingVolumeTree::RayCastLeaves(const CVector3& origin, const CVector3& direction, float& distance,
+                                        LeafTest leafTest) const
+{
+    if (mNodes.empty())  return false;
+
+    CVector3 inverseDirection = InverseDirection(direction);
+    bool hit = false;
+    float entry;
+    if (!RayHitsBox(mNodes[0].box, origin, inverseDirection, distance, entry))  return false;
+
+    uint32_t stack[kStackSize];
+    float    stackEntry[kStackSize];
+    uint32_t stackSize = 0;
+    stack[stackSize] = 0;
+    stackEntry[stackSize++] = entry;
+    while (stackSize > 0)
+    {
+        --stackSize;
+        if (stackEntry[stackSize] >= distance)  continue; // Hit something nearer since this node was pushed
+        const Node* node = &mNodes[stack[stackSize]];
+
+        // Go down the tree towards the nearer child, pushing the further one to visit later
+        while (!IsLeaf(*node))
+        {
+            uint32_t left = static_cast<uint32_t>(node - mNodes.data()) + 1;
+            uint32_t right = node->right;
+            float leftEntry, rightEntry;
+            bool hitLeft  = RayHitsBox(mNodes[left].box,  origin, inverseDirection, distance, leftEntry);
+            bool hitRight = RayHitsBox(mNodes[right].box, origin, inverseDirection, distance, rightEntry);
+            if (hitLeft && hitRight)
+            {
+                if (rightEntry < leftEntry)
+                {
+                    stack[stackSize] = left;
+                    stackEntry[stackSize++] = leftEntry;
+                    node = &mNodes[right];
+                }
+                else
+                {
+                    stack[stackSize] = right;
+                    stackEntry[stackSize++] = rightEntry;
+                    node = &mNodes[left];
+                }
+            }
+            else if (hitLeft)   node = &mNodes[left];
+            else if (hitRight)  node = &mNodes[right];
+            else                break;
+        }
+        if (!IsLeaf(*node))  continue;
+
+        float hitDistance = leafTest(node->firstItem, node->numItems, distance);
+        if (hitDistance < distance)
+        {
+            distance = hitDistance;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+
+#endif // _CBOUNDING_VOLUME_TREE_H_DEFINED_
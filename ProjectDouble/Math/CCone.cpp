@@ -0,0 +1,92 @@
+//--------------------------------------------------------------------------------------
+// Cone - the volume lit by a spotlight, for culling bounding spheres
+//--------------------------------------------------------------------------------------
+
+#include "CCone.h"
+#include "MathSIMD.h"
+#include <cmath>
+
+
+/*-----------------------------------------------------------------------------------------
+    Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Cone from its apex, axis direction and half angle in radians
+CCone::CCone(const CVector3& apex, const CVector3& axis, float halfAngle)
+    : mApex(apex), mAxis(Normalise(axis)), mCosHalfAngle(std::cos(halfAngle)), mSinHalfAngle(std::sin(halfAngle))
+{
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Tests
+-----------------------------------------------------------------------------------------*/
+
+// Whether any part of the given sphere may be inside the cone. With the sphere centre split into the distance along
+// the axis and the distance from it, the distance from the centre to the side of the cone is
+// fromAxis * cos(halfAngle) - alongAxis * sin(halfAngle). This is less than the true distance for centres nearest the
+// apex, which only makes the test more conservative. Spheres behind the apex are also outside
+// (B. Wronski, Cull that cone! Improved cone/spotlight visibility tests for tiled and clustered lighting, 2017)
+bool CCone::IsVisible(const CBoundingSphere& sphere) const
+{
+    if (sphere.IsEmpty())  return true;
+
+    CVector3 toCentre = sphere.centre - mApex;
+    float alongAxis = Dot(toCentre, mAxis);
+    float fromAxisSquared = Dot(toCentre, toCentre) - alongAxis * alongAxis;
+    float fromAxis = std::sqrt(fromAxisSquared > 0 ? fromAxisSquared : 0);
+
+    if (alongAxis < -sphere.radius)  return false;
+    return fromAxis * mCosHalfAngle - alongAxis * mSinHalfAngle <= sphere.radius;
+}
+
+
+// Test n spheres, setting visible[i] to 1 or 0 for each one. Returns the number visible
+std::size_t CCone::TestSpheres(const CBoundingSphere* spheres, uint8_t* visible, std::size_t n) const
+{
+    std::size_t numVisible = 0;
+    std::size_t i = 0;
+
+#if defined(MATH_SSE)
+    // Four spheres at a time, transposed to SoA form as in CFrustum::TestSpheres
+    __m128 apexX = _mm_set1_ps(mApex.x), apexY = _mm_set1_ps(mApex.y), apexZ = _mm_set1_ps(mApex.z);
+    __m128 axisX = _mm_set1_ps(mAxis.x), axisY = _mm_set1_ps(mAxis.y), axisZ = _mm_set1_ps(mAxis.z);
+    __m128 cosHalfAngle = _mm_set1_ps(mCosHalfAngle), sinHalfAngle = _mm_set1_ps(mSinHalfAngle);
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&spheres[i + 0].centre.x);
+        __m128 y = _mm_loadu_ps(&spheres[i + 1].centre.x);
+        __m128 z = _mm_loadu_ps(&spheres[i + 2].centre.x);
+        __m128 radius = _mm_loadu_ps(&spheres[i + 3].centre.x);
+        _MM_TRANSPOSE4_PS(x, y, z, radius);
+
+        x = _mm_sub_ps(x, apexX);
+        y = _mm_sub_ps(y, apexY);
+        z = _mm_sub_ps(z, apexZ);
+        __m128 alongAxis = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, axisX), _mm_mul_ps(y, axisY)), _mm_mul_ps(z, axisZ));
+        __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 fromAxis = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSquared, _mm_mul_ps(alongAxis, alongAxis)), zero));
+
+        __m128 sideDistance = _mm_sub_ps(_mm_mul_ps(fromAxis, cosHalfAngle), _mm_mul_ps(alongAxis, sinHalfAngle));
+        __m128 outside = _mm_or_ps(_mm_cmpgt_ps(sideDistance, radius),
+                                   _mm_cmplt_ps(_mm_add_ps(alongAxis, radius), zero));
+        outside = _mm_andnot_ps(_mm_cmplt_ps(radius, zero), outside); // Empty spheres are visible
+
+        int outsideMask = _mm_movemask_ps(outside);
+        for (int s = 0; s < 4; ++s)
+        {
+            visible[i + s] = (outsideMask & (1 << s)) ? 0 : 1;
+            numVisible += visible[i + s];
+        }
+    }
+#endif
+
+    // Remaining spheres (or all of them without SIMD)
+    for (; i < n; ++i)
+    {
+        visible[i] = IsVisible(spheres[i]) ? 1 : 0;
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
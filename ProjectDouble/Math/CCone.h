@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// Cone - the volume lit by a spotlight, for culling bounding spheres
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// A spotlight lights a cone, but its shadow map covers the square frustum around that cone. A model in the corners of
+// the frustum but outside the cone can't shadow anything lit by the spotlight - its shadow falls on points outside the
+// cone too - so shadow casters are culled against the cone as well as the frustum. The cone has no far end, a light
+// frustum's far plane covers that. As with CFrustum, tests are conservative and empty spheres are always visible.
+// The batch test processes four spheres at a time with SIMD where available (see MathSIMD.h)
+
+#ifndef _CCONE_H_DEFINED_
+#define _CCONE_H_DEFINED_
+
+#include "BoundingVolumes.h"
+#include "CVector3.h"
+#include <cstddef>
+#include <cstdint>
+
+
+class CCone
+{
+public:
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves the cone uninitialised
+    CCone() {}
+
+    // Cone from its apex, the direction of its axis (needn't be unit length) and the angle between the axis and the
+    // sides in radians, which must be less than 90 degrees
+    CCone(const CVector3& apex, const CVector3& axis, float halfAngle);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Tests
+    -----------------------------------------------------------------------------------------*/
+
+    // Whether any part of the given sphere may be inside the cone
+    bool IsVisible(const CBoundingSphere& sphere) const;
+
+    // Test n spheres, setting visible[i] to 1 or 0 for each one. Returns the number visible
+    std::size_t TestSpheres(const CBoundingSphere* spheres, uint8_t* visible, std::size_t n) const;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Data access
+    -----------------------------------------------------------------------------------------*/
+
+    const CVector3& Apex() const  { return mApex; }
+    const CVector3& Axis() const  { return mAxis; } // Unit length
+
+
+private:
+    CVector3 mApex;
+    CVector3 mAxis;
+    float    mCosHalfAngle;
+    float    mSinHalfAngle;
+};
+
+
+#endif // _CCONE_H_DEFINED_
@@ -0,0 +1,111 @@
+//--------------------------------------------------------------------------------------
+// Dual quaternion class (cut down version), to hold rigid transforms
+//--------------------------------------------------------------------------------------
+
+#include "CDualQuaternion.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Construct a transform that rotates by the given unit quaternion then translates by the given vector
+CDualQuaternion::CDualQuaternion(const CQuaternion& rotation, const CVector3& translation)
+{
+    real = rotation;
+    dual = 0.5f * (rotation * CQuaternion(translation.x, translation.y, translation.z, 0.0f));
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return the translation held in this dual quaternion. Must be unit length
+CVector3 CDualQuaternion::GetTranslation() const
+{
+    CQuaternion t = 2.0f * (Conjugate(real) * dual);
+    return { t.x, t.y, t.z };
+}
+
+// Return the given point transformed by this dual quaternion. Must be unit length
+CVector3 CDualQuaternion::TransformPoint(const CVector3& p) const
+{
+    return real.Rotate(p) + GetTranslation();
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member operators
+-----------------------------------------------------------------------------------------*/
+
+// Dual quaternion multiplication - the transform dq1 followed by the transform dq2
+CDualQuaternion operator* (const CDualQuaternion& dq1, const CDualQuaternion& dq2)
+{
+    return { dq1.real * dq2.real, dq1.dual * dq2.real + dq1.real * dq2.dual };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return the identity dual quaternion (no rotation or translation)
+CDualQuaternion DualQuaternionIdentity()
+{
+    return { QuaternionIdentity(), CQuaternion(0, 0, 0, 0) };
+}
+
+// Return the conjugate of a dual quaternion - for a unit dual quaternion this is the inverse transform
+CDualQuaternion Conjugate(const CDualQuaternion& dq)
+{
+    return { Conjugate(dq.real), Conjugate(dq.dual) };
+}
+
+// Return a unit dual quaternion holding the same transform as the given one. Call after
+// blending or after many multiplies to correct for drift
+CDualQuaternion Normalise(const CDualQuaternion& dq)
+{
+    float lengthSq = Dot(dq.real, dq.real);
+    if (IsZero(lengthSq))
+    {
+        return DualQuaternionIdentity();
+    }
+
+    // Scale both parts by the length of the real part, then make the dual part orthogonal to the real part
+    float invLength = InvSqrt(lengthSq);
+    CQuaternion real = dq.real * invLength;
+    CQuaternion dual = dq.dual * invLength;
+    return { real, dual + real * -Dot(real, dual) };
+}
+
+// Blend between two unit dual quaternions, t from 0 to 1 (dual quaternion linear blending).
+// Takes the shortest rotation path, the result is normalised
+CDualQuaternion Blend(const CDualQuaternion& dq1, const CDualQuaternion& dq2, float t)
+{
+    // q and -q are the same rotation, flip the second transform if needed to take the shortest path
+    float t2 = Dot(dq1.real, dq2.real) < 0.0f ? -t : t;
+    float t1 = 1.0f - t;
+    return Normalise({ dq1.real * t1 + dq2.real * t2, dq1.dual * t1 + dq2.dual * t2 });
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Conversion to and from matrices
+-----------------------------------------------------------------------------------------*/
+
+// Return the matrix holding the given unit dual quaternion's transform
+CMatrix4x4 MatrixFromDualQuaternion(const CDualQuaternion& dq)
+{
+    return MatrixTransform(dq.GetTranslation(), dq.real, { 1, 1, 1 });
+}
+
+// Return the rotation and translation held in the given matrix as a dual quaternion. Any
+// scaling in the matrix is discarded
+CDualQuaternion DualQuaternionFromMatrix(const CMatrix4x4& m)
+{
+    CVector3 position, scale;
+    CQuaternion rotation;
+    DecomposeMatrix(m, position, rotation, scale);
+    return { rotation, position };
+}
@@ -0,0 +1,99 @@
+//--------------------------------------------------------------------------------------
+// Dual quaternion class (cut down version), to hold rigid transforms
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// A unit dual quaternion holds a rotation and a translation (no scaling) in 8 floats. They
+// combine more cheaply than matrices and, unlike matrices, blend without shrinking the
+// result, which makes them suitable for skinning and interpolating node transforms.
+//
+// Multiplication follows the same order as CMatrix4x4 and CQuaternion: dq1 * dq2 is the
+// transform dq1 followed by the transform dq2
+
+#ifndef _CDUALQUATERNION_H_DEFINED_
+#define _CDUALQUATERNION_H_DEFINED_
+
+#include "CVector3.h"
+#include "CQuaternion.h"
+#include "CMatrix4x4.h"
+
+class CDualQuaternion
+{
+// Concrete class - public access
+public:
+    CQuaternion real; // The rotation
+    CQuaternion dual; // Half the translation multiplied by the rotation
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CDualQuaternion() {}
+
+    // Construct with the two parts directly
+    CDualQuaternion(const CQuaternion& realIn, const CQuaternion& dualIn)
+    {
+        real = realIn;
+        dual = dualIn;
+    }
+
+    // Construct a transform that rotates by the given unit quaternion then translates by the given vector
+    CDualQuaternion(const CQuaternion& rotation, const CVector3& translation);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+    // Return the rotation and translation held in this dual quaternion. Must be unit length
+    CQuaternion GetRotation() const  { return real; }
+    CVector3 GetTranslation() const;
+
+    // Return the given point transformed by this dual quaternion. Must be unit length
+    CVector3 TransformPoint(const CVector3& p) const;
+
+    // Return the given vector rotated by this dual quaternion (translation is ignored). Must be unit length
+    CVector3 TransformVector(const CVector3& v) const  { return real.Rotate(v); }
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member operators
+-----------------------------------------------------------------------------------------*/
+
+// Dual quaternion multiplication - the transform dq1 followed by the transform dq2
+CDualQuaternion operator* (const CDualQuaternion& dq1, const CDualQuaternion& dq2);
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return the identity dual quaternion (no rotation or translation)
+CDualQuaternion DualQuaternionIdentity();
+
+// Return the conjugate of a dual quaternion - for a unit dual quaternion this is the inverse transform
+CDualQuaternion Conjugate(const CDualQuaternion& dq);
+
+// Return a unit dual quaternion holding the same transform as the given one. Call after
+// blending or after many multiplies to correct for drift
+CDualQuaternion Normalise(const CDualQuaternion& dq);
+
+// Blend between two unit dual quaternions, t from 0 to 1 (dual quaternion linear blending).
+// Takes the shortest rotation path, the result is normalised
+CDualQuaternion Blend(const CDualQuaternion& dq1, const CDualQuaternion& dq2, float t);
+
+
+/*-----------------------------------------------------------------------------------------
+    Conversion to and from matrices
+-----------------------------------------------------------------------------------------*/
+
+// Return the matrix holding the given unit dual quaternion's transform
+CMatrix4x4 MatrixFromDualQuaternion(const CDualQuaternion& dq);
+
+// Return the rotation and translation held in the given matrix as a dual quaternion. Any
+// scaling in the matrix is discarded
+CDualQuaternion DualQuaternionFromMatrix(const CMatrix4x4& m);
+
+
+#endif // _CDUALQUATERNION_H_DEFINED_
@@ -0,0 +1,225 @@
+//--------------------------------------------------------------------------------------
+// View frustum - six planes for culling bounding volumes against a camera or light
+//--------------------------------------------------------------------------------------
+
+#include "CFrustum.h"
+#include "MathSIMD.h"
+#include <cmath>
+
+
+/*-----------------------------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------------------------*/
+
+namespace
+{
+    // Large half-size given to empty boxes in the batch tests so they are never outside a plane
+    const float kEmptyBoxHalfSize = 1e30f;
+
+    // Scale a plane so its normal has unit length
+    inline CVector4 NormalisePlane(const CVector4& p)
+    {
+        float invLength = InvSqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        return { p.x * invLength, p.y * invLength, p.z * invLength, p.w * invLength };
+    }
+
+    // Distance of a point from a plane, positive on the inside
+    inline float PlaneDistance(const CVector4& plane, const CVector3& p)
+    {
+        return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Extract the planes from a view-projection matrix (DirectX conventions - row vectors, clip space z from 0 to w)
+// A point is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w in clip space. Each clip space value is the point
+// multiplied by a column of the matrix, so each condition gives a plane made from sums of columns
+// (G. Gribb & K. Hartmann, Fast Extraction of Viewing Frustum Planes, 2001)
+CFrustum::CFrustum(const CMatrix4x4& viewProjection)
+{
+    const CMatrix4x4& m = viewProjection;
+    CVector4 column0 = { m.e00, m.e10, m.e20, m.e30 };
+    CVector4 column1 = { m.e01, m.e11, m.e21, m.e31 };
+    CVector4 column2 = { m.e02, m.e12, m.e22, m.e32 };
+    CVector4 column3 = { m.e03, m.e13, m.e23, m.e33 };
+
+    mPlanes[0] = NormalisePlane({ column3.x + column0.x, column3.y + column0.y, column3.z + column0.z, column3.w + column0.w }); // Left
+    mPlanes[1] = NormalisePlane({ column3.x - column0.x, column3.y - column0.y, column3.z - column0.z, column3.w - column0.w }); // Right
+    mPlanes[2] = NormalisePlane({ column3.x + column1.x, column3.y + column1.y, column3.z + column1.z, column3.w + column1.w }); // Bottom
+    mPlanes[3] = NormalisePlane({ column3.x - column1.x, column3.y - column1.y, column3.z - column1.z, column3.w - column1.w }); // Top
+    mPlanes[4] = NormalisePlane(column2);                                                                                      // Near
+    mPlanes[5] = NormalisePlane({ column3.x - column2.x, column3.y - column2.y, column3.z - column2.z, column3.w - column2.w }); // Far
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Tests
+-----------------------------------------------------------------------------------------*/
+
+// Whether any part of the given box may be inside the frustum. The box is outside a plane if its centre is further
+// outside than the box's extent along the plane normal
+bool CFrustum::IsVisible(const CBoundingBox& box) const
+{
+    if (box.IsEmpty())  return true;
+
+    CVector3 centre = box.Centre();
+    CVector3 halfSize = box.HalfSize();
+    for (auto& plane : mPlanes)
+    {
+        float extent = halfSize.x * std::abs(plane.x) + halfSize.y * std::abs(plane.y) + halfSize.z * std::abs(plane.z);
+        if (PlaneDistance(plane, centre) < -extent)  return false;
+    }
+    return true;
+}
+
+// Whether any part of the given sphere may be inside the frustum
+bool CFrustum::IsVisible(const CBoundingSphere& sphere) const
+{
+    if (sphere.IsEmpty())  return true;
+
+    for (auto& plane : mPlanes)
+    {
+        if (PlaneDistance(plane, sphere.centre) < -sphere.radius)  return false;
+    }
+    return true;
+}
+
+
+// Whether a box is outside, partly inside or completely inside the frustum, only testing the planes in planeMask.
+// Planes the box is completely inside are cleared from the mask (U. Assarsson & T. Moller, Optimized View Frustum
+// Culling Algorithms for Bounding Boxes, 2000)
+CFrustum::Containment CFrustum::Classify(const CBoundingBox& box, uint32_t& planeMask) const
+{
+    if (box.IsEmpty())  return Containment::Intersects;
+
+    CVector3 centre = box.Centre();
+    CVector3 halfSize = box.HalfSize();
+    for (int p = 0; p < kNumPlanes; ++p)
+    {
+        if (!(planeMask & (1 << p)))  continue;
+
+        const CVector4& plane = mPlanes[p];
+        float extent = halfSize.x * std::abs(plane.x) + halfSize.y * std::abs(plane.y) + halfSize.z * std::abs(plane.z);
+        float distance = PlaneDistance(plane, centre);
+        if (distance < -extent)  return Containment::Outside;
+        if (distance >= extent)  planeMask &= ~(1 << p);
+    }
+    return planeMask == 0 ? Containment::Inside : Containment::Intersects;
+}
+
+
+// Test n boxes, setting visible[i] to 1 or 0 for each one. Returns the number visible
+std::size_t CFrustum::TestBoxes(const CBoundingBox* boxes, uint8_t* visible, std::size_t n) const
+{
+    std::size_t numVisible = 0;
+    std::size_t i = 0;
+
+#if defined(MATH_SSE)
+    // Four boxes at a time, centres and half-sizes in SoA form
+    __m128 planeX[kNumPlanes], planeY[kNumPlanes], planeZ[kNumPlanes], planeW[kNumPlanes];
+    __m128 absPlaneX[kNumPlanes], absPlaneY[kNumPlanes], absPlaneZ[kNumPlanes];
+    for (int p = 0; p < kNumPlanes; ++p)
+    {
+        planeX[p] = _mm_set1_ps(mPlanes[p].x);  absPlaneX[p] = _mm_set1_ps(std::abs(mPlanes[p].x));
+        planeY[p] = _mm_set1_ps(mPlanes[p].y);  absPlaneY[p] = _mm_set1_ps(std::abs(mPlanes[p].y));
+        planeZ[p] = _mm_set1_ps(mPlanes[p].z);  absPlaneZ[p] = _mm_set1_ps(std::abs(mPlanes[p].z));
+        planeW[p] = _mm_set1_ps(mPlanes[p].w);
+    }
+
+    for (; i + 4 <= n; i += 4)
+    {
+        alignas(16) float cx[4], cy[4], cz[4], hx[4], hy[4], hz[4];
+        for (int b = 0; b < 4; ++b)
+        {
+            const CBoundingBox& box = boxes[i + b];
+            if (box.IsEmpty())
+            {
+                cx[b] = cy[b] = cz[b] = 0;
+                hx[b] = hy[b] = hz[b] = kEmptyBoxHalfSize;
+            }
+            else
+            {
+                cx[b] = (box.minimum.x + box.maximum.x) * 0.5f;  hx[b] = (box.maximum.x - box.minimum.x) * 0.5f;
+                cy[b] = (box.minimum.y + box.maximum.y) * 0.5f;  hy[b] = (box.maximum.y - box.minimum.y) * 0.5f;
+                cz[b] = (box.minimum.z + box.maximum.z) * 0.5f;  hz[b] = (box.maximum.z - box.minimum.z) * 0.5f;
+            }
+        }
+        __m128 centreX = _mm_load_ps(cx), centreY = _mm_load_ps(cy), centreZ = _mm_load_ps(cz);
+        __m128 halfX = _mm_load_ps(hx), halfY = _mm_load_ps(hy), halfZ = _mm_load_ps(hz);
+
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < kNumPlanes; ++p)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(centreX, planeX[p]), _mm_mul_ps(centreY, planeY[p])),
+                                         _mm_add_ps(_mm_mul_ps(centreZ, planeZ[p]), planeW[p]));
+            __m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(halfX, absPlaneX[p]), _mm_mul_ps(halfY, absPlaneY[p])),
+                                       _mm_mul_ps(halfZ, absPlaneZ[p]));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, extent), _mm_setzero_ps()));
+        }
+
+        int outsideMask = _mm_movemask_ps(outside);
+        for (int b = 0; b < 4; ++b)
+        {
+            visible[i + b] = (outsideMask & (1 << b)) ? 0 : 1;
+            numVisible += visible[i + b];
+        }
+    }
+#endif
+
+    // Remaining boxes (or all of them without SIMD)
+    for (; i < n; ++i)
+    {
+        visible[i] = IsVisible(boxes[i]) ? 1 : 0;
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
+
+
+// Test n spheres, setting visible[i] to 1 or 0 for each one. Returns the number visible
+std::size_t CFrustum::TestSpheres(const CBoundingSphere* spheres, uint8_t* visible, std::size_t n) const
+{
+    std::size_t numVisible = 0;
+    std::size_t i = 0;
+
+#if defined(MATH_SSE)
+    // Four spheres at a time. CBoundingSphere is four floats so each one can be loaded directly, then the four are
+    // transposed to SoA form
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&spheres[i + 0].centre.x);
+        __m128 y = _mm_loadu_ps(&spheres[i + 1].centre.x);
+        __m128 z = _mm_loadu_ps(&spheres[i + 2].centre.x);
+        __m128 radius = _mm_loadu_ps(&spheres[i + 3].centre.x);
+        _MM_TRANSPOSE4_PS(x, y, z, radius);
+
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < kNumPlanes; ++p)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(mPlanes[p].x)), _mm_mul_ps(y, _mm_set1_ps(mPlanes[p].y))),
+                                         _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(mPlanes[p].z)), _mm_set1_ps(mPlanes[p].w)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        outside = _mm_andnot_ps(_mm_cmplt_ps(radius, _mm_setzero_ps()), outside); // Empty spheres are visible
+
+        int outsideMask = _mm_movemask_ps(outside);
+        for (int s = 0; s < 4; ++s)
+        {
+            visible[i + s] = (outsideMask & (1 << s)) ? 0 : 1;
+            numVisible += visible[i + s];
+        }
+    }
+#endif
+
+    // Remaining spheres (or all of them without SIMD)
+    for (; i < n; ++i)
+    {
+        visible[i] = IsVisible(spheres[i]) ? 1 : 0;
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// View frustum - six planes for culling bounding volumes against a camera or light
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The planes are extracted from a view-projection matrix, so the same code works for cameras, spotlights and
+// anything else with a projection. Volumes are tested conservatively - a volume is only reported as outside if
+// it is completely outside one of the planes. Empty volumes (see BoundingVolumes.h) are always visible.
+// The batch tests process four volumes at a time with SIMD where available (see MathSIMD.h)
+
+#ifndef _CFRUSTUM_H_DEFINED_
+#define _CFRUSTUM_H_DEFINED_
+
+#include "BoundingVolumes.h"
+#include "CVector4.h"
+#include "CMatrix4x4.h"
+#include <cstddef>
+#include <cstdint>
+
+
+class CFrustum
+{
+public:
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves planes uninitialised
+    CFrustum() {}
+
+    // Extract the planes from a view-projection matrix (DirectX conventions - row vectors, clip space z from 0 to w)
+    explicit CFrustum(const CMatrix4x4& viewProjection);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Tests
+    -----------------------------------------------------------------------------------------*/
+
+    // Whether any part of the given volume may be inside the frustum
+    bool IsVisible(const CBoundingBox& box) const;
+    bool IsVisible(const CBoundingSphere& sphere) const;
+
+    // Result of Classify
+    enum class Containment
+    {
+        Outside,    // Completely outside one of the planes
+        Intersects, // May be partly inside
+        Inside,     // Completely inside all the planes
+    };
+
+    // Whether a box is outside, partly inside or completely inside the frustum, for hierarchical culling. Only the
+    // planes whose bits are set in planeMask are tested (bit n for plane n). On return the bits are cleared for
+    // planes the box is completely inside, so the same mask can be passed on when testing volumes inside the box.
+    // Empty boxes intersect
+    static const uint32_t kAllPlanes = 0x3f; // All six planes
+    Containment Classify(const CBoundingBox& box, uint32_t& planeMask) const;
+
+    // Test n volumes, setting visible[i] to 1 or 0 for each one. Returns the number visible
+    std::size_t TestBoxes(const CBoundingBox* boxes, uint8_t* visible, std::size_t n) const;
+    std::size_t TestSpheres(const CBoundingSphere* spheres, uint8_t* visible, std::size_t n) const;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Data access
+    -----------------------------------------------------------------------------------------*/
+
+    // Planes are left, right, bottom, top, near, far. Normal (x,y,z) points into the frustum and has unit
+    // length, w is the distance term, so a point p is inside a plane if Dot(normal, p) + w >= 0
+    static const int kNumPlanes = 6;
+    const CVector4& Plane(int plane) const  { return mPlanes[plane]; }
+
+
+private:
+    CVector4 mPlanes[kNumPlanes];
+};
+
+
+#endif // _CFRUSTUM_H_DEFINED_
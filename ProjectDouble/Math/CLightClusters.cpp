@@ -0,0 +1,378 @@
+//--------------------------------------------------------------------------------------
+// Light clusters - lists of the lights reaching each cell of a view frustum grid
+//--------------------------------------------------------------------------------------
+
+#include "CLightClusters.h"
+#include "BatchTransform.h"
+#include "MathSIMD.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+
+const uint32_t CLightClusters::kMinLightsPerThread;
+
+
+// Stop the worker threads, which are all waiting for a job as Assign waits for each job to finish
+CLightClusters::~CLightClusters()
+{
+    {
+        std::lock_guard<std::mutex> lock(mJobMutex);
+        mStopWorkers = true;
+    }
+    mJobStarted.notify_all();
+    for (auto& worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Setup
+-----------------------------------------------------------------------------------------*/
+
+// Set the size of the grid and the view it covers, working out the view space box of each cluster. A tile's sides
+// are planes through the camera, so its x and y extent in a slice is widest at one end of the slice or the other
+void CLightClusters::SetGrid(uint32_t tilesX, uint32_t tilesY, uint32_t slices, const CMatrix4x4& projection,
+                             float nearClip, float farClip, float firstSliceDepth)
+{
+    mTilesX = (std::max)(tilesX, 1u);
+    mTilesY = (std::max)(tilesY, 1u);
+    mSlices = (std::max)(slices, 2u);
+    mPaddedTilesX = (mTilesX + 3) / 4 * 4;
+    mScaleX = projection.e00;
+    mScaleY = projection.e11;
+
+    // Slice 0 is from the near clip to the first slice depth, the others share the rest exponentially
+    mFirstSliceDepth = (std::min)((std::max)(firstSliceDepth, nearClip), farClip * 0.5f);
+    mDepthScale = (mSlices - 1) / std::log(farClip / mFirstSliceDepth);
+    mDepthBias = -std::log(mFirstSliceDepth) * mDepthScale;
+
+    mSliceNear.resize(mSlices);
+    mSliceFar.resize(mSlices);
+    mSliceNear[0] = nearClip;
+    mSliceFar[0] = mFirstSliceDepth;
+    for (uint32_t slice = 1; slice < mSlices; ++slice)
+    {
+        mSliceNear[slice] = mSliceFar[slice - 1];
+        mSliceFar[slice] = mFirstSliceDepth * std::pow(farClip / mFirstSliceDepth, float(slice) / (mSlices - 1));
+    }
+    mSliceFar[mSlices - 1] = farClip;
+
+    // Tile bounds in each slice. Padding columns have empty ranges so the SIMD tests reject them
+    mColumnMinX.resize(mSlices * mPaddedTilesX);
+    mColumnMaxX.resize(mSlices * mPaddedTilesX);
+    mRowMinY.resize(mSlices * mTilesY);
+    mRowMaxY.resize(mSlices * mTilesY);
+    for (uint32_t slice = 0; slice < mSlices; ++slice)
+    {
+        float zNear = mSliceNear[slice];
+        float zFar = mSliceFar[slice];
+        for (uint32_t column = 0; column < mPaddedTilesX; ++column)
+        {
+            float& minX = mColumnMinX[slice * mPaddedTilesX + column];
+            float& maxX = mColumnMaxX[slice * mPaddedTilesX + column];
+            if (column >= mTilesX)
+            {
+                minX = FLT_MAX;
+                maxX = -FLT_MAX;
+                continue;
+            }
+            float left = -1.0f + 2.0f * column / mTilesX;
+            float right = -1.0f + 2.0f * (column + 1) / mTilesX;
+            minX = (std::min)(left * zNear, left * zFar) / mScaleX;
+            maxX = (std::max)(right * zNear, right * zFar) / mScaleX;
+        }
+        for (uint32_t row = 0; row < mTilesY; ++row)
+        {
+            float top = 1.0f - 2.0f * row / mTilesY;
+            float bottom = 1.0f - 2.0f * (row + 1) / mTilesY;
+            mRowMinY[slice * mTilesY + row] = (std::min)(bottom * zNear, bottom * zFar) / mScaleY;
+            mRowMaxY[slice * mTilesY + row] = (std::max)(top * zNear, top * zFar) / mScaleY;
+        }
+    }
+
+    mClusterSpheres.resize(NumClusters());
+    for (uint32_t slice = 0; slice < mSlices; ++slice)
+    {
+        for (uint32_t row = 0; row < mTilesY; ++row)
+        {
+            for (uint32_t column = 0; column < mTilesX; ++column)
+            {
+                CBoundingBox box = { { mColumnMinX[slice * mPaddedTilesX + column], mRowMinY[slice * mTilesY + row], mSliceNear[slice] },
+                                     { mColumnMaxX[slice * mPaddedTilesX + column], mRowMaxY[slice * mTilesY + row], mSliceFar[slice] } };
+                mClusterSpheres[ClusterIndex(column, row, slice)] = SphereFromBox(box);
+            }
+        }
+    }
+
+    mClusters.assign(NumClusters(), { 0, 0 });
+    mLightIndices.clear();
+    mSlicePairs.resize(mSlices);
+}
+
+
+// Slice of a view depth, using the same formula as the shaders
+uint32_t CLightClusters::Slice(float viewDepth) const
+{
+    if (!(viewDepth >= mFirstSliceDepth))  return 0;
+    float slice = (std::max)(std::log(viewDepth) * mDepthScale + mDepthBias, 0.0f);
+    return (slice < mSlices - 2) ? 1 + static_cast<uint32_t>(slice) : mSlices - 1;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Binning
+-----------------------------------------------------------------------------------------*/
+
+// Build the light lists. The lights are moved into view space in batches, and the range of slices each one touches is
+// found. Then each slice is binned separately, on as many threads as there are lights to keep busy. Finally the
+// per-slice lists are gathered into the compact index list, cluster by cluster
+void CLightClusters::Assign(const Light* lights, uint32_t numLights, const CMatrix4x4& viewMatrix,
+                            uint32_t numThreads /*= 1*/)
+{
+    if (mSlices == 0)  return; // SetGrid not called
+    ++mStats.assigns;
+    mStats.lights += numLights;
+
+    // Lights into view space
+    mWorldPositions.resize(numLights);
+    mWorldDirections.resize(numLights);
+    mViewPositions.resize(numLights);
+    mViewDirections.resize(numLights);
+    for (uint32_t i = 0; i < numLights; ++i)
+    {
+        mWorldPositions[i] = lights[i].position;
+        mWorldDirections[i] = lights[i].direction;
+    }
+    TransformPoints(viewMatrix, mWorldPositions.data(), mViewPositions.data(), numLights);
+    TransformVectors(viewMatrix, mWorldDirections.data(), mViewDirections.data(), numLights);
+
+    // Slices each light touches, widened by one either way against rounding in Slice. AssignSlice tests the depths
+    // exactly so the extra slices cost little
+    mRanges.resize(numLights);
+    mFirstSlices.resize(numLights);
+    mLastSlices.resize(numLights);
+    mIsSpot.resize(numLights);
+    mCones.resize(numLights);
+    for (uint32_t i = 0; i < numLights; ++i)
+    {
+        float depth = mViewPositions[i].z;
+        float range = lights[i].range;
+        mRanges[i] = range;
+        if (depth + range < mSliceNear[0] || depth - range > mSliceFar[mSlices - 1])
+        {
+            mFirstSlices[i] = 1;
+            mLastSlices[i] = 0;
+        }
+        else
+        {
+            uint32_t firstSlice = Slice(depth - range);
+            mFirstSlices[i] = (firstSlice > 0) ? firstSlice - 1 : 0;
+            mLastSlices[i] = (std::min)(Slice(depth + range) + 1, mSlices - 1);
+        }
+
+        mIsSpot[i] = lights[i].spotHalfAngle > 0;
+        if (mIsSpot[i])  mCones[i] = CCone(mViewPositions[i], mViewDirections[i], lights[i].spotHalfAngle);
+    }
+
+    // Bin the slices, sharing them between threads if there are enough lights. Small numbers of lights are binned on
+    // the calling thread alone, as waking the workers would cost more than it saves
+    if (numThreads == 0)  numThreads = std::thread::hardware_concurrency(); // May be 0 if unknown
+    numThreads = (std::min)(numThreads, mSlices);
+    numThreads = (std::min)(numThreads, numLights / kMinLightsPerThread);
+    if (numThreads < 1)  numThreads = 1;
+
+    mThreadStats.assign(numThreads, Stats());
+    if (numThreads == 1)
+    {
+        AssignSlices(0, 1);
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(mJobMutex);
+        while (mWorkers.size() < numThreads - 1)
+        {
+            mWorkers.emplace_back(&CLightClusters::WorkerLoop, this, static_cast<uint32_t>(mWorkers.size()) + 1, mJob);
+        }
+        ++mJob;
+        mJobThreads = numThreads;
+        mJobWorkersBusy = numThreads - 1;
+        lock.unlock();
+        mJobStarted.notify_all();
+
+        AssignSlices(0, numThreads);
+
+        lock.lock();
+        mJobFinished.wait(lock, [this]() { return mJobWorkersBusy == 0; });
+    }
+    for (auto& stats : mThreadStats)  mStats.clusterTests += stats.clusterTests;
+
+    // Each cluster's part of the index list follows the one before
+    uint32_t numIndices = 0;
+    uint32_t maxPerCluster = 0;
+    for (auto& cluster : mClusters)
+    {
+        cluster.offset = numIndices;
+        numIndices += cluster.count;
+        maxPerCluster = (std::max)(maxPerCluster, cluster.count);
+    }
+
+    // Gather the pairs, which are in light order in each slice, so the lights stay in order in each cluster
+    mLightIndices.resize(numIndices);
+    mFill.assign(mClusters.size(), 0);
+    uint32_t clustersPerSlice = mTilesX * mTilesY;
+    for (uint32_t slice = 0; slice < mSlices; ++slice)
+    {
+        const SlicePairs& pairs = mSlicePairs[slice];
+        for (std::size_t pair = 0; pair < pairs.lights.size(); ++pair)
+        {
+            uint32_t cluster = slice * clustersPerSlice + pairs.clusters[pair];
+            mLightIndices[mClusters[cluster].offset + mFill[cluster]++] = pairs.lights[pair];
+        }
+    }
+
+    mReached.assign(numLights, 0);
+    for (uint32_t light : mLightIndices)  mReached[light] = 1;
+    for (uint8_t reached : mReached)  mStats.lightsInView += reached;
+    mStats.indices += numIndices;
+    mStats.maxPerCluster = (std::max)(mStats.maxPerCluster, maxPerCluster);
+}
+
+
+// Bin every n-th slice starting from this thread's, so the near slices (which tend to have more lights in range) are
+// spread between threads. Each slice's pairs and clusters are only written by one thread
+void CLightClusters::AssignSlices(uint32_t thread, uint32_t numThreads)
+{
+    for (uint32_t slice = thread; slice < mSlices; slice += numThreads)
+    {
+        AssignSlice(slice, mThreadStats[thread]);
+    }
+}
+
+
+// Worker thread loop. Waits for each new job, takes part if the job uses this many threads, then tells Assign when done
+void CLightClusters::WorkerLoop(uint32_t thread, uint32_t lastJob)
+{
+    std::unique_lock<std::mutex> lock(mJobMutex);
+    while (true)
+    {
+        // Workers not in a job may sleep through several, so wait for any job after the last one seen
+        mJobStarted.wait(lock, [&]() { return mStopWorkers || mJob != lastJob; });
+        if (mStopWorkers)  return;
+        lastJob = mJob;
+
+        if (thread < mJobThreads)
+        {
+            uint32_t numThreads = mJobThreads;
+            lock.unlock();
+            AssignSlices(thread, numThreads);
+            lock.lock();
+            if (--mJobWorkersBusy == 0)  mJobFinished.notify_one();
+        }
+    }
+}
+
+
+// Bin the lights into one slice. The part of a light's sphere within the slice is projected to find the tiles it may
+// cover, then the sphere is tested against the box of each of those clusters: the squared distance from the centre to
+// the box is the sum of the squared distances outside the box in x, y and z, which must be within the squared range.
+// The z and y distances are the same along a row of tiles, so four columns are tested at once with SIMD
+void CLightClusters::AssignSlice(uint32_t slice, Stats& stats)
+{
+    SlicePairs& pairs = mSlicePairs[slice];
+    pairs.clusters.clear();
+    pairs.lights.clear();
+
+    uint32_t clustersPerSlice = mTilesX * mTilesY;
+    Cluster* clusters = &mClusters[slice * clustersPerSlice];
+    const CBoundingSphere* clusterSpheres = &mClusterSpheres[slice * clustersPerSlice];
+    for (uint32_t cluster = 0; cluster < clustersPerSlice; ++cluster)  clusters[cluster].count = 0;
+
+    float zNear = mSliceNear[slice];
+    float zFar = mSliceFar[slice];
+    const float* columnMinX = &mColumnMinX[slice * mPaddedTilesX];
+    const float* columnMaxX = &mColumnMaxX[slice * mPaddedTilesX];
+    const float* rowMinY = &mRowMinY[slice * mTilesY];
+    const float* rowMaxY = &mRowMaxY[slice * mTilesY];
+
+    uint32_t numLights = static_cast<uint32_t>(mRanges.size());
+    for (uint32_t light = 0; light < numLights; ++light)
+    {
+        if (slice < mFirstSlices[light] || slice > mLastSlices[light])  continue;
+
+        const CVector3& centre = mViewPositions[light];
+        float range = mRanges[light];
+        float outsideZ = (centre.z < zNear) ? zNear - centre.z : (centre.z > zFar) ? centre.z - zFar : 0.0f;
+        float remaining = range * range - outsideZ * outsideZ;
+        if (remaining < 0)  continue;
+
+        // Screen extent of the sphere between the depths it covers in the slice. The sphere's left side is furthest
+        // left on screen at the nearest depth if it is left of the camera, at the furthest depth if not, and so on
+        float depthMin = (std::max)(zNear, centre.z - range);
+        float depthMax = (std::min)(zFar, centre.z + range);
+        float left = centre.x - range, right = centre.x + range;
+        float bottom = centre.y - range, top = centre.y + range;
+        float screenLeft = left * mScaleX / (left < 0 ? depthMin : depthMax);
+        float screenRight = right * mScaleX / (right > 0 ? depthMin : depthMax);
+        float screenBottom = bottom * mScaleY / (bottom < 0 ? depthMin : depthMax);
+        float screenTop = top * mScaleY / (top > 0 ? depthMin : depthMax);
+        if (screenLeft > 1 || screenRight < -1 || screenBottom > 1 || screenTop < -1)  continue;
+
+        auto tile = [](float position, uint32_t numTiles)
+        {
+            float t = std::floor(position * 0.5f * numTiles);
+            return static_cast<uint32_t>((std::min)((std::max)(t, 0.0f), float(numTiles - 1)));
+        };
+        uint32_t firstColumn = tile(screenLeft + 1, mTilesX);
+        uint32_t lastColumn = tile(screenRight + 1, mTilesX);
+        uint32_t firstRow = tile(1 - screenTop, mTilesY);
+        uint32_t lastRow = tile(1 - screenBottom, mTilesY);
+
+        // Add the light to a cluster in the current row whose box the sphere reaches, if the cluster is also inside a
+        // spotlight's cone
+        auto addLight = [&](uint32_t cluster)
+        {
+            if (mIsSpot[light] && !mCones[light].IsVisible(clusterSpheres[cluster]))  return;
+            pairs.clusters.push_back(cluster);
+            pairs.lights.push_back(light);
+            ++clusters[cluster].count;
+        };
+
+        for (uint32_t row = firstRow; row <= lastRow; ++row)
+        {
+            float outsideY = (std::max)((std::max)(rowMinY[row] - centre.y, centre.y - rowMaxY[row]), 0.0f);
+            float rowRemaining = remaining - outsideY * outsideY;
+            if (rowRemaining < 0)  continue;
+            stats.clusterTests += lastColumn - firstColumn + 1;
+
+            uint32_t column = firstColumn;
+#if defined(MATH_SSE)
+            // Four columns at a time from the group of four holding the first one. Columns outside the light's range
+            // are masked off, padding columns are never reached
+            __m128 centreX = _mm_set1_ps(centre.x);
+            __m128 rowRemainingX = _mm_set1_ps(rowRemaining);
+            __m128 zero = _mm_setzero_ps();
+            for (column = firstColumn & ~3u; column <= lastColumn; column += 4)
+            {
+                __m128 outsideX = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(columnMinX + column), centreX),
+                                                        _mm_sub_ps(centreX, _mm_loadu_ps(columnMaxX + column))), zero);
+                int reached = _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(outsideX, outsideX), rowRemainingX));
+                for (uint32_t s = 0; s < 4; ++s)
+                {
+                    uint32_t c = column + s;
+                    if ((reached & (1 << s)) && c >= firstColumn && c <= lastColumn)  addLight(row * mTilesX + c);
+                }
+            }
+#endif
+
+            // Remaining columns (or all of them without SIMD)
+            for (; column <= lastColumn; ++column)
+            {
+                float outsideX = (std::max)((std::max)(columnMinX[column] - centre.x, centre.x - columnMaxX[column]), 0.0f);
+                if (outsideX * outsideX <= rowRemaining)  addLight(row * mTilesX + column);
+            }
+        }
+    }
+}
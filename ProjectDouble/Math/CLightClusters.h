@@ -0,0 +1,204 @@
+//--------------------------------------------------------------------------------------
+// Light clusters - lists of the lights reaching each cell of a view frustum grid
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The view frustum is split into tiles across the screen and slices in depth, giving a grid of clusters. Each light is
+// binned into the clusters its sphere of influence touches, so a pixel shader only loops over the few lights listed for
+// the cluster holding the pixel, however many lights there are in the scene
+// (O. Olsson, M. Billeter & U. Assarsson, Clustered Deferred and Forward Shading, 2012).
+//
+// Slices get thicker with distance: slice 0 covers everything nearer than the first slice depth and the rest divide
+// the depth from there to the far clip exponentially, so each slice is a fixed proportion deeper than the one before,
+// as the tiles are wider. The slice of a view depth is found with a log, see Slice - shaders must use the same formula
+// with DepthScale and DepthBias.
+//
+// Each light's sphere is tested exactly against the view space box of every cluster in its range, four clusters at a
+// time with SIMD where available (see MathSIMD.h), and spotlights are also tested against their cone (see CCone.h).
+// Slices are shared between threads for large numbers of lights. The worker threads are started by the first Assign
+// that needs them and wait between calls, so binning every frame doesn't create and join threads each time. The
+// result is a compact list of light indices, each cluster having the offset and count of its part. Lights are in increasing index order within a cluster whatever
+// the number of threads, so the lists are the same from run to run. No GPU is involved, so the lists can be built (and
+// checked) without a device.
+//
+// Tests are conservative, a light may be listed for a cluster it doesn't quite reach. Symmetric perspective
+// projections only (DirectX conventions - row vectors, view space z is depth). Tile rows count down from the top
+
+#ifndef _CLIGHT_CLUSTERS_H_DEFINED_
+#define _CLIGHT_CLUSTERS_H_DEFINED_
+
+#include "BoundingVolumes.h"
+#include "CCone.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include <vector>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+class CLightClusters
+{
+public:
+    CLightClusters() = default;
+    ~CLightClusters(); // Stops the worker threads
+
+    // Holds threads waiting on its own members, so can't be copied
+    CLightClusters(const CLightClusters&) = delete;
+    CLightClusters& operator=(const CLightClusters&) = delete;
+
+    // A light to bin, in world space. Lights have no effect beyond their range
+    struct Light
+    {
+        CVector3 position;
+        float    range;
+        CVector3 direction;     // Spotlights only, needn't be unit length
+        float    spotHalfAngle; // Angle between a spotlight's direction and the side of its cone in radians, less than
+                                // 90 degrees. 0 for point lights
+    };
+
+    // Part of the light index list for one cluster
+    struct Cluster
+    {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    // Don't share slices between threads unless each thread has at least this many lights to bin
+    static const uint32_t kMinLightsPerThread = 64;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Setup
+    -----------------------------------------------------------------------------------------*/
+
+    // Set the size of the grid and the view it covers. Slices past the first are spread exponentially between
+    // firstSliceDepth and farClip. Only needs calling again when the projection changes
+    void SetGrid(uint32_t tilesX, uint32_t tilesY, uint32_t slices, const CMatrix4x4& projection,
+                 float nearClip, float farClip, float firstSliceDepth);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Binning
+    -----------------------------------------------------------------------------------------*/
+
+    // Build the light lists for the given lights seen with the given view matrix, replacing the previous lists. Uses
+    // up to the given number of threads including the calling one (0 for one per processor core). SetGrid must have
+    // been called
+    void Assign(const Light* lights, uint32_t numLights, const CMatrix4x4& viewMatrix, uint32_t numThreads = 1);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Data access
+    -----------------------------------------------------------------------------------------*/
+
+    uint32_t TilesX() const  { return mTilesX; }
+    uint32_t TilesY() const  { return mTilesY; }
+    uint32_t Slices() const  { return mSlices; }
+    uint32_t NumClusters() const  { return mTilesX * mTilesY * mSlices; }
+
+    // Slice of a view depth: 0 if nearer than FirstSliceDepth, otherwise 1 + log(depth) * DepthScale + DepthBias
+    // rounded down, up to the last slice
+    uint32_t Slice(float viewDepth) const;
+    float    FirstSliceDepth() const  { return mFirstSliceDepth; }
+    float    DepthScale() const       { return mDepthScale; }
+    float    DepthBias() const        { return mDepthBias; }
+
+    // Position of a cluster in Clusters()
+    uint32_t ClusterIndex(uint32_t tileX, uint32_t tileY, uint32_t slice) const
+    {
+        return (slice * mTilesY + tileY) * mTilesX + tileX;
+    }
+
+    // Results of the last Assign. Each cluster's light indices are LightIndices()[offset] to [offset + count - 1]
+    const std::vector<Cluster>&  Clusters() const      { return mClusters; }
+    const std::vector<uint32_t>& LightIndices() const  { return mLightIndices; }
+
+    // Counts since the last ResetStats
+    struct Stats
+    {
+        uint32_t assigns       = 0; // Calls to Assign
+        uint32_t lights        = 0; // Lights given
+        uint32_t lightsInView  = 0; // Lights reaching at least one cluster
+        uint32_t clusterTests  = 0; // Light sphere / cluster box tests
+        uint32_t indices       = 0; // Light indices listed
+        uint32_t maxPerCluster = 0; // Most lights in one cluster
+    };
+    const Stats& GetStats() const  { return mStats; }
+    void         ResetStats()      { mStats = {}; }
+
+
+private:
+    // Bin the lights into one slice, listing the light / cluster pairs found in mSlicePairs and counting them in the
+    // slice's clusters
+    void AssignSlice(uint32_t slice, Stats& stats);
+
+    // Bin the slices taken by one of the given number of threads: thread t takes slices t, t + n, t + 2n...
+    void AssignSlices(uint32_t thread, uint32_t numThreads);
+
+    // Loop run by each worker thread (1 and up, the calling thread is 0), binning its share of the slices each time
+    // Assign starts a job after the given one, until the workers are stopped
+    void WorkerLoop(uint32_t thread, uint32_t lastJob);
+
+    uint32_t mTilesX = 0;
+    uint32_t mTilesY = 0;
+    uint32_t mSlices = 0;
+    uint32_t mPaddedTilesX = 0; // Tiles across rounded up to a multiple of 4 for SIMD
+    float    mScaleX = 1;       // Projection matrix scaling of x and y
+    float    mScaleY = 1;
+    float    mFirstSliceDepth = 1;
+    float    mDepthScale = 0;
+    float    mDepthBias = 0;
+
+    // View space bounds of the grid. Slices by near and far depth, tile columns and rows by slice. The columns are
+    // padded with empty ranges that no light reaches
+    std::vector<float>           mSliceNear;
+    std::vector<float>           mSliceFar;
+    std::vector<float>           mColumnMinX;
+    std::vector<float>           mColumnMaxX;
+    std::vector<float>           mRowMinY;
+    std::vector<float>           mRowMaxY;
+    std::vector<CBoundingSphere> mClusterSpheres; // Around each cluster's box, for the spotlight cone tests
+
+    // Lights in view space, set up by Assign. The slice range is empty for lights outside the grid
+    std::vector<CVector3> mViewPositions;
+    std::vector<float>    mRanges;
+    std::vector<uint32_t> mFirstSlices;
+    std::vector<uint32_t> mLastSlices;
+    std::vector<uint8_t>  mIsSpot;
+    std::vector<CCone>    mCones; // For spotlights
+    std::vector<CVector3> mWorldPositions;
+    std::vector<CVector3> mWorldDirections;
+    std::vector<CVector3> mViewDirections;
+
+    // Light index and cluster (within the slice) of each light found to reach a cluster, by slice, in light order.
+    // Each slice is only touched by one thread. Kept between calls to avoid allocations
+    struct SlicePairs
+    {
+        std::vector<uint32_t> clusters;
+        std::vector<uint32_t> lights;
+    };
+    std::vector<SlicePairs> mSlicePairs;
+
+    std::vector<Cluster>  mClusters;
+    std::vector<uint32_t> mLightIndices;
+    std::vector<uint32_t> mFill;    // Working space for building the index list
+    std::vector<uint8_t>  mReached; // Working space for the stats
+
+    // Worker threads, kept between calls to Assign. Each job is numbered, the workers taking part in it are those
+    // below mJobThreads, and Assign waits for mJobWorkersBusy to reach 0. Only read or written with mJobMutex locked
+    std::vector<std::thread> mWorkers;
+    std::mutex               mJobMutex;
+    std::condition_variable  mJobStarted;
+    std::condition_variable  mJobFinished;
+    uint32_t                 mJob = 0;
+    uint32_t                 mJobThreads = 0;
+    uint32_t                 mJobWorkersBusy = 0;
+    bool                     mStopWorkers = false;
+    std::vector<Stats>       mThreadStats; // Counts from each thread in the current job
+
+    Stats mStats;
+};
+
+
+#endif // _CLIGHT_CLUSTERS_H_DEFINED_
@@ -32,6 +32,10 @@ CVector3 CMatrix4x4::GetRow(int iRow) const
 // Post-multiply this matrix by the given one
 CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
 {
+#if defined(MATH_SSE)
+    // All rows of the result are calculated before any are stored, so multiplying by self is safe
+    *this = *this * m;
+#else
     if (this == &m)
     {
         // Special case of multiplying by self - no copy optimisations so use binary version
@@ -73,6 +77,7 @@ CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
         e31 = t1;
         e32 = t2;
     }
+#endif
     return *this;
 }
 
@@ -80,14 +85,7 @@ CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
 // Return the given CVector4 transformed by this matrix
 CVector4 CMatrix4x4::operator*=(const CVector4& v)
 {
-    CVector4 vOut;
-
-	vOut.x = v.x * e00 + v.y * e10 + v.z * e20 + v.w * e30;
-	vOut.y = v.x * e01 + v.y * e11 + v.z * e21 + v.w * e31;
-	vOut.z = v.x * e02 + v.y * e12 + v.z * e22 + v.w * e32;
-	vOut.w = v.x * e03 + v.y * e13 + v.z * e23 + v.w * e33;
-
-	return vOut;
+    return v * *this;
 }
 
 
@@ -100,6 +98,47 @@ CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2)
 {
     CMatrix4x4 mOut;
 
+#if defined(MATH_AVX)
+    // Two rows of the result per iteration. The rows of m2 are duplicated into both 128-bit lanes,
+    // each lane then works exactly like the SSE version below
+    __m256 r0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m2.e00));
+    __m256 r1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m2.e10));
+    __m256 r2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m2.e20));
+    __m256 r3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m2.e30));
+
+    __m256 a01 = _mm256_loadu_ps(&m1.e00); // Matrices are only guaranteed 16-byte alignment
+    __m256 a23 = _mm256_loadu_ps(&m1.e20);
+
+    __m256 out01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(0, 0, 0, 0)), r0);
+    __m256 out23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, _MM_SHUFFLE(0, 0, 0, 0)), r0);
+    out01 = _mm256_add_ps(out01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(1, 1, 1, 1)), r1));
+    out23 = _mm256_add_ps(out23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, _MM_SHUFFLE(1, 1, 1, 1)), r1));
+    out01 = _mm256_add_ps(out01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(2, 2, 2, 2)), r2));
+    out23 = _mm256_add_ps(out23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, _MM_SHUFFLE(2, 2, 2, 2)), r2));
+    out01 = _mm256_add_ps(out01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, _MM_SHUFFLE(3, 3, 3, 3)), r3));
+    out23 = _mm256_add_ps(out23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, _MM_SHUFFLE(3, 3, 3, 3)), r3));
+
+    _mm256_storeu_ps(&mOut.e00, out01);
+    _mm256_storeu_ps(&mOut.e20, out23);
+
+#elif defined(MATH_SSE)
+    // Each row of the result is the matching row of m1 transformed by m2
+    __m128 r0 = _mm_load_ps(&m2.e00);
+    __m128 r1 = _mm_load_ps(&m2.e10);
+    __m128 r2 = _mm_load_ps(&m2.e20);
+    __m128 r3 = _mm_load_ps(&m2.e30);
+
+    __m128 out0 = SIMDTransformRow(_mm_load_ps(&m1.e00), r0, r1, r2, r3);
+    __m128 out1 = SIMDTransformRow(_mm_load_ps(&m1.e10), r0, r1, r2, r3);
+    __m128 out2 = SIMDTransformRow(_mm_load_ps(&m1.e20), r0, r1, r2, r3);
+    __m128 out3 = SIMDTransformRow(_mm_load_ps(&m1.e30), r0, r1, r2, r3);
+
+    _mm_store_ps(&mOut.e00, out0);
+    _mm_store_ps(&mOut.e10, out1);
+    _mm_store_ps(&mOut.e20, out2);
+    _mm_store_ps(&mOut.e30, out3);
+
+#else
     mOut.e00 = m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20 + m1.e03*m2.e30;
     mOut.e01 = m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21 + m1.e03*m2.e31;
     mOut.e02 = m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22 + m1.e03*m2.e32;
@@ -119,6 +158,7 @@ CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2)
     mOut.e31 = m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m1.e33*m2.e31;
     mOut.e32 = m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m1.e33*m2.e32;
     mOut.e33 = m1.e30*m2.e03 + m1.e31*m2.e13 + m1.e32*m2.e23 + m1.e33*m2.e33;
+#endif
 
     return mOut;
 }
@@ -128,10 +168,16 @@ CVector4 operator*(const CVector4& v, const CMatrix4x4& m)
 {
     CVector4 vOut;
 
+#if defined(MATH_SSE)
+    __m128 out = SIMDTransformRow(_mm_loadu_ps(&v.x), _mm_load_ps(&m.e00), _mm_load_ps(&m.e10),
+                                                      _mm_load_ps(&m.e20), _mm_load_ps(&m.e30));
+    _mm_storeu_ps(&vOut.x, out);
+#else
 	vOut.x = v.x * m.e00 + v.y * m.e10 + v.z * m.e20 + v.w * m.e30;
 	vOut.y = v.x * m.e01 + v.y * m.e11 + v.z * m.e21 + v.w * m.e31;
 	vOut.z = v.x * m.e02 + v.y * m.e12 + v.z * m.e22 + v.w * m.e32;
 	vOut.w = v.x * m.e03 + v.y * m.e13 + v.z * m.e23 + v.w * m.e33;
+#endif
 
 	return vOut;
 }
@@ -226,6 +272,39 @@ CMatrix4x4 InverseAffine(const CMatrix4x4& m)
 {
     CMatrix4x4 mOut;
 
+#if defined(MATH_SSE)
+    __m128 r0 = _mm_load_ps(&m.e00);
+    __m128 r1 = _mm_load_ps(&m.e10);
+    __m128 r2 = _mm_load_ps(&m.e20);
+
+    // The columns of the inverse of the upper left 3x3 are the cross products of pairs of rows
+    // divided by the determinant. Same values as the scalar code below (det0-2 are c0.xyz)
+    __m128 c0 = SIMDCross(r1, r2);
+    __m128 c1 = SIMDCross(r2, r0);
+    __m128 c2 = SIMDCross(r0, r1);
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), SIMDDot3(r0, c0));
+    c0 = _mm_mul_ps(c0, invDet);
+    c1 = _mm_mul_ps(c1, invDet);
+    c2 = _mm_mul_ps(c2, invDet);
+
+    // Transpose columns into rows, fourth column comes out as 0 for an affine matrix
+    __m128 c3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+    // Transform negative translation by inverted 3x3 to get inverse
+    __m128 t = _mm_load_ps(&m.e30);
+    __m128 pos =           _mm_mul_ps(MATH_SPLAT(t, 0), c0);
+    pos = _mm_add_ps(pos, _mm_mul_ps(MATH_SPLAT(t, 1), c1));
+    pos = _mm_add_ps(pos, _mm_mul_ps(MATH_SPLAT(t, 2), c2));
+    pos = _mm_sub_ps(_mm_setzero_ps(), pos);
+
+    _mm_store_ps(&mOut.e00, c0);
+    _mm_store_ps(&mOut.e10, c1);
+    _mm_store_ps(&mOut.e20, c2);
+    _mm_store_ps(&mOut.e30, pos);
+    mOut.e33 = 1.0f;
+#else
+
     // Calculate determinant of upper left 3x3
     float det0 = m.e11*m.e22 - m.e12*m.e21;
     float det1 = m.e12*m.e20 - m.e10*m.e22;
@@ -256,6 +335,7 @@ CMatrix4x4 InverseAffine(const CMatrix4x4& m)
     mOut.e13 = 0.0f;
     mOut.e23 = 0.0f;
     mOut.e33 = 1.0f;
+#endif
 
     return mOut;
 }
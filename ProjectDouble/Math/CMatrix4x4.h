@@ -9,11 +9,14 @@
 #include "CVector3.h"
 #include "CVector4.h"
 #include <cmath>
+#include <cstring>
 #include "BaseMath.h"
+#include "MathSIMD.h"
 
 
 // Matrix class
-class CMatrix4x4
+// Aligned to 16 bytes so each row can be loaded directly into a SIMD register (see MathSIMD.h)
+class GEN_ALIGN(16) CMatrix4x4
 {
 // Concrete class - public access
 public:
@@ -36,8 +39,8 @@ public:
     // Can be used to access position or x,y,z axes from a matrix
     CVector3 GetRow(int iRow) const;
 
-    // Initialise this matrix with a pointer to 16 floats 
-    void SetValues(float* matrixValues)  { *this = *reinterpret_cast<CMatrix4x4*>(matrixValues); }
+    // Initialise this matrix with a pointer to 16 floats. The source need not be aligned (e.g. assimp matrices)
+    void SetValues(const float* matrixValues)  { std::memcpy(&e00, matrixValues, sizeof(float) * 16); }
 	void FaceTarget
 	(
 		const CVector3& target,
@@ -311,6 +314,8 @@ public:
 
 };
 
+static_assert(sizeof(CMatrix4x4) == 16 * sizeof(float), "CMatrix4x4 must be tightly packed, it is copied to GPU constant buffers");
+
 
 /*-----------------------------------------------------------------------------------------
     Non-member Operators
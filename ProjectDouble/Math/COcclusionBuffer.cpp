@@ -0,0 +1,429 @@
+//--------------------------------------------------------------------------------------
+// Occlusion buffer - low resolution software depth buffer for occlusion culling
+//--------------------------------------------------------------------------------------
+
+#include "COcclusionBuffer.h"
+#include "MathSIMD.h"
+#include <algorithm>
+#include <cmath>
+
+
+/*-----------------------------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------------------------*/
+
+namespace
+{
+    // A box is only hidden if it is this much further away than the occluders (as a proportion of their distance),
+    // so surfaces lying on an occluder, e.g. the occluder's own box, aren't lost to rounding
+    const float kDepthBiasScale = 1.001f;
+
+    // Boxes covering more texels than this across at one level of the pyramid are tested at the next level up
+    const uint32_t kMaxTestTexels = 4;
+
+    // Element of a matrix by row and column
+    inline float Element(const CMatrix4x4& m, int row, int column)
+    {
+        return (&m.e00)[row * 4 + column];
+    }
+
+    // Point on the line from a to b where clip space z is 0 (the near plane)
+    inline CVector4 NearPlaneIntersection(const CVector4& a, const CVector4& b)
+    {
+        float t = a.z / (a.z - b.z);
+        return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, 0.0f, a.w + (b.w - a.w) * t };
+    }
+}
+
+const uint32_t COcclusionBuffer::kTileSize;
+
+
+/*-----------------------------------------------------------------------------------------
+    Rendering
+-----------------------------------------------------------------------------------------*/
+
+// Set the buffer size in pixels and work out the sizes of the pyramid levels
+void COcclusionBuffer::Resize(uint32_t width, uint32_t height)
+{
+    mWidth = (std::max)(kTileSize, (width + kTileSize - 1) / kTileSize * kTileSize);
+    mHeight = (std::max)(kTileSize, (height + kTileSize - 1) / kTileSize * kTileSize);
+
+    mLevels.clear();
+    mLevelWidths.clear();
+    mLevelHeights.clear();
+    uint32_t levelWidth = mWidth;
+    uint32_t levelHeight = mHeight;
+    while (true)
+    {
+        mLevels.emplace_back(levelWidth * levelHeight, 0.0f);
+        mLevelWidths.push_back(levelWidth);
+        mLevelHeights.push_back(levelHeight);
+        if (levelWidth == 1 && levelHeight == 1)  break;
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+}
+
+
+// Clear the buffer to start a new view, nothing is occluded until occluders are rendered
+void COcclusionBuffer::Clear(const CMatrix4x4& viewProjection)
+{
+    mViewProjection = viewProjection;
+    for (auto& level : mLevels)  std::fill(level.begin(), level.end(), 0.0f);
+}
+
+
+// Rasterise the triangles of a tree. The tree stores each triangle as a vertex and two edges, so the other vertices in
+// clip space are the first vertex's clip position plus the edges transformed without translation. Four triangles are
+// transformed at a time. With SIMD the four are also rejected and projected together, only triangles crossing the near
+// plane go through the general clipping code
+void COcclusionBuffer::RenderTriangles(const CTriangleTree& triangles, const CMatrix4x4& worldMatrix)
+{
+    if (mLevels.empty())  return;
+
+    CMatrix4x4 m = worldMatrix * mViewProjection;
+    uint32_t numTriangles = triangles.NumTriangles();
+    mStats.triangles += numTriangles;
+
+    for (uint32_t first = 0; first < numTriangles; first += 4)
+    {
+        uint32_t count = (std::min)(4u, numTriangles - first);
+
+#if defined(MATH_SSE)
+        __m128 v0x = _mm_loadu_ps(triangles.Vertex0(0) + first);
+        __m128 v0y = _mm_loadu_ps(triangles.Vertex0(1) + first);
+        __m128 v0z = _mm_loadu_ps(triangles.Vertex0(2) + first);
+        __m128 e1x = _mm_loadu_ps(triangles.Edge1(0) + first);
+        __m128 e1y = _mm_loadu_ps(triangles.Edge1(1) + first);
+        __m128 e1z = _mm_loadu_ps(triangles.Edge1(2) + first);
+        __m128 e2x = _mm_loadu_ps(triangles.Edge2(0) + first);
+        __m128 e2y = _mm_loadu_ps(triangles.Edge2(1) + first);
+        __m128 e2z = _mm_loadu_ps(triangles.Edge2(2) + first);
+
+        // Clip space x, y, z, w of each vertex of the four triangles
+        __m128 clip[3][4];
+        for (int c = 0; c < 4; ++c)
+        {
+            __m128 m0 = _mm_set1_ps(Element(m, 0, c));
+            __m128 m1 = _mm_set1_ps(Element(m, 1, c));
+            __m128 m2 = _mm_set1_ps(Element(m, 2, c));
+            clip[0][c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v0x, m0), _mm_mul_ps(v0y, m1)),
+                                    _mm_add_ps(_mm_mul_ps(v0z, m2), _mm_set1_ps(Element(m, 3, c))));
+            clip[1][c] = _mm_add_ps(clip[0][c], _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, m0), _mm_mul_ps(e1y, m1)), _mm_mul_ps(e1z, m2)));
+            clip[2][c] = _mm_add_ps(clip[0][c], _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, m0), _mm_mul_ps(e2y, m1)), _mm_mul_ps(e2z, m2)));
+        }
+
+        // Triangles entirely outside one of the planes other than the near plane are dropped, those partly behind the
+        // near plane need clipping
+        const __m128 allSet = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 allLeft = allSet, allRight = allSet, allBelow = allSet, allAbove = allSet, allFar = allSet;
+        __m128 nearClip = _mm_setzero_ps();
+        for (int v = 0; v < 3; ++v)
+        {
+            __m128 w = clip[v][3];
+            __m128 negW = _mm_sub_ps(_mm_setzero_ps(), w);
+            allLeft  = _mm_and_ps(allLeft,  _mm_cmplt_ps(clip[v][0], negW));
+            allRight = _mm_and_ps(allRight, _mm_cmpgt_ps(clip[v][0], w));
+            allBelow = _mm_and_ps(allBelow, _mm_cmplt_ps(clip[v][1], negW));
+            allAbove = _mm_and_ps(allAbove, _mm_cmpgt_ps(clip[v][1], w));
+            allFar   = _mm_and_ps(allFar,   _mm_cmpgt_ps(clip[v][2], w));
+            nearClip = _mm_or_ps(nearClip, _mm_cmplt_ps(clip[v][2], _mm_setzero_ps()));
+        }
+        __m128 outside = _mm_or_ps(_mm_or_ps(_mm_or_ps(allLeft, allRight), _mm_or_ps(allBelow, allAbove)), allFar);
+        int outsideMask = _mm_movemask_ps(outside);
+        int nearClipMask = _mm_movemask_ps(nearClip) & ~outsideMask;
+        if (outsideMask == 0xf)  continue;
+
+        // Project all the vertices, only used for triangles that didn't need clipping, and drop the back faces among
+        // those (see RasteriseTriangle)
+        __m128 screen[3][3]; // [vertex][x/y/1/w]
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (int v = 0; v < 3; ++v)
+        {
+            __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), clip[v][3]);
+            screen[v][0] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip[v][0], invW), half), half), _mm_set1_ps(static_cast<float>(mWidth)));
+            screen[v][1] = _mm_mul_ps(_mm_sub_ps(half, _mm_mul_ps(_mm_mul_ps(clip[v][1], invW), half)), _mm_set1_ps(static_cast<float>(mHeight)));
+            screen[v][2] = invW;
+        }
+        __m128 area = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(screen[1][0], screen[0][0]), _mm_sub_ps(screen[2][1], screen[0][1])),
+                                 _mm_mul_ps(_mm_sub_ps(screen[1][1], screen[0][1]), _mm_sub_ps(screen[2][0], screen[0][0])));
+        int skipMask = outsideMask | (~_mm_movemask_ps(_mm_cmpgt_ps(area, _mm_setzero_ps())) & ~nearClipMask);
+        if ((skipMask & 0xf) == 0xf)  continue;
+
+        alignas(16) float screenValues[3][3][4]; // [vertex][x/y/1/w][triangle]
+        for (int v = 0; v < 3; ++v)
+        {
+            for (int c = 0; c < 3; ++c)  _mm_store_ps(screenValues[v][c], screen[v][c]);
+        }
+
+        for (uint32_t t = 0; t < count; ++t)
+        {
+            if (skipMask & (1 << t))  continue;
+            if (nearClipMask & (1 << t))
+            {
+                alignas(16) float values[3][4][4];
+                for (int v = 0; v < 3; ++v)
+                {
+                    for (int c = 0; c < 4; ++c)  _mm_store_ps(values[v][c], clip[v][c]);
+                }
+                CVector4 vertices[3];
+                for (int v = 0; v < 3; ++v)  vertices[v] = { values[v][0][t], values[v][1][t], values[v][2][t], values[v][3][t] };
+                ClipAndRasterise(vertices);
+            }
+            else
+            {
+                ScreenVertex vertices[3];
+                for (int v = 0; v < 3; ++v)  vertices[v] = { screenValues[v][0][t], screenValues[v][1][t], screenValues[v][2][t] };
+                RasteriseTriangle(vertices[0], vertices[1], vertices[2]);
+            }
+        }
+
+#else
+        for (uint32_t t = 0; t < count; ++t)
+        {
+            CVector3 v0 = { triangles.Vertex0(0)[first + t], triangles.Vertex0(1)[first + t], triangles.Vertex0(2)[first + t] };
+            CVector3 e1 = { triangles.Edge1(0)[first + t], triangles.Edge1(1)[first + t], triangles.Edge1(2)[first + t] };
+            CVector3 e2 = { triangles.Edge2(0)[first + t], triangles.Edge2(1)[first + t], triangles.Edge2(2)[first + t] };
+            CVector4 vertices[3];
+            vertices[0] = CVector4(v0, 1) * m;
+            CVector4 edge1 = CVector4(e1, 0) * m;
+            CVector4 edge2 = CVector4(e2, 0) * m;
+            vertices[1] = { vertices[0].x + edge1.x, vertices[0].y + edge1.y, vertices[0].z + edge1.z, vertices[0].w + edge1.w };
+            vertices[2] = { vertices[0].x + edge2.x, vertices[0].y + edge2.y, vertices[0].z + edge2.z, vertices[0].w + edge2.w };
+            ClipAndRasterise(vertices);
+        }
+#endif
+    }
+}
+
+
+// Clip a triangle in clip space to the near plane and rasterise what is left. Triangles entirely outside one of the
+// other frustum planes are dropped, those crossing them are left to the rasteriser's screen bounds
+void COcclusionBuffer::ClipAndRasterise(const CVector4 clip[3])
+{
+    if (clip[0].x >  clip[0].w && clip[1].x >  clip[1].w && clip[2].x >  clip[2].w)  return;
+    if (clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w)  return;
+    if (clip[0].y >  clip[0].w && clip[1].y >  clip[1].w && clip[2].y >  clip[2].w)  return;
+    if (clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w)  return;
+    if (clip[0].z >  clip[0].w && clip[1].z >  clip[1].w && clip[2].z >  clip[2].w)  return;
+
+    // Sutherland-Hodgman against the near plane only, giving a triangle or a quad
+    CVector4 polygon[4];
+    int numVertices = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        const CVector4& a = clip[i];
+        const CVector4& b = clip[(i + 1) % 3];
+        if (a.z >= 0)  polygon[numVertices++] = a;
+        if ((a.z >= 0) != (b.z >= 0))  polygon[numVertices++] = NearPlaneIntersection(a, b);
+    }
+    if (numVertices < 3)  return;
+
+    ScreenVertex screen[4];
+    for (int i = 0; i < numVertices; ++i)
+    {
+        if (polygon[i].w <= 0)  return; // Not a perspective projection
+        float invW = 1.0f / polygon[i].w;
+        screen[i].x = (polygon[i].x * invW * 0.5f + 0.5f) * mWidth;
+        screen[i].y = (0.5f - polygon[i].y * invW * 0.5f) * mHeight;
+        screen[i].invW = invW;
+    }
+    RasteriseTriangle(screen[0], screen[1], screen[2]);
+    if (numVertices == 4)  RasteriseTriangle(screen[0], screen[2], screen[3]);
+}
+
+
+// Rasterise a projected triangle into level 0, keeping the nearest depth at each pixel. Back faces are culled with the
+// GPU's default rule (clockwise front faces), leaving out occluder triangles only ever hides less. Uses edge functions, which are
+// positive on the inside of each edge, evaluated at pixel centres (J. Pineda, A Parallel Algorithm for Polygon
+// Rasterization, 1988). A pixel is covered if its centre is, as on the GPU, so a model only visible through a gap
+// narrower than a pixel of this buffer may be culled. Tiles the triangle doesn't reach are skipped by testing the
+// edges at the tile corner nearest the inside of each edge
+void COcclusionBuffer::RasteriseTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2)
+{
+    // Clockwise triangles on screen (y down) have a positive area, the rest face away or are degenerate
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (!(area > 0) || !std::isfinite(area))  return;
+    const ScreenVertex* v[3] = { &v0, &v1, &v2 };
+
+    // Pixels whose centres are inside the triangle's bounds, clamped to the buffer. Tiny triangles between pixel
+    // centres cover nothing
+    float minX = (std::min)({ v[0]->x, v[1]->x, v[2]->x });
+    float maxX = (std::max)({ v[0]->x, v[1]->x, v[2]->x });
+    float minY = (std::min)({ v[0]->y, v[1]->y, v[2]->y });
+    float maxY = (std::max)({ v[0]->y, v[1]->y, v[2]->y });
+    float startX = (std::max)(std::ceil(minX - 0.5f), 0.0f);
+    float endX   = (std::min)(std::floor(maxX - 0.5f), static_cast<float>(mWidth - 1));
+    float startY = (std::max)(std::ceil(minY - 0.5f), 0.0f);
+    float endY   = (std::min)(std::floor(maxY - 0.5f), static_cast<float>(mHeight - 1));
+    if (startX > endX || startY > endY)  return;
+
+    // Edge function for the edge opposite each vertex, E(x,y) = a*x + b*y + c, and the depth plane from the
+    // barycentric coordinates E/area
+    float a[3], b[3], c[3];
+    for (int e = 0; e < 3; ++e)
+    {
+        const ScreenVertex& from = *v[(e + 1) % 3];
+        const ScreenVertex& to   = *v[(e + 2) % 3];
+        a[e] = from.y - to.y;
+        b[e] = to.x - from.x;
+        c[e] = from.x * to.y - from.y * to.x;
+    }
+    float invArea = 1.0f / area;
+    float depthA = (a[0] * v[0]->invW + a[1] * v[1]->invW + a[2] * v[2]->invW) * invArea;
+    float depthB = (b[0] * v[0]->invW + b[1] * v[1]->invW + b[2] * v[2]->invW) * invArea;
+    float depthC = (c[0] * v[0]->invW + c[1] * v[1]->invW + c[2] * v[2]->invW) * invArea;
+
+    std::vector<float>& depths = mLevels[0];
+    uint32_t firstTileX = static_cast<uint32_t>(startX) / kTileSize * kTileSize;
+    uint32_t firstTileY = static_cast<uint32_t>(startY) / kTileSize * kTileSize;
+    uint32_t lastX = static_cast<uint32_t>(endX);
+    uint32_t lastY = static_cast<uint32_t>(endY);
+    bool covered = false;
+    for (uint32_t tileY = firstTileY; tileY <= lastY; tileY += kTileSize)
+    {
+        for (uint32_t tileX = firstTileX; tileX <= lastX; tileX += kTileSize)
+        {
+            bool outside = false;
+            for (int e = 0; e < 3 && !outside; ++e)
+            {
+                float x = tileX + (a[e] > 0 ? kTileSize - 0.5f : 0.5f);
+                float y = tileY + (b[e] > 0 ? kTileSize - 0.5f : 0.5f);
+                outside = a[e] * x + b[e] * y + c[e] < 0;
+            }
+            if (outside)  continue;
+            covered = true;
+            ++mStats.tiles;
+
+#if defined(MATH_SSE)
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+            const __m128 depthAs = _mm_set1_ps(depthA);
+            for (uint32_t row = 0; row < kTileSize; ++row)
+            {
+                float y = tileY + row + 0.5f;
+                __m128 rowE0 = _mm_set1_ps(b[0] * y + c[0]);
+                __m128 rowE1 = _mm_set1_ps(b[1] * y + c[1]);
+                __m128 rowE2 = _mm_set1_ps(b[2] * y + c[2]);
+                __m128 rowDepth = _mm_set1_ps(depthB * y + depthC);
+                for (uint32_t column = 0; column < kTileSize; column += 4)
+                {
+                    float x = tileX + column + 0.5f;
+                    __m128 xs = _mm_add_ps(_mm_set1_ps(x), _mm_setr_ps(0, 1, 2, 3));
+                    __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, xs), rowE0), zero);
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, xs), rowE1), zero));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, xs), rowE2), zero));
+                    if (_mm_movemask_ps(inside) == 0)  continue;
+
+                    float* pixels = &depths[(tileY + row) * mWidth + tileX + column];
+                    __m128 oldDepth = _mm_loadu_ps(pixels);
+                    __m128 newDepth = _mm_max_ps(oldDepth, _mm_add_ps(_mm_mul_ps(depthAs, xs), rowDepth));
+                    _mm_storeu_ps(pixels, _mm_or_ps(_mm_and_ps(inside, newDepth), _mm_andnot_ps(inside, oldDepth)));
+                }
+            }
+#else
+            for (uint32_t row = 0; row < kTileSize; ++row)
+            {
+                float y = tileY + row + 0.5f;
+                for (uint32_t column = 0; column < kTileSize; ++column)
+                {
+                    float x = tileX + column + 0.5f;
+                    if (a[0] * x + b[0] * y + c[0] < 0 || a[1] * x + b[1] * y + c[1] < 0 ||
+                        a[2] * x + b[2] * y + c[2] < 0)  continue;
+
+                    float& pixel = depths[(tileY + row) * mWidth + tileX + column];
+                    pixel = (std::max)(pixel, depthA * x + depthB * y + depthC);
+                }
+            }
+#endif
+        }
+    }
+    if (covered)  ++mStats.rasterised;
+}
+
+
+// Build the depth pyramid, each texel holding the furthest (smallest) depth of the texels below it. Texels on the
+// edge of a level with an odd size just repeat the last row or column below
+void COcclusionBuffer::BuildPyramid()
+{
+    for (std::size_t level = 1; level < mLevels.size(); ++level)
+    {
+        const std::vector<float>& below = mLevels[level - 1];
+        uint32_t belowWidth = mLevelWidths[level - 1];
+        uint32_t belowHeight = mLevelHeights[level - 1];
+        std::vector<float>& texels = mLevels[level];
+        for (uint32_t y = 0; y < mLevelHeights[level]; ++y)
+        {
+            uint32_t y0 = y * 2;
+            uint32_t y1 = (std::min)(y0 + 1, belowHeight - 1);
+            for (uint32_t x = 0; x < mLevelWidths[level]; ++x)
+            {
+                uint32_t x0 = x * 2;
+                uint32_t x1 = (std::min)(x0 + 1, belowWidth - 1);
+                texels[y * mLevelWidths[level] + x] = (std::min)({ below[y0 * belowWidth + x0], below[y0 * belowWidth + x1],
+                                                                   below[y1 * belowWidth + x0], below[y1 * belowWidth + x1] });
+            }
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Tests
+-----------------------------------------------------------------------------------------*/
+
+// Whether any part of a world space box may be in front of the occluders. The box's corners are projected to find the
+// pixels it covers and its nearest depth, then the smallest pyramid level where it covers only a few texels is checked.
+// The box is hidden if it is further than the furthest occluder in every one of those texels
+bool COcclusionBuffer::IsVisible(const CBoundingBox& box) const
+{
+    ++mStats.tests;
+    if (box.IsEmpty() || mLevels.empty())  return true;
+
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+    float nearestInvW = 0;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        CVector3 point = { (corner & 1) ? box.maximum.x : box.minimum.x,
+                           (corner & 2) ? box.maximum.y : box.minimum.y,
+                           (corner & 4) ? box.maximum.z : box.minimum.z };
+        CVector4 clip = CVector4(point, 1) * mViewProjection;
+        if (clip.z < 0 || clip.w <= 0)  return true; // Crosses the near plane
+
+        float invW = 1.0f / clip.w;
+        float x = (clip.x * invW * 0.5f + 0.5f) * mWidth;
+        float y = (0.5f - clip.y * invW * 0.5f) * mHeight;
+        minX = (std::min)(minX, x);
+        maxX = (std::max)(maxX, x);
+        minY = (std::min)(minY, y);
+        maxY = (std::max)(maxY, y);
+        nearestInvW = (std::max)(nearestInvW, invW);
+    }
+
+    // Boxes off the screen are left to frustum culling
+    if (maxX < 0 || maxY < 0 || minX >= mWidth || minY >= mHeight)  return true;
+    uint32_t startX = static_cast<uint32_t>((std::max)(minX, 0.0f));
+    uint32_t startY = static_cast<uint32_t>((std::max)(minY, 0.0f));
+    uint32_t endX = static_cast<uint32_t>((std::min)(maxX, static_cast<float>(mWidth - 1)));
+    uint32_t endY = static_cast<uint32_t>((std::min)(maxY, static_cast<float>(mHeight - 1)));
+
+    std::size_t level = 0;
+    while (level + 1 < mLevels.size() &&
+           ((endX >> level) - (startX >> level) >= kMaxTestTexels || (endY >> level) - (startY >> level) >= kMaxTestTexels))
+    {
+        ++level;
+    }
+
+    const std::vector<float>& texels = mLevels[level];
+    uint32_t levelWidth = mLevelWidths[level];
+    float boxDepth = nearestInvW * kDepthBiasScale;
+    for (uint32_t y = startY >> level; y <= endY >> level; ++y)
+    {
+        for (uint32_t x = startX >> level; x <= endX >> level; ++x)
+        {
+            if (boxDepth >= texels[y * levelWidth + x])  return true;
+        }
+    }
+    ++mStats.occluded;
+    return false;
+}
@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------------
+// Occlusion buffer - low resolution software depth buffer for occlusion culling
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// A few large models (occluders) are rasterised on the CPU into a small depth buffer from the camera's point of view,
+// then the bounding boxes of other models are tested against it before they are submitted for rendering. A box that
+// is behind the occluders at every pixel it covers can't be seen and needn't be drawn. No GPU is involved, so the
+// buffer can be used (and checked) without a device.
+//
+// The buffer stores 1/w (the reciprocal of view space depth), which unlike w varies linearly across a triangle in
+// screen space and is independent of the near and far clip distances. Larger values are nearer, 0 is infinitely far.
+// Triangles are clipped to the near plane and rasterised in 8x8 pixel tiles, skipping tiles outside the triangle, and
+// each tile is filled four pixels at a time with SIMD where available (see MathSIMD.h). Occluder triangles are taken
+// from CTriangleTree's per-component arrays, which also lets four triangles be transformed at once.
+// After the occluders, a hierarchical-Z pyramid is built where each texel holds the furthest depth of the four below
+// it, so a box is tested against a handful of texels whatever its size on screen
+// (N. Greene, M. Kass & G. Miller, Hierarchical Z-Buffer Visibility, 1993).
+//
+// The tests are conservative: a box is only occluded if it is entirely behind the occluders, and boxes crossing the
+// near plane are always visible. Perspective projections only (DirectX conventions - row vectors, clip z from 0 to w)
+
+#ifndef _COCCLUSION_BUFFER_H_DEFINED_
+#define _COCCLUSION_BUFFER_H_DEFINED_
+
+#include "BoundingVolumes.h"
+#include "CTriangleTree.h"
+#include "CMatrix4x4.h"
+#include <vector>
+#include <cstdint>
+
+
+class COcclusionBuffer
+{
+public:
+    // Width and height of a tile in pixels, the buffer size must be a multiple of this
+    static const uint32_t kTileSize = 8;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Rendering
+    -----------------------------------------------------------------------------------------*/
+
+    // Set the buffer size in pixels. A few hundred pixels across is plenty, the aspect ratio needn't match the screen
+    void Resize(uint32_t width, uint32_t height);
+
+    // Clear the buffer to start a new view
+    void Clear(const CMatrix4x4& viewProjection);
+
+    // Rasterise the triangles of a tree, which are transformed by the given world matrix. Back faces are culled
+    void RenderTriangles(const CTriangleTree& triangles, const CMatrix4x4& worldMatrix);
+
+    // Build the depth pyramid from the rendered occluders, call before testing boxes
+    void BuildPyramid();
+
+
+    /*-----------------------------------------------------------------------------------------
+        Tests
+    -----------------------------------------------------------------------------------------*/
+
+    // Whether any part of a world space box may be in front of the occluders. Empty boxes are always visible
+    bool IsVisible(const CBoundingBox& box) const;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Data access
+    -----------------------------------------------------------------------------------------*/
+
+    uint32_t Width() const   { return mWidth; }
+    uint32_t Height() const  { return mHeight; }
+
+    // 1/w of the nearest occluder at a pixel, 0 where there is none
+    float Depth(uint32_t x, uint32_t y) const  { return mLevels[0][y * mWidth + x]; }
+
+    // Counts since the last ResetStats
+    struct Stats
+    {
+        uint32_t triangles  = 0; // Occluder triangles given
+        uint32_t rasterised = 0; // Triangles covering at least one tile after clipping and culling
+        uint32_t tiles      = 0; // Tiles filled
+        uint32_t tests      = 0; // Boxes tested
+        uint32_t occluded   = 0; // Boxes found to be hidden
+    };
+    const Stats& GetStats() const  { return mStats; }
+    void         ResetStats()      { mStats = {}; }
+
+
+private:
+    // A vertex after projection, in pixels with y down, and 1/w
+    struct ScreenVertex
+    {
+        float x, y, invW;
+    };
+
+    // Clip a triangle in clip space to the near plane and rasterise what is left
+    void ClipAndRasterise(const CVector4 clip[3]);
+
+    // Rasterise a projected triangle into level 0 of the buffer
+    void RasteriseTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2);
+
+    uint32_t   mWidth = 0;
+    uint32_t   mHeight = 0;
+    CMatrix4x4 mViewProjection;
+
+    // Level 0 is the buffer itself (nearest depth of each pixel), each level after is half the size of the one before
+    // (rounded up) and holds the furthest depth of the texels below it
+    std::vector<std::vector<float>> mLevels;
+    std::vector<uint32_t>           mLevelWidths;
+    std::vector<uint32_t>           mLevelHeights;
+
+    mutable Stats mStats;
+};
+
+
+#endif // _COCCLUSION_BUFFER_H_DEFINED_
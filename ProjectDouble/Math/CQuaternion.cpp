@@ -0,0 +1,328 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version), to hold rotations
+//--------------------------------------------------------------------------------------
+
+#include "CQuaternion.h"
+#include "MathSIMD.h"
+
+#include <algorithm>
+
+
+/*-----------------------------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------------------------*/
+
+namespace
+{
+    // Build a quaternion from the three rows of a pure rotation matrix (rows must be unit length and orthogonal)
+    // Uses the largest of the diagonal/trace terms to avoid dividing by a small value
+    CQuaternion QuaternionFromRotationRows(const CVector3& r0, const CVector3& r1, const CVector3& r2)
+    {
+        float trace = r0.x + r1.y + r2.z;
+        if (trace > 0.0f)
+        {
+            float s = 0.5f / std::sqrt(trace + 1.0f);
+            return { (r1.z - r2.y) * s, (r2.x - r0.z) * s, (r0.y - r1.x) * s, 0.25f / s };
+        }
+        else if (r0.x > r1.y && r0.x > r2.z)
+        {
+            float s = 2.0f * std::sqrt(1.0f + r0.x - r1.y - r2.z);
+            float invS = 1.0f / s;
+            return { 0.25f * s, (r0.y + r1.x) * invS, (r0.z + r2.x) * invS, (r1.z - r2.y) * invS };
+        }
+        else if (r1.y > r2.z)
+        {
+            float s = 2.0f * std::sqrt(1.0f + r1.y - r0.x - r2.z);
+            float invS = 1.0f / s;
+            return { (r0.y + r1.x) * invS, 0.25f * s, (r1.z + r2.y) * invS, (r2.x - r0.z) * invS };
+        }
+        else
+        {
+            float s = 2.0f * std::sqrt(1.0f + r2.z - r0.x - r1.y);
+            float invS = 1.0f / s;
+            return { (r0.z + r2.x) * invS, (r1.z + r2.y) * invS, 0.25f * s, (r0.y - r1.x) * invS };
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Constructors
+-----------------------------------------------------------------------------------------*/
+
+// Construct a rotation of the given angle (radians) around the given axis (need not be normalised)
+CQuaternion::CQuaternion(const CVector3& axis, const float angle)
+{
+    CVector3 unitAxis = Normalise(axis);
+    float s = std::sin(angle * 0.5f);
+    x = unitAxis.x * s;
+    y = unitAxis.y * s;
+    z = unitAxis.z * s;
+    w = std::cos(angle * 0.5f);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Member functions
+-----------------------------------------------------------------------------------------*/
+
+// Post-multiply this quaternion by the given one (i.e. this rotation followed by q)
+CQuaternion& CQuaternion::operator*= (const CQuaternion& q)
+{
+    *this = *this * q;
+    return *this;
+}
+
+
+// Return the given vector rotated by this quaternion. Quaternion must be unit length
+// Uses v' = v + w*t + (q.xyz x t) where t = 2 * (q.xyz x v), which is cheaper than q*v*q'
+CVector3 CQuaternion::Rotate(const CVector3& v) const
+{
+    CVector3 u = { x, y, z };
+    CVector3 t = 2.0f * Cross(u, v);
+    return v + w * t + Cross(u, t);
+}
+
+
+// Return the rotation held in this quaternion as Euler angles, using the same order and
+// conventions as CMatrix4x4::GetEulerAngles. Quaternion must be unit length
+// Only the matrix elements needed are calculated. No scaling to remove so this is simpler
+// than the matrix version (the cos(X) terms cancel in the atan2 calls)
+CVector3 CQuaternion::GetEulerAngles() const
+{
+    float sX = 2.0f * (w * x - y * z);  // -e21 of the rotation matrix
+    sX = std::min(std::max(sX, -1.0f), 1.0f);
+    float cX = std::sqrt(1.0f - sX * sX);
+
+    // If no gimbal lock...
+    if (std::abs(cX) > 0.001f)
+    {
+        return { std::atan2(sX, cX),
+                 std::atan2(2.0f * (x * z + w * y), 1.0f - 2.0f * (x * x + y * y)),    // e20, e22
+                 std::atan2(2.0f * (x * y + w * z), 1.0f - 2.0f * (x * x + z * z)) };  // e01, e11
+    }
+    else
+    {
+        // Gimbal lock - force Z angle to 0
+        return { std::atan2(sX, cX),
+                 std::atan2(2.0f * (w * y - x * z), 1.0f - 2.0f * (y * y + z * z)),   // -e02, e00
+                 0.0f };
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member operators
+-----------------------------------------------------------------------------------------*/
+
+// Quaternion multiplication - the rotation q1 followed by the rotation q2
+// This is the standard (Hamilton) product q2q1, reversed to match the row-vector matrices used here
+CQuaternion operator* (const CQuaternion& q1, const CQuaternion& q2)
+{
+    return { q2.w * q1.x + q2.x * q1.w + q2.y * q1.z - q2.z * q1.y,
+             q2.w * q1.y - q2.x * q1.z + q2.y * q1.w + q2.z * q1.x,
+             q2.w * q1.z + q2.x * q1.y - q2.y * q1.x + q2.z * q1.w,
+             q2.w * q1.w - q2.x * q1.x - q2.y * q1.y - q2.z * q1.z };
+}
+
+// Component-wise addition and scalar multiplication, mainly for interpolation
+CQuaternion operator+ (const CQuaternion& q1, const CQuaternion& q2)
+{
+    return { q1.x + q2.x, q1.y + q2.y, q1.z + q2.z, q1.w + q2.w };
+}
+
+CQuaternion operator* (const CQuaternion& q, float s)
+{
+    return { q.x * s, q.y * s, q.z * s, q.w * s };
+}
+
+CQuaternion operator* (float s, const CQuaternion& q)
+{
+    return { q.x * s, q.y * s, q.z * s, q.w * s };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return the identity quaternion (no rotation)
+CQuaternion QuaternionIdentity()
+{
+    return { 0, 0, 0, 1 };
+}
+
+// Return a quaternion for a rotation around the X, Y or Z axis of the given angle (in radians)
+CQuaternion QuaternionRotationX(float x)
+{
+    return { std::sin(x * 0.5f), 0, 0, std::cos(x * 0.5f) };
+}
+
+CQuaternion QuaternionRotationY(float y)
+{
+    return { 0, std::sin(y * 0.5f), 0, std::cos(y * 0.5f) };
+}
+
+CQuaternion QuaternionRotationZ(float z)
+{
+    return { 0, 0, std::sin(z * 0.5f), std::cos(z * 0.5f) };
+}
+
+// Return a quaternion for the given Euler angles, in the same order as the rest of the code
+// uses (Z then X then Y), so it matches MatrixRotationZ(z) * MatrixRotationX(x) * MatrixRotationY(y)
+CQuaternion QuaternionFromEulerAngles(const CVector3& angles)
+{
+    return QuaternionRotationZ(angles.z) * QuaternionRotationX(angles.x) * QuaternionRotationY(angles.y);
+}
+
+
+// Dot product of two quaternions
+float Dot(const CQuaternion& q1, const CQuaternion& q2)
+{
+    return q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w;
+}
+
+// Return the conjugate of a quaternion - for a unit quaternion this is the inverse rotation
+CQuaternion Conjugate(const CQuaternion& q)
+{
+    return { -q.x, -q.y, -q.z, q.w };
+}
+
+// Return unit length quaternion in the same direction as the given one. A zero length
+// quaternion is returned as the identity (no rotation)
+CQuaternion Normalise(const CQuaternion& q)
+{
+    float lengthSq = Dot(q, q);
+    if (IsZero(lengthSq))
+    {
+        return QuaternionIdentity();
+    }
+    return q * InvSqrt(lengthSq);
+}
+
+// Returns length of a quaternion
+float Length(const CQuaternion& q)
+{
+    return std::sqrt(Dot(q, q));
+}
+
+
+// Normalised linear interpolation between two unit quaternions, t from 0 to 1. Cheaper than
+// slerp, but the rotation speed is not constant over the interpolation
+CQuaternion Nlerp(const CQuaternion& q1, const CQuaternion& q2, float t)
+{
+#if defined(MATH_SSE)
+    __m128 a = _mm_loadu_ps(&q1.x);
+    __m128 b = _mm_loadu_ps(&q2.x);
+
+    // q and -q are the same rotation, flip the second quaternion if needed to take the shortest path
+    __m128 signMask = _mm_and_ps(SIMDDot4(a, b), _mm_set1_ps(-0.0f));
+    b = _mm_xor_ps(b, signMask);
+
+    __m128 r = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+    r = _mm_div_ps(r, _mm_sqrt_ps(SIMDDot4(r, r)));
+
+    CQuaternion result;
+    _mm_storeu_ps(&result.x, r);
+    return result;
+#else
+    // q and -q are the same rotation, flip the second quaternion if needed to take the shortest path
+    float sign = Dot(q1, q2) < 0.0f ? -1.0f : 1.0f;
+    return Normalise(q1 * (1.0f - t) + q2 * (sign * t));
+#endif
+}
+
+
+// Spherical linear interpolation between two unit quaternions, t from 0 to 1. Rotates at a
+// constant speed. Both functions take the shortest path between the two rotations
+CQuaternion Slerp(const CQuaternion& q1, const CQuaternion& q2, float t)
+{
+    float cosTheta = Dot(q1, q2);
+    float sign = 1.0f;
+    if (cosTheta < 0.0f)
+    {
+        cosTheta = -cosTheta;
+        sign = -1.0f;
+    }
+
+    // Nearly identical rotations - sin(theta) below tends to zero, but nlerp is accurate here
+    if (cosTheta > 0.9995f)
+    {
+        return Nlerp(q1, q2, t);
+    }
+
+    float theta = std::acos(cosTheta);
+    float invSinTheta = 1.0f / std::sin(theta);
+    float w1 = std::sin((1.0f - t) * theta) * invSinTheta;
+    float w2 = std::sin(t * theta) * invSinTheta * sign;
+
+#if defined(MATH_SSE)
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&q1.x), _mm_set1_ps(w1)),
+                          _mm_mul_ps(_mm_loadu_ps(&q2.x), _mm_set1_ps(w2)));
+    CQuaternion result;
+    _mm_storeu_ps(&result.x, r);
+    return result;
+#else
+    return q1 * w1 + q2 * w2;
+#endif
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Conversion to and from matrices
+-----------------------------------------------------------------------------------------*/
+
+// Return a rotation matrix holding the given unit quaternion
+CMatrix4x4 MatrixFromQuaternion(const CQuaternion& q)
+{
+    return MatrixTransform({ 0, 0, 0 }, q, { 1, 1, 1 });
+}
+
+// Return the rotation held in the given matrix as a quaternion. Any scaling in the matrix
+// is removed first, the position is ignored
+CQuaternion QuaternionFromMatrix(const CMatrix4x4& m)
+{
+    CVector3 position, scale;
+    CQuaternion rotation;
+    DecomposeMatrix(m, position, rotation, scale);
+    return rotation;
+}
+
+// Return a matrix that scales, then rotates, then translates, i.e. the same as
+// MatrixScaling(scale) * MatrixFromQuaternion(rotation) * MatrixTranslation(position),
+// but built directly without any matrix multiplies
+CMatrix4x4 MatrixTransform(const CVector3& position, const CQuaternion& rotation, const CVector3& scale)
+{
+    const CQuaternion& q = rotation;
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    return CMatrix4x4{ (1.0f - 2.0f * (yy + zz)) * scale.x,        2.0f * (xy + wz) * scale.x,         2.0f * (xz - wy) * scale.x, 0.0f,
+                              2.0f * (xy - wz) * scale.y, (1.0f - 2.0f * (xx + zz)) * scale.y,         2.0f * (yz + wx) * scale.y, 0.0f,
+                              2.0f * (xz + wy) * scale.z,         2.0f * (yz - wx) * scale.z, (1.0f - 2.0f * (xx + yy)) * scale.z, 0.0f,
+                                              position.x,                         position.y,                         position.z, 1.0f };
+}
+
+// Split an affine matrix (without shear) into position, rotation and scale - the reverse of
+// MatrixTransform. A mirroring matrix is returned as a negative X scale
+void DecomposeMatrix(const CMatrix4x4& m, CVector3& position, CQuaternion& rotation, CVector3& scale)
+{
+    position = m.GetRow(3);
+
+    CVector3 row0 = m.GetRow(0);
+    CVector3 row1 = m.GetRow(1);
+    CVector3 row2 = m.GetRow(2);
+    scale = { Length(row0), Length(row1), Length(row2) };
+    if (IsZero(scale.x) || IsZero(scale.y) || IsZero(scale.z))
+    {
+        // Degenerate matrix, no meaningful rotation
+        rotation = QuaternionIdentity();
+        return;
+    }
+
+    // A negative determinant means the matrix mirrors, which a rotation can't hold, so put it in the scale
+    if (Dot(Cross(row0, row1), row2) < 0.0f)  scale.x = -scale.x;
+
+    rotation = QuaternionFromRotationRows(row0 / scale.x, row1 / scale.y, row2 / scale.z);
+}
@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version), to hold rotations
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Quaternions are a more compact and cheaper way to hold and combine rotations than matrices,
+// and can be interpolated smoothly. Only unit quaternions represent rotations.
+//
+// Multiplication follows the same order as CMatrix4x4: q1 * q2 is the rotation q1 followed by
+// the rotation q2, i.e. MatrixFromQuaternion(q1 * q2) == MatrixFromQuaternion(q1) * MatrixFromQuaternion(q2)
+
+#ifndef _CQUATERNION_H_DEFINED_
+#define _CQUATERNION_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "MathHelpers.h"
+#include <cmath>
+
+class CQuaternion
+{
+// Concrete class - public access
+public:
+    // Quaternion components - x,y,z is the vector part, w the scalar part. This order
+    // allows a quaternion to be loaded directly into a SIMD register
+    float x;
+    float y;
+    float z;
+    float w;
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CQuaternion() {}
+
+    // Construct with 4 values
+    CQuaternion(const float xIn, const float yIn, const float zIn, const float wIn)
+    {
+        x = xIn;
+        y = yIn;
+        z = zIn;
+        w = wIn;
+    }
+
+    // Construct a rotation of the given angle (radians) around the given axis (need not be normalised)
+    CQuaternion(const CVector3& axis, const float angle);
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+    // Post-multiply this quaternion by the given one (i.e. this rotation followed by q)
+    CQuaternion& operator*= (const CQuaternion& q);
+
+    // Return the given vector rotated by this quaternion. Quaternion must be unit length
+    CVector3 Rotate(const CVector3& v) const;
+
+    // Return the rotation held in this quaternion as Euler angles, using the same order and
+    // conventions as CMatrix4x4::GetEulerAngles. Quaternion must be unit length
+    CVector3 GetEulerAngles() const;
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member operators
+-----------------------------------------------------------------------------------------*/
+
+// Quaternion multiplication - the rotation q1 followed by the rotation q2
+CQuaternion operator* (const CQuaternion& q1, const CQuaternion& q2);
+
+// Component-wise addition and scalar multiplication, mainly for interpolation
+CQuaternion operator+ (const CQuaternion& q1, const CQuaternion& q2);
+CQuaternion operator* (const CQuaternion& q, float s);
+CQuaternion operator* (float s, const CQuaternion& q);
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return the identity quaternion (no rotation)
+CQuaternion QuaternionIdentity();
+
+// Return a quaternion for a rotation around the X, Y or Z axis of the given angle (in radians)
+CQuaternion QuaternionRotationX(float x);
+CQuaternion QuaternionRotationY(float y);
+CQuaternion QuaternionRotationZ(float z);
+
+// Return a quaternion for the given Euler angles, in the same order as the rest of the code
+// uses (Z then X then Y), so it matches MatrixRotationZ(z) * MatrixRotationX(x) * MatrixRotationY(y)
+CQuaternion QuaternionFromEulerAngles(const CVector3& angles);
+
+
+// Dot product of two quaternions
+float Dot(const CQuaternion& q1, const CQuaternion& q2);
+
+// Return the conjugate of a quaternion - for a unit quaternion this is the inverse rotation
+CQuaternion Conjugate(const CQuaternion& q);
+
+// Return unit length quaternion in the same direction as the given one. A zero length
+// quaternion is returned as the identity (no rotation)
+CQuaternion Normalise(const CQuaternion& q);
+
+// Returns length of a quaternion
+float Length(const CQuaternion& q);
+
+
+// Normalised linear interpolation between two unit quaternions, t from 0 to 1. Cheaper than
+// slerp, but the rotation speed is not constant over the interpolation
+CQuaternion Nlerp(const CQuaternion& q1, const CQuaternion& q2, float t);
+
+// Spherical linear interpolation between two unit quaternions, t from 0 to 1. Rotates at a
+// constant speed. Both functions take the shortest path between the two rotations
+CQuaternion Slerp(const CQuaternion& q1, const CQuaternion& q2, float t);
+
+
+/*-----------------------------------------------------------------------------------------
+    Conversion to and from matrices
+-----------------------------------------------------------------------------------------*/
+
+// Return a rotation matrix holding the given unit quaternion
+CMatrix4x4 MatrixFromQuaternion(const CQuaternion& q);
+
+// Return the rotation held in the given matrix as a quaternion. Any scaling in the matrix
+// is removed first, the position is ignored
+CQuaternion QuaternionFromMatrix(const CMatrix4x4& m);
+
+// Return a matrix that scales, then rotates, then translates, i.e. the same as
+// MatrixScaling(scale) * MatrixFromQuaternion(rotation) * MatrixTranslation(position),
+// but built directly without any matrix multiplies
+CMatrix4x4 MatrixTransform(const CVector3& position, const CQuaternion& rotation, const CVector3& scale);
+
+// Split an affine matrix (without shear) into position, rotation and scale - the reverse of
+// MatrixTransform. A mirroring matrix is returned as a negative X scale
+void DecomposeMatrix(const CMatrix4x4& m, CVector3& position, CQuaternion& rotation, CVector3& scale);
+
+
+#endif // _CQUATERNION_H_DEFINED_
@@ -0,0 +1,187 @@
+//--------------------------------------------------------------------------------------
+// Triangle tree - bounding volume tree over the triangles of a mesh for ray picking
+//--------------------------------------------------------------------------------------
+
+#include "CTriangleTree.h"
+#include "MathSIMD.h"
+#include <cfloat>
+
+
+/*-----------------------------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------------------------*/
+
+namespace
+{
+    // Read the nth index from 2 or 4 byte index data
+    inline uint32_t ReadIndex(const void* indices, std::size_t indexSize, uint32_t n)
+    {
+        if (indexSize == 2)  return static_cast<const uint16_t*>(indices)[n];
+        return static_cast<const uint32_t*>(indices)[n];
+    }
+
+    // Position of the nth vertex
+    inline const CVector3& ReadVertex(const void* vertices, std::size_t vertexStride, uint32_t n)
+    {
+        return *reinterpret_cast<const CVector3*>(static_cast<const unsigned char*>(vertices) + n * vertexStride);
+    }
+}
+
+const uint32_t CTriangleTree::kNoTriangle;
+
+
+/*-----------------------------------------------------------------------------------------
+    Building
+-----------------------------------------------------------------------------------------*/
+
+// Build the tree from a triangle list
+void CTriangleTree::Build(const void* vertices, std::size_t vertexStride, const void* indices, std::size_t indexSize,
+                          uint32_t numIndices)
+{
+    uint32_t numTriangles = numIndices / 3;
+    std::vector<CBoundingBox> boxes(numTriangles);
+    for (uint32_t t = 0; t < numTriangles; ++t)
+    {
+        boxes[t] = CBoundingBox::Empty();
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            boxes[t].Include(ReadVertex(vertices, vertexStride, ReadIndex(indices, indexSize, t * 3 + corner)));
+        }
+    }
+    mTree.Build(boxes.data(), numTriangles);
+
+    // Copy the triangles in leaf order
+    uint32_t numPositions = mTree.NumLeafItems();
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        mVertex0[axis].assign(numTriangles + 3, 0.0f);
+        mEdge1[axis].assign(numTriangles + 3, 0.0f);
+        mEdge2[axis].assign(numTriangles + 3, 0.0f);
+    }
+    for (uint32_t position = 0; position < numPositions; ++position)
+    {
+        uint32_t t = mTree.LeafItem(position);
+        const CVector3& v0 = ReadVertex(vertices, vertexStride, ReadIndex(indices, indexSize, t * 3 + 0));
+        CVector3 edge1 = ReadVertex(vertices, vertexStride, ReadIndex(indices, indexSize, t * 3 + 1)) - v0;
+        CVector3 edge2 = ReadVertex(vertices, vertexStride, ReadIndex(indices, indexSize, t * 3 + 2)) - v0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            mVertex0[axis][position] = (&v0.x)[axis];
+            mEdge1[axis][position] = (&edge1.x)[axis];
+            mEdge2[axis][position] = (&edge2.x)[axis];
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Queries
+-----------------------------------------------------------------------------------------*/
+
+// Nearest triangle hit by a ray, or kNoTriangle if none
+uint32_t CTriangleTree::RayCast(const CVector3& origin, const CVector3& direction, float& distance) const
+{
+    uint32_t hitTriangle = kNoTriangle;
+    mTree.RayCastLeaves(origin, direction, distance, [&](uint32_t firstPosition, uint32_t numTriangles, float maxDistance)
+    {
+        uint32_t hitPosition;
+        float hitDistance = RayCastLeaf(origin, direction, firstPosition, numTriangles, maxDistance, hitPosition);
+        if (hitDistance < maxDistance)  hitTriangle = mTree.LeafItem(hitPosition);
+        return hitDistance;
+    });
+    return hitTriangle;
+}
+
+
+// Test a ray against the triangles in the given positions. Uses the barycentric coordinates of the point where the ray
+// meets each triangle's plane, which must all be positive for a hit (T. Moller & B. Trumbore, Fast, Minimum Storage
+// Ray/Triangle Intersection, 1997). A zero determinant means the ray is parallel to the triangle
+float CTriangleTree::RayCastLeaf(const CVector3& origin, const CVector3& direction, uint32_t firstPosition,
+                                 uint32_t numTriangles, float maxDistance, uint32_t& hitPosition) const
+{
+#if defined(MATH_SSE)
+    // Four triangles at once, the arrays are padded so there are always four to load
+    __m128 v0x = _mm_loadu_ps(&mVertex0[0][firstPosition]);
+    __m128 v0y = _mm_loadu_ps(&mVertex0[1][firstPosition]);
+    __m128 v0z = _mm_loadu_ps(&mVertex0[2][firstPosition]);
+    __m128 e1x = _mm_loadu_ps(&mEdge1[0][firstPosition]);
+    __m128 e1y = _mm_loadu_ps(&mEdge1[1][firstPosition]);
+    __m128 e1z = _mm_loadu_ps(&mEdge1[2][firstPosition]);
+    __m128 e2x = _mm_loadu_ps(&mEdge2[0][firstPosition]);
+    __m128 e2y = _mm_loadu_ps(&mEdge2[1][firstPosition]);
+    __m128 e2z = _mm_loadu_ps(&mEdge2[2][firstPosition]);
+    __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+
+    // p = direction x edge2, determinant = edge1 . p
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 invDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+    // s = origin - vertex0, u = (s . p) / determinant
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), v0x);
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), v0y);
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), v0z);
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDeterminant);
+
+    // q = s x edge1, v = (direction . q) / determinant, distance = (edge2 . q) / determinant
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDeterminant);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDeterminant);
+
+    // All comparisons are false for NaNs, so parallel rays (infinite 1/determinant) fail the tests
+    __m128 zero = _mm_setzero_ps();
+    __m128 hit = _mm_cmpneq_ps(determinant, zero);
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_set1_ps(maxDistance)));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(static_cast<float>(numTriangles))));
+
+    int hitMask = _mm_movemask_ps(hit);
+    if (hitMask == 0)  return maxDistance;
+
+    alignas(16) float distances[4];
+    _mm_store_ps(distances, t);
+    float nearest = maxDistance;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        if ((hitMask & (1 << i)) && distances[i] < nearest)
+        {
+            nearest = distances[i];
+            hitPosition = firstPosition + i;
+        }
+    }
+    return nearest;
+
+#else
+    float nearest = maxDistance;
+    for (uint32_t position = firstPosition; position < firstPosition + numTriangles; ++position)
+    {
+        CVector3 edge1 = { mEdge1[0][position], mEdge1[1][position], mEdge1[2][position] };
+        CVector3 edge2 = { mEdge2[0][position], mEdge2[1][position], mEdge2[2][position] };
+        CVector3 p = Cross(direction, edge2);
+        float determinant = Dot(edge1, p);
+        if (determinant == 0)  continue;
+        float invDeterminant = 1.0f / determinant;
+
+        CVector3 s = origin - CVector3{ mVertex0[0][position], mVertex0[1][position], mVertex0[2][position] };
+        float u = Dot(s, p) * invDeterminant;
+        if (u < 0 || u > 1)  continue;
+        CVector3 q = Cross(s, edge1);
+        float v = Dot(direction, q) * invDeterminant;
+        if (v < 0 || u + v > 1)  continue;
+        float t = Dot(edge2, q) * invDeterminant;
+        if (t >= 0 && t < nearest)
+        {
+            nearest = t;
+            hitPosition = position;
+        }
+    }
+    return nearest;
+#endif
+}
@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// Triangle tree - bounding volume tree over the triangles of a mesh for ray picking
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Built once from indexed triangle list data, e.g. when a mesh is loaded, and then only queried. The tree itself is a
+// CBoundingVolumeTree over the triangles' boxes. The triangles are copied in the tree's leaf order, with one array
+// per component, so the (up to four) triangles in a leaf can be tested against a ray at the same time with SIMD
+// where available (see MathSIMD.h). Triangles are hit from either side
+
+#ifndef _CTRIANGLE_TREE_H_DEFINED_
+#define _CTRIANGLE_TREE_H_DEFINED_
+
+#include "CBoundingVolumeTree.h"
+#include "CVector3.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+
+class CTriangleTree
+{
+public:
+    // Returned by RayCast when nothing is hit
+    static const uint32_t kNoTriangle = ~0u;
+
+    // Build the tree from a triangle list. The position is the first thing in each vertex, the vertices are
+    // vertexStride bytes apart so they can be read straight from vertex data. Indexes are 2 or 4 bytes each
+    void Build(const void* vertices, std::size_t vertexStride, const void* indices, std::size_t indexSize,
+               uint32_t numIndices);
+
+    // Nearest triangle hit by a ray, or kNoTriangle if none. Triangles are numbered in index order (the triangle
+    // using indexes 3n to 3n+2 is triangle n). The distance passed is the maximum distance to search and is updated
+    // to the distance to the hit, in units of the direction's length
+    uint32_t RayCast(const CVector3& origin, const CVector3& direction, float& distance) const;
+
+    uint32_t NumTriangles() const  { return mTree.NumItems(); }
+
+    // The triangles in leaf order (which is not index order) for other per-triangle work, e.g. see COcclusionBuffer.
+    // Each is its first vertex and the edges from there to the other two, with one array for each of x, y and z. The
+    // arrays are padded with degenerate triangles so four can be read from any position below NumTriangles()
+    const float* Vertex0(int axis) const  { return mVertex0[axis].data(); }
+    const float* Edge1(int axis) const    { return mEdge1[axis].data(); }
+    const float* Edge2(int axis) const    { return mEdge2[axis].data(); }
+
+
+private:
+    // Test a ray against the triangles in the given positions of the arrays below (at most four). Returns the distance
+    // to the nearest hit before maxDistance, giving its position, or a distance of at least maxDistance for a miss
+    float RayCastLeaf(const CVector3& origin, const CVector3& direction, uint32_t firstPosition, uint32_t numTriangles,
+                      float maxDistance, uint32_t& hitPosition) const;
+
+    CBoundingVolumeTree mTree;
+
+    // Triangles in the tree's leaf order as the first vertex and the two edges from it, the values used by the
+    // intersection test. One array for each of x, y and z, padded so four triangles can always be loaded
+    std::vector<float> mVertex0[3];
+    std::vector<float> mEdge1[3];
+    std::vector<float> mEdge2[3];
+};
+
+
+#endif // _CTRIANGLE_TREE_H_DEFINED_
@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+// SIMD selection for the maths classes
+//--------------------------------------------------------------------------------------
+// The instruction set is chosen at compile time from the compiler's target settings.
+// Every SIMD path has a scalar fallback, define MATH_NO_SIMD in the project settings to
+// force the scalar code (useful for comparing results or timings)
+
+#ifndef _MATH_SIMD_H_DEFINED_
+#define _MATH_SIMD_H_DEFINED_
+
+#if !defined(MATH_NO_SIMD)
+	// SSE2 is always present on x64, on Win32 it depends on the /arch setting
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define MATH_SSE
+	#endif
+
+	// AVX only when explicitly targeted (/arch:AVX or above)
+	#if defined(MATH_SSE) && defined(__AVX__)
+		#define MATH_AVX
+	#endif
+#endif
+
+#if defined(MATH_AVX)
+	#include <immintrin.h>
+#elif defined(MATH_SSE)
+	#include <emmintrin.h>
+#endif
+
+
+#if defined(MATH_SSE)
+
+// Broadcast a single element (0-3) of a SIMD vector to all four elements
+#define MATH_SPLAT(v, i) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(i, i, i, i))
+
+// Return the row vector v transformed by the matrix with rows r0-r3: v.x*r0 + v.y*r1 + v.z*r2 + v.w*r3
+inline __m128 SIMDTransformRow(const __m128 v, const __m128 r0, const __m128 r1, const __m128 r2, const __m128 r3)
+{
+	__m128 out =           _mm_mul_ps(MATH_SPLAT(v, 0), r0);
+	out = _mm_add_ps(out, _mm_mul_ps(MATH_SPLAT(v, 1), r1));
+	out = _mm_add_ps(out, _mm_mul_ps(MATH_SPLAT(v, 2), r2));
+	out = _mm_add_ps(out, _mm_mul_ps(MATH_SPLAT(v, 3), r3));
+	return out;
+}
+
+// Cross product of the x,y,z elements of two SIMD vectors, w of the result is 0
+inline __m128 SIMDCross(const __m128 a, const __m128 b)
+{
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Dot product of the x,y,z elements of two SIMD vectors, result in all four elements
+inline __m128 SIMDDot3(const __m128 a, const __m128 b)
+{
+	__m128 p = _mm_mul_ps(a, b);
+	return _mm_add_ps(_mm_add_ps(MATH_SPLAT(p, 0), MATH_SPLAT(p, 1)), MATH_SPLAT(p, 2));
+}
+
+// Dot product of all four elements of two SIMD vectors, result in all four elements
+inline __m128 SIMDDot4(const __m128 a, const __m128 b)
+{
+	__m128 p = _mm_mul_ps(a, b);
+	p = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// Load four consecutive CVector3 (12 floats) and split them into separate x, y and z vectors
+inline void SIMDLoadVector3x4(const float* p, __m128& x, __m128& y, __m128& z)
+{
+	__m128 a = _mm_loadu_ps(p);     // x0 y0 z0 x1
+	__m128 b = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+	__m128 c = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+	x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// Reverse of the above - interleave separate x, y and z vectors into four consecutive CVector3
+inline void SIMDStoreVector3x4(float* p, const __m128 x, const __m128 y, const __m128 z)
+{
+	__m128 a = _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	_mm_storeu_ps(p,     a);
+	_mm_storeu_ps(p + 4, b);
+	_mm_storeu_ps(p + 8, c);
+}
+
+#endif // MATH_SSE
+
+
+#endif // _MATH_SIMD_H_DEFINED_
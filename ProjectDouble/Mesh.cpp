@@ -6,7 +6,10 @@
 // expected to select these things. A later lab will introduce a more robust loader.
 
 #include "Mesh.h"
-#include "Shader.h" // Needed for helper function CreateSignatureForVertexLayout
+#include "MeshCache.h"
+#include "GeometryArena.h"
+#include "InstanceBuffer.h"
+#include "RenderDevice.h"
 #include "GraphicsHelpers.h" // Helper functions to unclutter the code here
 #include "CVector2.h" 
 #include "CVector3.h" 
@@ -17,18 +20,89 @@
 #include <assimp/DefaultLogger.hpp>
 
 #include <memory>
+#include <mutex>
+
+
+// Number of imports currently using the assimp logger, see ImportMesh
+static std::mutex gAssimpLoggerMutex;
+static int        gAssimpLoggerUsers = 0;
 
 
 // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
 // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
 // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
+// The imported data is written to a cache file, later loads use that file and skip assimp (see MeshCache.h)
+// To load on a worker thread pass false for createGPUResources, the constructor then only reads and processes the
+// file (no DirectX calls) and CreateGPUResources must be called afterwards on the main thread
+Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/, bool createGPUResources /*= true*/)
 {
-	Assimp::Importer importer;
+	mFileName = fileName;
+
+	unsigned int assimpFlags, removeComponents;
+	GetImportFlags(requireTangents, assimpFlags, removeComponents);
+
+	// The cache file is only used if it was written for the current contents of the mesh file and the same import flags
+	MeshCacheHeader cacheHeader;
+	bool canCache = MakeMeshCacheHeader(fileName, assimpFlags, removeComponents, cacheHeader);
+	std::string cacheFileName = canCache ? MeshCacheFileName(fileName) : "";
+
+	// The sub-mesh data points into the cache file or the import storage, both are kept until the sub-meshes are created
+	mPendingCacheFile = std::make_unique<MappedFile>();
+	bool loadedFromCache = false;
+	if (canCache && mPendingCacheFile->Open(cacheFileName))
+	{
+		try
+		{
+			loadedFromCache = ReadCache(*mPendingCacheFile, cacheHeader, mPendingSubMeshes);
+		}
+		catch (const std::exception&)
+		{
+			// Corrupt cache file - ignore it, it will be replaced below
+		}
+	}
+
+	if (!loadedFromCache)
+	{
+		mPendingCacheFile->Close(); // Must close before the file can be rewritten
+		mNodes.clear();
+		mPendingSubMeshes.clear();
+		ImportMesh(fileName, requireTangents, assimpFlags, removeComponents, mPendingSubMeshes, mPendingImportStorage);
+		if (canCache)  WriteCache(cacheFileName, cacheHeader, mPendingSubMeshes);
+	}
+	CalculateBounds(mPendingSubMeshes);
+	BuildTriangleTrees(mPendingSubMeshes);
 
+	if (createGPUResources)
+	{
+		CreateGPUResources();
+	}
+}
+
+
+// Second stage of loading when the constructor was called with createGPUResources false. Adds the geometry to the
+// shared vertex / index buffers and loads the textures. Will throw a std::runtime_error exception on failure
+void Mesh::CreateGPUResources()
+{
+	mSubMeshes.resize(mPendingSubMeshes.size());
+	for (unsigned int m = 0; m < mPendingSubMeshes.size(); ++m)
+	{
+		CreateSubMesh(mPendingSubMeshes[m], mSubMeshes[m], mFileName);
+	}
+
+	// The GPU now has its own copy of the data
+	mPendingSubMeshes.clear();
+	mPendingCacheFile.reset();
+	mPendingImportStorage.clear();
+}
+
+
+// Get the assimp flags used to import a mesh file with or without tangents
+// The settings in ImportMesh also affect the import, kMeshCacheVersion must be increased if they are changed
+void Mesh::GetImportFlags(bool requireTangents, unsigned int& assimpFlags, unsigned int& removeComponents)
+{
 	// Flags for processing the mesh. Assimp provides a huge amount of control - right click any of these
 	// and "Peek Definition" to see documention above each constant
-	unsigned int assimpFlags = aiProcess_MakeLeftHanded |
+	assimpFlags = aiProcess_MakeLeftHanded |
 		aiProcess_GenSmoothNormals |
 		aiProcess_FixInfacingNormals |
 		aiProcess_GenUVCoords |
@@ -50,7 +124,7 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 		aiProcess_RemoveComponent;
 
 	// Flags to specify what mesh data to ignore
-	int removeComponents = aiComponent_LIGHTS | aiComponent_CAMERAS  | aiComponent_COLORS |
+	removeComponents = aiComponent_LIGHTS | aiComponent_CAMERAS  | aiComponent_COLORS |
 		aiComponent_ANIMATIONS ;
 
 	// Add / remove tangents as required by user
@@ -62,6 +136,14 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 	{
 		removeComponents |= aiComponent_TANGENTS_AND_BITANGENTS;
 	}
+}
+
+
+// Import a mesh file with assimp. Fills in the nodes and the CPU-side sub-mesh data, the geometry is held in the given storage
+void Mesh::ImportMesh(const std::string& fileName, bool requireTangents, unsigned int assimpFlags, unsigned int removeComponents,
+                      std::vector<SubMeshData>& subMeshData, std::vector<std::unique_ptr<unsigned char[]>>& storage)
+{
+	Assimp::Importer importer;
 
 	// Other miscellaneous settings
 	importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f); // Smoothing angle for normals
@@ -77,10 +159,17 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 
 	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removeComponents);
 
-	// Import mesh with assimp given above requirements - log output
-	Assimp::DefaultLogger::create("", Assimp::DefaultLogger::VERBOSE);
+	// Import mesh with assimp given above requirements - log output. The logger is shared by all imports, so when
+	// meshes are loaded on several threads it is created by the first import to start and removed by the last to finish
+	{
+		std::lock_guard<std::mutex> lock(gAssimpLoggerMutex);
+		if (gAssimpLoggerUsers++ == 0)  Assimp::DefaultLogger::create("", Assimp::DefaultLogger::VERBOSE);
+	}
 	const aiScene* scene = importer.ReadFile(fileName, assimpFlags);
-	Assimp::DefaultLogger::kill();
+	{
+		std::lock_guard<std::mutex> lock(gAssimpLoggerMutex);
+		if (--gAssimpLoggerUsers == 0)  Assimp::DefaultLogger::kill();
+	}
 	if (scene == nullptr)  throw std::runtime_error("Error loading mesh (" + fileName + "). " + importer.GetErrorString());
 	if (scene->mNumMeshes == 0)  throw std::runtime_error("No usable geometry in mesh: " + fileName);
 
@@ -105,36 +194,34 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 
 
 	// A mesh is made of sub-meshes, each one can have a different material (texture)
-	// Import each sub-mesh in the file to seperate index / vertex buffer (could share buffers between sub-meshes but that would make things more complex)
-	mSubMeshes.resize(scene->mNumMeshes);
+	// Import each sub-mesh in the file to seperate index / vertex data (GPU buffers are created later in CreateSubMesh)
+	subMeshData.resize(scene->mNumMeshes);
 	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
 	{
 		aiMesh* assimpMesh = scene->mMeshes[m];
 		std::string subMeshName = assimpMesh->mName.C_Str();
-		auto& subMesh = mSubMeshes[m]; // Short name for the submesh we're currently preparing - makes code below more readable
+		auto& subMesh = subMeshData[m]; // Short name for the submesh we're currently preparing - makes code below more readable
 
 
 		//-----------------------------------
 
 		// Check for presence of position and normal data. Tangents and UVs are optional.
-		std::vector<D3D11_INPUT_ELEMENT_DESC> vertexElements;
 		unsigned int offset = 0;
 
 		if (!assimpMesh->HasPositions())  throw std::runtime_error("No position data for sub-mesh " + subMeshName + " in " + fileName);
 		unsigned int positionOffset = offset;
-		vertexElements.push_back({ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, positionOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
 		offset += 12;
 
 		if (!assimpMesh->HasNormals())  throw std::runtime_error("No normal data for sub-mesh " + subMeshName + " in " + fileName);
 		unsigned int normalOffset = offset;
-		vertexElements.push_back({ "normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, normalOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		subMesh.vertexComponents |= VertexNormal;
 		offset += 12;
 
 		unsigned int tangentOffset = offset;
 		if (requireTangents)
 		{
 			if (!assimpMesh->HasTangentsAndBitangents())  throw std::runtime_error("No tangent data for sub-mesh " + subMeshName + " in " + fileName);
-			vertexElements.push_back({ "tangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, tangentOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+			subMesh.vertexComponents |= VertexTangent;
 			offset += 12;
 		}
 
@@ -142,40 +229,34 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 		if (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0))
 		{
 			if (assimpMesh->mNumUVComponents[0] != 2)  throw std::runtime_error("Unsupported texture coordinates in " + subMeshName + " in " + fileName);
-			vertexElements.push_back({ "uv", 0, DXGI_FORMAT_R32G32_FLOAT, 0, uvOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+			subMesh.vertexComponents |= VertexUV;
 			offset += 8;
 		}
 
 		unsigned int bonesOffset = offset;
 		if (mHasBones)
 		{
-			vertexElements.push_back({ "bones"  , 0, DXGI_FORMAT_R8G8B8A8_UINT,      0, bonesOffset,     D3D11_INPUT_PER_VERTEX_DATA, 0 });
-			offset += 4;
-			vertexElements.push_back({ "weights", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, bonesOffset + 4, D3D11_INPUT_PER_VERTEX_DATA, 0 });
-			offset += 16;
+			subMesh.vertexComponents |= VertexBones;
+			offset += 20;
 		}
 
 		subMesh.vertexSize = offset;
 
 
-		// Create a "vertex layout" to describe to DirectX what is data in each vertex of this mesh
-		auto shaderSignature = CreateSignatureForVertexLayout(vertexElements.data(), static_cast<int>(vertexElements.size()));
-		HRESULT hr = gD3DDevice->CreateInputLayout(vertexElements.data(), static_cast<UINT>(vertexElements.size()),
-			shaderSignature->GetBufferPointer(), shaderSignature->GetBufferSize(),
-			&subMesh.vertexLayout);
-		if (shaderSignature)  shaderSignature->Release();
-		if (FAILED(hr))  throw std::runtime_error("Failure creating input layout for " + fileName);
-
-
-
 		//-----------------------------------
 
 		// Create CPU-side buffers to hold current mesh data - exact content is flexible so can't use a structure for a vertex - so just a block of bytes
 		// Note: for large arrays a unique_ptr is better than a vector because vectors default-initialise all the values which is a waste of time.
+		// Use 16-bit indices when there are few enough vertices, halving the size of the index buffer
 		subMesh.numVertices = assimpMesh->mNumVertices;
 		subMesh.numIndices = assimpMesh->mNumFaces * 3;
-		auto vertices = std::make_unique<unsigned char[]>(subMesh.numVertices * subMesh.vertexSize);
-		auto indices  = std::make_unique<unsigned char[]>(subMesh.numIndices * 4); // Using 32 bit indexes (4 bytes) for each indeex
+		subMesh.indexSize = (subMesh.numVertices <= 0x10000) ? 2 : 4;
+		storage.push_back(std::make_unique<unsigned char[]>(subMesh.numVertices * subMesh.vertexSize));
+		unsigned char* vertices = storage.back().get();
+		storage.push_back(std::make_unique<unsigned char[]>(subMesh.numIndices * subMesh.indexSize));
+		unsigned char* indices = storage.back().get();
+		subMesh.vertices = vertices;
+		subMesh.indices = indices;
 
 
 		//-----------------------------------
@@ -183,7 +264,7 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 		// Copy mesh data from assimp to our CPU-side vertex buffer
 
 		CVector3* assimpPosition = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
-		unsigned char* position = vertices.get() + positionOffset;
+		unsigned char* position = vertices + positionOffset;
 		unsigned char* positionEnd = position + subMesh.numVertices * subMesh.vertexSize;
 		while (position != positionEnd)
 		{
@@ -193,7 +274,7 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 		}
 
 		CVector3* assimpNormal = reinterpret_cast<CVector3*>(assimpMesh->mNormals);
-		unsigned char* normal = vertices.get() + normalOffset;
+		unsigned char* normal = vertices + normalOffset;
 		unsigned char* normalEnd = normal + subMesh.numVertices * subMesh.vertexSize;
 		while (normal != normalEnd)
 		{
@@ -205,7 +286,7 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 		if (requireTangents)
 		{
 			CVector3* assimpTangent = reinterpret_cast<CVector3*>(assimpMesh->mTangents);
-			unsigned char* tangent = vertices.get() + tangentOffset;
+			unsigned char* tangent = vertices + tangentOffset;
 			unsigned char* tangentEnd = tangent + subMesh.numVertices * subMesh.vertexSize;
 			while (tangent != tangentEnd)
 			{
@@ -218,7 +299,7 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 		if (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0))
 		{
 			aiVector3D* assimpUV = assimpMesh->mTextureCoords[0];
-			unsigned char* uv = vertices.get() + uvOffset;
+			unsigned char* uv = vertices + uvOffset;
 			unsigned char* uvEnd = uv + subMesh.numVertices * subMesh.vertexSize;
 			while (uv != uvEnd)
 			{
@@ -234,7 +315,7 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 			if (assimpMesh->HasBones())
 			{
 				// Set all bones and weights to 0 to start with
-				unsigned char* bones = vertices.get() + bonesOffset;
+				unsigned char* bones = vertices + bonesOffset;
 				unsigned char* bonesEnd = bones + subMesh.numVertices * subMesh.vertexSize;
 				while (bones != bonesEnd)
 				{
@@ -248,7 +329,7 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 				}
 
 				// Go through each assimp bone
-				bones = vertices.get() + bonesOffset;
+				bones = vertices + bonesOffset;
 				for (unsigned int i = 0; i < assimpMesh->mNumBones; ++i)
 				{
 					// Get offset matrix for the bone (transform from skinned mesh root to bone root
@@ -300,7 +381,7 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 					}
 				}
 
-				unsigned char* bones = vertices.get() + bonesOffset;
+				unsigned char* bones = vertices + bonesOffset;
 				unsigned char* bonesEnd = bones + subMesh.numVertices * subMesh.vertexSize;
 				while (bones != bonesEnd)
 				{
@@ -320,155 +401,253 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 		// Copy face data from assimp to our CPU-side index buffer
 		if (!assimpMesh->HasFaces())  throw std::runtime_error("No face data in " + subMeshName + " in " + fileName);
 
-		DWORD* index = reinterpret_cast<DWORD*>(indices.get());
-		for (unsigned int face = 0; face < assimpMesh->mNumFaces; ++face)
+		if (subMesh.indexSize == 2)
 		{
-			*index++ = assimpMesh->mFaces[face].mIndices[0];
-			*index++ = assimpMesh->mFaces[face].mIndices[1];
-			*index++ = assimpMesh->mFaces[face].mIndices[2];
+			uint16_t* index = reinterpret_cast<uint16_t*>(indices);
+			for (unsigned int face = 0; face < assimpMesh->mNumFaces; ++face)
+			{
+				*index++ = static_cast<uint16_t>(assimpMesh->mFaces[face].mIndices[0]);
+				*index++ = static_cast<uint16_t>(assimpMesh->mFaces[face].mIndices[1]);
+				*index++ = static_cast<uint16_t>(assimpMesh->mFaces[face].mIndices[2]);
+			}
+		}
+		else
+		{
+			DWORD* index = reinterpret_cast<DWORD*>(indices);
+			for (unsigned int face = 0; face < assimpMesh->mNumFaces; ++face)
+			{
+				*index++ = assimpMesh->mFaces[face].mIndices[0];
+				*index++ = assimpMesh->mFaces[face].mIndices[1];
+				*index++ = assimpMesh->mFaces[face].mIndices[2];
+			}
 		}
-
-
-		//-----------------------------------
-
-		D3D11_BUFFER_DESC bufferDesc;
-		D3D11_SUBRESOURCE_DATA initData;
-
-		// Create GPU-side vertex buffer and copy the vertices imported by assimp into it
-		bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Indicate it is a vertex buffer
-		bufferDesc.Usage = D3D11_USAGE_DEFAULT;          // Default usage for this buffer - we'll see other usages later
-		bufferDesc.ByteWidth = subMesh.numVertices * subMesh.vertexSize; // Size of the buffer in bytes
-		bufferDesc.CPUAccessFlags = 0;
-		bufferDesc.MiscFlags = 0;
-		initData.pSysMem = vertices.get(); // Fill the new vertex buffer with data loaded by assimp
-
-		hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.vertexBuffer);
-		if (FAILED(hr))  throw std::runtime_error("Failure creating vertex buffer for " + fileName);
-
-
-		// Create GPU-side index buffer and copy the vertices imported by assimp into it
-		bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; // Indicate it is an index buffer
-		bufferDesc.Usage = D3D11_USAGE_DEFAULT;         // Default usage for this buffer - we'll see other usages later
-		bufferDesc.ByteWidth = subMesh.numIndices * sizeof(DWORD); // Size of the buffer in bytes
-		bufferDesc.CPUAccessFlags = 0;
-		bufferDesc.MiscFlags = 0;
-		initData.pSysMem = indices.get(); // Fill the new index buffer with data loaded by assimp
-
-		hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.indexBuffer);
-		if (FAILED(hr))  throw std::runtime_error("Failure creating index buffer for " + fileName);
 	}
+
+	// Get texture names from the materials. Textures are loaded in CreateSubMesh
 	if (scene->HasMaterials())
 	{
-		for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+		for (unsigned int i = 0; i < scene->mNumMaterials && i < scene->mNumMeshes; ++i)
 		{
 			aiMaterial* mainMaterial = scene->mMaterials[i];//Get current material
-			aiString materialName;//The name of the materials found in the name
-			aiReturn ret;//Load failed/sucessful
-
-			ret = mainMaterial->Get(AI_MATKEY_NAME, materialName);//Material name passed  
-			if (ret != AI_SUCCESS)materialName = "";//Failed to pass material name
-
-			//DiffuseMaps
-			int numOfTextures = mainMaterial->GetTextureCount(aiTextureType_DIFFUSE);//Diffuse texture count
 			aiString textureName;//aiString assimp structure
 
-			if (numOfTextures > 0)
+			//DiffuseMaps
+			if (mainMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0 &&
+				mainMaterial->Get(AI_MATKEY_TEXTURE(aiTextureType_DIFFUSE, 0), textureName) == AI_SUCCESS)
 			{
-				//Create a diffuse map using texture name from the document
-
-				ret = mainMaterial->Get(AI_MATKEY_TEXTURE(aiTextureType_DIFFUSE, 0), textureName);
-				std::string textureFileName = textureName.data;//The actual name of the texture file
-
-				//Loads filename into diffuse map
-				if (!LoadTexture(".\\Media\\Textures\\" + textureFileName, &mSubMeshes[i].diffuseMap, &mSubMeshes[i].diffuseMapSRV))
-				{
-					throw std::runtime_error("Diffuse texture for mesh NOT loaded");
-				}
+				subMeshData[i].diffuseMap = textureName.data;//The actual name of the texture file
 			}
 			//Normal maps
-			numOfTextures = mainMaterial->GetTextureCount(aiTextureType_NORMALS);
-			if (numOfTextures > 0)
+			if (mainMaterial->GetTextureCount(aiTextureType_NORMALS) > 0 &&
+				mainMaterial->Get(AI_MATKEY_TEXTURE(aiTextureType_NORMALS, 0), textureName) == AI_SUCCESS)
 			{
-				ret = mainMaterial->Get(AI_MATKEY_TEXTURE(aiTextureType_NORMALS, 0), textureName);
-
-				
-				std::string textureFileName = textureName.data;//The actual name of the texture file
-
-				//Loads filename intonormal map
-				if (!LoadTexture(".\\Media\\Textures\\" + textureFileName, &mSubMeshes[i].normalMap, &mSubMeshes[i].normalMapSRV))
-				{
-					throw std::runtime_error("Normal texture for mesh NOT loaded");
-				}
-
+				subMeshData[i].normalMap = textureName.data;
 			}
-
-			numOfTextures = mainMaterial->GetTextureCount(aiTextureType_SPECULAR);
-			if (numOfTextures > 0)
+			//Specular maps
+			if (mainMaterial->GetTextureCount(aiTextureType_SPECULAR) > 0 &&
+				mainMaterial->Get(AI_MATKEY_TEXTURE(aiTextureType_SPECULAR, 0), textureName) == AI_SUCCESS)
 			{
-				ret = mainMaterial->Get(AI_MATKEY_TEXTURE(aiTextureType_SPECULAR, 0), textureName);
+				subMeshData[i].specularMap = textureName.data;
+			}
+		}
+	}
+}
 
 
-				std::string textureFileName = textureName.data;//The actual name of the texture file
+// Read the nodes and the CPU-side sub-mesh data from a cache file, which must stay open until the sub-meshes are created.
+// Returns false if the cache file is not for the given header or is damaged. Throws a std::runtime_error if the data
+// is inconsistent
+bool Mesh::ReadCache(const MappedFile& cacheFile, const MeshCacheHeader& header, std::vector<SubMeshData>& subMeshData)
+{
+	if (!CheckMeshCacheFile(cacheFile.Data(), cacheFile.Size(), header))
+	{
+		return false; // Different version, source file or import flags, or a damaged body
+	}
+	MeshCacheReader reader(cacheFile.Data() + sizeof(MeshCacheHeader), cacheFile.Size() - sizeof(MeshCacheHeader));
 
-				//Loads filename intonormal map
-				if (!LoadTexture(".\\Media\\Textures\\" + textureFileName, &mSubMeshes[i].specularMap, &mSubMeshes[i].specularMapSRV))
-				{
-					throw std::runtime_error("Normal texture for mesh NOT loaded");
-				}
+	mHasBones = reader.Read<uint32_t>() != 0;
 
-			}
+	// Smallest sizes in the file of a node and a sub-mesh, i.e. with empty strings and lists
+	const size_t kMinNodeSize = sizeof(uint32_t) + sizeof(float) * 32 + sizeof(uint32_t) * 3;
+	const size_t kMinSubMeshSize = sizeof(uint32_t) * 8;
+
+	mNodes.resize(reader.ReadCount(kMinNodeSize));
+	for (auto& node : mNodes)
+	{
+		node.name = reader.ReadString();
+		node.defaultMatrix.SetValues(reinterpret_cast<const float*>(reader.Read(sizeof(float) * 16)));
+		node.offsetMatrix.SetValues(reinterpret_cast<const float*>(reader.Read(sizeof(float) * 16)));
+		node.parentIndex = reader.Read<uint32_t>();
+		reader.ReadVector(node.childNodes);
+		reader.ReadVector(node.subMeshes);
+	}
+
+	subMeshData.resize(reader.ReadCount(kMinSubMeshSize));
+	for (auto& subMesh : subMeshData)
+	{
+		subMesh.vertexComponents = reader.Read<uint32_t>();
+		subMesh.vertexSize = reader.Read<uint32_t>();
+		subMesh.numVertices = reader.Read<uint32_t>();
+		subMesh.numIndices = reader.Read<uint32_t>();
+		subMesh.indexSize = reader.Read<uint32_t>();
+		subMesh.diffuseMap = reader.ReadString();
+		subMesh.normalMap = reader.ReadString();
+		subMesh.specularMap = reader.ReadString();
+
+		// Vertices and indices are used directly from the mapped file
+		reader.Align();
+		subMesh.vertices = reader.Read(static_cast<size_t>(subMesh.numVertices) * subMesh.vertexSize);
+		reader.Align();
+		subMesh.indices = reader.Read(static_cast<size_t>(subMesh.numIndices) * subMesh.indexSize);
+
+		if (subMesh.vertexSize == 0 || (subMesh.indexSize != 2 && subMesh.indexSize != 4))
+		{
+			throw std::runtime_error("Bad vertex or index size in mesh cache file");
 		}
 	}
+
+	// Nodes refer to each other and to sub-meshes by index, later code uses the indices without checking
+	unsigned int numNodes = static_cast<unsigned int>(mNodes.size());
+	unsigned int numSubMeshes = static_cast<unsigned int>(subMeshData.size());
+	if (numNodes == 0)  throw std::runtime_error("No nodes in mesh cache file");
+	for (auto& node : mNodes)
+	{
+		bool valid = node.parentIndex < numNodes;
+		for (auto child : node.childNodes)  valid = valid && child < numNodes;
+		for (auto subMesh : node.subMeshes)  valid = valid && subMesh < numSubMeshes;
+		if (!valid)  throw std::runtime_error("Bad node or sub-mesh index in mesh cache file");
+	}
+
+	if (!reader.AtEnd())  throw std::runtime_error("Unexpected data at end of mesh cache file");
+	return true;
 }
-//Special mesh that allows to create grid in the XZ plane
-//This function allow to use a 2D grind to render water surface //Not usable to create depth and underwater mechanics 
-Mesh::Mesh(CVector3 minPt, CVector3 maxPt, int subDivX, int subDivZ, bool normals /*= false*/, bool uvs /*= true*/)
+
+
+// Write the nodes and the CPU-side sub-mesh data to a cache file. Failure is ignored, the mesh will just be imported again next time
+void Mesh::WriteCache(const std::string& cacheFileName, const MeshCacheHeader& header, const std::vector<SubMeshData>& subMeshData)
 {
-	// Create a single node, disable skinning
-	mNodes.push_back({ "Grid", MatrixIdentity(), MatrixIdentity(), 0, {}, {0} });
-	mHasBones = false;
+	MeshCacheWriter writer;
+	writer.Write(static_cast<uint32_t>(mHasBones ? 1 : 0));
 
-	mSubMeshes.resize(1); // Grid will be in a single sub-mesh
+	writer.Write(static_cast<uint32_t>(mNodes.size()));
+	for (auto& node : mNodes)
+	{
+		writer.WriteString(node.name);
+		writer.Write(&node.defaultMatrix.e00, sizeof(float) * 16);
+		writer.Write(&node.offsetMatrix.e00, sizeof(float) * 16);
+		writer.Write(static_cast<uint32_t>(node.parentIndex));
+		writer.WriteVector(node.childNodes);
+		writer.WriteVector(node.subMeshes);
+	}
 
-	// Determine vertex layout based on parameters
+	writer.Write(static_cast<uint32_t>(subMeshData.size()));
+	for (auto& subMesh : subMeshData)
+	{
+		writer.Write(static_cast<uint32_t>(subMesh.vertexComponents));
+		writer.Write(static_cast<uint32_t>(subMesh.vertexSize));
+		writer.Write(static_cast<uint32_t>(subMesh.numVertices));
+		writer.Write(static_cast<uint32_t>(subMesh.numIndices));
+		writer.Write(static_cast<uint32_t>(subMesh.indexSize));
+		writer.WriteString(subMesh.diffuseMap);
+		writer.WriteString(subMesh.normalMap);
+		writer.WriteString(subMesh.specularMap);
+
+		writer.Align();
+		writer.Write(subMesh.vertices, static_cast<size_t>(subMesh.numVertices) * subMesh.vertexSize);
+		writer.Align();
+		writer.Write(subMesh.indices, static_cast<size_t>(subMesh.numIndices) * subMesh.indexSize);
+	}
+
+	writer.Save(cacheFileName, header);
+}
+
+
+// Create the GPU-side resources for a sub-mesh: geometry in the shared vertex / index buffers, and textures
+void Mesh::CreateSubMesh(const SubMeshData& data, SubMesh& subMesh, const std::string& fileName)
+{
+	// Describe to DirectX what is data in each vertex of this mesh - must match the order used in ImportMesh
 	std::vector<D3D11_INPUT_ELEMENT_DESC> vertexElements;
 	unsigned int offset = 0;
 
-	unsigned int positionOffset = offset;
-	vertexElements.push_back({ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, positionOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+	vertexElements.push_back({ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
 	offset += 12;
-
-	unsigned int normalOffset = offset;
-	if (normals)
+	if (data.vertexComponents & VertexNormal)
 	{
-		vertexElements.push_back({ "normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, normalOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		vertexElements.push_back({ "normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
 		offset += 12;
 	}
-
-	unsigned int uvOffset = offset;
-	if (uvs)
+	if (data.vertexComponents & VertexTangent)
 	{
-		vertexElements.push_back({ "uv", 0, DXGI_FORMAT_R32G32_FLOAT, 0, uvOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		vertexElements.push_back({ "tangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		offset += 12;
+	}
+	if (data.vertexComponents & VertexUV)
+	{
+		vertexElements.push_back({ "uv", 0, DXGI_FORMAT_R32G32_FLOAT, 0, offset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
 		offset += 8;
 	}
+	if (data.vertexComponents & VertexBones)
+	{
+		vertexElements.push_back({ "bones"  , 0, DXGI_FORMAT_R8G8B8A8_UINT,      0, offset,     D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		vertexElements.push_back({ "weights", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offset + 4, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		offset += 20;
+	}
+	if (offset != data.vertexSize || (data.indexSize != 2 && data.indexSize != 4))
+	{
+		throw std::runtime_error("Inconsistent vertex data for " + fileName);
+	}
 
-	mSubMeshes[0].vertexSize = offset;
+	subMesh.vertexSize = data.vertexSize;
+	subMesh.numVertices = data.numVertices;
+	subMesh.numIndices = data.numIndices;
 
-	// Create a vertex layout object from above array - used by DirectX to understand the data in each vertex of this mesh
-	auto shaderSignature = CreateSignatureForVertexLayout(vertexElements.data(), static_cast<int>(vertexElements.size()));
-	HRESULT hr = gD3DDevice->CreateInputLayout(vertexElements.data(), static_cast<UINT>(vertexElements.size()),
-		shaderSignature->GetBufferPointer(), shaderSignature->GetBufferSize(),
-		&mSubMeshes[0].vertexLayout);
-	if (shaderSignature)  shaderSignature->Release();
-	if (FAILED(hr))  throw std::runtime_error("Failure creating input layout for grid mesh");
+	// Copy the vertices and indices into the shared buffers for this vertex layout (see GeometryArena.h)
+	subMesh.geometry = gGeometryArena.Add(data.vertexComponents, vertexElements, data.vertexSize, data.vertices, data.numVertices,
+	                                     data.indexSize, data.indices, data.numIndices);
 
 
+	//-----------------------------------
+
+	// Load the textures named in the sub-mesh's material
+	if (!data.diffuseMap.empty() &&
+		!LoadTexture(".\\Media\\Textures\\" + data.diffuseMap, &subMesh.diffuseMap, &subMesh.diffuseMapSRV))
+	{
+		throw std::runtime_error("Diffuse texture for mesh NOT loaded");
+	}
+	if (!data.normalMap.empty() &&
+		!LoadTexture(".\\Media\\Textures\\" + data.normalMap, &subMesh.normalMap, &subMesh.normalMapSRV))
+	{
+		throw std::runtime_error("Normal texture for mesh NOT loaded");
+	}
+	if (!data.specularMap.empty() &&
+		!LoadTexture(".\\Media\\Textures\\" + data.specularMap, &subMesh.specularMap, &subMesh.specularMapSRV))
+	{
+		throw std::runtime_error("Specular texture for mesh NOT loaded");
+	}
+}
+
+
+//Special mesh that allows to create grid in the XZ plane
+//This function allow to use a 2D grind to render water surface //Not usable to create depth and underwater mechanics 
+Mesh::Mesh(CVector3 minPt, CVector3 maxPt, int subDivX, int subDivZ, bool normals /*= false*/, bool uvs /*= true*/)
+{
+	// Create a single node, disable skinning
+	mNodes.push_back({ "Grid", MatrixIdentity(), MatrixIdentity(), 0, {}, {0} });
+	mHasBones = false;
+
+	mSubMeshes.resize(1); // Grid will be in a single sub-mesh
+
+	// Determine vertex layout based on parameters, CreateSubMesh uses this to create the DirectX vertex layout
+	SubMeshData data;
+	data.vertexComponents = (normals ? VertexNormal : 0) | (uvs ? VertexUV : 0);
+	data.vertexSize = 12 + (normals ? 12 : 0) + (uvs ? 8 : 0);
+
 
 	//-----------------------------------
 
 	// Allocate space to create the grid vertices (CPU-side first)
-	mSubMeshes[0].numVertices = (subDivX + 1) * (subDivZ + 1);
-	auto vertexData = std::make_unique<char[]>(mSubMeshes[0].numVertices * mSubMeshes[0].vertexSize); // Smart pointer
+	data.numVertices = (subDivX + 1) * (subDivZ + 1);
+	auto vertexData = std::make_unique<unsigned char[]>(data.numVertices * data.vertexSize); // Smart pointer
 
 	// Create the grid vertices (CPU-side), to be passed to the GPU afterwards
 	float xStep = (maxPt.x - minPt.x) / subDivX; // X-size of a single grid square
@@ -508,8 +687,9 @@ Mesh::Mesh(CVector3 minPt, CVector3 maxPt, int subDivX, int subDivZ, bool normal
 
 	// Allocate space to create the grid indices. To keep model rendering code simpler using a triangle
 	// list, even though a strip would work nicely here
-	mSubMeshes[0].numIndices = subDivX * subDivZ * 6; // Two triangles for each grid square
-	auto indexData = std::make_unique<char[]>(mSubMeshes[0].numIndices * 4); // 4 byte integer for each index
+	data.numIndices = subDivX * subDivZ * 6; // Two triangles for each grid square
+	data.indexSize = 4;                      // 4 byte integer for each index
+	auto indexData = std::make_unique<unsigned char[]>(data.numIndices * data.indexSize);
 
 	// Create the grid indexes (CPU-side first)
 	uint32_t tlIndex = 0;
@@ -534,41 +714,19 @@ Mesh::Mesh(CVector3 minPt, CVector3 maxPt, int subDivX, int subDivZ, bool normal
 	}
 
 
-	// Create the vertex buffer and fill it with the loaded vertex data
-	D3D11_BUFFER_DESC bufferDesc;
-	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	bufferDesc.Usage = D3D11_USAGE_DEFAULT; // Not a dynamic buffer
-	bufferDesc.ByteWidth = mSubMeshes[0].numVertices * mSubMeshes[0].vertexSize; // Buffer size
-	bufferDesc.CPUAccessFlags = 0;
-	bufferDesc.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA initData; // Initial data
-	initData.pSysMem = vertexData.get();
-	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, &initData, &mSubMeshes[0].vertexBuffer)))
-	{
-		throw std::runtime_error("Failure creating vertex buffer for grid mesh");
-	}
-
-
-	// Create the index buffer
-	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	bufferDesc.ByteWidth = mSubMeshes[0].numIndices * 4;
-	bufferDesc.CPUAccessFlags = 0;
-	bufferDesc.MiscFlags = 0;
-	initData.pSysMem = indexData.get();
-	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, &initData, &mSubMeshes[0].indexBuffer)))
-	{
-		throw std::runtime_error("Failure creating index buffer for grid mesh");
-	}
+	// Copy the grid into the shared geometry buffers, the grid has no textures
+	data.vertices = vertexData.get();
+	data.indices = indexData.get();
+	CalculateBounds({ data });
+	BuildTriangleTrees({ data });
+	CreateSubMesh(data, mSubMeshes[0], "grid mesh");
 }
 
 Mesh::~Mesh()
 {
 	for (auto& subMesh : mSubMeshes)
 	{
-		if (subMesh.indexBuffer)	subMesh.indexBuffer->Release();
-		if (subMesh.vertexBuffer)	subMesh.vertexBuffer->Release();
-		if (subMesh.vertexLayout)	subMesh.vertexLayout->Release();
+		// The vertex and index data is held in the geometry arena, which lasts until the app closes
 		if (subMesh.normalMap)		subMesh.normalMap->Release();
 		if (subMesh.normalMapSRV)	subMesh.normalMapSRV->Release();
 		if (subMesh.specularMap)	subMesh.specularMap->Release();
@@ -582,73 +740,216 @@ Mesh::~Mesh()
 //--------------------------------------------------------------------------------------
 
 // Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
-void Mesh::RenderSubMesh(const SubMesh& subMesh)
+// Pass a number of instances to draw the sub-mesh instanced (see RenderInstanced), 0 for an ordinary draw
+void Mesh::RenderSubMesh(const SubMesh& subMesh, unsigned int numInstances /*= 0*/)
 {
-	if(SetTexture)gD3DContext->PSSetShaderResources(0, 1, &subMesh.diffuseMapSRV);
-	if (SetTexture)gD3DContext->PSSetShaderResources(9, 1, &subMesh.specularMapSRV);
-	if (SetTexture)gD3DContext->PSSetShaderResources(10, 1, &subMesh.normalMapSRV);
+	if(SetTexture)gRenderDevice->PSSetShaderResources(0, 1, &subMesh.diffuseMapSRV);
+	if (SetTexture)gRenderDevice->PSSetShaderResources(9, 1, &subMesh.specularMapSRV);
+	if (SetTexture)gRenderDevice->PSSetShaderResources(10, 1, &subMesh.normalMapSRV);
+
+	// Render mesh from the shared geometry buffers. The buffers, vertex layout and topology (triangle list) are only set
+	// when this sub-mesh uses a different pool from the last one drawn
+	if (numInstances == 0)  gGeometryArena.Draw(subMesh.geometry);
+	else                    gGeometryArena.DrawInstanced(subMesh.geometry, numInstances);
+}
 
-	// Set vertex buffer as next data source for GPU
-	UINT stride = subMesh.vertexSize;
-	UINT offset = 0;
-	gD3DContext->IASetVertexBuffers(0, 1, &subMesh.vertexBuffer, &stride, &offset);
 
-	// Indicate the layout of vertex buffer
-	gD3DContext->IASetInputLayout(subMesh.vertexLayout);
 
-	// Set index buffer as next data source for GPU, indicate it uses 32-bit integers
-	gD3DContext->IASetIndexBuffer(subMesh.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+// Calculate the absolute (world) matrix of every node from a model's node matrices, which are relative to their parent
+// The output vector is resized if necessary, so the caller can keep it between calls to avoid allocations
+void Mesh::CalculateAbsoluteMatrices(const std::vector<CMatrix4x4>& modelMatrices, std::vector<CMatrix4x4>& absoluteMatrices)
+{
+	absoluteMatrices.resize(modelMatrices.size());
+	absoluteMatrices[0] = modelMatrices[0]; // First matrix for a model is the root matrix, already in world space
+	for (unsigned int nodeIndex = 1; nodeIndex < mNodes.size(); ++nodeIndex)
+	{
+		// Multiply each model matrix by its parent's absolute world matrix (already calculated earlier in this loop)
+		absoluteMatrices[nodeIndex] = modelMatrices[nodeIndex] * absoluteMatrices[mNodes[nodeIndex].parentIndex];
+	}
+}
 
-	// Using triangle lists only in this class
-	gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	// Render mesh
-	gD3DContext->DrawIndexed(subMesh.numIndices, 0, 0);
+// Calculate the bounding volumes of the sub-meshes, nodes and the whole mesh from the vertex positions, which are
+// always at the start of each vertex. Called while loading, before the sub-meshes' GPU resources are created
+void Mesh::CalculateBounds(const std::vector<SubMeshData>& subMeshData)
+{
+	mSubMeshes.resize(subMeshData.size());
+	mBounds = CBoundingBox::Empty();
+	for (unsigned int m = 0; m < subMeshData.size(); ++m)
+	{
+		const SubMeshData& data = subMeshData[m];
+		SubMesh& subMesh = mSubMeshes[m];
+		subMesh.bounds = BoundPoints(data.vertices, data.vertexSize, data.numVertices);
+		subMesh.sphere = BoundPointsSphere(data.vertices, data.vertexSize, data.numVertices, subMesh.bounds);
+		mBounds.Include(subMesh.bounds);
+	}
+
+	std::vector<CBoundingSphere> nodeSpheres;
+	for (auto& node : mNodes)
+	{
+		node.bounds = CBoundingBox::Empty();
+		nodeSpheres.clear();
+		for (auto subMeshIndex : node.subMeshes)
+		{
+			node.bounds.Include(mSubMeshes[subMeshIndex].bounds);
+			nodeSpheres.push_back(mSubMeshes[subMeshIndex].sphere);
+		}
+		node.sphere = EnclosingSphere(nodeSpheres.data(), nodeSpheres.size(), node.bounds);
+	}
 }
 
 
+// Build the triangle tree of each sub-mesh for ray picking. Called while loading, like CalculateBounds. Skinned meshes
+// are left out as the bones move their vertices away from the positions here
+void Mesh::BuildTriangleTrees(const std::vector<SubMeshData>& subMeshData)
+{
+	if (mHasBones)  return;
+	for (unsigned int m = 0; m < subMeshData.size(); ++m)
+	{
+		const SubMeshData& data = subMeshData[m];
+		mSubMeshes[m].triangles.Build(data.vertices, data.vertexSize, data.indices, data.indexSize, data.numIndices);
+	}
+}
+
 
-// Render the mesh with the given matrices
-// Handles rigid body meshes (including single part meshes) as well as skinned meshes
-// LIMITATION: The mesh must use a single texture throughout
-void Mesh::Render(std::vector<CMatrix4x4>& modelMatrices)
+// World space box and sphere containing the mesh when rendered with the given absolute matrices
+void Mesh::WorldBounds(const std::vector<CMatrix4x4>& absoluteMatrices, CBoundingBox& worldBox, CBoundingSphere& worldSphere)
 {
-	// Skinning needs all matrices available in the shader at the same time, so first calculate all the absolute
-	// matrices before rendering anything
-	std::vector<CMatrix4x4> absoluteMatrices(modelMatrices.size());
-	absoluteMatrices[0] = modelMatrices[0]; // First matrix for a model is the root matrix, already in world space
-	for (unsigned int nodeIndex = 1; nodeIndex < mNodes.size(); ++nodeIndex)
+	worldBox = CBoundingBox::Empty();
+	if (mHasBones)
 	{
-		// Multiply each model matrix by its parent's absolute world matrix (already calculated earlier in this loop)
-		// Same process as for rigid bodies, simply done prior to rendering now
-		absoluteMatrices[nodeIndex] = modelMatrices[nodeIndex] * absoluteMatrices[mNodes[nodeIndex].parentIndex];
+		// A skinned vertex is a weighted average of its position transformed by several bone matrices, so it lies inside
+		// the box containing the whole mesh transformed by each of the bone matrices (as used in Render below)
+		unsigned int numBones = NumberNodes();
+		if (numBones > MAX_BONES)  numBones = MAX_BONES;
+		for (unsigned int nodeIndex = 0; nodeIndex < numBones; ++nodeIndex)
+		{
+			worldBox.Include(TransformBox(mBounds, mNodes[nodeIndex].offsetMatrix * absoluteMatrices[nodeIndex]));
+		}
+		worldSphere = SphereFromBox(worldBox);
 	}
+	else
+	{
+		// Rigid nodes each move their own sub-meshes. The sphere is centred on the box and reaches the furthest node sphere
+		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+		{
+			worldBox.Include(TransformBox(mNodes[nodeIndex].bounds, absoluteMatrices[nodeIndex]));
+		}
+		worldSphere = SphereFromBox(worldBox);
+		if (!worldSphere.IsEmpty())
+		{
+			float radius = 0;
+			for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+			{
+				CBoundingSphere nodeSphere = TransformSphere(mNodes[nodeIndex].sphere, absoluteMatrices[nodeIndex]);
+				if (nodeSphere.IsEmpty())  continue;
+				float reach = Length(nodeSphere.centre - worldSphere.centre) + nodeSphere.radius;
+				if (reach > radius)  radius = reach;
+			}
+			if (radius < worldSphere.radius)  worldSphere.radius = radius;
+		}
+	}
+}
+
+
+// Nearest point where a world space ray hits the mesh when rendered with the given absolute matrices. Each node's
+// sub-meshes are tested in the node's space, so the ray is transformed by the inverse of the node's matrix instead of
+// transforming the triangles. An affine transform keeps distances along the ray in the same units (those of the
+// world space direction), so hits in different nodes can be compared directly
+bool Mesh::RayCast(const std::vector<CMatrix4x4>& absoluteMatrices, const CVector3& origin, const CVector3& direction,
+                   float& distance, unsigned int& node, unsigned int& subMesh, unsigned int& triangle)
+{
+	if (mHasBones)
+	{
+		CBoundingBox worldBox;
+		CBoundingSphere worldSphere;
+		WorldBounds(absoluteMatrices, worldBox, worldSphere);
+		float entry;
+		if (!RayHitsBox(worldBox, origin, InverseDirection(direction), distance, entry))  return false;
+		distance = entry;
+		node = 0;
+		subMesh = 0;
+		triangle = CTriangleTree::kNoTriangle;
+		return true;
+	}
+
+	bool hit = false;
+	for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+	{
+		if (mNodes[nodeIndex].subMeshes.empty())  continue;
+
+		CMatrix4x4 worldToNode = InverseAffine(absoluteMatrices[nodeIndex]);
+		CVector4 nodeOrigin = CVector4(origin, 1) * worldToNode;
+		CVector4 nodeDirection = CVector4(direction, 0) * worldToNode;
+		CVector3 rayOrigin = { nodeOrigin.x, nodeOrigin.y, nodeOrigin.z };
+		CVector3 rayDirection = { nodeDirection.x, nodeDirection.y, nodeDirection.z };
+
+		// Skip nodes whose box is missed or is further than the nearest hit so far
+		float entry;
+		if (!RayHitsBox(mNodes[nodeIndex].bounds, rayOrigin, InverseDirection(rayDirection), distance, entry))  continue;
+
+		for (auto subMeshIndex : mNodes[nodeIndex].subMeshes)
+		{
+			uint32_t hitTriangle = mSubMeshes[subMeshIndex].triangles.RayCast(rayOrigin, rayDirection, distance);
+			if (hitTriangle != CTriangleTree::kNoTriangle)
+			{
+				node = nodeIndex;
+				subMesh = subMeshIndex;
+				triangle = hitTriangle;
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
 
+
+// Rasterise the mesh into an occlusion buffer with the given absolute matrices. Each sub-mesh's triangle tree is in
+// its node's space, so is rendered with the node's matrix
+void Mesh::RenderOccluder(COcclusionBuffer& buffer, const std::vector<CMatrix4x4>& absoluteMatrices)
+{
+	if (mHasBones)  return;
+	for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+	{
+		for (auto subMeshIndex : mNodes[nodeIndex].subMeshes)
+		{
+			buffer.RenderTriangles(mSubMeshes[subMeshIndex].triangles, absoluteMatrices[nodeIndex]);
+		}
+	}
+}
+
+
+// Render the mesh with the given absolute matrices (see CalculateAbsoluteMatrices above)
+// Handles rigid body meshes (including single part meshes) as well as skinned meshes
+// LIMITATION: The mesh must use a single texture throughout
+void Mesh::Render(const std::vector<CMatrix4x4>& absoluteMatrices)
+{
 	if (mHasBones) // Render a mesh that uses skinning
 	{
-		// Advanced point: the above loop will get the absolute world matrices **of the bones**. However, they are
+		// Advanced point: CalculateAbsoluteMatrices gets the absolute world matrices **of the bones**. However, they are
 		// not actually rendered, they merely influence the skinned mesh, which has its origin at a particular node.
 		// So for each bone there is a fixed offset (transform) between where that bone is and where the root of the
-		// skinned mesh is. We need to apply that offset to each of the bone matrices calculated in the last loop to make
+		// skinned mesh is. We need to apply that offset to each of the bone matrices to make
 		// the bone influences work on the skinned mesh.
 		// These offset matrices are fixed for the model and have been calculated when the mesh was imported
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
-		{
-			absoluteMatrices[nodeIndex] = mNodes[nodeIndex].offsetMatrix * absoluteMatrices[nodeIndex];
-		}
-
-		// Send all matrices over to the GPU for skinning via a constant buffer - each matrix can represent a bone which influences nearby vertices
-		// MISSING - code to fill the gPerModelConstants.boneMatrices array with the contents of the absoluteMatrices vector
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+		// The results go straight into the constant buffer so the absolute matrices can be reused by other passes
+		// Send the matrices over to the GPU for skinning via a constant buffer - each matrix can represent a bone which influences nearby vertices.
+		// Only the matrices for this mesh's nodes are sent, the shader never reads past them
+		unsigned int numBones = NumberNodes();
+		if (numBones > MAX_BONES)  numBones = MAX_BONES; // Shader limit
+		for (unsigned int nodeIndex = 0; nodeIndex < numBones; ++nodeIndex)
 		{
-			gPerModelConstants.boneMatrices[nodeIndex] = absoluteMatrices[nodeIndex];
+			gPerSkeletonConstants.boneMatrices[nodeIndex] = mNodes[nodeIndex].offsetMatrix * absoluteMatrices[nodeIndex];
 		}
-		UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
+		UpdateConstantBuffer(gPerSkeletonConstantBuffer, &gPerSkeletonConstants, numBones * sizeof(CMatrix4x4)); // Send to GPU
+		UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Object colour is still needed
 
-		// Indicate that the constant buffer we just updated is for use in the vertex shader (VS), geometry shader (GS) and pixel shader (PS)
-		gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-		gD3DContext->GSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-		gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+		// Indicate that the constant buffers we just updated are for use in the vertex shader (VS), geometry shader (GS) and pixel shader (PS)
+		gRenderDevice->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
+		gRenderDevice->GSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
+		gRenderDevice->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+		gRenderDevice->VSSetConstantBuffers(2, 1, &gPerSkeletonConstantBuffer); // Bones are only used for vertex positions
+		gRenderDevice->GSSetConstantBuffers(2, 1, &gPerSkeletonConstantBuffer);
 
 		// Already sent over all the absolute matrices for the entire mesh so we can render sub-meshes directly
 		// rather than iterating through the nodes. 
@@ -661,18 +962,18 @@ void Mesh::Render(std::vector<CMatrix4x4>& modelMatrices)
 	{
 		// Render a mesh without skinning. Although slightly reorganised to use the matrices calculated
 		// above, this is basically the same code as the rigid body animation lab
+		// Indicate that the constant buffer updated below is for use in the vertex shader (VS) and pixel shader (PS)
+		gRenderDevice->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
+		gRenderDevice->GSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+		gRenderDevice->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+
 		// Iterate through each node
 		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
 		{
-			// Send this node's matrix to the GPU via a constant buffer
+			// Send this node's matrix to the GPU via a constant buffer (no bone matrices, they are in a separate buffer)
 			gPerModelConstants.worldMatrix = absoluteMatrices[nodeIndex];
 			UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
 
-			// Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-			gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-			gD3DContext->GSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
-			gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
-
 			// Render the sub-meshes attached to this node (no bones - rigid movement)
 			for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
 			{
@@ -683,6 +984,26 @@ void Mesh::Render(std::vector<CMatrix4x4>& modelMatrices)
 }
 
 
+// Render several models using this (rigid) mesh at once. Their matrices must already be in the instance buffer,
+// starting at the given instance and laid out as described in InstanceBuffer.h, and uploaded. An instanced vertex
+// shader must be set. One draw call per sub-mesh whatever the number of instances
+void Mesh::RenderInstanced(unsigned int firstInstance, unsigned int numInstances)
+{
+	// The instances for each node are together in the buffer, so each node's sub-meshes are drawn for all the models
+	// at once. Only the position of the node's instances changes between nodes
+	for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+	{
+		if (mNodes[nodeIndex].subMeshes.empty())  continue;
+
+		gInstanceBuffer.SetFirstInstance(firstInstance + nodeIndex * numInstances);
+		for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
+		{
+			RenderSubMesh(mSubMeshes[subMeshIndex], numInstances);
+		}
+	}
+}
+
+
 //--------------------------------------------------------------------------------------
 // Helper functions
 //--------------------------------------------------------------------------------------
@@ -709,6 +1030,7 @@ unsigned int Mesh::ReadNodes(aiNode* assimpNode, unsigned int nodeIndex, unsigne
 
 	node.defaultMatrix.SetValues(&assimpNode->mTransformation.a1);
 	node.defaultMatrix.Transpose(); // Assimp stores matrices differently to this app
+	node.offsetMatrix = MatrixIdentity(); // Set for bones when reading the geometry
 
 	node.subMeshes.resize(assimpNode->mNumMeshes);
 	for (unsigned int i = 0; i < assimpNode->mNumMeshes; ++i)
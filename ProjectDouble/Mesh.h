@@ -11,11 +11,19 @@
 #include <assimp/scene.h>
 #include <string>
 #include <vector>
+#include <memory>
 #include "TextureManager.h"
+#include "GeometryArena.h"
+#include "BoundingVolumes.h"
+#include "CTriangleTree.h"
+#include "COcclusionBuffer.h"
 #include "Definitions.h"
 #ifndef _MESH_H_INCLUDED_
 #define _MESH_H_INCLUDED_
 
+class MappedFile;
+struct MeshCacheHeader;
+
 class Mesh
 {
 //--------------------------------------------------------------------------------------
@@ -26,27 +34,68 @@ public:
     // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
     // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
     // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-    Mesh(const std::string& fileName, bool requireTangents = false);
+    // The imported data is written to a cache file, later loads use that file and skip assimp (see MeshCache.h)
+    // To load on a worker thread pass false for createGPUResources, the constructor then only reads and processes the
+    // file (no DirectX calls) and CreateGPUResources must be called afterwards on the main thread
+    Mesh(const std::string& fileName, bool requireTangents = false, bool createGPUResources = true);
 	Mesh(CVector3 minPt, CVector3 maxPt, int subDivX, int subDivZ, bool normals = false, bool uvs = true);
 
 
     ~Mesh();
 
+	// Second stage of loading when the constructor was called with createGPUResources false. Adds the geometry to the
+	// shared vertex / index buffers and loads the textures. Will throw a std::runtime_error exception on failure
+	void CreateGPUResources();
+
 
 	// How many nodes are in the hierarchy for this mesh. Nodes can control individual parts (rigid body animation),
 	// or bones (skinned animation), or they can be dummy nodes to create child parts in a more convenient way
 	unsigned int NumberNodes()  { return static_cast<unsigned int>(mNodes.size()); }
 
+	// Whether the mesh is skinned (bones) rather than rigid. Only rigid meshes can be instanced
+	bool IsSkinned()  { return mHasBones; }
+
     // The default matrix for a given node - used to set the initial position for a new model
     CMatrix4x4 GetNodeDefaultMatrix(unsigned int node) { return mNodes[node].defaultMatrix; }
 
 
-	// Render the mesh with the given matrices
+	// Calculate the absolute (world) matrix of every node from a model's node matrices, which are relative to their parent
+	// The output vector is resized if necessary, so the caller can keep it between calls to avoid allocations
+	void CalculateAbsoluteMatrices(const std::vector<CMatrix4x4>& modelMatrices, std::vector<CMatrix4x4>& absoluteMatrices);
+
+	// Render the mesh with the given absolute matrices (see CalculateAbsoluteMatrices above)
 	// Handles rigid body meshes (including single part meshes) as well as skinned meshes
 	// LIMITATION: The mesh must use a single texture throughout
-	void Render(std::vector<CMatrix4x4>& modelMatrices);
+	void Render(const std::vector<CMatrix4x4>& absoluteMatrices);
+
+	// Render several models using this (rigid) mesh at once. Their matrices must already be in the instance buffer,
+	// starting at the given instance and laid out as described in InstanceBuffer.h, and uploaded. An instanced vertex
+	// shader must be set. One draw call per sub-mesh whatever the number of instances
+	void RenderInstanced(unsigned int firstInstance, unsigned int numInstances);
 	bool SetTexture = false;
 
+	// Bounding volumes calculated when the mesh was loaded. Node and sub-mesh volumes are in the node's space (for
+	// skinned meshes all sub-meshes are in the mesh's bind pose space). Empty if there is no geometry
+	unsigned int           NumberSubMeshes()  { return static_cast<unsigned int>(mSubMeshes.size()); }
+	const CBoundingBox&    NodeBounds(unsigned int node)          { return mNodes[node].bounds; }
+	const CBoundingSphere& NodeSphere(unsigned int node)          { return mNodes[node].sphere; }
+	const CBoundingBox&    SubMeshBounds(unsigned int subMesh)    { return mSubMeshes[subMesh].bounds; }
+	const CBoundingSphere& SubMeshSphere(unsigned int subMesh)    { return mSubMeshes[subMesh].sphere; }
+
+	// World space box and sphere containing the mesh when rendered with the given absolute matrices
+	void WorldBounds(const std::vector<CMatrix4x4>& absoluteMatrices, CBoundingBox& worldBox, CBoundingSphere& worldSphere);
+
+	// Nearest point where a world space ray hits the mesh when rendered with the given absolute matrices. The distance
+	// passed is the maximum distance to search and is updated to the distance to the hit. Also gives the node and
+	// sub-mesh hit and the triangle in the sub-mesh (see CTriangleTree). Skinned meshes only test their world box, as
+	// their vertices are moved by the bones, and give node and sub-mesh 0 and triangle CTriangleTree::kNoTriangle
+	bool RayCast(const std::vector<CMatrix4x4>& absoluteMatrices, const CVector3& origin, const CVector3& direction,
+	             float& distance, unsigned int& node, unsigned int& subMesh, unsigned int& triangle);
+
+	// Rasterise the mesh into an occlusion buffer with the given absolute matrices, using the triangles kept for
+	// picking. Skinned meshes have none so add nothing
+	void RenderOccluder(COcclusionBuffer& buffer, const std::vector<CMatrix4x4>& absoluteMatrices);
+
 
 //--------------------------------------------------------------------------------------
 // Private data structures
@@ -54,18 +103,18 @@ public:
 private:
 
 	// A mesh is made of multiple sub-meshes. Each one uses a single material (texture).
-	// Each sub-mesh has a vertex / index buffer on the GPU. Could share buffers for performance but that would be complex.
+	// The geometry of all sub-meshes is held in shared GPU buffers, one set per vertex layout (see GeometryArena.h)
 	struct SubMesh
 	{
 		unsigned int       vertexSize = 0;         // Size in bytes of a single vertex (depends on what it contains, uvs, tangents etc.)
-		ID3D11InputLayout* vertexLayout = nullptr; // DirectX specification of data held in a single vertex
-
-		// GPU-side vertex and index buffers
 		unsigned int       numVertices = 0;
-		ID3D11Buffer*      vertexBuffer = nullptr;
-
 		unsigned int       numIndices = 0;
-		ID3D11Buffer*      indexBuffer  = nullptr;
+
+		GeometryArena::Allocation geometry;        // Where the vertices and indices are in the shared buffers
+
+		CBoundingBox    bounds = CBoundingBox::Empty(); // Volumes containing the vertices, see CalculateBounds
+		CBoundingSphere sphere = { { 0, 0, 0 }, -1 };
+		CTriangleTree   triangles;                      // For ray picking, in the node's space. Not built for skinned meshes
 
 		ID3D11Resource* diffuseMap=nullptr;
 		ID3D11ShaderResourceView* diffuseMapSRV=nullptr;
@@ -94,6 +143,35 @@ private:
 
 		std::vector<unsigned int> childNodes; // Child nodes that are controlled by this node (indexes into the mNodes vector below)
 		std::vector<unsigned int> subMeshes;  // The geometry representing this node (indexes into the mSubMeshes vector below)
+
+		CBoundingBox    bounds = CBoundingBox::Empty(); // Volumes containing this node's sub-meshes, in the node's space
+		CBoundingSphere sphere = { { 0, 0, 0 }, -1 };
+	};
+
+
+	// The data that may be held in each vertex, in the order it is stored. Position is always present
+	enum VertexComponent
+	{
+		VertexNormal  = 1,
+		VertexTangent = 2,
+		VertexUV      = 4,
+		VertexBones   = 8, // Bone indices and weights
+	};
+
+	// CPU-side data for a sub-mesh, used to create its GPU resources. Filled in either from an assimp import or
+	// from a cache file. The vertex and index pointers refer to memory held elsewhere while the mesh is loading
+	struct SubMeshData
+	{
+		unsigned int         vertexComponents = 0; // Combination of VertexComponent flags
+		unsigned int         vertexSize = 0;       // Size in bytes of a single vertex
+		unsigned int         numVertices = 0;
+		const unsigned char* vertices = nullptr;
+
+		unsigned int         numIndices = 0;
+		unsigned int         indexSize = 4;        // 2 or 4 bytes per index
+		const unsigned char* indices = nullptr;
+
+		std::string diffuseMap, normalMap, specularMap; // Texture file names, empty if not used
 	};
 
 
@@ -108,8 +186,33 @@ private:
 	// Help build the arrays of submeshes and nodes from the assimp data - recursive
 	unsigned int ReadNodes(aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex);
 
+	// Get the assimp flags used to import a mesh file with or without tangents
+	static void GetImportFlags(bool requireTangents, unsigned int& assimpFlags, unsigned int& removeComponents);
+
+	// Import a mesh file with assimp. Fills in the nodes and the CPU-side sub-mesh data, the geometry is held in the given storage
+	void ImportMesh(const std::string& fileName, bool requireTangents, unsigned int assimpFlags, unsigned int removeComponents,
+	                std::vector<SubMeshData>& subMeshData, std::vector<std::unique_ptr<unsigned char[]>>& storage);
+
+	// Read the nodes and the CPU-side sub-mesh data from a cache file, which must stay open until the sub-meshes are created.
+	// Returns false if the cache file is not for the given header or is damaged. Throws a std::runtime_error if the data
+	// is inconsistent
+	bool ReadCache(const MappedFile& cacheFile, const MeshCacheHeader& header, std::vector<SubMeshData>& subMeshData);
+
+	// Write the nodes and the CPU-side sub-mesh data to a cache file. Failure is ignored, the mesh will just be imported again next time
+	void WriteCache(const std::string& cacheFileName, const MeshCacheHeader& header, const std::vector<SubMeshData>& subMeshData);
+
+	// Calculate the bounding volumes of the sub-meshes, nodes and the whole mesh from the vertex positions
+	void CalculateBounds(const std::vector<SubMeshData>& subMeshData);
+
+	// Build the triangle tree of each sub-mesh for ray picking. Call after CalculateBounds
+	void BuildTriangleTrees(const std::vector<SubMeshData>& subMeshData);
+
+	// Create the GPU-side resources for a sub-mesh: geometry in the shared vertex / index buffers, and textures
+	void CreateSubMesh(const SubMeshData& data, SubMesh& subMesh, const std::string& fileName);
+
 	// Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
-	void RenderSubMesh(const SubMesh& subMesh);
+	// Pass a number of instances to draw the sub-mesh instanced (see RenderInstanced), 0 for an ordinary draw
+	void RenderSubMesh(const SubMesh& subMesh, unsigned int numInstances = 0);
 
 
 
@@ -122,6 +225,13 @@ private:
     std::vector<Node>    mNodes;     // The mesh hierarchy. First entry is root. remainder aree stored in depth-first order
 	
 	bool mHasBones; // If any submesh has bones, then all submeshes are given bones - makes rendering easier (one shader for the whole mesh)
+	CBoundingBox mBounds; // Box containing the whole mesh in its bind pose, used for skinned meshes
+
+	// Loaded data waiting for CreateGPUResources. The sub-mesh data points into the cache file or the import storage
+	std::string                                   mFileName;
+	std::vector<SubMeshData>                      mPendingSubMeshes;
+	std::unique_ptr<MappedFile>                   mPendingCacheFile;
+	std::vector<std::unique_ptr<unsigned char[]>> mPendingImportStorage;
 };
 
 
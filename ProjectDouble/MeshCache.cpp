@@ -0,0 +1,205 @@
+//--------------------------------------------------------------------------------------
+// Binary mesh cache - support for storing imported meshes so later runs can skip assimp
+//--------------------------------------------------------------------------------------
+
+#include "MeshCache.h"
+#include "CHashTable.h" // For XXHash64
+
+#include <fstream>
+#include <cstdio>
+#include <cstddef>
+
+
+// Folder that holds the cache files
+static const std::string kMeshCacheFolder = "./Media/Cache/";
+
+
+//--------------------------------------------------------------------------------------
+// Cache file header
+//--------------------------------------------------------------------------------------
+
+// Build the header for the given source file and import settings. Reads and hashes the source file, returns
+// false if it can't be read (the caller should import as usual so assimp can report the error)
+bool MakeMeshCacheHeader(const std::string& sourceFileName, uint32_t importFlags, uint32_t removeComponents,
+                         MeshCacheHeader& header)
+{
+	MappedFile sourceFile;
+	if (!sourceFile.Open(sourceFileName))  return false;
+
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "MESH", 4);
+	header.version = kMeshCacheVersion;
+	header.sourceHash = gen::XXHash64(sourceFile.Data(), static_cast<gen::TUInt32>(sourceFile.Size()));
+	header.sourceSize = sourceFile.Size();
+	header.importFlags = importFlags;
+	header.removeComponents = removeComponents;
+	return true;
+}
+
+
+// Check that a cache file was written for the given header and that its body has the size and hash recorded in the
+// file's header
+bool CheckMeshCacheFile(const unsigned char* data, size_t size, const MeshCacheHeader& header)
+{
+	if (size < sizeof(MeshCacheHeader))  return false;
+
+	// Everything before the body size must match, it identifies the import
+	MeshCacheHeader fileHeader;
+	std::memcpy(&fileHeader, data, sizeof(MeshCacheHeader));
+	if (std::memcmp(&fileHeader, &header, offsetof(MeshCacheHeader, bodySize)) != 0)  return false;
+
+	size_t bodySize = size - sizeof(MeshCacheHeader);
+	return fileHeader.bodySize == bodySize && bodySize <= UINT32_MAX &&
+	       fileHeader.bodyHash == gen::XXHash64(data + sizeof(MeshCacheHeader), static_cast<gen::TUInt32>(bodySize));
+}
+
+
+// Return the name of the cache file used for the given source file. Cache files are kept in their own folder,
+// which is created if necessary
+std::string MeshCacheFileName(const std::string& sourceFileName)
+{
+	CreateDirectoryA(kMeshCacheFolder.c_str(), nullptr); // Fails harmlessly if the folder already exists
+
+	// Use the file name without its path for readability, plus a hash of the full path in case two folders
+	// contain meshes with the same name
+	size_t nameStart = sourceFileName.find_last_of("/\\");
+	std::string name = (nameStart == std::string::npos) ? sourceFileName : sourceFileName.substr(nameStart + 1);
+	uint64_t pathHash = gen::XXHash64(reinterpret_cast<const gen::TUInt8*>(sourceFileName.data()),
+	                                  static_cast<gen::TUInt32>(sourceFileName.length()));
+
+	char hashText[17];
+	sprintf_s(hashText, "%016llx", static_cast<unsigned long long>(pathHash));
+	return kMeshCacheFolder + name + "." + hashText + ".meshcache";
+}
+
+
+//--------------------------------------------------------------------------------------
+// Memory-mapped file
+//--------------------------------------------------------------------------------------
+
+// Map the given file, returns false if it doesn't exist or can't be mapped. Closes any file already open
+bool MappedFile::Open(const std::string& fileName)
+{
+	Close();
+
+	mFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)  return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close(); // Can't map an empty file
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	mData = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mSize = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)                UnmapViewOfFile(mData);
+	if (mMapping != nullptr)             CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)   CloseHandle(mFile);
+	mData = nullptr;
+	mMapping = nullptr;
+	mFile = INVALID_HANDLE_VALUE;
+	mSize = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reading and writing cache data
+//--------------------------------------------------------------------------------------
+
+void MeshCacheWriter::Write(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	mData.insert(mData.end(), bytes, bytes + size);
+}
+
+void MeshCacheWriter::WriteString(const std::string& s)
+{
+	Write(static_cast<uint32_t>(s.length()));
+	Write(s.data(), s.length());
+}
+
+// Pad the data to a 4-byte boundary, used before large blocks of vertex / index data
+void MeshCacheWriter::Align()
+{
+	mData.resize((mData.size() + 3) & ~static_cast<size_t>(3), 0);
+}
+
+// Write the header, with the body size and hash filled in, then the data to the given file. Returns false on failure
+bool MeshCacheWriter::Save(const std::string& fileName, const MeshCacheHeader& header) const
+{
+	if (mData.size() > UINT32_MAX)  return false; // Too large to hash
+
+	MeshCacheHeader fileHeader = header;
+	fileHeader.bodySize = mData.size();
+	fileHeader.bodyHash = gen::XXHash64(mData.data(), static_cast<gen::TUInt32>(mData.size()));
+
+	// The temporary name is unique to the process and thread, so two loads of the same mesh don't write into the
+	// same file. Whichever finishes last replaces the other's file, which holds the same data
+	std::string tempFileName = fileName + "." + std::to_string(GetCurrentProcessId()) + "." +
+	                           std::to_string(GetCurrentThreadId()) + ".tmp";
+	std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+	if (!file)  return false;
+
+	file.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+	file.write(reinterpret_cast<const char*>(mData.data()), mData.size());
+	file.close();
+	if (!file || !MoveFileExA(tempFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		std::remove(tempFileName.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+// Return a pointer to the next block of data of the given size and step past it
+const unsigned char* MeshCacheReader::Read(size_t size)
+{
+	if (size > mSize - mPosition)  throw std::runtime_error("Mesh cache file is truncated");
+	const unsigned char* data = mData + mPosition;
+	mPosition += size;
+	return data;
+}
+
+// Read a count of items, each taking at least the given number of bytes in the file
+uint32_t MeshCacheReader::ReadCount(size_t minItemSize)
+{
+	uint32_t count = Read<uint32_t>();
+	if (minItemSize > 0 && count > (mSize - mPosition) / minItemSize)
+	{
+		throw std::runtime_error("Mesh cache file has a bad count");
+	}
+	return count;
+}
+
+std::string MeshCacheReader::ReadString()
+{
+	uint32_t length = Read<uint32_t>();
+	return std::string(reinterpret_cast<const char*>(Read(length)), length);
+}
+
+void MeshCacheReader::Align()
+{
+	size_t aligned = (mPosition + 3) & ~static_cast<size_t>(3);
+	Read(aligned - mPosition);
+}
@@ -0,0 +1,169 @@
+//--------------------------------------------------------------------------------------
+// Binary mesh cache - support for storing imported meshes so later runs can skip assimp
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Importing a mesh with assimp parses the file and runs many post-process steps (normal generation, vertex
+// joining, cache optimisation etc.), which is the bulk of the start-up time. The Mesh class writes the result
+// of an import to a cache file, and on later runs memory-maps that file and creates the GPU buffers directly
+// from it. This file contains the file format helpers, the Mesh class decides what is stored.
+//
+// A cache file is only used if its header matches exactly: the format version, a hash of the source file's
+// contents and the import flags. So editing a mesh, changing the import settings or changing the format all
+// cause a re-import, and the cache file is rewritten. The header also holds the size and a checksum of the rest of
+// the file (the body), so a damaged file is re-imported too. Files are written under a temporary name and renamed
+// into place once complete, so a crash or another process loading the same mesh never sees a partial file
+
+#ifndef _MESH_CACHE_H_INCLUDED_
+#define _MESH_CACHE_H_INCLUDED_
+
+#define NOMINMAX // Use this to stop Windows headers defining "min" and "max", which breaks some libraries (e.g. assimp)
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+
+//--------------------------------------------------------------------------------------
+// Cache file header
+//--------------------------------------------------------------------------------------
+
+// Increase this whenever the data written by Mesh::WriteCache changes, so old cache files are ignored
+const uint32_t kMeshCacheVersion = 2;
+
+// The start of every cache file, identifies the exact import that the rest of the file holds
+struct MeshCacheHeader
+{
+	char     magic[4];         // "MESH"
+	uint32_t version;          // kMeshCacheVersion
+	uint64_t sourceHash;       // 64-bit hash of the source mesh file contents
+	uint64_t sourceSize;       // Size in bytes of the source mesh file
+	uint32_t importFlags;      // Assimp post-process flags used for the import
+	uint32_t removeComponents; // Assimp components removed during the import
+	uint64_t bodySize;         // Size in bytes of the data after the header, filled in by MeshCacheWriter::Save
+	uint64_t bodyHash;         // 64-bit hash of the data after the header, filled in by MeshCacheWriter::Save
+};
+
+// Build the header for the given source file and import settings. Reads and hashes the source file, returns
+// false if it can't be read (the caller should import as usual so assimp can report the error). The body size
+// and hash are left zero
+bool MakeMeshCacheHeader(const std::string& sourceFileName, uint32_t importFlags, uint32_t removeComponents,
+                         MeshCacheHeader& header);
+
+// Check that a cache file was written for the given header (see MakeMeshCacheHeader) and that its body has the
+// size and hash recorded in the file's header. Returns false if not, the caller should then import as usual
+bool CheckMeshCacheFile(const unsigned char* data, size_t size, const MeshCacheHeader& header);
+
+// Return the name of the cache file used for the given source file. Cache files are kept in their own folder,
+// which is created if necessary
+std::string MeshCacheFileName(const std::string& sourceFileName);
+
+
+//--------------------------------------------------------------------------------------
+// Memory-mapped file
+//--------------------------------------------------------------------------------------
+
+// A read-only view of an entire file. The operating system pages the file in as it is accessed, so there is
+// no up-front read or copy. Data can be passed straight to the GPU from the view, but the file must stay open
+// until then
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile()  { Close(); }
+
+	// Map the given file, returns false if it doesn't exist or can't be mapped. Closes any file already open
+	bool Open(const std::string& fileName);
+	void Close();
+
+	const unsigned char* Data() const  { return mData; }
+	size_t               Size() const  { return mSize; }
+
+private:
+	// Disallow copying, the handles would be closed twice
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	HANDLE               mFile = INVALID_HANDLE_VALUE;
+	HANDLE               mMapping = nullptr;
+	const unsigned char* mData = nullptr;
+	size_t               mSize = 0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Reading and writing cache data
+//--------------------------------------------------------------------------------------
+
+// Builds up the body of a cache file in memory, then writes it after the header in one go
+class MeshCacheWriter
+{
+public:
+	void Write(const void* data, size_t size);
+	void WriteString(const std::string& s);
+
+	// Write a value of simple type (integers, floats, structures without pointers)
+	template <class T> void Write(const T& value)  { Write(&value, sizeof(T)); }
+
+	// Write a vector of simple types, preceded by its length
+	template <class T> void WriteVector(const std::vector<T>& v)
+	{
+		Write(static_cast<uint32_t>(v.size()));
+		if (!v.empty())  Write(v.data(), v.size() * sizeof(T));
+	}
+
+	// Pad the data to a 4-byte boundary, used before large blocks of vertex / index data
+	void Align();
+
+	// Write the header, with the body size and hash filled in, then the data to the given file. Returns false on
+	// failure. The file is written under a temporary name and only replaces the given file once complete
+	bool Save(const std::string& fileName, const MeshCacheHeader& header) const;
+
+private:
+	std::vector<unsigned char> mData;
+};
+
+
+// Reads the body of a cache file in the same order as MeshCacheWriter wrote it. Data is read directly from memory
+// (usually a MappedFile, after the header). Throws a std::runtime_error if reading past the end or if a count is
+// larger than the data left could hold, which indicate a damaged file
+class MeshCacheReader
+{
+public:
+	MeshCacheReader(const unsigned char* data, size_t size) : mData(data), mSize(size) {}
+
+	// Return a pointer to the next block of data of the given size and step past it
+	const unsigned char* Read(size_t size);
+	std::string ReadString();
+
+	template <class T> T Read()
+	{
+		T value;
+		std::memcpy(&value, Read(sizeof(T)), sizeof(T));
+		return value;
+	}
+
+	// Read a count of items, each taking at least the given number of bytes in the file. Checking the count against
+	// the data left means a damaged count can't cause a huge allocation
+	uint32_t ReadCount(size_t minItemSize);
+
+	template <class T> void ReadVector(std::vector<T>& v)
+	{
+		v.resize(ReadCount(sizeof(T)));
+		if (!v.empty())  std::memcpy(v.data(), Read(v.size() * sizeof(T)), v.size() * sizeof(T));
+	}
+
+	void Align();
+
+	// True if all the data has been read
+	bool AtEnd() const  { return mPosition == mSize; }
+
+private:
+	const unsigned char* mData;
+	size_t               mSize;
+	size_t               mPosition = 0;
+};
+
+
+#endif //_MESH_CACHE_H_INCLUDED_
@@ -13,19 +13,86 @@
 Model::Model(Mesh* mesh, CVector3 position /*= { 0,0,0 }*/, CVector3 rotation /*= { 0,0,0 }*/, float scale /*= 1*/)
     : mMesh(mesh)
 {
-    // Set default matrices from mesh
+    // Set default transforms from mesh
+    mTransforms.resize(mesh->NumberNodes());
     mWorldMatrices.resize(mesh->NumberNodes());
+    mMatrixOutOfDate.resize(mesh->NumberNodes());
     for (int i = 0; i < mWorldMatrices.size(); ++i)
-        mWorldMatrices[i] = mesh->GetNodeDefaultMatrix(i);
+        SetWorldMatrix(mesh->GetNodeDefaultMatrix(i), i);
 }
 
 
+// Setting the matrix directly splits it into position, rotation and scale (it must not contain shear)
+// The given matrix is kept as the world matrix so it is returned exactly until the node is changed again
+void Model::SetWorldMatrix(CMatrix4x4 matrix, int node /*= 0*/)
+{
+    DecomposeMatrix(matrix, mTransforms[node].position, mTransforms[node].rotation, mTransforms[node].scale);
+    mWorldMatrices[node] = matrix;
+    mMatrixOutOfDate[node] = false;
+    mAbsoluteMatricesOutOfDate = true;
+}
+
+
+// Make sure the absolute (world space) matrices of all nodes are up to date. They are only recalculated
+// if the model has changed since they were last calculated, so the many passes that render a model
+// each frame share the same result. A model found up to date is counted as skipped on its first call each frame only
+void Model::UpdateAbsoluteMatrices()
+{
+    if (!mAbsoluteMatricesOutOfDate)
+    {
+        if (mStatsFrame != gFrameNumber)  ++gTransformCacheStats.skipped;
+        mStatsFrame = gFrameNumber;
+        return;
+    }
+    mStatsFrame = gFrameNumber;
+
+    for (int i = 0; i < mWorldMatrices.size(); ++i)
+        UpdateWorldMatrix(i);
+    mMesh->CalculateAbsoluteMatrices(mWorldMatrices, mAbsoluteMatrices);
+
+    mAbsoluteMatricesOutOfDate = false;
+    ++mBoundsVersion;
+    mWorldBoundsOutOfDate = true;
+    ++gTransformCacheStats.recalculated;
+}
+
+
+
+// Recalculate the world bounds if the absolute matrices have changed since they were last calculated
+void Model::UpdateWorldBounds()
+{
+    UpdateAbsoluteMatrices();
+    if (mWorldBoundsOutOfDate)
+    {
+        mMesh->WorldBounds(mAbsoluteMatrices, mWorldBounds, mWorldSphere);
+        mWorldBoundsOutOfDate = false;
+    }
+}
+
+
+// Nearest point where a world space ray hits the model's triangles, see Mesh::RayCast
+bool Model::RayCast(const CVector3& origin, const CVector3& direction, float& distance,
+                    unsigned int& node, unsigned int& subMesh, unsigned int& triangle)
+{
+    UpdateAbsoluteMatrices();
+    return mMesh->RayCast(mAbsoluteMatrices, origin, direction, distance, node, subMesh, triangle);
+}
+
+
+// Rasterise the model into an occlusion buffer, see Mesh::RenderOccluder
+void Model::RenderOccluder(COcclusionBuffer& buffer)
+{
+    UpdateAbsoluteMatrices();
+    mMesh->RenderOccluder(buffer, mAbsoluteMatrices);
+}
+
 
 // The render function simply passes this model's matrices over to Mesh:Render.
 // All other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
 void Model::Render()
 {
-    mMesh->Render(mWorldMatrices);
+    UpdateAbsoluteMatrices();
+    mMesh->Render(mAbsoluteMatrices);
 }
 
 
@@ -33,63 +100,68 @@ void Model::Render()
 void Model:: Control(int node, float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
 	KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward, KeyCode moveLeft, KeyCode moveRight, KeyCode moveUp, KeyCode moveDown)
 {
-    auto& matrix = mWorldMatrices[node]; // Use reference to node matrix to make code below more readable
+    auto& transform = mTransforms[node]; // Use reference to node transform to make code below more readable
 
+	// Rotations are local, so are applied before the existing rotation
 	if (KeyHeld( turnUp ))
 	{
-		matrix = MatrixRotationX(ROTATION_SPEED * frameTime) * matrix;
+		transform.rotation = QuaternionRotationX(ROTATION_SPEED * frameTime) * transform.rotation;
 	}
 	if (KeyHeld( turnDown ))
 	{
-		matrix = MatrixRotationX(-ROTATION_SPEED * frameTime) * matrix;
+		transform.rotation = QuaternionRotationX(-ROTATION_SPEED * frameTime) * transform.rotation;
 	}
 	if (KeyHeld( turnRight ))
 	{
-		matrix = MatrixRotationY(ROTATION_SPEED * frameTime) * matrix;
+		transform.rotation = QuaternionRotationY(ROTATION_SPEED * frameTime) * transform.rotation;
 	}
 	if (KeyHeld( turnLeft ))
 	{
-		matrix = MatrixRotationY(-ROTATION_SPEED * frameTime) * matrix;
+		transform.rotation = QuaternionRotationY(-ROTATION_SPEED * frameTime) * transform.rotation;
 	}
 	if (KeyHeld( turnCW ))
 	{
-		matrix = MatrixRotationZ(ROTATION_SPEED * frameTime) * matrix;
+		transform.rotation = QuaternionRotationZ(ROTATION_SPEED * frameTime) * transform.rotation;
 	}
 	if (KeyHeld( turnCCW ))
 	{
-		matrix = MatrixRotationZ(-ROTATION_SPEED * frameTime) * matrix;
+		transform.rotation = QuaternionRotationZ(-ROTATION_SPEED * frameTime) * transform.rotation;
 	}
 
-	// Local Z movement - move in the direction of the Z axis, get axis from world matrix
-    CVector3 localZDir = Normalise(matrix.GetRow(2)); // normalise axis in case world matrix has scaling
+	// Local Z movement - move in the direction of the Z axis, get axis by rotating the unit Z axis
+    CVector3 localZDir = transform.rotation.Rotate({ 0, 0, 1 });
 	if (KeyHeld( moveForward ))
 	{
 
-		matrix.SetRow(3, matrix.GetRow(3) + localZDir * MOVEMENT_SPEED * frameTime);
+		transform.position += localZDir * MOVEMENT_SPEED * frameTime;
 	}
 	if (KeyHeld( moveBackward ))
 	{
-		matrix.SetRow(3, matrix.GetRow(3) - localZDir * MOVEMENT_SPEED * frameTime);
+		transform.position -= localZDir * MOVEMENT_SPEED * frameTime;
 	}
 
-	CVector3 localXDir = Normalise(matrix.GetRow(0)); // normalise axis in case world matrix has scaling
+	CVector3 localXDir = transform.rotation.Rotate({ 1, 0, 0 });
 	if (KeyHeld(moveRight))
 	{
-		matrix.SetRow(3, matrix.GetRow(3) + localXDir * MOVEMENT_SPEED * frameTime);
+		transform.position += localXDir * MOVEMENT_SPEED * frameTime;
 	}
 	if (KeyHeld(moveLeft))
 	{
-		matrix.SetRow(3, matrix.GetRow(3) - localXDir * MOVEMENT_SPEED * frameTime);
+		transform.position -= localXDir * MOVEMENT_SPEED * frameTime;
 	}
 
-	CVector3 localYDir = Normalise(matrix.GetRow(1)); // normalise axis in case world matrix has scaling
+	CVector3 localYDir = transform.rotation.Rotate({ 0, 1, 0 });
 	if (KeyHeld(moveUp))
 	{
-		matrix.SetRow(3, matrix.GetRow(3) + localYDir * MOVEMENT_SPEED * frameTime);
+		transform.position += localYDir * MOVEMENT_SPEED * frameTime;
 	}
 	if (KeyHeld(moveDown))
 	{
-		matrix.SetRow(3, matrix.GetRow(3) - localYDir * MOVEMENT_SPEED * frameTime);
+		transform.position -= localYDir * MOVEMENT_SPEED * frameTime;
 	}
-}
 
+	// Repeated quaternion multiplies slowly drift from unit length
+	transform.rotation = Normalise(transform.rotation);
+	mMatrixOutOfDate[node] = true;
+	mAbsoluteMatricesOutOfDate = true;
+}
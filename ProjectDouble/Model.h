@@ -1,11 +1,13 @@
 //--------------------------------------------------------------------------------------
 // Class encapsulating a model
 //--------------------------------------------------------------------------------------
-// Holds a pointer to a mesh as well as position, rotation and scaling, which are converted to a world matrix when required
+// Holds a pointer to a mesh as well as position, rotation (quaternion) and scaling, which are converted to a world matrix when required
 // This is more of a convenience class, the Mesh class does most of the difficult work.
 
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "CQuaternion.h"
+#include "BoundingVolumes.h"
 #include "Input.h"
 
 #include <vector>
@@ -14,6 +16,7 @@
 #define _MODEL_H_INCLUDED_
 
 class Mesh;
+class COcclusionBuffer;
 
 class Model
 {
@@ -23,6 +26,7 @@ public:
 	//-------------------------------------
     bool Selected = false;
     float ScaleFactor = 0.0f;
+    unsigned int TreeItem = ~0u; // Item index in the scene's bounding volume tree (see ModelManager), ~0u if not in it
     Model(Mesh* mesh, CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, float scale = 1);
 
 
@@ -30,6 +34,35 @@ public:
     // All other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
     void Render();
 
+    // The mesh this model is an instance of
+    Mesh* GetMesh()  { return mMesh; }
+
+    // Make sure the absolute (world space) matrices of all nodes are up to date. They are only recalculated
+    // if the model has changed since they were last calculated, so the many passes that render a model
+    // each frame share the same result. Called by Render, but can be called earlier if the matrices are needed
+    void UpdateAbsoluteMatrices();
+
+    // Absolute (world space) matrix of a node, i.e. including the effect of all its parent nodes
+    CMatrix4x4 AbsoluteMatrix(int node = 0)  { UpdateAbsoluteMatrices(); return mAbsoluteMatrices[node]; }
+
+    // Incremented each time the absolute matrices are recalculated, i.e. after any change to the model's transforms.
+    // A copy of the model's world bounds (e.g. in the scene's bounding volume tree) taken at a different version is
+    // out of date, however many times the model has been queried since it moved
+    unsigned int BoundsVersion()  { UpdateAbsoluteMatrices(); return mBoundsVersion; }
+
+    // World space box and sphere containing the model in its current position, for culling, picking etc. They are
+    // only recalculated when the model has moved, so repeated queries are cheap. Empty if the mesh has no geometry
+    const CBoundingBox&    WorldBounds()  { UpdateWorldBounds(); return mWorldBounds; }
+    const CBoundingSphere& WorldSphere()  { UpdateWorldBounds(); return mWorldSphere; }
+
+    // Nearest point where a world space ray hits the model's triangles, see Mesh::RayCast. The distance passed is the
+    // maximum distance to search and is updated to the distance to the hit. Returns false if the model is missed
+    bool RayCast(const CVector3& origin, const CVector3& direction, float& distance,
+                 unsigned int& node, unsigned int& subMesh, unsigned int& triangle);
+
+    // Rasterise the model into an occlusion buffer so it hides the models behind it, see Mesh::RenderOccluder
+    void RenderOccluder(COcclusionBuffer& buffer);
+
 
 	// Control a given node in the model using keys provided. Amount of motion performed depends on frame time
 	
@@ -38,9 +71,9 @@ public:
 
 	void FaceTarget(CVector3 target, int node= 0)
 	{
-		SetWorldMatrix(mWorldMatrices[node], node);
-		mWorldMatrices[node].FaceTarget(target);
-		SetRotation(Rotation(node), node);
+		CMatrix4x4 matrix = WorldMatrix(node);
+		matrix.FaceTarget(target);
+		SetWorldMatrix(matrix, node);
 	}
 	//-------------------------------------
 	// Data access
@@ -50,24 +83,30 @@ public:
     // All functions now accept a "node" parameter which specifies which node in the hierarchy to use. Defaults to 0, the root.
     // The hierarchy is stored in depth-first order
 
-	// Getters - model only stores matrices. Position, rotation and scale are extracted if requested.
-	CVector3 Position(int node = 0)  { return mWorldMatrices[node].GetRow(3); }         // Position is on bottom row of matrix
-	CVector3 Rotation(int node = 0)  { return mWorldMatrices[node].GetEulerAngles(); }  // Getting angles from a matrix is complex - see .cpp file
-	CVector3 Scale(int node = 0)     { return { Length(mWorldMatrices[node].GetRow(0)),
-                                                Length(mWorldMatrices[node].GetRow(1)), 
-                                                Length(mWorldMatrices[node].GetRow(2)) }; } // Scale is length of rows 0-2 in matrix
-	CMatrix4x4 WorldMatrix(int node = 0)  { return mWorldMatrices[node]; }
+	// Getters - model stores position, rotation (quaternion) and scale for each node, so these are cheap.
+	CVector3    Position(int node = 0)            { return mTransforms[node].position; }
+	CVector3    Rotation(int node = 0)            { return mTransforms[node].rotation.GetEulerAngles(); } // Euler angles from quaternion - see .cpp file
+	CQuaternion RotationQuaternion(int node = 0)  { return mTransforms[node].rotation; }
+	CVector3    Scale(int node = 0)               { return mTransforms[node].scale; }
 
-    // Setters - model only stores matricies , so if user sets position, rotation or scale, just update those aspects of the matrix
-	void SetPosition(CVector3 position, int node = 0)  { mWorldMatrices[node].SetRow(3, position); }
+	// The world matrix is built from the position, rotation and scale only when they have changed
+	CMatrix4x4 WorldMatrix(int node = 0)  { UpdateWorldMatrix(node); return mWorldMatrices[node]; }
 
-	void SetRotation(CVector3 rotation, int node = 0)
-    {
-        // To put rotation angles into a matrix we need to build the matrix from scratch to make sure we retain existing scaling and position
-        mWorldMatrices[node] = MatrixScaling(Scale(node)) *
-                               MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) * MatrixRotationY(rotation.y) *
-                               MatrixTranslation(Position(node));
-    }
+    // Setters - only the changed part is stored, the matrix is rebuilt the next time it is needed
+	void SetPosition(CVector3 position, int node = 0)
+	{
+		mTransforms[node].position = position;
+		if (!mMatrixOutOfDate[node])  mWorldMatrices[node].SetRow(3, position); // Position alone can be updated in place
+		mAbsoluteMatricesOutOfDate = true;
+	}
+
+	void SetRotation(CVector3 rotation, int node = 0)  { SetRotation(QuaternionFromEulerAngles(rotation), node); }
+	void SetRotation(CQuaternion rotation, int node = 0)
+	{
+		mTransforms[node].rotation = rotation;
+		mMatrixOutOfDate[node] = true;
+		mAbsoluteMatricesOutOfDate = true;
+	}
   
     void RotateX(float angle,int node = 0)
     {
@@ -75,28 +114,65 @@ public:
         SetRotation(mRotation, node);
     }
 	// Two ways to set scale: x,y,z separately, or all to the same value
-    // To set scale without affecting rotation, normalise each row, then multiply it by the scale value.
 	void SetScale(CVector3 scale, int node = 0)
     {
-        mWorldMatrices[node].SetRow(0, Normalise(mWorldMatrices[node].GetRow(0)) * scale.x); 
-        mWorldMatrices[node].SetRow(1, Normalise(mWorldMatrices[node].GetRow(1)) * scale.y); 
-        mWorldMatrices[node].SetRow(2, Normalise(mWorldMatrices[node].GetRow(2)) * scale.z); 
+		mTransforms[node].scale = scale;
+		mMatrixOutOfDate[node] = true;
+		mAbsoluteMatricesOutOfDate = true;
     }
 	void SetScale(float scale)  { SetScale({ scale, scale, scale });}
 
-    void SetWorldMatrix(CMatrix4x4 matrix, int node = 0)  { mWorldMatrices[node] = matrix; }
+	// Setting the matrix directly splits it into position, rotation and scale (it must not contain shear)
+    void SetWorldMatrix(CMatrix4x4 matrix, int node = 0);
 
 
 	//-------------------------------------
 	// Private data / members
 	//-------------------------------------
 private:
+	// Rebuild the world matrix for the given node if its position, rotation or scale have changed
+	void UpdateWorldMatrix(int node)
+	{
+		if (mMatrixOutOfDate[node])
+		{
+			mWorldMatrices[node] = MatrixTransform(mTransforms[node].position, mTransforms[node].rotation, mTransforms[node].scale);
+			mMatrixOutOfDate[node] = false;
+		}
+	}
+
+	// Recalculate the world bounds if the absolute matrices have changed since they were last calculated
+	void UpdateWorldBounds();
+
+	// Position, rotation and scale of a single node
+	struct NodeTransform
+	{
+		CVector3    position;
+		CQuaternion rotation;
+		CVector3    scale;
+	};
+
     Mesh* mMesh;
-	// World matrices for the model
-    // Now that meshes have multiple parts, we need multiple matrices. The root matrix (the first one) is the world matrix
-    // for the entire model. The remaining matrices are relative to their parent part. The hierarchy is defined in the mesh (nodes)
+	// Transforms for the model
+    // Now that meshes have multiple parts, we need multiple transforms. The root transform (the first one) is the world transform
+    // for the entire model. The remaining transforms are relative to their parent part. The hierarchy is defined in the mesh (nodes)
     CVector3 mRotation;
+	std::vector<NodeTransform> mTransforms;
+
+	// World matrices built from the transforms above, each one is only rebuilt when it is out of date
 	std::vector<CMatrix4x4> mWorldMatrices;
+	std::vector<bool>       mMatrixOutOfDate;
+
+	// Absolute matrices for each node, combining the world matrices above with those of their parents. Passed to the mesh
+	// for rendering. Only recalculated when any node has changed
+	std::vector<CMatrix4x4> mAbsoluteMatrices;
+	bool                    mAbsoluteMatricesOutOfDate = true;
+	unsigned int            mBoundsVersion = 0;
+	unsigned int            mStatsFrame = ~0u; // Frame of the last call to UpdateAbsoluteMatrices, to count skips once per frame
+
+	// World space bounds from the absolute matrices above, recalculated when the matrices are
+	CBoundingBox            mWorldBounds;
+	CBoundingSphere         mWorldSphere;
+	bool                    mWorldBoundsOutOfDate = true;
 };
 
 
@@ -1,16 +1,33 @@
 #include "ModelManager.h"
+#include "AssetLoader.h"
+#include "GeometryArena.h"
+#include "RenderDevice.h"
+#include "InstanceBuffer.h"
+#include "Profiler.h"
+
+#include <cstring>
 
 ModelManager::ModelManager()
 {
 	// Additional light information
-	CVector3 gLightsPosition2[NUM_LIGHTS] = { {30,30,0},{-20,30,30},{20,30,130},{ 50.0f,60.0f, -30.0f },{50,30,0},{ 50.0f,40.0f, -100.0f } };
-	float gLightStrengths2[NUM_LIGHTS] = {10.0f,40.0f,40.0f,20.0f,40.0f,20.0f};
-	CVector3 gLightsColours2[NUM_LIGHTS] = { { 0.8f, 0.8f, 1.0f } , { 1.0f, 0.8f, 0.2f },{ 0.5f, 0.8f, 0.2f },{ 1.0f, 0.8f, 0.2f }, { 1.0f, 0.8f, 0.2f },{ 1.0f, 0.8f, 0.2f } };
-	for (int i = 0; i < NUM_LIGHTS; i++)
+	// The last two lights are the spotlights with shadow maps. More lights can be added here, the shaders are not
+	// limited to a fixed number
+	const int kStartLights = 6;
+	CVector3 gLightsPosition2[kStartLights] = { {30,30,0},{-20,30,30},{20,30,130},{ 50.0f,60.0f, -30.0f },{50,30,0},{ 50.0f,40.0f, -100.0f } };
+	float gLightStrengths2[kStartLights] = {10.0f,40.0f,40.0f,20.0f,40.0f,20.0f};
+	CVector3 gLightsColours2[kStartLights] = { { 0.8f, 0.8f, 1.0f } , { 1.0f, 0.8f, 0.2f },{ 0.5f, 0.8f, 0.2f },{ 1.0f, 0.8f, 0.2f }, { 1.0f, 0.8f, 0.2f },{ 1.0f, 0.8f, 0.2f } };
+	for (int i = 0; i < kStartLights; i++)
 	{
-		gLightsPosition[i] = gLightsPosition2[i];
-		gLightStrengths[i] = gLightStrengths2[i];
-		gLightsColours[i] = gLightsColours2[i];
+		Light light;
+		light.model = nullptr;
+		light.colour = gLightsColours2[i];
+		light.strength = gLightStrengths2[i];
+		light.spotlight = (i >= 4);
+		light.shadowMap = (i >= 4) ? i - 3 : 0;
+		if (i < 2)   light.lightSets |= LightBuffer::kLightSetWaterSpecular;     // The water's highlights
+		if (i == 3)  light.lightSets |= LightBuffer::kLightSetTransformLighting;
+		gLights.push_back(light);
+		gLightsPosition.push_back(gLightsPosition2[i]);
 	}
 	
 	gColourSwitch = false;
@@ -37,7 +54,7 @@ ModelManager::~ModelManager()
 	delete gPortal;  gPortal = nullptr;
 	delete gPortal2;  gPortal2 = nullptr;
 	
-	for (int i = 0; i < NUM_LIGHTS; i++)
+	for (unsigned int i = 0; i < gLights.size(); i++)
 	{
 		delete gLights[i].model;
 		gLights[i].model=nullptr;
@@ -90,31 +107,58 @@ ModelManager::~ModelManager()
 //==================Creating a new meshes===========================//
 bool ModelManager::LoadMeshes()
 {
-	try
-	{
-		gDuckMesh = new Mesh(MeshesMediaFolder + "duck.obj");
-		gHouseTwoMesh = new Mesh(MeshesMediaFolder + "House2.obj");
-		gTreeMesh = new Mesh(MeshesMediaFolder + "Tree.obj");
-		gTree2Mesh = new Mesh(MeshesMediaFolder + "Tree2.obj");
-		gCubeMesh = new Mesh(MeshesMediaFolder + "Cube.x");
-		gTrollMesh = new Mesh(MeshesMediaFolder + "Troll.x");
-		gDecalMesh = new Mesh(MeshesMediaFolder + "Decal.x");
-		gCrateMesh = new Mesh(MeshesMediaFolder + "CargoContainer.x");
-		gSphereMesh = new Mesh(MeshesMediaFolder + "Sphere.x");
-		gGroundMesh = new Mesh(MeshesMediaFolder + "Hills.x");
-		gLightMesh = new Mesh(MeshesMediaFolder + "Light.x");
-		gPortalMesh = new Mesh(MeshesMediaFolder + "Portal.x");
-		gTeapotMesh = new Mesh(MeshesMediaFolder + "Teapot.x");
-		gFloorMesh = new Mesh(MeshesMediaFolder + "mount.obj");
-		gWaterHouseMesh = new Mesh(MeshesMediaFolder + "waterHouseTwo.obj");
-		gMainHouseMesh = new Mesh(MeshesMediaFolder + "mainHouse.obj");
-		gSkyMesh = new Mesh(MeshesMediaFolder + "Skybox.x");
-		gDummyMesh = new Mesh(MeshesMediaFolder + "Dummy.x");
-		gWaterMesh = new Mesh(CVector3(-200, 0, -200), CVector3(200, 0, 200), 400, 400, true);
-	}
-	catch (std::runtime_error e)
-	{
-		gLastError = e.what();
+	PROFILE_ZONE("LoadMeshes");
+
+	// Meshes are imported (or read from the mesh cache) on worker threads, the GPU buffers for each mesh are
+	// created here as soon as it is ready
+	struct MeshFile
+	{
+		const char* file;
+		Mesh**      mesh;
+	};
+	const MeshFile meshFiles[] =
+	{
+		{ "duck.obj",           &gDuckMesh },
+		{ "House2.obj",         &gHouseTwoMesh },
+		{ "Tree.obj",           &gTreeMesh },
+		{ "Tree2.obj",          &gTree2Mesh },
+		{ "Cube.x",             &gCubeMesh },
+		{ "Troll.x",            &gTrollMesh },
+		{ "Decal.x",            &gDecalMesh },
+		{ "CargoContainer.x",   &gCrateMesh },
+		{ "Sphere.x",           &gSphereMesh },
+		{ "Hills.x",            &gGroundMesh },
+		{ "Light.x",            &gLightMesh },
+		{ "Portal.x",           &gPortalMesh },
+		{ "Teapot.x",           &gTeapotMesh },
+		{ "mount.obj",          &gFloorMesh },
+		{ "waterHouseTwo.obj",  &gWaterHouseMesh },
+		{ "mainHouse.obj",      &gMainHouseMesh },
+		{ "Skybox.x",           &gSkyMesh },
+		{ "Dummy.x",            &gDummyMesh },
+	};
+
+	AssetLoader loader;
+	for (auto& meshFile : meshFiles)
+	{
+		std::string fileName = MeshesMediaFolder + meshFile.file;
+		Mesh** mesh = meshFile.mesh;
+		loader.Add(meshFile.file, [fileName, mesh]() { *mesh = new Mesh(fileName, false, false); },
+		                          [mesh]() { (*mesh)->CreateGPUResources(); });
+	}
+	loader.Add("Water grid", nullptr, [this]() { gWaterMesh = new Mesh(CVector3(-200, 0, -200), CVector3(200, 0, 200), 400, 400, true); });
+
+	std::string error;
+	bool success = loader.Run(error);
+
+	// All mesh geometry is now in the shared buffers, release the space left over from growing them
+	if (success)  gGeometryArena.Trim();
+	ReportLoadTimes(loader.TimingReport("Meshes") + "  Geometry: " + std::to_string(gGeometryArena.NumPools()) + " vertex layouts in " +
+	                std::to_string(gGeometryArena.NumBuffers()) + " buffers, " +
+	                std::to_string(gGeometryArena.NumBytes() / 1024) + "KB\n");
+	if (!success)
+	{
+		gLastError = error;
 		return false;
 	}
 	return true;
@@ -152,7 +196,7 @@ void ModelManager::CreateModels()
 	gModelList.push_back(gWaterHouse);
 	gMainHouse = new Model(gMainHouseMesh);
 	gModelList.push_back(gMainHouse);
-	for (int i = 0; i < NUM_LIGHTS; i++)
+	for (unsigned int i = 0; i < gLights.size(); i++)
 	{
 		gLights[i].model = new Model(gLightMesh);
 	}
@@ -180,6 +224,28 @@ void ModelManager::CreateModels()
 	gDuckMesh->SetTexture = true;
 	gModelList.push_back(gDuck);
 
+	// The houses and the mountain floor hide much of the scene from most places. The second house is see-through
+	gOccluders = { gMainHouse, gWaterHouse, gFloor };
+	gOcclusionBuffer.Resize(kOcclusionWidth, kOcclusionHeight);
+
+	// Shadow casters that only move in the level builder have their shadows cached. The troll, the small models near
+	// it and the water (whose height can be changed) are rendered into the shadow maps every frame
+	gShadowCache.AddCaster(gFloor, true);
+	gShadowCache.AddCaster(gCrate, true);
+	gShadowCache.AddCaster(gCube[0], true);
+	gShadowCache.AddCaster(gCube[1], true);
+	gShadowCache.AddCaster(gMainHouse, true);
+	gShadowCache.AddCaster(gHouseTwo, true, true);
+	for (unsigned int i = 0; i < kTreeNum; ++i)
+	{
+		gShadowCache.AddCaster(gTree[i], true, true);
+		gShadowCache.AddCaster(gTree2[i], true, true);
+	}
+	gShadowCache.AddCaster(gTroll, false, true);
+	gShadowCache.AddCaster(gSphere, false);
+	gShadowCache.AddCaster(gTeapot, false);
+	gShadowCache.AddCaster(gDuck, false, true);
+	gShadowCache.AddCaster(gWater, false);
 }
 //==================Scene set up===========================//
 void ModelManager::InitialSceneSetup()
@@ -187,12 +253,10 @@ void ModelManager::InitialSceneSetup()
 	
 	//Create the lights around the scene
 	//The lights are not added to the model list therefore cant be controlled by model loader
-	for (int i = 0; i < NUM_LIGHTS; i++)
+	for (unsigned int i = 0; i < gLights.size(); i++)
 	{
 		gLights[i].model->SetPosition(gLightsPosition[i]);
-		gLights[i].strength = gLightStrengths[i];
-		gLights[i].colour = gLightsColours[i];
-		gLights[i].model->SetScale(pow(gLightStrengths[i],0.7f));
+		gLights[i].model->SetScale(pow(gLights[i].strength,0.7f));
 	}
 	gLights[4].model->FaceTarget(gTroll->Position());
 	gLights[5].model->FaceTarget(gTroll->Position());
@@ -266,87 +330,83 @@ void ModelManager::CreateCameras()
 }
 
 //==================Default models rendering===========================//
-void ModelManager::RenderDefaultModels()
+// Render the ordinary scene models for a pass from the given camera. The pass uses the given pixel shader and rasterizer
+// state for models that don't need their own. The render queue culls models the camera can't see and sorts the rest
+// so the state changes are kept to a minimum, the pass state is restored afterwards. If an occlusion buffer is given
+// (rendered from the same camera) the models hidden in it are culled as well
+void ModelManager::RenderDefaultModels(const std::string& passName, Camera* camera,
+                                       ID3D11PixelShader* passPixelShader, ID3D11RasterizerState* passRasterizerState,
+                                       const COcclusionBuffer* occlusion /*= nullptr*/)
 {
-	//Set texture to be passed inside the shader if it was manually loaded
-	//Render the model
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gGreyDiffuseSpecularMapSRV);
-	gWaterHouse->Render();
-	gMainHouse->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-	//Ground Texture Selection
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gGroundDiffuseSpecularMapSRV);
-	gFloor->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-
-
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gStoneDiffuseSpecularMapSRV);
-	gCube[0]->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-
+	RenderState passState;
+	passState.vertexShader = gPixelLightingVertexShader;
+	passState.pixelShader = passPixelShader;
+	passState.blendState = gNoBlendingState;
+	passState.depthState = gUseDepthBufferState;
+	passState.rasterizerState = passRasterizerState;
+	PROFILE_ZONE("RenderDefaultModels");
+	gRenderQueue.Begin(passName, passState, camera->Position(), camera->ViewProjectionMatrix(), occlusion);
 
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gCrateDiffuseSpecularMapSRV);
-	gCrate->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-
-
-
-	gTroll->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gTeapotSpecularDiffuseMapSRV);
-	gTeapot->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-
-	gD3DContext->VSSetShader(gLerpVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gLerpPixelShader, nullptr, 0);
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gStoneDiffuseSpecularMapSRV);
-	gD3DContext->PSSetShaderResources(6, 1, &TextureCreator->gBrickDiffuseSpecularMapSRV);
-	gCube[1]->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-	gD3DContext->PSSetShaderResources(6, 1, &gNullSRV);
-
-	
-	gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gPixelLightingPixelShader, nullptr, 0);
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gPortalTextureSRV);
-	gPortal->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-
-
-
-	gD3DContext->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-	gD3DContext->RSSetState(gCullNoneState);
-
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gDecalDiffuseSpecularMapSRV);
-	gDecal->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-
-
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-	gD3DContext->RSSetState(gCullBackState);
-
-	gD3DContext->PSSetShader(gTreePixelShader, nullptr, 0);
-	gD3DContext->OMSetBlendState(gAlphaBlendingState, nullptr, 0xffffff);
-	gDuck->Render();
+	//Set texture to be passed inside the shader if it was manually loaded
+	const RenderState usePassState;
+	gRenderQueue.Submit(gWaterHouse, RenderLayer::Opaque, usePassState, TextureCreator->gGreyDiffuseSpecularMapSRV);
+	gRenderQueue.Submit(gMainHouse,  RenderLayer::Opaque, usePassState, TextureCreator->gGreyDiffuseSpecularMapSRV);
+	gRenderQueue.Submit(gFloor,      RenderLayer::Opaque, usePassState, TextureCreator->gGroundDiffuseSpecularMapSRV);
+	gRenderQueue.Submit(gCube[0],    RenderLayer::Opaque, usePassState, TextureCreator->gStoneDiffuseSpecularMapSRV);
+	gRenderQueue.Submit(gCrate,      RenderLayer::Opaque, usePassState, TextureCreator->gCrateDiffuseSpecularMapSRV);
+	gRenderQueue.Submit(gTeapot,     RenderLayer::Opaque, usePassState, TextureCreator->gTeapotSpecularDiffuseMapSRV);
+	gRenderQueue.SubmitWithMeshTextures(gTroll, RenderLayer::Opaque, usePassState);
+
+	// Cube blending between two textures
+	RenderState lerpState;
+	lerpState.vertexShader = gLerpVertexShader;
+	lerpState.pixelShader = gLerpPixelShader;
+	gRenderQueue.Submit(gCube[1], RenderLayer::Opaque, lerpState,
+	                    TextureCreator->gStoneDiffuseSpecularMapSRV, TextureCreator->gBrickDiffuseSpecularMapSRV);
+
+	// Portals show the scene rendered from their cameras, always with ordinary lighting
+	RenderState portalState;
+	portalState.vertexShader = gPixelLightingVertexShader;
+	portalState.pixelShader = gPixelLightingPixelShader;
+	gRenderQueue.Submit(gPortal,  RenderLayer::Opaque, portalState, TextureCreator->gPortalTextureSRV);
+	gRenderQueue.Submit(gPortal2, RenderLayer::Opaque, portalState,
+	                    TextureCreator->gTVDiffuseSpecularMapSRV, TextureCreator->gPortalTextureSRV);
+
+	// Decal is added on top of the surface behind it
+	RenderState decalState = portalState;
+	decalState.blendState = gAdditiveBlendingState;
+	decalState.depthState = gDepthReadOnlyState;
+	decalState.rasterizerState = gCullNoneState;
+	gRenderQueue.Submit(gDecal, RenderLayer::Decal, decalState, TextureCreator->gDecalDiffuseSpecularMapSRV);
+
+	// Alpha blended models with their own textures, sorted back to front
+	RenderState alphaState;
+	alphaState.vertexShader = gPixelLightingVertexShader;
+	alphaState.pixelShader = gTreePixelShader;
+	alphaState.blendState = gAlphaBlendingState;
 	gPerFrameConstants.alphaValue = 0.1f;
-	gHouseTwo->Render();
+	gRenderQueue.SubmitWithMeshTextures(gDuck,     RenderLayer::Transparent, alphaState);
+	gRenderQueue.SubmitWithMeshTextures(gHouseTwo, RenderLayer::Transparent, alphaState);
+
+	// The tree shader discards most of the transparent pixels, so the trees only need to be back to front among copies
+	// of the same mesh. That lets the queue draw each tree mesh with a single instanced draw
 	for (unsigned int i = 0; i < kTreeNum; ++i)
 	{
-		gTree[i]->Render();
-		gTree2[i]->Render();
+		gRenderQueue.SubmitWithMeshTextures(gTree[i],  RenderLayer::AlphaTested, alphaState);
+		gRenderQueue.SubmitWithMeshTextures(gTree2[i], RenderLayer::AlphaTested, alphaState);
 	}
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gPixelLightingPixelShader, nullptr, 0);
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gTVDiffuseSpecularMapSRV);
-	gD3DContext->PSSetShaderResources(6, 1, &TextureCreator->gPortalTextureSRV);
-	gPortal2->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
-	gD3DContext->PSSetShaderResources(6, 1, &gNullSRV);
 
+	gRenderQueue.Flush();
+}
+//==================Occluders===========================//
+// Rasterise the occluders into the occlusion buffer from the given camera, ready for RenderDefaultModels to test models
+// against. Done on the CPU, see COcclusionBuffer.h
+void ModelManager::RenderOccluders(Camera* camera)
+{
+	PROFILE_ZONE("RenderOccluders");
+	gOcclusionBuffer.Clear(camera->ViewProjectionMatrix());
+	for (auto occluder : gOccluders)  occluder->RenderOccluder(gOcclusionBuffer);
+	gOcclusionBuffer.BuildPyramid();
 }
 //==================Camera details passed to shaders===========================//
 void ModelManager::GetCamera(Camera* cameraIn)
@@ -359,172 +419,234 @@ void ModelManager::GetCamera(Camera* cameraIn)
 	UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
 
 	// Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-	gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
-	gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+	gRenderDevice->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
+	gRenderDevice->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+
+	// Lights reaching each part of this camera's view
+	gLightBuffer.Assign(cameraIn);
+}
+//==================Water and portal visibility===========================//
+// Reflect the camera's matrix in the water plane - to show what is seen in the reflection.
+// Will assume the water is horizontal in the xz plane, which makes the reflection simple:
+// - Negate the y component of the x,y and z axes of the reflected camera matrix
+// - Put the reflected camera y position on the opposite side of the water y position
+CMatrix4x4 ModelManager::ReflectedCameraMatrix(Camera* camera)
+{
+	CMatrix4x4 reflected = camera->WorldMatrix();
+	reflected.e01 *= -1; // Negate y component of each axis of the matrix
+	reflected.e11 *= -1;
+	reflected.e21 *= -1;
+
+	// Camera distance above water = Camera.y - Water.y
+	// Reflected camera is same distance below water = Water.y - (Camera.y - Water.y) = 2*Water.y - Camera.y
+	// (Position is on bottom row (row 3) of matrix so Camera.y is matrix element e31)
+	reflected.e31 = gWater->Position().y * 2 - reflected.e31;
+	return reflected;
+}
+
+// The water textures are only seen from above the water, and only if the water surface is on screen
+bool ModelManager::WaterVisible(Camera* camera)
+{
+	if (camera->Position().y < gWater->Position().y)  return false;
+	return PassScheduler::SurfaceVisible(gWater->WorldBounds(), camera->ViewProjectionMatrix());
+}
+
+// The portal scene is shown on both portal models, which may also be seen reflected in the water
+bool ModelManager::PortalVisible(Camera* camera)
+{
+	CMatrix4x4 viewProjection = camera->ViewProjectionMatrix();
+	if (PassScheduler::SurfaceVisible(gPortal->WorldBounds(), viewProjection) ||
+	    PassScheduler::SurfaceVisible(gPortal2->WorldBounds(), viewProjection))  return true;
+
+	if (!WaterVisible(camera))  return false;
+	CMatrix4x4 reflectedViewProjection = InverseAffine(ReflectedCameraMatrix(camera)) * camera->ProjectionMatrix();
+	return PassScheduler::SurfaceVisible(gPortal->WorldBounds(), reflectedViewProjection) ||
+	       PassScheduler::SurfaceVisible(gPortal2->WorldBounds(), reflectedViewProjection);
 }
 //==================Render Lights===========================//
-void ModelManager::RenderLights()
+// Render the sky and the light models with the vertex and pixel shaders already set. If instanced versions of the
+// shaders are given the light models are rendered together in a single instanced draw instead
+void ModelManager::RenderLights(ID3D11VertexShader* instancedVertexShader /*= nullptr*/,
+                                ID3D11PixelShader* instancedPixelShader /*= nullptr*/)
 {
+	PROFILE_ZONE("RenderLights");
 	gPerModelConstants.objectColour = { 1, 1, 1 };
 
 	// Sky points inwards
-	gD3DContext->RSSetState(gCullNoneState);
+	gRenderDevice->RSSetState(gCullNoneState);
 
 	// Render sky
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gSkyDiffuseSpecularMapSRV);
+	gRenderDevice->PSSetShaderResources(0, 1, &TextureCreator->gSkyDiffuseSpecularMapSRV);
 	gSky->Render();
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
+	gRenderDevice->PSSetShaderResources(0, 1, &gNullSRV);
 
 
 	//// Render lights ////
 
 	//Using a pixel shader that tints the texture - don't need a tint on the sky so set it to white
 
-	gD3DContext->PSSetShaderResources(0, 1, &TextureCreator->gLightDiffuseMapSRV);
+	gRenderDevice->PSSetShaderResources(0, 1, &TextureCreator->gLightDiffuseMapSRV);
 
-	gD3DContext->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-	gD3DContext->RSSetState(gCullNoneState);
+	gRenderDevice->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
+	gRenderDevice->OMSetDepthStencilState(gDepthReadOnlyState, 0);
+	gRenderDevice->RSSetState(gCullNoneState);
 
 	// Render other lit models ////
 	
 
-	for (int i = 0; i < NUM_LIGHTS; i++)
+	// All the lights use the same mesh, so they can be instanced with each light's colour in the instance buffer
+	unsigned int firstInstance = InstanceBuffer::kNoRoom;
+	if (instancedVertexShader != nullptr && instancedPixelShader != nullptr)
 	{
-		gPerModelConstants.objectColour = gLights[i].colour;
-		gLights[i].model->Render();
+		gLightModels.clear();
+		gLightColours.clear();
+		for (auto& light : gLights)
+		{
+			gLightModels.push_back(light.model);
+			gLightColours.push_back(light.colour);
+		}
+		firstInstance = gInstanceBuffer.AddBatch(gLightModels.data(), static_cast<unsigned int>(gLights.size()), gLightColours.data());
 	}
 
-	gD3DContext->PSSetShaderResources(0, 1, &gNullSRV);
+	if (firstInstance != InstanceBuffer::kNoRoom)
+	{
+		gInstanceBuffer.Upload();
+		gRenderDevice->VSSetShader(instancedVertexShader, nullptr, 0);
+		gRenderDevice->PSSetShader(instancedPixelShader, nullptr, 0);
+		gLightMesh->RenderInstanced(firstInstance, static_cast<unsigned int>(gLights.size()));
+	}
+	else
+	{
+		for (unsigned int i = 0; i < gLights.size(); i++)
+		{
+			gPerModelConstants.objectColour = gLights[i].colour;
+			gLights[i].model->Render();
+		}
+	}
+
+	gRenderDevice->PSSetShaderResources(0, 1, &gNullSRV);
 
 	// Restore standard states
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-	gD3DContext->RSSetState(gCullBackState);
+	gRenderDevice->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gRenderDevice->OMSetDepthStencilState(gUseDepthBufferState, 0);
+	gRenderDevice->RSSetState(gCullBackState);
 }
 
 //==================Prepare Render Order===========================//
 void ModelManager::PrepareRenderModels( Camera* camera)
 {
+	PROFILE_ZONE("PrepareRenderModels");
+
 	//***************************
 	// Render scene for portal texture
 	//***************************
 	//Perform normal Render for portal textures first
-	gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gShadowMappingPixelShader, nullptr, 0);
-	
-	gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
-	gD3DContext->VSSetSamplers(0, 1, &gAnisotropic4xSampler);
-	gD3DContext->PSSetSamplers(1, 1, &gBilinearMirrorSampler);
-	
-
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-	gD3DContext->RSSetState(gCullBackState);
+	gRenderDevice->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
+	gRenderDevice->VSSetSamplers(0, 1, &gAnisotropic4xSampler);
+	gRenderDevice->PSSetSamplers(1, 1, &gBilinearMirrorSampler);
 
-	RenderDefaultModels();
+	RenderDefaultModels("Portal", camera, gShadowMappingPixelShader, gCullBackState);
 
+	gRenderDevice->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
+	gRenderDevice->PSSetShader(gPixelLightingPixelShader, nullptr, 0);
 	RenderLights();
 
+	// The water height, refraction and reflection textures are only shown on the water surface, so these passes are
+	// skipped if the water can't be seen from the camera (see PassScheduler.h)
+	bool waterVisible = WaterVisible(camera);
+
 	//***************************
 	// Render water height
 	//***************************
-	gD3DContext->PSSetShaderResources(1, 1, &TextureCreator-> gWaterNormalMapSRV);
-	gD3DContext->VSSetShaderResources(1, 1, &TextureCreator->gWaterNormalMapSRV);
-
-	// Target the water height texture for rendering
-	gD3DContext->OMSetRenderTargets(1, &TextureCreator->gWaterHeightRenderTarget, gDepthStencil);
-
-	// Clear the water depth texture and depth buffer
-	// Note we reuse the same depth buffer for all the rendering passes, clearing it each time
-	float Zero[4] = { 0,0,0,0 };
-	gD3DContext->ClearRenderTargetView(TextureCreator->gWaterHeightRenderTarget, Zero);
-	gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-	// Select shaders
-	gD3DContext->VSSetShader(gWaterSurfaceVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gWaterHeightPixelShader, nullptr, 0);
-	gD3DContext->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
-
-	// Render heights of water surface
-	gWater->Render();
-	
+	if (gPassScheduler.Schedule("Water height", waterVisible))
+	{
+		PROFILE_ZONE("Water height");
+		gRenderDevice->PSSetShaderResources(1, 1, &TextureCreator-> gWaterNormalMapSRV);
+		gRenderDevice->VSSetShaderResources(1, 1, &TextureCreator->gWaterNormalMapSRV);
+
+		// Target the water height texture for rendering
+		gRenderDevice->OMSetRenderTargets(1, &TextureCreator->gWaterHeightRenderTarget, gDepthStencil);
+
+		// Clear the water depth texture and depth buffer
+		// Note we reuse the same depth buffer for all the rendering passes, clearing it each time
+		float Zero[4] = { 0,0,0,0 };
+		gRenderDevice->ClearRenderTargetView(TextureCreator->gWaterHeightRenderTarget, Zero);
+		gRenderDevice->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+		// Select shaders
+		gRenderDevice->VSSetShader(gWaterSurfaceVertexShader, nullptr, 0);
+		gRenderDevice->PSSetShader(gWaterHeightPixelShader, nullptr, 0);
+		gRenderDevice->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
+
+		// Render heights of water surface
+		gWater->Render();
+	}
 
 	//***************************
 	// Render refracted scene
 	//***************************
+	if (gPassScheduler.Schedule("Refraction", waterVisible))
+	{
+		PROFILE_ZONE("Refraction");
+		// Target the refraction texture for rendering and clear depth buffer
+		gRenderDevice->OMSetRenderTargets(1, &TextureCreator->gRefractionRenderTarget, gDepthStencil);
+		gRenderDevice->ClearRenderTargetView(TextureCreator->gRefractionRenderTarget, &gBackgroundColor.r);
+		gRenderDevice->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-	// Target the refraction texture for rendering and clear depth buffer
-	gD3DContext->OMSetRenderTargets(1, &TextureCreator->gRefractionRenderTarget, gDepthStencil);
-	gD3DContext->ClearRenderTargetView(TextureCreator->gRefractionRenderTarget, &gBackgroundColor.r);
-	gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-	// Select the water height map (rendered in the last step) as a texture, so the refraction shader can tell what is underwater
-	gD3DContext->PSSetShaderResources(2, 1, &TextureCreator->gWaterHeightSRV); // First parameter must match texture slot number in the shader
+		// Select the water height map (rendered in the last step) as a texture, so the refraction shader can tell what is underwater
+		gRenderDevice->PSSetShaderResources(2, 1, &TextureCreator->gWaterHeightSRV); // First parameter must match texture slot number in the shader
 
-	gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gRefractedPixelLightingPixelShader, nullptr, 0);
+		RenderDefaultModels("Refraction", camera, gRefractedPixelLightingPixelShader, gCullBackState);
 
-	RenderDefaultModels();
+		gRenderDevice->VSSetShader(gBasicTransformWorldPosVertexShader, nullptr, 0);
+		gRenderDevice->PSSetShader(gRefractedTintedTexturePixelShader, nullptr, 0);
 
-	gD3DContext->VSSetShader(gBasicTransformWorldPosVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gRefractedTintedTexturePixelShader, nullptr, 0);
+		RenderLights();
+	}
 
-	RenderLights();
-	
 	//***************************
 	// Render reflected scene
 	//***************************
+	if (gPassScheduler.Schedule("Reflection", waterVisible))
+	{
+		PROFILE_ZONE("Reflection");
+		// Reflect the camera's matrix in the water plane - to show what is seen in the reflection
+		CMatrix4x4 originalMatrix = camera->WorldMatrix();
+		camera->WorldMatrix() = ReflectedCameraMatrix(camera);
 
-	// Reflect the camera's matrix in the water plane - to show what is seen in the reflection.
-	// Will assume the water is horizontal in the xz plane, which makes the reflection simple:
-	// - Negate the y component of the x,y and z axes of the reflected camera matrix
-	// - Put the reflected camera y position on the opposite side of the water y position
-	CMatrix4x4 originalMatrix = camera->WorldMatrix();
-	camera->XAxis().y *= -1; // Negate y component of each axis of the matrix
-	camera->YAxis().y *= -1;
-	camera->ZAxis().y *= -1;
-
-	// Camera distance above water = Camera.y - Water.y
-	// Reflected camera is same distance below water = Water.y - (Camera.y - Water.y) = 2*Water.y - Camera.y
-	// (Position is on bottom row (row 3) of matrix so Camera.y is matrix element e31)
-	camera->Position().y = gWater->Position().y * 2 - camera->Position().y;
-
-	// Use camera with reflected matrix for rendering
-	GetCamera(camera);
+		// Use camera with reflected matrix for rendering
+		GetCamera(camera);
 
-	// IMPORTANT: when rendering in a mirror must switch from back face culling to front face culling (because clockwise / anti-clockwise order of points will be reversed)
-	gD3DContext->RSSetState(gCullFrontState);
+		// IMPORTANT: when rendering in a mirror must switch from back face culling to front face culling (because clockwise / anti-clockwise order of points will be reversed)
+		gRenderDevice->RSSetState(gCullFrontState);
 
-	// Target the reflection texture for rendering and clear depth buffer
-	gD3DContext->OMSetRenderTargets(1, &TextureCreator->gReflectionRenderTarget, gDepthStencil);
-	gD3DContext->ClearRenderTargetView(TextureCreator->gReflectionRenderTarget, &gBackgroundColor.r);
-	gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+		// Target the reflection texture for rendering and clear depth buffer
+		gRenderDevice->OMSetRenderTargets(1, &TextureCreator->gReflectionRenderTarget, gDepthStencil);
+		gRenderDevice->ClearRenderTargetView(TextureCreator->gReflectionRenderTarget, &gBackgroundColor.r);
+		gRenderDevice->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-	// Note that water height map is still selected as a texture (from the previous step) and will be used here to tell what is above the water
+		// Note that water height map is still selected as a texture (from the previous step) and will be used here to tell what is above the water
 
-	////// Render lit models
+		////// Render lit models
 
-	// Select shaders for reflection rendering of lit models
-	gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gReflectedPixelLightingPixelShader, nullptr, 0);
+		// Select shaders for reflection rendering of lit models
+		RenderDefaultModels("Reflection", camera, gReflectedPixelLightingPixelShader, gCullFrontState);
 
-	RenderDefaultModels();
 
+		// Select shaders for reflection rendering of non-lit models
+		gRenderDevice->VSSetShader(gBasicTransformWorldPosVertexShader, nullptr, 0);
+		gRenderDevice->PSSetShader(gReflectedTintedTexturePixelShader, nullptr, 0);
 
-	// Select shaders for reflection rendering of non-lit models
-	gD3DContext->VSSetShader(gBasicTransformWorldPosVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gReflectedTintedTexturePixelShader, nullptr, 0);
+		RenderLights();
 
-	RenderLights();
-	
-	// Restore original camera and culling state
-	camera->WorldMatrix() = originalMatrix;
-	GetCamera(camera);
-	gD3DContext->RSSetState(gCullBackState);
+		// Restore original camera and culling state
+		camera->WorldMatrix() = originalMatrix;
+		GetCamera(camera);
+		gRenderDevice->RSSetState(gCullBackState);
+	}
 
 	// Detach the water height map from being a source texture so it can be used as a render target again next frame (if you don't do this DX emits lots of warnings)
-	gD3DContext->PSSetShaderResources(2, 1, &gNullSRV);
+	gRenderDevice->PSSetShaderResources(2, 1, &gNullSRV);
 
 
 	/****************************
@@ -532,54 +654,102 @@ void ModelManager::PrepareRenderModels( Camera* camera)
 	****************************/
 
 	// Finally target the back buffer for rendering, clear depth buffer
-	gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
-	gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	gRenderDevice->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
+	gRenderDevice->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
 	////// Render lit models
 
 	// Select shaders for ordinary rendering of lit models
-	gD3DContext->PSSetShaderResources(7, 1, &TextureCreator->gShadowMap1SRV);
-	gD3DContext->PSSetShaderResources(8, 1, &TextureCreator->gShadowMap2SRV);
+	gRenderDevice->PSSetShaderResources(7, 1, &TextureCreator->gShadowMap1SRV);
+	gRenderDevice->PSSetShaderResources(8, 1, &TextureCreator->gShadowMap2SRV);
 
-	gD3DContext->PSSetSamplers(1, 1, &gPointSampler);
-	gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gShadowMappingPixelShader, nullptr, 0);
-	
-	
-	RenderDefaultModels();
+	gRenderDevice->PSSetSamplers(1, 1, &gPointSampler);
+
+	// Only the main pass uses the occlusion buffer. The refraction pass is from the same camera but its shader drops
+	// what is above the water, so the occluders may not hide anything there
+	RenderOccluders(camera);
+	RenderDefaultModels("Main", camera, gShadowMappingPixelShader, gCullBackState, &gOcclusionBuffer);
 
 	////// Render water surface - combining reflection and refraction
 	// Render water before transparent objects or it will draw over them
 
 	// Select the reflection and refraction textures (rendered in the previous steps)
-	gD3DContext->PSSetShaderResources(3, 1, &TextureCreator->gRefractionSRV); // First parameter must match texture slot number in the shader
-	gD3DContext->PSSetShaderResources(4, 1, &TextureCreator->gReflectionSRV);
+	gRenderDevice->PSSetShaderResources(3, 1, &TextureCreator->gRefractionSRV); // First parameter must match texture slot number in the shader
+	gRenderDevice->PSSetShaderResources(4, 1, &TextureCreator->gReflectionSRV);
 
-	gD3DContext->VSSetShader(gWaterSurfaceVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gWaterSurfacePixelShader, nullptr, 0);
+	gRenderDevice->VSSetShader(gWaterSurfaceVertexShader, nullptr, 0);
+	gRenderDevice->PSSetShader(gWaterSurfacePixelShader, nullptr, 0);
 	gWater->Render();
 
 	// Detach the reflection/refraction maps from being source textures so they can be used as a render target again next frame (if you don't do this DX emits lots of warnings)
-	gD3DContext->PSSetShaderResources(3, 1, &gNullSRV);
-	gD3DContext->PSSetShaderResources(4, 1, &gNullSRV);
+	gRenderDevice->PSSetShaderResources(3, 1, &gNullSRV);
+	gRenderDevice->PSSetShaderResources(4, 1, &gNullSRV);
 
 
 	////// Render sky and lights
 
 	// Select shaders for ordinary rendering of non-lit models
-	gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gTintedTexturePixelShader, nullptr, 0);
+	gRenderDevice->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
+	gRenderDevice->PSSetShader(gTintedTexturePixelShader, nullptr, 0);
 
-	RenderLights();
-	gD3DContext->PSSetShaderResources(7, 1, &gNullSRV);
-	gD3DContext->PSSetShaderResources(8, 1, &gNullSRV);
+	RenderLights(gLightModelInstancedVertexShader, gTintedTextureInstancedPixelShader);
+	gRenderDevice->PSSetShaderResources(7, 1, &gNullSRV);
+	gRenderDevice->PSSetShaderResources(8, 1, &gNullSRV);
 	
 	
 }
 
+//==================Update model tree===========================//
+// Keep the tree of model bounds up to date, call once per frame before rendering. The tree is built when the model list
+// changes. Otherwise only models whose bounds have changed since their tree item was set are updated, and now and then
+// the tree is rebuilt if the updates have made it too loose. Movement is found from the models' bounds versions rather
+// than the frame their matrices were recalculated, as a model moved and then queried earlier in the frame (e.g. by
+// picking) would already have new matrices but an old box in the tree
+void ModelManager::UpdateModelTree()
+{
+	PROFILE_ZONE("UpdateModelTree");
+	if (gModelTree.NumItems() != gModelList.size())
+	{
+		gModelTreeBounds.clear();
+		gModelTreeVersions.clear();
+		for (unsigned int i = 0; i < gModelList.size(); ++i)
+		{
+			gModelList[i]->TreeItem = i;
+			gModelTreeBounds.push_back(gModelList[i]->WorldBounds());
+			gModelTreeVersions.push_back(gModelList[i]->BoundsVersion());
+		}
+		gModelTree.Build(gModelTreeBounds.data(), static_cast<uint32_t>(gModelTreeBounds.size()));
+		gModelTreeLastCheck = gFrameNumber;
+		return;
+	}
+
+	bool modelsMoved = false;
+	for (auto model : gModelList)
+	{
+		unsigned int version = model->BoundsVersion(); // Recalculates the matrices if the model has changed
+		if (version != gModelTreeVersions[model->TreeItem])
+		{
+			gModelTree.Update(model->TreeItem, model->WorldBounds());
+			gModelTreeVersions[model->TreeItem] = version;
+			modelsMoved = true;
+		}
+	}
+
+	if (modelsMoved && gFrameNumber - gModelTreeLastCheck >= gModelTreeCheckFrames)
+	{
+		gModelTreeLastCheck = gFrameNumber;
+		if (gModelTree.NeedsRebuild())
+		{
+			for (unsigned int i = 0; i < gModelList.size(); ++i)  gModelTreeBounds[i] = gModelTree.ItemBox(i);
+			gModelTree.Build(gModelTreeBounds.data(), static_cast<uint32_t>(gModelTreeBounds.size()));
+		}
+	}
+}
+
 //==================Update models===========================//
 void ModelManager::UpdateModels(float &frameTime)
 {
+	PROFILE_ZONE("UpdateModels");
 
 	static float rotate2 = 0.0f;
 	static float go = true;
@@ -719,9 +889,7 @@ void ModelManager::UpdateModels(float &frameTime)
 	if (KeyHeld(Key_I)) gPerFrameConstants.blurIncrement += gBloomIncrement * frameTime;
 	if (KeyHeld(Key_K)) gPerFrameConstants.blurIncrement -= gBloomIncrement * frameTime;
 	//Updating the matrix of the Water mill to create a spinning animation for the water mill
-	MatrixCopy = gWaterHouse->WorldMatrix(2);
-	MatrixCopy.RotateLocalX(-(gWaterMillSpin *frameTime));
-	gWaterHouse->SetWorldMatrix(MatrixCopy,2);
+	gWaterHouse->SetRotation(Normalise(QuaternionRotationX(-(gWaterMillSpin * frameTime)) * gWaterHouse->RotationQuaternion(2)), 2);
 	//Camera Work with selecting models
 	//Main camera
 	if (KeyHit(Key_F1))
@@ -748,22 +916,55 @@ void ModelManager::UpdateModels(float &frameTime)
 		//Every time the game is ran after saving the model changed position, it will load the model with coordinates read from the file
 		if (KeyHit(Mouse_LButton))
 		{
-			//Perform Camera Picking so the closest object in the camera Z-direction will be picked
-			//Check which model you have selected by running through a list of models
+			//Perform Camera Picking so the closest object under the mouse will be picked
+			//A ray from the camera through the mouse is cast into the model tree, which only tests the models near the ray,
+			//then against the triangles of those models (see Mesh::RayCast)
 			//Once the model has been selected make a new pointer to point at it so we can modify it's values 
 			//The new pointer allows us to deal with individual model without having to access their main pointer
-			for (auto it = gModelList.begin(); it != gModelList.end(); it++)
+			CVector3 rayOrigin, rayDirection;
+			gCamera->RayFromPixel(CVector2((float)GetMouseX(), (float)GetMouseY()), gViewportWidth, gViewportHeight, rayOrigin, rayDirection);
+			CVector3 inverseDirection = InverseDirection(rayDirection);
+
+			//The sky surrounds everything and can't be clicked on, so it is skipped. Other models' boxes may contain the camera
+			//(e.g. the floor or the mountain) and are still tested - RayHitsBox gives an entry distance of 0 for them
+			float pickDistance = gCamera->FarClip();
+			unsigned int hitNode = 0, hitSubMesh = 0, hitTriangle = 0;
+			uint32_t picked = gModelTree.RayCast(rayOrigin, rayDirection, pickDistance, [&](uint32_t item, float maxDistance)
+			{
+				if (gModelList[item] == gSky)  return FLT_MAX;
+				float entry;
+				if (!RayHitsBox(gModelTree.ItemBox(item), rayOrigin, inverseDirection, maxDistance, entry))  return FLT_MAX;
+
+				float distance = maxDistance;
+				unsigned int node, subMesh, triangle;
+				if (!gModelList[item]->RayCast(rayOrigin, rayDirection, distance, node, subMesh, triangle))  return FLT_MAX;
+				hitNode = node;
+				hitSubMesh = subMesh;
+				hitTriangle = triangle;
+				return distance;
+			});
+			if (picked != CBoundingVolumeTree::kNoItem)
 			{
-				CVector3 modelPicked = gCamera->PixelFromWorldPt((*it)->Position(), gViewportWidth, gViewportHeight);
-				float pixelDistance = Distance(CVector2((float)GetMouseX(), (float)GetMouseY()), CVector2(modelPicked.x, modelPicked.y));
-				if (pixelDistance < gNearestDistance)
-				{
-					gSelectedModel = *it;
-					gSelectedModel->Selected = true;//Additional check if the model has been selected
-				}
+				gSelectedModel = gModelList[picked];
+				gSelectedNode = hitNode;
+				gSelectedSubMesh = hitSubMesh;
+				gSelectedTriangle = hitTriangle;
+				gSelectedModel->Selected = true;//Additional check if the model has been selected
 			}
 
 		}
+		//If you have selected model the Right Mouse Key will allow you to unselect it
+		if (KeyHit(Mouse_RButton) && gSelectedModel != nullptr)
+		{
+			gSelectedModel->Selected = false;
+			gSelectedModel = nullptr;
+		}
+		//Keep the selected model's matrix to see if the controls below move it. Taken once this frame's picking and
+		//unselecting are done, so it is the model the controls will move
+		Model* movedModel = gSelectedModel;
+		CMatrix4x4 movedModelMatrix;
+		if (movedModel != nullptr)  movedModelMatrix = movedModel->WorldMatrix();
+
 		//If a model has been selected
 		if (gSelectedModel != nullptr && gSelectedModel->Selected)
 		{
@@ -799,16 +1000,16 @@ void ModelManager::UpdateModels(float &frameTime)
 			gRotationFile.close();
 			gScaleFile.close();
 		}
-		//If you have selected model the Right Mouse Key will allow you to unselect it
-		if (KeyHit(Mouse_RButton) && gSelectedModel != nullptr)
-		{
-			gSelectedModel->Selected = false;
-			gSelectedModel = nullptr;
-		}
 		//Controls for the model
 		if (gSelectedModel != nullptr && gSelectedModel->Selected)gSelectedModel->Control(0, frameTime,
 			Key_Numpad0, Key_Numpad0, Key_Numpad1, Key_Numpad3, Key_Multiply, Key_Divide,
 			Key_Numpad8, Key_Numpad2, Key_Numpad4, Key_Numpad6, Key_Numpad7, Key_Numpad9);
+		//Moving a static shadow caster makes the cached shadow maps out of date (see ShadowCache.h)
+		if (movedModel != nullptr)
+		{
+			CMatrix4x4 newMatrix = movedModel->WorldMatrix();
+			if (std::memcmp(&movedModelMatrix, &newMatrix, sizeof(CMatrix4x4)) != 0)  gShadowCache.InvalidateModel(movedModel);
+		}
 		gLastPosition = gCamera->Position();//Keeps the last position of the main camera for swithching between cameras
 	}
 	else if (gCurrentCamera == CameraTypes::FirtsPerson)
@@ -9,6 +9,12 @@
 #include <sstream>
 #include <string>
 #include "SoundClass.h"
+#include "RenderQueue.h"
+#include "CBoundingVolumeTree.h"
+#include "COcclusionBuffer.h"
+#include "PassScheduler.h"
+#include "ShadowCache.h"
+#include "LightBuffer.h"
 #ifndef _MODELMANAGER_H_INCLUDED_
 #define _MODELMANAGER_H_INCLUDED_
 class ModelManager
@@ -20,7 +26,6 @@ public:
 	static const int kTreeNum = 10;
 	const float gLightOrbit = 20.0f;
 	const float gLightOrbitSpeed = 0.7f;
-	static const int NUM_LIGHTS = 6;
 	const float gScaleFactor = 0.5f;
 	float ColourMax = 1.0f;
 	float gWiggleIncrement = 6.0f;
@@ -29,7 +34,6 @@ public:
 	const float gBloomIncrement = 10.0f;
 	const float gWaterMillSpin = 0.5f;
 	const int gWholeMesh = 0;
-	const float gNearestDistance = 150;
 	float gFirstPersonY = 27.0f;
 	float gFirstPersonZ = 2.0f;
 	const std::string MeshesMediaFolder = "./Media/Meshes/";
@@ -45,6 +49,15 @@ public:
 	string ScaleFile = "ScaleFactor.txt";
 	//==========Meshes=========//
 	vector <Model*> gModelList;
+	CBoundingVolumeTree gModelTree;          // World bounds of the models in gModelList, for picking and culling
+	vector <CBoundingBox> gModelTreeBounds;  // Working space for building the tree
+	vector <unsigned int> gModelTreeVersions; // Bounds version (see Model::BoundsVersion) of each model in the tree
+	const unsigned int gModelTreeCheckFrames = 60; // How often to check if the tree needs rebuilding while models move
+	unsigned int gModelTreeLastCheck = 0;
+	COcclusionBuffer gOcclusionBuffer;       // Software depth buffer of the occluders below, culls the main pass models hidden behind them
+	vector <Model*> gOccluders;              // Large rigid models that hide much of the scene
+	static const int kOcclusionWidth = 256;  // Size of the occlusion buffer in pixels
+	static const int kOcclusionHeight = 144;
 
 	Mesh* gCubeMesh;
 	Mesh* gTreeMesh;
@@ -82,17 +95,24 @@ public:
 	Model* gWater;
 	Model* gSky;
 	Model* gSelectedModel;
+	unsigned int gSelectedNode = 0;     // Where the ray hit the selected model, see Model::RayCast
+	unsigned int gSelectedSubMesh = 0;
+	unsigned int gSelectedTriangle = 0;
 	struct Light
 	{
-		Model*   model;
-		CVector3 colour;
-		float    strength;
+		Model*       model;
+		CVector3     colour;
+		float        strength;
+		bool         spotlight = false; // Spotlights shine along the model's z axis, see gSpotlightConeAngle
+		unsigned int shadowMap = 0;     // 1 or 2 for the spotlights rendered with shadow maps, else 0
+		unsigned int lightSets = LightBuffer::kLightSetGeneral; // Shaders using the light, see LightBuffer.h
 	};
 	bool gRenderPortal = true;
-	Light gLights[NUM_LIGHTS];
-	CVector3 gLightsPosition[NUM_LIGHTS];
-	float gLightStrengths[NUM_LIGHTS];
-	CVector3 gLightsColours[NUM_LIGHTS];
+	vector <Light> gLights;              // Any number of lights, binned into clusters for the shaders (see LightBuffer.h)
+	vector <CVector3> gLightsPosition;   // Starting positions of the lights
+	const float gLightCutoff = 0.05f;    // Lights fade out where strength / distance drops to this, so range = strength / cutoff
+	vector <Model*> gLightModels;        // Working space for rendering the light models instanced
+	vector <CVector3> gLightColours;
 	Model* gInnScene;
 	Model* gTroll;
 	Model* gPortal;
@@ -143,9 +163,11 @@ public:
 	float gMaxLightStrength;
 	bool gTextureCount;
 	float gSpotlightConeAngle;
-	CMatrix4x4 MatrixCopy;
 
 	ID3D11ShaderResourceView* gNullSRV = nullptr;
+	RenderQueue gRenderQueue; // Sorts the default models in each pass to reduce state changes
+	PassScheduler gPassScheduler; // Skips the portal and water passes when their surfaces can't be seen
+	ShadowCache gShadowCache;     // Static and dynamic shadow casters, and which cached shadow maps are up to date
 	enum class CameraTypes
 	{
 		Free,
@@ -160,10 +182,23 @@ public:
 	void CreateModels();
 	void InitialSceneSetup();
 	void CreateCameras();
-	void RenderDefaultModels();
-	void RenderLights();
+	void RenderDefaultModels(const std::string& passName, Camera* camera,
+	                         ID3D11PixelShader* passPixelShader, ID3D11RasterizerState* passRasterizerState,
+	                         const COcclusionBuffer* occlusion = nullptr);
+	// Rasterise the occluders into the occlusion buffer from the given camera
+	void RenderOccluders(Camera* camera);
+	// Render the sky and the light models with the vertex and pixel shaders already set. If instanced versions of the
+	// shaders are given the light models are rendered together in a single instanced draw instead
+	void RenderLights(ID3D11VertexShader* instancedVertexShader = nullptr, ID3D11PixelShader* instancedPixelShader = nullptr);
 	void GetCamera(Camera* camera);
+	// The camera's world matrix reflected in the water surface
+	CMatrix4x4 ReflectedCameraMatrix(Camera* camera);
+	// Whether the water surface can be seen from the camera, i.e. whether its textures need rendering
+	bool WaterVisible(Camera* camera);
+	// Whether either portal can be seen from the camera, directly or in the water
+	bool PortalVisible(Camera* camera);
 	void PrepareRenderModels( Camera *camera);
+	void UpdateModelTree();
 	void UpdateModels(float &frameTime);
 };
 extern ModelManager* ModelCreator;
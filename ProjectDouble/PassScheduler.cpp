@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Pass scheduler - decides which auxiliary rendering passes are needed each frame
+//--------------------------------------------------------------------------------------
+
+#include "PassScheduler.h"
+#include "CFrustum.h"
+
+#include <sstream>
+#include <iomanip>
+
+
+// A surface smaller than about 30x30 pixels on a 1280x720 screen
+const float PassScheduler::kMinScreenArea = 0.001f;
+
+
+// Whether a surface can be seen: inside the frustum and covering enough of the screen
+bool PassScheduler::SurfaceVisible(const CBoundingBox& worldBounds, const CMatrix4x4& viewProjection)
+{
+	if (!CFrustum(viewProjection).IsVisible(worldBounds))  return false;
+	return ProjectedArea(worldBounds, viewProjection) >= kMinScreenArea;
+}
+
+
+// Start the decisions for a new frame
+void PassScheduler::BeginFrame()
+{
+	mFrame.clear();
+}
+
+
+// Record whether a pass runs this frame and return it
+bool PassScheduler::Schedule(const std::string& passName, bool run)
+{
+	mFrame.push_back({ passName, run });
+
+	PassStats* stats = nullptr;
+	for (auto& passStats : mStats)
+	{
+		if (passStats.name == passName)  stats = &passStats;
+	}
+	if (stats == nullptr)
+	{
+		mStats.emplace_back();
+		stats = &mStats.back();
+		stats->name = passName;
+	}
+	if (run)  ++stats->ran;
+	else      ++stats->skipped;
+	return run;
+}
+
+
+// Which passes ran and which were skipped in the current frame
+std::string PassScheduler::FrameReport() const
+{
+	std::string ran, skipped;
+	for (auto& decision : mFrame)
+	{
+		std::string& list = decision.ran ? ran : skipped;
+		if (!list.empty())  list += ", ";
+		list += decision.name;
+	}
+	return "ran: " + (ran.empty() ? "none" : ran) + "  skipped: " + (skipped.empty() ? "none" : skipped);
+}
+
+
+// One line per pass, averaged over the given number of frames
+std::string PassScheduler::StatsReport(unsigned int numFrames) const
+{
+	if (numFrames == 0)  numFrames = 1;
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(1);
+	for (auto& passStats : mStats)
+	{
+		report << "  " << std::left << std::setw(16) << passStats.name << std::right
+		       << " ran " << std::setw(4) << static_cast<float>(passStats.ran) / numFrames
+		       << "  skipped " << std::setw(4) << static_cast<float>(passStats.skipped) / numFrames << " per frame\n";
+	}
+	return report.str();
+}
@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------------------
+// Pass scheduler - decides which auxiliary rendering passes are needed each frame
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Some passes only render a texture for a surface in the scene: the portal scene is shown on the portal models, the
+// water height, refraction and reflection textures on the water. These passes are skipped when none of the surfaces
+// showing their result can be seen, i.e. the surfaces are outside the view frustum or too small on screen to matter.
+// A skipped pass leaves its texture as it was, but the texture is only stale while its surfaces are out of sight - the
+// pass runs again in the same frame they come back into view.
+//
+// Call BeginFrame once per frame, then Schedule for each auxiliary pass with whether its surfaces are visible. The
+// scheduler records the decisions for the per-frame report and the run counts used in the debug output
+
+#ifndef _PASS_SCHEDULER_H_INCLUDED_
+#define _PASS_SCHEDULER_H_INCLUDED_
+
+#include "BoundingVolumes.h"
+#include "CMatrix4x4.h"
+#include <string>
+#include <vector>
+
+
+class PassScheduler
+{
+public:
+	// Surfaces covering less than this fraction of the screen don't make their passes run
+	static const float kMinScreenArea;
+
+	// Whether a surface with the given world bounds can be seen with the given view-projection matrix: inside the
+	// frustum and covering at least kMinScreenArea of the screen
+	static bool SurfaceVisible(const CBoundingBox& worldBounds, const CMatrix4x4& viewProjection);
+
+	// Start the decisions for a new frame
+	void BeginFrame();
+
+	// Record whether a pass runs this frame and return it, so it can be used directly in an if statement. A pass may be
+	// scheduled more than once a frame, e.g. once for each camera
+	bool Schedule(const std::string& passName, bool run);
+
+	// Which passes ran and which were skipped in the current frame, e.g. "ran: Reflection  skipped: Portal scene"
+	std::string FrameReport() const;
+
+	// One line per pass with how many times it ran and was skipped, averaged over the given number of frames
+	std::string StatsReport(unsigned int numFrames) const;
+	void        ResetStats()  { mStats.clear(); }
+
+
+private:
+	struct PassStats
+	{
+		std::string  name;
+		unsigned int ran     = 0;
+		unsigned int skipped = 0;
+	};
+	std::vector<PassStats> mStats;
+
+	// Decisions in the current frame, in the order they were made
+	struct Decision
+	{
+		std::string name;
+		bool        ran;
+	};
+	std::vector<Decision> mFrame;
+};
+
+
+#endif //_PASS_SCHEDULER_H_INCLUDED_
@@ -0,0 +1,193 @@
+//--------------------------------------------------------------------------------------
+// Recording render device - a render device that captures commands instead of using the GPU
+//--------------------------------------------------------------------------------------
+
+#include "RecordingRenderDevice.h"
+
+
+// Clear the log and the counts. The log keeps its memory so recording the next frame doesn't allocate
+void RecordingRenderDevice::Reset()
+{
+	mCommands.clear();
+	for (auto& count : mCounts)  count = 0;
+	mBytesUploaded = 0;
+}
+
+// Number of Set... commands, i.e. the types up to SetDepthStencilState. Clears, copies, draws, buffer updates and
+// presents are not state changes
+unsigned int RecordingRenderDevice::NumStateChanges() const
+{
+	unsigned int numStateChanges = 0;
+	for (int type = 0; type <= static_cast<int>(RenderCommandType::SetDepthStencilState); ++type)
+	{
+		numStateChanges += mCounts[type];
+	}
+	return numStateChanges;
+}
+
+
+// Count a command and log it if required
+void RecordingRenderDevice::Record(RenderCommandType type, RenderShaderStage stage, const void* object,
+                                   UINT slot /*= 0*/, UINT count /*= 1*/, UINT value /*= 0*/, INT baseVertex /*= 0*/)
+{
+	++mCounts[static_cast<int>(type)];
+	if (mLogCommands)
+	{
+		mCommands.push_back({ type, stage, object, slot, count, value, baseVertex });
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Render device methods - record the command, nothing is sent to DirectX
+//--------------------------------------------------------------------------------------
+
+void RecordingRenderDevice::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	Record(RenderCommandType::SetInputLayout, RenderShaderStage::None, inputLayout);
+}
+
+void RecordingRenderDevice::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	Record(RenderCommandType::SetPrimitiveTopology, RenderShaderStage::None, nullptr, 0, 1, static_cast<UINT>(topology));
+}
+
+void RecordingRenderDevice::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* vertexBuffers,
+                                               const UINT* /*strides*/, const UINT* /*offsets*/)
+{
+	Record(RenderCommandType::SetVertexBuffers, RenderShaderStage::None, First(vertexBuffers, numBuffers), startSlot, numBuffers);
+}
+
+void RecordingRenderDevice::IASetIndexBuffer(ID3D11Buffer* indexBuffer, DXGI_FORMAT format, UINT /*offset*/)
+{
+	Record(RenderCommandType::SetIndexBuffer, RenderShaderStage::None, indexBuffer, 0, 1, static_cast<UINT>(format));
+}
+
+
+void RecordingRenderDevice::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const*, UINT)
+{
+	Record(RenderCommandType::SetShader, RenderShaderStage::Vertex, shader);
+}
+
+void RecordingRenderDevice::GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const*, UINT)
+{
+	Record(RenderCommandType::SetShader, RenderShaderStage::Geometry, shader);
+}
+
+void RecordingRenderDevice::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const*, UINT)
+{
+	Record(RenderCommandType::SetShader, RenderShaderStage::Pixel, shader);
+}
+
+
+void RecordingRenderDevice::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	Record(RenderCommandType::SetConstantBuffers, RenderShaderStage::Vertex, First(constantBuffers, numBuffers), startSlot, numBuffers);
+}
+
+void RecordingRenderDevice::GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	Record(RenderCommandType::SetConstantBuffers, RenderShaderStage::Geometry, First(constantBuffers, numBuffers), startSlot, numBuffers);
+}
+
+void RecordingRenderDevice::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	Record(RenderCommandType::SetConstantBuffers, RenderShaderStage::Pixel, First(constantBuffers, numBuffers), startSlot, numBuffers);
+}
+
+
+void RecordingRenderDevice::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews)
+{
+	Record(RenderCommandType::SetShaderResources, RenderShaderStage::Vertex, First(shaderResourceViews, numViews), startSlot, numViews);
+}
+
+void RecordingRenderDevice::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews)
+{
+	Record(RenderCommandType::SetShaderResources, RenderShaderStage::Pixel, First(shaderResourceViews, numViews), startSlot, numViews);
+}
+
+
+void RecordingRenderDevice::VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	Record(RenderCommandType::SetSamplers, RenderShaderStage::Vertex, First(samplers, numSamplers), startSlot, numSamplers);
+}
+
+void RecordingRenderDevice::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	Record(RenderCommandType::SetSamplers, RenderShaderStage::Pixel, First(samplers, numSamplers), startSlot, numSamplers);
+}
+
+
+void RecordingRenderDevice::RSSetState(ID3D11RasterizerState* rasterizerState)
+{
+	Record(RenderCommandType::SetRasterizerState, RenderShaderStage::None, rasterizerState);
+}
+
+void RecordingRenderDevice::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* /*viewports*/)
+{
+	Record(RenderCommandType::SetViewports, RenderShaderStage::None, nullptr, 0, numViewports);
+}
+
+void RecordingRenderDevice::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargetViews,
+                                               ID3D11DepthStencilView* depthStencilView)
+{
+	// Log the first render target, or the depth buffer if there are no render targets (e.g. a shadow map pass)
+	const void* object = First(renderTargetViews, numViews);
+	Record(RenderCommandType::SetRenderTargets, RenderShaderStage::None, object != nullptr ? object : depthStencilView, 0, numViews);
+}
+
+void RecordingRenderDevice::OMSetBlendState(ID3D11BlendState* blendState, const FLOAT* /*blendFactor*/, UINT /*sampleMask*/)
+{
+	Record(RenderCommandType::SetBlendState, RenderShaderStage::None, blendState);
+}
+
+void RecordingRenderDevice::OMSetDepthStencilState(ID3D11DepthStencilState* depthStencilState, UINT stencilRef)
+{
+	Record(RenderCommandType::SetDepthStencilState, RenderShaderStage::None, depthStencilState, 0, 1, stencilRef);
+}
+
+
+void RecordingRenderDevice::ClearRenderTargetView(ID3D11RenderTargetView* renderTargetView, const FLOAT* /*colour*/)
+{
+	Record(RenderCommandType::ClearRenderTarget, RenderShaderStage::None, renderTargetView);
+}
+
+void RecordingRenderDevice::ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT, UINT8)
+{
+	Record(RenderCommandType::ClearDepthStencil, RenderShaderStage::None, depthStencilView, 0, 1, clearFlags);
+}
+
+void RecordingRenderDevice::CopyResource(ID3D11Resource* destination, ID3D11Resource* /*source*/)
+{
+	Record(RenderCommandType::CopyResource, RenderShaderStage::None, destination);
+}
+
+void RecordingRenderDevice::Draw(UINT vertexCount, UINT startVertex)
+{
+	Record(RenderCommandType::Draw, RenderShaderStage::None, nullptr, startVertex, vertexCount);
+}
+
+void RecordingRenderDevice::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	Record(RenderCommandType::DrawIndexed, RenderShaderStage::None, nullptr, startIndex, indexCount, 0, baseVertex);
+}
+
+void RecordingRenderDevice::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex,
+                                                 UINT /*startInstance*/)
+{
+	Record(RenderCommandType::DrawIndexedInstanced, RenderShaderStage::None, nullptr, startIndex, indexCountPerInstance,
+	       instanceCount, baseVertex);
+}
+
+
+void RecordingRenderDevice::UpdateBuffer(ID3D11Buffer* buffer, const void* /*data*/, size_t size)
+{
+	Record(RenderCommandType::UpdateBuffer, RenderShaderStage::None, buffer, 0, 1, static_cast<UINT>(size));
+	mBytesUploaded += size;
+}
+
+
+void RecordingRenderDevice::Present(UINT syncInterval)
+{
+	Record(RenderCommandType::Present, RenderShaderStage::None, nullptr, 0, 1, syncInterval);
+}
@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+// Recording render device - a render device that captures commands instead of using the GPU
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Every call made to the device is counted by type, and if logging is on it is also added to an in-memory command
+// log, which can be inspected or cleared at any time. Nothing is sent to DirectX, so the DirectX objects passed in
+// are only stored as handles and may be null (e.g. if the resources were never created). Buffer updates copy no
+// data, only their size is recorded.
+//
+// With logging off this is a "null" device - use it to measure the CPU cost of the rendering code itself. With
+// logging on it can be used to check what the rendering code does, e.g. how many state changes a pass makes.
+
+#ifndef _RECORDING_RENDER_DEVICE_H_INCLUDED_
+#define _RECORDING_RENDER_DEVICE_H_INCLUDED_
+
+#include "RenderDevice.h"
+#include <vector>
+
+// Types of command captured. The state changes come first, up to SetDepthStencilState (see NumStateChanges)
+enum class RenderCommandType
+{
+	SetInputLayout,
+	SetPrimitiveTopology,
+	SetVertexBuffers,
+	SetIndexBuffer,
+	SetShader,
+	SetConstantBuffers,
+	SetShaderResources,
+	SetSamplers,
+	SetRasterizerState,
+	SetViewports,
+	SetRenderTargets,
+	SetBlendState,
+	SetDepthStencilState,
+	ClearRenderTarget,
+	ClearDepthStencil,
+	CopyResource,
+	Draw,
+	DrawIndexed,
+	DrawIndexedInstanced,
+	UpdateBuffer,
+	Present,
+
+	NumTypes
+};
+
+// Shader stage of a SetShader / SetConstantBuffers / SetShaderResources / SetSamplers command
+enum class RenderShaderStage
+{
+	None,
+	Vertex,
+	Geometry,
+	Pixel,
+};
+
+// A captured command. The meaning of the values depends on the type:
+//   Set... commands    - object is the first (or only) object set, slot / count give the range of slots set
+//   SetPrimitiveTopology, SetIndexBuffer - value is the topology / index format
+//   Draw / DrawIndexed - count is the vertex / index count, slot the start vertex / index, baseVertex as DrawIndexed
+//   DrawIndexedInstanced - as DrawIndexed (count is per instance), value is the number of instances
+//   CopyResource       - object is the destination resource
+//   UpdateBuffer       - object is the buffer, value is the number of bytes
+struct RenderCommand
+{
+	RenderCommandType type;
+	RenderShaderStage stage;
+	const void*       object;
+	UINT              slot;
+	UINT              count;
+	UINT              value;
+	INT               baseVertex;
+};
+
+
+class RecordingRenderDevice : public RenderDevice
+{
+public:
+	// Pass false to only count the commands, not log them (a null device)
+	RecordingRenderDevice(bool logCommands = true)  : mLogCommands(logCommands) { Reset(); }
+
+	// Command log, and the number of commands of each type, since construction or the last Reset
+	const std::vector<RenderCommand>& Commands() const  { return mCommands; }
+	unsigned int NumCommands(RenderCommandType type) const  { return mCounts[static_cast<int>(type)]; }
+	unsigned int NumDrawCalls() const  { return NumCommands(RenderCommandType::Draw) + NumCommands(RenderCommandType::DrawIndexed) +
+	                                            NumCommands(RenderCommandType::DrawIndexedInstanced); }
+	unsigned int NumStateChanges() const; // Set... commands only (types up to SetDepthStencilState)
+	unsigned long long BytesUploaded() const  { return mBytesUploaded; }
+
+	// Clear the log and the counts. The log keeps its memory so recording the next frame doesn't allocate
+	void Reset();
+
+
+	void IASetInputLayout(ID3D11InputLayout* inputLayout) override;
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* vertexBuffers,
+	                        const UINT* strides, const UINT* offsets) override;
+	void IASetIndexBuffer(ID3D11Buffer* indexBuffer, DXGI_FORMAT format, UINT offset) override;
+
+	void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+	void GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+	void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+
+	void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+	void GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+	void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+
+	void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews) override;
+	void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews) override;
+
+	void VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) override;
+	void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) override;
+
+	void RSSetState(ID3D11RasterizerState* rasterizerState) override;
+	void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports) override;
+	void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargetViews,
+	                        ID3D11DepthStencilView* depthStencilView) override;
+	void OMSetBlendState(ID3D11BlendState* blendState, const FLOAT blendFactor[4], UINT sampleMask) override;
+	void OMSetDepthStencilState(ID3D11DepthStencilState* depthStencilState, UINT stencilRef) override;
+
+	void ClearRenderTargetView(ID3D11RenderTargetView* renderTargetView, const FLOAT colour[4]) override;
+	void ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil) override;
+	void CopyResource(ID3D11Resource* destination, ID3D11Resource* source) override;
+	void Draw(UINT vertexCount, UINT startVertex) override;
+	void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) override;
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex,
+	                          UINT startInstance) override;
+
+	void UpdateBuffer(ID3D11Buffer* buffer, const void* data, size_t size) override;
+
+	void Present(UINT syncInterval) override;
+
+private:
+	// Count a command and log it if required
+	void Record(RenderCommandType type, RenderShaderStage stage, const void* object,
+	            UINT slot = 0, UINT count = 1, UINT value = 0, INT baseVertex = 0);
+
+	// First object in an array of objects, or null if there are none
+	template <class T>
+	static const void* First(T* const* objects, UINT count)  { return (objects != nullptr && count > 0) ? objects[0] : nullptr; }
+
+	bool                       mLogCommands;
+	std::vector<RenderCommand> mCommands;
+	unsigned int               mCounts[static_cast<int>(RenderCommandType::NumTypes)];
+	unsigned long long         mBytesUploaded;
+};
+
+
+#endif //_RECORDING_RENDER_DEVICE_H_INCLUDED_
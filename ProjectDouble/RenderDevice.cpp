@@ -0,0 +1,170 @@
+//--------------------------------------------------------------------------------------
+// Render device - the interface used by the frame rendering code to issue GPU commands
+//--------------------------------------------------------------------------------------
+
+#include "RenderDevice.h"
+
+#include <cstring>
+
+
+// The device used by all rendering code, created in InitDirect3D
+RenderDevice* gRenderDevice = nullptr;
+
+
+//--------------------------------------------------------------------------------------
+// D3D11 render device - each call is passed straight to the DirectX context
+//--------------------------------------------------------------------------------------
+
+void D3D11RenderDevice::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	mContext->IASetInputLayout(inputLayout);
+}
+
+void D3D11RenderDevice::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	mContext->IASetPrimitiveTopology(topology);
+}
+
+void D3D11RenderDevice::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* vertexBuffers,
+                                           const UINT* strides, const UINT* offsets)
+{
+	mContext->IASetVertexBuffers(startSlot, numBuffers, vertexBuffers, strides, offsets);
+}
+
+void D3D11RenderDevice::IASetIndexBuffer(ID3D11Buffer* indexBuffer, DXGI_FORMAT format, UINT offset)
+{
+	mContext->IASetIndexBuffer(indexBuffer, format, offset);
+}
+
+
+void D3D11RenderDevice::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	mContext->VSSetShader(shader, classInstances, numClassInstances);
+}
+
+void D3D11RenderDevice::GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	mContext->GSSetShader(shader, classInstances, numClassInstances);
+}
+
+void D3D11RenderDevice::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	mContext->PSSetShader(shader, classInstances, numClassInstances);
+}
+
+
+void D3D11RenderDevice::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	mContext->VSSetConstantBuffers(startSlot, numBuffers, constantBuffers);
+}
+
+void D3D11RenderDevice::GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	mContext->GSSetConstantBuffers(startSlot, numBuffers, constantBuffers);
+}
+
+void D3D11RenderDevice::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	mContext->PSSetConstantBuffers(startSlot, numBuffers, constantBuffers);
+}
+
+
+void D3D11RenderDevice::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews)
+{
+	mContext->VSSetShaderResources(startSlot, numViews, shaderResourceViews);
+}
+
+void D3D11RenderDevice::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews)
+{
+	mContext->PSSetShaderResources(startSlot, numViews, shaderResourceViews);
+}
+
+
+void D3D11RenderDevice::VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	mContext->VSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+void D3D11RenderDevice::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	mContext->PSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+
+void D3D11RenderDevice::RSSetState(ID3D11RasterizerState* rasterizerState)
+{
+	mContext->RSSetState(rasterizerState);
+}
+
+void D3D11RenderDevice::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports)
+{
+	mContext->RSSetViewports(numViewports, viewports);
+}
+
+void D3D11RenderDevice::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargetViews,
+                                           ID3D11DepthStencilView* depthStencilView)
+{
+	mContext->OMSetRenderTargets(numViews, renderTargetViews, depthStencilView);
+}
+
+void D3D11RenderDevice::OMSetBlendState(ID3D11BlendState* blendState, const FLOAT blendFactor[4], UINT sampleMask)
+{
+	mContext->OMSetBlendState(blendState, blendFactor, sampleMask);
+}
+
+void D3D11RenderDevice::OMSetDepthStencilState(ID3D11DepthStencilState* depthStencilState, UINT stencilRef)
+{
+	mContext->OMSetDepthStencilState(depthStencilState, stencilRef);
+}
+
+
+void D3D11RenderDevice::ClearRenderTargetView(ID3D11RenderTargetView* renderTargetView, const FLOAT colour[4])
+{
+	mContext->ClearRenderTargetView(renderTargetView, colour);
+}
+
+void D3D11RenderDevice::ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil)
+{
+	mContext->ClearDepthStencilView(depthStencilView, clearFlags, depth, stencil);
+}
+
+void D3D11RenderDevice::CopyResource(ID3D11Resource* destination, ID3D11Resource* source)
+{
+	mContext->CopyResource(destination, source);
+}
+
+void D3D11RenderDevice::Draw(UINT vertexCount, UINT startVertex)
+{
+	mContext->Draw(vertexCount, startVertex);
+}
+
+void D3D11RenderDevice::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	mContext->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void D3D11RenderDevice::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex,
+                                             UINT startInstance)
+{
+	mContext->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+
+// Replace the contents of a dynamic buffer (e.g. a constant buffer) with the given data. Anything in the buffer
+// past the given size is undefined afterwards
+void D3D11RenderDevice::UpdateBuffer(ID3D11Buffer* buffer, const void* data, size_t size)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (SUCCEEDED(mContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		std::memcpy(mapped.pData, data, size);
+		mContext->Unmap(buffer, 0);
+	}
+}
+
+
+// Show the frame that has been rendered
+void D3D11RenderDevice::Present(UINT syncInterval)
+{
+	mSwapChain->Present(syncInterval, 0);
+}
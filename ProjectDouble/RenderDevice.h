@@ -0,0 +1,173 @@
+//--------------------------------------------------------------------------------------
+// Render device - the interface used by the frame rendering code to issue GPU commands
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The rendering code (RenderScene and the functions it calls) sends all its state changes, draw calls and constant
+// buffer updates through gRenderDevice rather than directly to the DirectX context. The methods mirror the
+// ID3D11DeviceContext methods of the same name, so converting code is just a case of changing "gD3DContext->" to
+// "gRenderDevice->". DirectX objects are passed through as handles, only the D3D11 device below uses them.
+//
+// D3D11RenderDevice sends the commands to DirectX. RecordingRenderDevice (see RecordingRenderDevice.h) doesn't use the
+// GPU at all, it just counts and optionally logs the commands. So the rendering code can be run without a GPU to
+// measure its CPU cost and the number of calls it makes.
+//
+// Resource creation (buffers, textures, shaders, states) and start-up uploads still use gD3DDevice / gD3DContext
+//
+// Away from Visual Studio the DirectX types used by the interface are declared here instead of including d3d11.h. The
+// objects are only passed through as handles, so that is enough to build RecordingRenderDevice and test it without
+// DirectX (see Tests/RecordingRenderDeviceTest.cpp). D3D11RenderDevice is still Windows only
+
+#ifndef _RENDER_DEVICE_H_INCLUDED_
+#define _RENDER_DEVICE_H_INCLUDED_
+
+#if defined (_MSC_VER)
+	#include <d3d11.h>
+#else
+	typedef unsigned int  UINT;
+	typedef int           INT;
+	typedef float         FLOAT;
+	typedef unsigned char UINT8;
+
+	struct ID3D11DeviceContext;
+	struct IDXGISwapChain;
+	struct ID3D11InputLayout;
+	struct ID3D11Buffer;
+	struct ID3D11ClassInstance;
+	struct ID3D11VertexShader;
+	struct ID3D11GeometryShader;
+	struct ID3D11PixelShader;
+	struct ID3D11ShaderResourceView;
+	struct ID3D11SamplerState;
+	struct ID3D11RasterizerState;
+	struct ID3D11RenderTargetView;
+	struct ID3D11DepthStencilView;
+	struct ID3D11BlendState;
+	struct ID3D11DepthStencilState;
+	struct ID3D11Resource;
+
+	// Only the values the tests use
+	enum D3D11_PRIMITIVE_TOPOLOGY { D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4 };
+	enum DXGI_FORMAT { DXGI_FORMAT_R32_UINT = 42 };
+
+	struct D3D11_VIEWPORT
+	{
+		FLOAT TopLeftX;
+		FLOAT TopLeftY;
+		FLOAT Width;
+		FLOAT Height;
+		FLOAT MinDepth;
+		FLOAT MaxDepth;
+	};
+#endif
+#include <cstddef>
+
+class RenderDevice
+{
+public:
+	virtual ~RenderDevice() {}
+
+	// Input assembler
+	virtual void IASetInputLayout(ID3D11InputLayout* inputLayout) = 0;
+	virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* vertexBuffers,
+	                                const UINT* strides, const UINT* offsets) = 0;
+	virtual void IASetIndexBuffer(ID3D11Buffer* indexBuffer, DXGI_FORMAT format, UINT offset) = 0;
+
+	// Shaders and their resources
+	virtual void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) = 0;
+	virtual void GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) = 0;
+	virtual void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) = 0;
+
+	virtual void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) = 0;
+	virtual void GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) = 0;
+	virtual void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) = 0;
+
+	virtual void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews) = 0;
+	virtual void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews) = 0;
+
+	virtual void VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) = 0;
+	virtual void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) = 0;
+
+	// Rasterizer and output merger
+	virtual void RSSetState(ID3D11RasterizerState* rasterizerState) = 0;
+	virtual void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports) = 0;
+	virtual void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargetViews,
+	                                ID3D11DepthStencilView* depthStencilView) = 0;
+	virtual void OMSetBlendState(ID3D11BlendState* blendState, const FLOAT blendFactor[4], UINT sampleMask) = 0;
+	virtual void OMSetDepthStencilState(ID3D11DepthStencilState* depthStencilState, UINT stencilRef) = 0;
+
+	// Clearing and drawing
+	virtual void ClearRenderTargetView(ID3D11RenderTargetView* renderTargetView, const FLOAT colour[4]) = 0;
+	virtual void ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil) = 0;
+	virtual void CopyResource(ID3D11Resource* destination, ID3D11Resource* source) = 0;
+	virtual void Draw(UINT vertexCount, UINT startVertex) = 0;
+	virtual void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) = 0;
+	virtual void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex,
+	                                  UINT startInstance) = 0;
+
+	// Replace the contents of a dynamic buffer (e.g. a constant buffer) with the given data. Anything in the buffer
+	// past the given size is undefined afterwards
+	virtual void UpdateBuffer(ID3D11Buffer* buffer, const void* data, size_t size) = 0;
+
+	// Show the frame that has been rendered
+	virtual void Present(UINT syncInterval) = 0;
+};
+
+
+// Render device that sends commands to the DirectX context and presents with the swap chain
+class D3D11RenderDevice : public RenderDevice
+{
+public:
+	D3D11RenderDevice(ID3D11DeviceContext* context, IDXGISwapChain* swapChain)
+		: mContext(context), mSwapChain(swapChain) {}
+
+	void IASetInputLayout(ID3D11InputLayout* inputLayout) override;
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* vertexBuffers,
+	                        const UINT* strides, const UINT* offsets) override;
+	void IASetIndexBuffer(ID3D11Buffer* indexBuffer, DXGI_FORMAT format, UINT offset) override;
+
+	void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+	void GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+	void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+
+	void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+	void GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+	void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+
+	void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews) override;
+	void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews) override;
+
+	void VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) override;
+	void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) override;
+
+	void RSSetState(ID3D11RasterizerState* rasterizerState) override;
+	void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports) override;
+	void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargetViews,
+	                        ID3D11DepthStencilView* depthStencilView) override;
+	void OMSetBlendState(ID3D11BlendState* blendState, const FLOAT blendFactor[4], UINT sampleMask) override;
+	void OMSetDepthStencilState(ID3D11DepthStencilState* depthStencilState, UINT stencilRef) override;
+
+	void ClearRenderTargetView(ID3D11RenderTargetView* renderTargetView, const FLOAT colour[4]) override;
+	void ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil) override;
+	void CopyResource(ID3D11Resource* destination, ID3D11Resource* source) override;
+	void Draw(UINT vertexCount, UINT startVertex) override;
+	void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) override;
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex,
+	                          UINT startInstance) override;
+
+	void UpdateBuffer(ID3D11Buffer* buffer, const void* data, size_t size) override;
+
+	void Present(UINT syncInterval) override;
+
+private:
+	ID3D11DeviceContext* mContext;
+	IDXGISwapChain*      mSwapChain;
+};
+
+
+// The device used by all rendering code, created in InitDirect3D
+extern RenderDevice* gRenderDevice;
+
+
+#endif //_RENDER_DEVICE_H_INCLUDED_
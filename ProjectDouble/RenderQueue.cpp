@@ -0,0 +1,530 @@
+//--------------------------------------------------------------------------------------
+// Render queue - sorts the models in a rendering pass to minimise state changes
+//--------------------------------------------------------------------------------------
+
+#include "RenderQueue.h"
+#include "RenderDevice.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "InstanceBuffer.h"
+
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+
+// Texture slots managed by the queue
+const UINT RenderQueue::kTextureSlots[RenderQueue::kNumTextures] = { 0, 6 };
+
+// Bit widths of the parts of the sort key, see the layout in RenderQueue.h
+static const unsigned int kLayerBits       = 4;
+static const unsigned int kShaderStateBits = 12;
+static const unsigned int kTextureSetBits  = 12;
+static const unsigned int kMeshBits        = 8;
+static const unsigned int kDepthBits       = 28;
+
+
+//--------------------------------------------------------------------------------------
+// Queueing
+//--------------------------------------------------------------------------------------
+
+// Start a pass. The pass state is set immediately, it is used for any state a model leaves null, and is restored
+// by Flush. All of its members must be given. The texture slots above must be unbound when the pass starts.
+// The camera position is used to sort by depth, models outside the view-projection matrix's frustum are culled.
+// If an occlusion buffer is given, models hidden by its occluders are culled too
+void RenderQueue::Begin(const std::string& passName, const RenderState& passState, const CVector3& cameraPosition,
+                        const CMatrix4x4& viewProjection, const COcclusionBuffer* occlusion /*= nullptr*/)
+{
+	mPassName = passName;
+	mPassState = passState;
+	mCameraPosition = cameraPosition;
+	mFrustum = CFrustum(viewProjection);
+	mOcclusion = occlusion;
+	mQueue.clear();
+	mSortKeys.clear();
+	mStateChanges = 0;
+
+	// Set the whole pass state, the caller may have left anything set
+	gRenderDevice->VSSetShader(passState.vertexShader, nullptr, 0);
+	gRenderDevice->PSSetShader(passState.pixelShader, nullptr, 0);
+	gRenderDevice->OMSetBlendState(passState.blendState, nullptr, 0xffffff);
+	gRenderDevice->OMSetDepthStencilState(passState.depthState, 0);
+	gRenderDevice->RSSetState(passState.rasterizerState);
+	mStateChanges += 5;
+	mCurrentState = passState;
+
+	for (unsigned int t = 0; t < kNumTextures; ++t)
+	{
+		mCurrentTextures[t] = nullptr;
+		mTextureKnown[t] = true;
+	}
+}
+
+
+// Queue a model with the state and textures it needs
+void RenderQueue::Submit(Model* model, RenderLayer layer, const RenderState& state,
+                         ID3D11ShaderResourceView* texture0 /*= nullptr*/, ID3D11ShaderResourceView* texture6 /*= nullptr*/)
+{
+	QueuedModel queued;
+	queued.model = model;
+	queued.layer = layer;
+	queued.meshTextures = false;
+
+	// Fill in the state the model leaves to the pass
+	queued.state.vertexShader    = state.vertexShader    ? state.vertexShader    : mPassState.vertexShader;
+	queued.state.pixelShader     = state.pixelShader     ? state.pixelShader     : mPassState.pixelShader;
+	queued.state.blendState      = state.blendState      ? state.blendState      : mPassState.blendState;
+	queued.state.depthState      = state.depthState      ? state.depthState      : mPassState.depthState;
+	queued.state.rasterizerState = state.rasterizerState ? state.rasterizerState : mPassState.rasterizerState;
+
+	queued.textures[0] = texture0;
+	queued.textures[1] = texture6;
+
+	mQueue.push_back(queued);
+}
+
+// Queue a model whose mesh sets its own textures (see Mesh::SetTexture)
+void RenderQueue::SubmitWithMeshTextures(Model* model, RenderLayer layer, const RenderState& state)
+{
+	Submit(model, layer, state);
+	mQueue.back().meshTextures = true;
+}
+
+
+// Models queued with the given vertex shader can be batched and drawn with the instanced shader instead. The
+// instanced shader must give the same output using the instance buffer. Lasts for the whole run
+void RenderQueue::SetInstancedShader(ID3D11VertexShader* vertexShader, ID3D11VertexShader* instancedVertexShader)
+{
+	for (auto& instancedShader : mInstancedShaders)
+	{
+		if (instancedShader.vertexShader == vertexShader)
+		{
+			instancedShader.instancedVertexShader = instancedVertexShader;
+			return;
+		}
+	}
+	mInstancedShaders.push_back({ vertexShader, instancedVertexShader });
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sorting
+//--------------------------------------------------------------------------------------
+
+// Small ids for shader states and texture sets, used in sort keys. There are only a handful of each so a linear
+// search is fine. The ids last for the whole run so keys are consistent from frame to frame
+unsigned int RenderQueue::ShaderStateId(const RenderState& state)
+{
+	for (unsigned int id = 0; id < mShaderStates.size(); ++id)
+	{
+		if (std::memcmp(&mShaderStates[id], &state, sizeof(RenderState)) == 0)  return id;
+	}
+	mShaderStates.push_back(state);
+	return static_cast<unsigned int>(mShaderStates.size() - 1) & ((1u << kShaderStateBits) - 1);
+}
+
+unsigned int RenderQueue::TextureSetId(ID3D11ShaderResourceView* const textures[kNumTextures])
+{
+	for (unsigned int id = 0; id < mTextureSets.size(); ++id)
+	{
+		if (std::memcmp(mTextureSets[id].textures, textures, sizeof(TextureSet)) == 0)  return id;
+	}
+	TextureSet textureSet;
+	std::memcpy(textureSet.textures, textures, sizeof(TextureSet));
+	mTextureSets.push_back(textureSet);
+	return static_cast<unsigned int>(mTextureSets.size() - 1);
+}
+
+unsigned int RenderQueue::MeshId(const Mesh* mesh)
+{
+	for (unsigned int id = 0; id < mMeshes.size(); ++id)
+	{
+		if (mMeshes[id] == mesh)  return id;
+	}
+	mMeshes.push_back(mesh);
+	return static_cast<unsigned int>(mMeshes.size() - 1);
+}
+
+
+// Sort key for a model, see the layout at the top of RenderQueue.h
+uint64_t RenderQueue::SortKey(const QueuedModel& queued)
+{
+	// The bit pattern of a positive float increases with its value, so the top bits of the squared distance
+	// can be used directly as a depth
+	CVector3 toModel = queued.model->Position() - mCameraPosition;
+	float distanceSquared = Dot(toModel, toModel);
+	uint32_t distanceBits;
+	std::memcpy(&distanceBits, &distanceSquared, sizeof(distanceBits));
+	uint64_t depth = distanceBits >> (32 - kDepthBits);
+
+	uint64_t shaderState = ShaderStateId(queued.state);
+	uint64_t textureSet = queued.meshTextures ? 0 : (1 + TextureSetId(queued.textures)) & ((1u << kTextureSetBits) - 1); // Mesh textures first
+	uint64_t mesh = MeshId(queued.model->GetMesh()) & ((1u << kMeshBits) - 1); // Models with the same mesh together, for instancing
+	uint64_t backToFront = ((1ull << kDepthBits) - 1) - depth;
+
+	uint64_t key = static_cast<uint64_t>(queued.layer) << (64 - kLayerBits);
+	if (queued.layer == RenderLayer::Transparent)
+	{
+		key |= backToFront << (kShaderStateBits + kTextureSetBits + kMeshBits);
+		key |= shaderState << (kTextureSetBits + kMeshBits);
+		key |= textureSet << kMeshBits;
+		key |= mesh;
+	}
+	else
+	{
+		key |= shaderState << (kTextureSetBits + kMeshBits + kDepthBits);
+		key |= textureSet << (kMeshBits + kDepthBits);
+		key |= mesh << kDepthBits;
+		key |= (queued.layer == RenderLayer::AlphaTested) ? backToFront : depth;
+	}
+	return key;
+}
+
+
+// Sort mSortKeys (with the queue indexes in mSortOrder alongside) using a radix sort on 8-bit digits. Least significant
+// digit first, each digit is a stable counting sort. Digits that are the same for every key are skipped, which is
+// common for the upper bits of the depth
+void RenderQueue::RadixSort()
+{
+	uint32_t numKeys = static_cast<uint32_t>(mSortKeys.size());
+	mTempKeys.resize(numKeys);
+	mTempOrder.resize(numKeys);
+
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t counts[256] = {};
+		for (uint32_t i = 0; i < numKeys; ++i)  ++counts[(mSortKeys[i] >> shift) & 0xff];
+		if (numKeys == 0 || counts[(mSortKeys[0] >> shift) & 0xff] == numKeys)  continue; // All the same
+
+		uint32_t offset = 0;
+		for (auto& count : counts)
+		{
+			uint32_t digitCount = count;
+			count = offset;
+			offset += digitCount;
+		}
+		for (uint32_t i = 0; i < numKeys; ++i)
+		{
+			uint32_t destination = counts[(mSortKeys[i] >> shift) & 0xff]++;
+			mTempKeys[destination] = mSortKeys[i];
+			mTempOrder[destination] = mSortOrder[i];
+		}
+		mSortKeys.swap(mTempKeys);
+		mSortOrder.swap(mTempOrder);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Instancing
+//--------------------------------------------------------------------------------------
+
+// Instanced version of a vertex shader, or null if there isn't one
+ID3D11VertexShader* RenderQueue::InstancedShader(ID3D11VertexShader* vertexShader) const
+{
+	for (auto& instancedShader : mInstancedShaders)
+	{
+		if (instancedShader.vertexShader == vertexShader)  return instancedShader.instancedVertexShader;
+	}
+	return nullptr;
+}
+
+// Whether two queued models can be drawn in the same instanced batch - the same rigid mesh, state and textures
+bool RenderQueue::CanInstanceTogether(const QueuedModel& a, const QueuedModel& b) const
+{
+	if (a.model->GetMesh() != b.model->GetMesh() || a.layer != b.layer || a.meshTextures != b.meshTextures)  return false;
+	if (std::memcmp(&a.state, &b.state, sizeof(RenderState)) != 0)  return false;
+	return a.meshTextures || std::memcmp(a.textures, b.textures, sizeof(a.textures)) == 0;
+}
+
+
+// Split the sorted models into batches. Each run of models that can be instanced together becomes one batch and its
+// instances are added to the instance buffer, all in a single pass over the sorted models. Everything else is a batch
+// of one, rendered as usual
+void RenderQueue::BuildBatches()
+{
+	mBatches.clear();
+	uint32_t numSorted = static_cast<uint32_t>(mSortOrder.size());
+	uint32_t start = 0;
+	while (start < numSorted)
+	{
+		const QueuedModel& first = mQueue[mSortOrder[start]];
+		uint32_t end = start + 1;
+		if (!first.model->GetMesh()->IsSkinned() && InstancedShader(first.state.vertexShader) != nullptr)
+		{
+			while (end < numSorted && CanInstanceTogether(first, mQueue[mSortOrder[end]]))  ++end;
+		}
+
+		Batch batch = { start, 1, InstanceBuffer::kNoRoom };
+		if (end - start > 1)
+		{
+			mBatchModels.clear();
+			for (uint32_t i = start; i < end; ++i)  mBatchModels.push_back(mQueue[mSortOrder[i]].model);
+			batch.firstInstance = gInstanceBuffer.AddBatch(mBatchModels.data(), end - start);
+			if (batch.firstInstance != InstanceBuffer::kNoRoom)  batch.count = end - start;
+		}
+
+		// If the instance buffer is full the models are rendered one at a time
+		if (batch.firstInstance == InstanceBuffer::kNoRoom)
+		{
+			for (uint32_t i = start; i < end; ++i)
+			{
+				batch.start = i;
+				mBatches.push_back(batch);
+			}
+		}
+		else
+		{
+			mBatches.push_back(batch);
+		}
+		start = end;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Rendering
+//--------------------------------------------------------------------------------------
+
+// Set the given state if it is not already set, counting the changes
+void RenderQueue::ApplyState(const RenderState& state)
+{
+	if (state.vertexShader != mCurrentState.vertexShader)
+	{
+		gRenderDevice->VSSetShader(state.vertexShader, nullptr, 0);
+		++mStateChanges;
+	}
+	if (state.pixelShader != mCurrentState.pixelShader)
+	{
+		gRenderDevice->PSSetShader(state.pixelShader, nullptr, 0);
+		++mStateChanges;
+	}
+	if (state.blendState != mCurrentState.blendState)
+	{
+		gRenderDevice->OMSetBlendState(state.blendState, nullptr, 0xffffff);
+		++mStateChanges;
+	}
+	if (state.depthState != mCurrentState.depthState)
+	{
+		gRenderDevice->OMSetDepthStencilState(state.depthState, 0);
+		++mStateChanges;
+	}
+	if (state.rasterizerState != mCurrentState.rasterizerState)
+	{
+		gRenderDevice->RSSetState(state.rasterizerState);
+		++mStateChanges;
+	}
+	mCurrentState = state;
+}
+
+// Set the given texture if it is not already set, counting the change
+void RenderQueue::ApplyTexture(unsigned int texture, ID3D11ShaderResourceView* srv)
+{
+	if (!mTextureKnown[texture] || srv != mCurrentTextures[texture])
+	{
+		gRenderDevice->PSSetShaderResources(kTextureSlots[texture], 1, &srv);
+		mCurrentTextures[texture] = srv;
+		mTextureKnown[texture] = true;
+		++mStateChanges;
+	}
+}
+
+
+// Cull and sort the queued models and render them, only setting state that has changed. Afterwards the pass state
+// is restored and the texture slots are unbound
+void RenderQueue::Flush()
+{
+	// Mark the culling tree's items that are visible in this pass, so models in the tree can just look up their item
+	if (mCullingTree != nullptr)
+	{
+		++mTreePass;
+		mTreeItems.clear();
+		mCullingTree->FrustumQuery(mFrustum, mTreeItems);
+		if (mTreeItemPass.size() < mCullingTree->NumItems())  mTreeItemPass.resize(mCullingTree->NumItems(), 0);
+		for (uint32_t item : mTreeItems)  mTreeItemPass[item] = mTreePass;
+	}
+
+	// Test the other models against the frustum in one batch, then only the visible ones are sorted
+	uint32_t numQueued = static_cast<uint32_t>(mQueue.size());
+	mVisible.resize(numQueued);
+	mBounds.clear();
+	mBoundsQueueIndex.clear();
+	for (uint32_t i = 0; i < numQueued; ++i)
+	{
+		unsigned int treeItem = mQueue[i].model->TreeItem;
+		if (mCullingTree != nullptr && treeItem < mCullingTree->NumItems())
+		{
+			mVisible[i] = mTreeItemPass[treeItem] == mTreePass ? 1 : 0;
+		}
+		else
+		{
+			mBounds.push_back(mQueue[i].model->WorldBounds());
+			mBoundsQueueIndex.push_back(i);
+		}
+	}
+	mBoundsVisible.resize(mBounds.size());
+	mFrustum.TestBoxes(mBounds.data(), mBoundsVisible.data(), mBounds.size());
+	for (size_t i = 0; i < mBounds.size(); ++i)  mVisible[mBoundsQueueIndex[i]] = mBoundsVisible[i];
+
+	// Models inside the frustum may still be hidden behind the occluders
+	unsigned int numOccluded = 0;
+	if (mOcclusion != nullptr)
+	{
+		for (uint32_t i = 0; i < numQueued; ++i)
+		{
+			if (mVisible[i] && !mOcclusion->IsVisible(mQueue[i].model->WorldBounds()))
+			{
+				mVisible[i] = 0;
+				++numOccluded;
+			}
+		}
+	}
+
+	unsigned int numVisible = 0;
+	for (uint32_t i = 0; i < numQueued; ++i)  numVisible += mVisible[i];
+
+	mSortKeys.clear();
+	mSortOrder.clear();
+	for (uint32_t i = 0; i < numQueued; ++i)
+	{
+		if (mVisible[i])
+		{
+			mSortKeys.push_back(SortKey(mQueue[i]));
+			mSortOrder.push_back(i);
+		}
+	}
+	RadixSort();
+
+	// Group the models into instanced batches where possible, then send all the instances to the GPU at once
+	BuildBatches();
+	unsigned int numInstanced = 0;
+	for (auto& batch : mBatches)
+	{
+		if (batch.firstInstance != InstanceBuffer::kNoRoom)  numInstanced += batch.count;
+	}
+	if (numInstanced > 0)  gInstanceBuffer.Upload();
+
+	for (auto& batch : mBatches)
+	{
+		const QueuedModel& queued = mQueue[mSortOrder[batch.start]];
+		bool instanced = (batch.firstInstance != InstanceBuffer::kNoRoom);
+		if (instanced)
+		{
+			RenderState instancedState = queued.state;
+			instancedState.vertexShader = InstancedShader(queued.state.vertexShader);
+			ApplyState(instancedState);
+		}
+		else
+		{
+			ApplyState(queued.state);
+		}
+
+		if (!queued.meshTextures)
+		{
+			for (unsigned int t = 0; t < kNumTextures; ++t)  ApplyTexture(t, queued.textures[t]);
+		}
+		if (instanced)  queued.model->GetMesh()->RenderInstanced(batch.firstInstance, batch.count);
+		else            queued.model->Render();
+		if (queued.meshTextures)
+		{
+			mTextureKnown[0] = false; // The mesh has set slot 0 (and slots of its own that the queue doesn't manage)
+		}
+	}
+
+	// Leave things as the pass started
+	ApplyState(mPassState);
+	for (unsigned int t = 0; t < kNumTextures; ++t)  ApplyTexture(t, nullptr);
+
+
+	// Add to the statistics for this pass name
+	PassStats* stats = nullptr;
+	for (auto& passStats : mStats)
+	{
+		if (passStats.name == mPassName)  stats = &passStats;
+	}
+	if (stats == nullptr)
+	{
+		mStats.emplace_back();
+		stats = &mStats.back();
+		stats->name = mPassName;
+	}
+	++stats->flushes;
+	stats->models += numQueued;
+	stats->visible += numVisible;
+	stats->culled += numQueued - numVisible - numOccluded;
+	stats->occluded += numOccluded;
+	stats->stateChanges += mStateChanges;
+	mLastFlushBatches = static_cast<unsigned int>(mBatches.size());
+	stats->batches += mLastFlushBatches;
+	stats->instanced += numInstanced;
+
+	mQueue.clear();
+	mSortKeys.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Statistics
+//--------------------------------------------------------------------------------------
+
+unsigned int RenderQueue::TotalStateChanges() const
+{
+	unsigned int total = 0;
+	for (auto& passStats : mStats)  total += passStats.stateChanges;
+	return total;
+}
+
+unsigned int RenderQueue::TotalVisible() const
+{
+	unsigned int total = 0;
+	for (auto& passStats : mStats)  total += passStats.visible;
+	return total;
+}
+
+unsigned int RenderQueue::TotalCulled() const
+{
+	unsigned int total = 0;
+	for (auto& passStats : mStats)  total += passStats.culled;
+	return total;
+}
+
+unsigned int RenderQueue::TotalOccluded() const
+{
+	unsigned int total = 0;
+	for (auto& passStats : mStats)  total += passStats.occluded;
+	return total;
+}
+
+unsigned int RenderQueue::TotalBatches() const
+{
+	unsigned int total = 0;
+	for (auto& passStats : mStats)  total += passStats.batches;
+	return total;
+}
+
+unsigned int RenderQueue::TotalInstanced() const
+{
+	unsigned int total = 0;
+	for (auto& passStats : mStats)  total += passStats.instanced;
+	return total;
+}
+
+// One line per pass, averaged over the given number of frames
+std::string RenderQueue::StatsReport(unsigned int numFrames) const
+{
+	if (numFrames == 0)  numFrames = 1;
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(1);
+	for (auto& passStats : mStats)
+	{
+		report << "  " << std::left << std::setw(16) << passStats.name << std::right
+		       << " models " << std::setw(6) << static_cast<float>(passStats.models) / numFrames
+		       << "  visible " << std::setw(6) << static_cast<float>(passStats.visible) / numFrames
+		       << "  culled " << std::setw(6) << static_cast<float>(passStats.culled) / numFrames
+		       << "  occluded " << std::setw(6) << static_cast<float>(passStats.occluded) / numFrames
+		       << "  state changes " << std::setw(6) << static_cast<float>(passStats.stateChanges) / numFrames
+		       << "  batches " << std::setw(6) << static_cast<float>(passStats.batches) / numFrames
+		       << "  instanced " << std::setw(6) << static_cast<float>(passStats.instanced) / numFrames << " per frame\n";
+	}
+	return report.str();
+}
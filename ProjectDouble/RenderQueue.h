@@ -0,0 +1,216 @@
+//--------------------------------------------------------------------------------------
+// Render queue - sorts the models in a rendering pass to minimise state changes
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Rather than setting shaders, states and textures by hand around each model, models are submitted to the queue
+// along with the state they need. When the pass is flushed the models are sorted on a 64-bit key and rendered in
+// that order, only setting state that differs from the previous model. So models sharing shaders and textures are
+// drawn together, and adding a model costs at most the state changes it really needs. Before sorting, the models
+// are culled against the pass's view frustum so only those that can be seen are sorted and rendered. Models in the
+// culling tree (see SetCullingTree) are culled with a single query of the tree rather than one test each. A pass
+// can also be given an occlusion buffer, then models the frustum leaves are also tested against the occluders in it.
+//
+// Key layout (most significant bits first):
+//   4 bits  layer          - opaque models, then decals, then alpha tested models, then transparent models
+//   Opaque / decal layers:  12 bits shader state, 12 bits texture set, 8 bits mesh, 28 bits depth (front to back)
+//   Alpha tested layer:     12 bits shader state, 12 bits texture set, 8 bits mesh, 28 bits depth (back to front)
+//   Transparent layer:      28 bits depth (back to front), 12 bits shader state, 12 bits texture set, 8 bits mesh
+// Shader states (shaders + blend / depth / rasterizer states), texture sets and meshes are given small ids as they
+// are seen. Each pass (render target + pass state) is a separate Begin / Flush, so the pass is not part of the key
+//
+// Instancing: after sorting, runs of models with the same state, textures and rigid mesh are next to each other. If
+// the vertex shader has an instanced version (see SetInstancedShader) each run is drawn with one instanced draw per
+// sub-mesh, the models' matrices going in the instance buffer (see InstanceBuffer.h) rather than a constant buffer
+
+#ifndef _RENDER_QUEUE_H_INCLUDED_
+#define _RENDER_QUEUE_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CFrustum.h"
+#include "CBoundingVolumeTree.h"
+#include "COcclusionBuffer.h"
+#include <d3d11.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class Model;
+class Mesh;
+
+// Groups of models rendered in order, each group is sorted separately
+enum class RenderLayer
+{
+	Opaque,      // Sorted by state then front to back
+	Decal,       // Rendered over opaque models, sorted by state
+	AlphaTested, // Mostly discarded pixels with some blending at the edges (e.g. foliage). Sorted by state then mesh,
+	             // then back to front, so copies of a mesh can be instanced but are still drawn in a sensible order
+	Transparent, // Sorted back to front
+};
+
+// Shaders and states for a queued model. Any left null use the pass's state (given to RenderQueue::Begin)
+struct RenderState
+{
+	ID3D11VertexShader*      vertexShader    = nullptr;
+	ID3D11PixelShader*       pixelShader     = nullptr;
+	ID3D11BlendState*        blendState      = nullptr;
+	ID3D11DepthStencilState* depthState      = nullptr;
+	ID3D11RasterizerState*   rasterizerState = nullptr;
+};
+
+
+class RenderQueue
+{
+public:
+	// Texture slots managed by the queue. Slot 0 is the diffuse / specular map, slot 6 the second map used by
+	// blending shaders. A null texture unbinds the slot
+	static const unsigned int kNumTextures = 2;
+	static const UINT         kTextureSlots[kNumTextures];
+
+	// Start a pass. The pass state is set immediately, it is used for any state a model leaves null, and is restored
+	// by Flush. All of its members must be given. The texture slots above must be unbound when the pass starts.
+	// The camera position is used to sort by depth, models outside the view-projection matrix's frustum are culled.
+	// If an occlusion buffer is given, rendered from the same view-projection matrix and with its pyramid built, models
+	// hidden by its occluders are culled too
+	void Begin(const std::string& passName, const RenderState& passState, const CVector3& cameraPosition,
+	           const CMatrix4x4& viewProjection, const COcclusionBuffer* occlusion = nullptr);
+
+	// Queue a model with the state and textures it needs
+	void Submit(Model* model, RenderLayer layer, const RenderState& state,
+	            ID3D11ShaderResourceView* texture0 = nullptr, ID3D11ShaderResourceView* texture6 = nullptr);
+
+	// Queue a model whose mesh sets its own textures (see Mesh::SetTexture)
+	void SubmitWithMeshTextures(Model* model, RenderLayer layer, const RenderState& state);
+
+	// Models queued with the given vertex shader can be batched and drawn with the instanced shader instead. The
+	// instanced shader must give the same output using the instance buffer. Lasts for the whole run
+	void SetInstancedShader(ID3D11VertexShader* vertexShader, ID3D11VertexShader* instancedVertexShader);
+
+	// Models in the given tree (see Model::TreeItem) are culled by querying the tree with the pass's frustum rather than
+	// testing each one. The tree must be up to date with the models' world bounds when passes are flushed. Null to
+	// test every model. Lasts for the whole run
+	void SetCullingTree(const CBoundingVolumeTree* tree)  { mCullingTree = tree; }
+
+	// Cull and sort the queued models and render them, only setting state that has changed. Afterwards the pass state
+	// is restored and the texture slots are unbound
+	void Flush();
+
+
+	// State changes made by Flush for each pass name, since the last ResetStats
+	struct PassStats
+	{
+		std::string  name;
+		unsigned int flushes      = 0;
+		unsigned int models       = 0; // Submitted, the sum of visible, culled and occluded
+		unsigned int visible      = 0;
+		unsigned int culled       = 0; // Outside the view frustum
+		unsigned int occluded     = 0; // Inside the frustum but hidden in the pass's occlusion buffer
+		unsigned int stateChanges = 0; // Shader, state and texture changes, including the pass start / restore
+		unsigned int batches      = 0; // Models rendered singly plus instanced batches, i.e. Render calls
+		unsigned int instanced    = 0; // Visible models rendered as part of an instanced batch
+	};
+	const std::vector<PassStats>& Stats() const  { return mStats; }
+	unsigned int TotalStateChanges() const;
+	unsigned int TotalVisible() const;
+	unsigned int TotalCulled() const;
+	unsigned int TotalOccluded() const;
+	unsigned int TotalBatches() const;
+	unsigned int TotalInstanced() const;
+	std::string  StatsReport(unsigned int numFrames) const; // One line per pass, averaged over the given number of frames
+	void         ResetStats()  { mStats.clear(); }
+
+	// Render calls made by the last Flush (models rendered singly plus instanced batches)
+	unsigned int LastFlushBatches() const  { return mLastFlushBatches; }
+
+
+private:
+	struct QueuedModel
+	{
+		Model*                    model;
+		RenderLayer               layer;
+		bool                      meshTextures; // Mesh sets its own textures, the texture set is ignored
+		RenderState               state;        // With the pass state filled in
+		ID3D11ShaderResourceView* textures[kNumTextures];
+	};
+
+	// A run of sorted models rendered together, either a single model or an instanced batch
+	struct Batch
+	{
+		uint32_t     start;         // Position of the first model in mSortOrder
+		uint32_t     count;
+		unsigned int firstInstance; // In the instance buffer, or InstanceBuffer::kNoRoom if not instanced
+	};
+
+	// Small ids for shader states, texture sets and meshes, used in sort keys
+	unsigned int ShaderStateId(const RenderState& state);
+	unsigned int TextureSetId(ID3D11ShaderResourceView* const textures[kNumTextures]);
+	unsigned int MeshId(const Mesh* mesh);
+
+	// Instanced version of a vertex shader, or null if there isn't one
+	ID3D11VertexShader* InstancedShader(ID3D11VertexShader* vertexShader) const;
+
+	// Whether two queued models can be drawn in the same instanced batch
+	bool CanInstanceTogether(const QueuedModel& a, const QueuedModel& b) const;
+
+	// Split the sorted models into batches, adding the instances of each instanced batch to the instance buffer
+	void BuildBatches();
+
+	// Sort key for a model, see the layout at the top of the file
+	uint64_t SortKey(const QueuedModel& queued);
+
+	// Sort mSortKeys (with the queue indexes in mSortOrder alongside) using a radix sort on 8-bit digits
+	void RadixSort();
+
+	// Set the given state / texture if it is not already set, counting the change
+	void ApplyState(const RenderState& state);
+	void ApplyTexture(unsigned int texture, ID3D11ShaderResourceView* srv);
+
+
+	std::string        mPassName;
+	RenderState        mPassState;
+	CVector3           mCameraPosition;
+	CFrustum           mFrustum;
+	const COcclusionBuffer* mOcclusion = nullptr;
+
+	std::vector<QueuedModel> mQueue;
+	std::vector<uint8_t>     mVisible;              // Culling result for each queued model
+	std::vector<CBoundingBox> mBounds;             // World bounds of the queued models not in the culling tree, their
+	std::vector<uint32_t>    mBoundsQueueIndex;     // positions in the queue and culling results
+	std::vector<uint8_t>     mBoundsVisible;
+
+	const CBoundingVolumeTree* mCullingTree = nullptr;
+	std::vector<uint32_t>    mTreeItems;            // Result of the tree query for this pass
+	std::vector<uint32_t>    mTreeItemPass;         // For each tree item, the last pass (mTreePass) it was visible in
+	uint32_t                 mTreePass = 0;
+	std::vector<uint64_t>    mSortKeys, mTempKeys;  // Kept between frames to avoid allocations
+	std::vector<uint32_t>    mSortOrder, mTempOrder;
+	std::vector<Batch>       mBatches;
+	std::vector<Model*>      mBatchModels;          // Models of the batch being built, for InstanceBuffer::AddBatch
+	unsigned int             mLastFlushBatches = 0;
+
+	struct TextureSet
+	{
+		ID3D11ShaderResourceView* textures[kNumTextures];
+	};
+	std::vector<RenderState> mShaderStates;         // Index in these vectors is the id
+	std::vector<TextureSet>  mTextureSets;
+	std::vector<const Mesh*> mMeshes;
+
+	struct InstancedShaderPair
+	{
+		ID3D11VertexShader* vertexShader;
+		ID3D11VertexShader* instancedVertexShader;
+	};
+	std::vector<InstancedShaderPair> mInstancedShaders;
+
+	// State currently set on the device
+	RenderState               mCurrentState;
+	ID3D11ShaderResourceView* mCurrentTextures[kNumTextures];
+	bool                      mTextureKnown[kNumTextures]; // False after a mesh has set its own textures
+	unsigned int              mStateChanges = 0;
+
+	std::vector<PassStats> mStats;
+};
+
+
+#endif //_RENDER_QUEUE_H_INCLUDED_
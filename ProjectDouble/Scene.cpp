@@ -6,6 +6,11 @@
 #include "Definitions.h"
 #include "ModelManager.h"
 #include "TextureManager.h"
+#include "GeometryArena.h"
+#include "RenderDevice.h"
+#include "InstanceBuffer.h"
+#include "LightBuffer.h"
+#include "Profiler.h"
 #include <d3d11.h>
 #include "Collision.h"
 #include "SoundClass.h"
@@ -19,11 +24,20 @@ ID3D11Buffer*     gPerFrameConstantBuffer;
 PerModelConstants gPerModelConstants;
 ID3D11Buffer*     gPerModelConstantBuffer;
 
+PerSkeletonConstants gPerSkeletonConstants;
+ID3D11Buffer*        gPerSkeletonConstantBuffer;
+
 PostProcessingConstants gPostProcessingConstants;      
 ID3D11Buffer* gPostProcessingConstantBuffer;
+unsigned int        gFrameNumber = 0;
+TransformCacheStats gTransformCacheStats;
+ConstantBufferStats gConstantBufferStats;
+RenderStateCacheStats gRenderStateCacheStats;
+
 const float ROTATION_SPEED = 2.0f;
 const float MOVEMENT_SPEED = 50.0f;
 const float gWiggleSpeed = 5.0f;
+const unsigned int gProfileCaptureFrames = 60; // Frames written to the Chrome trace when F3 is pressed
 
 //--------------------------------------------------------------------------------------
 // Scene Data
@@ -51,12 +65,21 @@ CMatrix4x4 CalculateLightProjectionMatrix(Model* light)
 	return MakeProjectionMatrix(1.0f, ToRadians(ModelCreator->gSpotlightConeAngle)); // Helper function in Utility\GraphicsHelpers.cpp
 }
 
+// The cone lit by a spotlight, inside the frustum of the matrices above
+CCone CalculateLightCone(Model* light)
+{
+	return CCone(light->Position(), light->WorldMatrix().GetZAxis(), ToRadians(ModelCreator->gSpotlightConeAngle / 2));
+}
+
 
 
 bool InitGeometry()
 {
     // Load mesh geometry data, support for multiple submeshes
-	ModelCreator->LoadMeshes();
+	if (!ModelCreator->LoadMeshes())
+	{
+		return false; // gLastError already set
+	}
 	
 
     // Load the shaders required for the geometry we will use (see Shader.cpp / .h)
@@ -77,15 +100,37 @@ bool InitGeometry()
     // See the comments above where these variable are declared and also the UpdateScene function
     gPerFrameConstantBuffer = CreateConstantBuffer(sizeof(gPerFrameConstants));
     gPerModelConstantBuffer = CreateConstantBuffer(sizeof(gPerModelConstants));
+    gPerSkeletonConstantBuffer = CreateConstantBuffer(sizeof(gPerSkeletonConstants));
 	gPostProcessingConstantBuffer = CreateConstantBuffer(sizeof(gPostProcessingConstants));
-    if (gPerFrameConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr || gPostProcessingConstantBuffer==nullptr)
+    if (gPerFrameConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr || gPerSkeletonConstantBuffer == nullptr ||
+        gPostProcessingConstantBuffer==nullptr)
     {
         gLastError = "Error creating constant buffers";
         return false;
     }
 
+	// Per-instance data for instanced rendering, and the shaders the render queue uses to instance models
+	if (!gInstanceBuffer.Create())
+	{
+		gLastError = "Error creating instance buffer";
+		return false;
+	}
+
+	// Lights and the light lists of each cluster of the view, for the lit shaders
+	if (!gLightBuffer.Create())
+	{
+		gLastError = "Error creating light buffer";
+		return false;
+	}
+	ModelCreator->gRenderQueue.SetInstancedShader(gPixelLightingVertexShader, gPixelLightingInstancedVertexShader);
+	ModelCreator->gRenderQueue.SetInstancedShader(gLightModelVertexShader, gLightModelInstancedVertexShader);
+	ModelCreator->gRenderQueue.SetCullingTree(&ModelCreator->gModelTree);
+
 	//Manually Loaded and Created Textures
-	TextureCreator->LoadTextures();
+	if (!TextureCreator->LoadTextures())
+	{
+		return false; // gLastError already set
+	}
 
 	TextureCreator->CreateTextures();
 
@@ -144,6 +189,7 @@ void ReleaseResources()
 	TextureCreator->ReleaseTextures();
     
     if (gPerModelConstantBuffer)  gPerModelConstantBuffer->Release();
+    if (gPerSkeletonConstantBuffer)  gPerSkeletonConstantBuffer->Release();
     if (gPerFrameConstantBuffer)  gPerFrameConstantBuffer->Release();
 	if (gPostProcessingConstantBuffer)gPostProcessingConstantBuffer->Release();
 
@@ -153,6 +199,9 @@ void ReleaseResources()
 	
 	delete TextureCreator;
 	delete ModelCreator;
+	gGeometryArena.Release(); // Vertex / index buffers used by all the meshes
+	gInstanceBuffer.Release();
+	gLightBuffer.Release();
 }
 
 
@@ -161,48 +210,77 @@ void ReleaseResources()
 // Scene Rendering
 //--------------------------------------------------------------------------------------
 
-// Render the scene from the given light's point of view. Only renders depth buffer
-void RenderDepthBufferFromLight(Model*Light)
+// Render the scene from the given light's point of view into a shadow map. Only renders depth buffer
+// The static casters are rendered into the shadow map's cached depth only when it is out of date (see ShadowCache.h),
+// then the cached depth is copied to the shadow map and the dynamic casters rendered over it. A map that keeps going
+// out of date has all its casters rendered straight into it instead
+void RenderDepthBufferFromLight(const std::string& passName, unsigned int shadowMap, Model* light,
+                                ID3D11Texture2D* shadowMapTexture, ID3D11DepthStencilView* shadowMapDepthStencil,
+                                ID3D11Texture2D* staticTexture, ID3D11DepthStencilView* staticDepthStencil)
 {
+	PROFILE_ZONE("Shadow map");
+
 	// Get camera-like matrices from the spotlight, seet in the constant buffer and send over to GPU
-	gPerFrameConstants.viewMatrix = CalculateLightViewMatrix(Light);
-	gPerFrameConstants.projectionMatrix = CalculateLightProjectionMatrix(Light);
+	gPerFrameConstants.viewMatrix = CalculateLightViewMatrix(light);
+	gPerFrameConstants.projectionMatrix = CalculateLightProjectionMatrix(light);
 	gPerFrameConstants.viewProjectionMatrix = gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
 	UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
 
 	// Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-	gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
-	gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+	gRenderDevice->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
+	gRenderDevice->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
 
 
 	//// Only render models that cast shadows ////
 
-	// Use special depth-only rendering shaders
-	gD3DContext->VSSetShader(gLightModelVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gDepthOnlyPixelShader, nullptr, 0);
-
-	// States - no blending, normal depth buffer and culling
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-	gD3DContext->RSSetState(gCullBackState);
+	// Use special depth-only rendering shaders, no blending, normal depth buffer and culling
+	RenderState passState;
+	passState.vertexShader = gLightModelVertexShader;
+	passState.pixelShader = gDepthOnlyPixelShader;
+	passState.blendState = gNoBlendingState;
+	passState.depthState = gUseDepthBufferState;
+	passState.rasterizerState = gCullBackState;
 
 	// Render models - no state changes required between each object in this situation (no textures used in this step)
-	ModelCreator->gFloor->Render();
-	ModelCreator->gTroll->Render();
-	ModelCreator->gCrate->Render();
-	ModelCreator->gSphere->Render();
-	ModelCreator->gCube[0]->Render();
-	ModelCreator->gCube[1]->Render();
-	ModelCreator->gTeapot->Render();
-	ModelCreator->gMainHouse->Render();
-	ModelCreator->gDuck->Render();
-	for (unsigned int i = 0; i < ModelCreator->kTreeNum; ++i)
+	// Casters outside the spotlight's frustum or cone are culled before they reach the queue. Meshes that set their
+	// own textures are still submitted as such so the queue knows which texture slots they have changed
+	RenderQueue& queue = ModelCreator->gRenderQueue;
+	ShadowCache& cache = ModelCreator->gShadowCache;
+	const RenderState usePassState;
+	const CFrustum lightFrustum(gPerFrameConstants.viewProjectionMatrix);
+	const CCone lightCone = CalculateLightCone(light);
+	ShadowCache::StaticMapUse staticMapUse = cache.UseStaticMap(shadowMap, gPerFrameConstants.viewProjectionMatrix);
+	if (staticMapUse == ShadowCache::StaticMapUse::Direct)
+	{
+		gRenderDevice->OMSetRenderTargets(0, nullptr, shadowMapDepthStencil);
+		gRenderDevice->ClearDepthStencilView(shadowMapDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+		queue.Begin(passName, passState, light->Position(), gPerFrameConstants.viewProjectionMatrix);
+		cache.CullCasters(true, lightFrustum, lightCone);
+		cache.CullCasters(false, lightFrustum, lightCone);
+		cache.SubmitCasters(queue, true, usePassState);
+		cache.SubmitCasters(queue, false, usePassState);
+		queue.Flush();
+		return;
+	}
+	if (staticMapUse == ShadowCache::StaticMapUse::Render)
 	{
-		ModelCreator->gTree[i]->Render();
-		ModelCreator->gTree2[i]->Render();
+		gRenderDevice->OMSetRenderTargets(0, nullptr, staticDepthStencil);
+		gRenderDevice->ClearDepthStencilView(staticDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+		queue.Begin(passName + " static", passState, light->Position(), gPerFrameConstants.viewProjectionMatrix);
+		cache.CullCasters(true, lightFrustum, lightCone);
+		cache.SubmitCasters(queue, true, usePassState);
+		queue.Flush();
+		cache.StaticMapRendered(shadowMap, gPerFrameConstants.viewProjectionMatrix, queue.LastFlushBatches());
 	}
-	ModelCreator->gWater->Render();
-	ModelCreator->gHouseTwo->Render();
+
+	// Start from the static casters' depth and add the dynamic casters
+	gRenderDevice->OMSetRenderTargets(0, nullptr, nullptr);
+	gRenderDevice->CopyResource(shadowMapTexture, staticTexture);
+	gRenderDevice->OMSetRenderTargets(0, nullptr, shadowMapDepthStencil);
+	queue.Begin(passName, passState, light->Position(), gPerFrameConstants.viewProjectionMatrix);
+	cache.CullCasters(false, lightFrustum, lightCone);
+	cache.SubmitCasters(queue, false, usePassState);
+	queue.Flush();
 }
 // Render everything in the scene from the given camera
 // This code is common between rendering the main scene and rendering the scene in the portal
@@ -223,8 +301,8 @@ void SelectPostProcessShaderAndTextures()
 	
 	if (gCurrentPostProcess == PostProcess::UnderWater)//Select Underwater
 	{
-		gD3DContext->PSSetShader(gUnderWaterPostProcess, nullptr, 0);
-		gD3DContext->Draw(4, 0);
+		gRenderDevice->PSSetShader(gUnderWaterPostProcess, nullptr, 0);
+		gRenderDevice->Draw(4, 0);
 
 	}
 	
@@ -232,23 +310,23 @@ void SelectPostProcessShaderAndTextures()
 	if (gCurrentPostProcess == PostProcess::Bloom)
 	{
 		//Apply vertical blur on select lighted area
-		gD3DContext->OMSetRenderTargets(1, &TextureCreator->gATextureRenderTarget, gDepthStencil);
-		gD3DContext->PSSetShaderResources(13, 1, &TextureCreator->gSceneTextureSRV);
-		gD3DContext->PSSetShader(gVerticalBloomPixelShader, nullptr, 0);
-		gD3DContext->Draw(4, 0);
+		gRenderDevice->OMSetRenderTargets(1, &TextureCreator->gATextureRenderTarget, gDepthStencil);
+		gRenderDevice->PSSetShaderResources(13, 1, &TextureCreator->gSceneTextureSRV);
+		gRenderDevice->PSSetShader(gVerticalBloomPixelShader, nullptr, 0);
+		gRenderDevice->Draw(4, 0);
 	
 		//Check the position of the bloom effect inside the vector is odd or even
 		//Prepare render target for horizontal blur on lighted area
-		gD3DContext->OMSetRenderTargets(1, &TextureCreator->gBTextureRenderTarget, gDepthStencil);
-		gD3DContext->PSSetShaderResources(13, 1, &TextureCreator->gSceneTextureSRV);
-		gD3DContext->PSSetShader(gHorizontalBloomPixelShader, nullptr, 0);
-		gD3DContext->Draw(4, 0);
+		gRenderDevice->OMSetRenderTargets(1, &TextureCreator->gBTextureRenderTarget, gDepthStencil);
+		gRenderDevice->PSSetShaderResources(13, 1, &TextureCreator->gSceneTextureSRV);
+		gRenderDevice->PSSetShader(gHorizontalBloomPixelShader, nullptr, 0);
+		gRenderDevice->Draw(4, 0);
 		////Finally combine all the texture togethers in a Final Pixel Shader
-		gD3DContext->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
-		gD3DContext->PSSetShaderResources(13, 1, &TextureCreator->gSceneTextureSRV);
-		gD3DContext->PSSetShaderResources(10, 1, &TextureCreator->gATextureSRV);
-		gD3DContext->PSSetShaderResources(11, 1, &TextureCreator->gBTextureSRV);
-		gD3DContext->PSSetShader(gFinalBloomPS, nullptr, 0);
+		gRenderDevice->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
+		gRenderDevice->PSSetShaderResources(13, 1, &TextureCreator->gSceneTextureSRV);
+		gRenderDevice->PSSetShaderResources(10, 1, &TextureCreator->gATextureSRV);
+		gRenderDevice->PSSetShaderResources(11, 1, &TextureCreator->gBTextureSRV);
+		gRenderDevice->PSSetShader(gFinalBloomPS, nullptr, 0);
 		
 	
 	}
@@ -260,29 +338,31 @@ void SelectPostProcessShaderAndTextures()
 
 void FullScreenPostProcess(PostProcess postProcess)
 {
+		PROFILE_ZONE("Post-process");
 	
 		// Select the back buffer to use for rendering. Not going to clear the back-buffer because we're going to overwrite it all
-		gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
+		gRenderDevice->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
 		// Give the pixel shader (post-processing shader) access to the scene texture 
-		gD3DContext->PSSetShaderResources(13, 1, &TextureCreator->gSceneTextureSRV);
-		gD3DContext->PSSetSamplers(5, 1, &gPointSampler); // Use point sampling (no bilinear, trilinear, mip-mapping etc. for most post-processes)
+		gRenderDevice->PSSetShaderResources(13, 1, &TextureCreator->gSceneTextureSRV);
+		gRenderDevice->PSSetSamplers(5, 1, &gPointSampler); // Use point sampling (no bilinear, trilinear, mip-mapping etc. for most post-processes)
 
 
 
 		// Using special vertex shader that creates its own data for a 2D screen quad
-		gD3DContext->VSSetShader(gFullScreenQuadVertexShader, nullptr, 0);
-		gD3DContext->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
+		gRenderDevice->VSSetShader(gFullScreenQuadVertexShader, nullptr, 0);
+		gRenderDevice->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
 
 
 		// States - no blending, don't write to depth buffer and ignore back-face culling
-		gD3DContext->OMSetBlendState(gAlphaBlendingState, nullptr, 0xffffff);
-		gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-		gD3DContext->RSSetState(gCullNoneState);
+		gRenderDevice->OMSetBlendState(gAlphaBlendingState, nullptr, 0xffffff);
+		gRenderDevice->OMSetDepthStencilState(gDepthReadOnlyState, 0);
+		gRenderDevice->RSSetState(gCullNoneState);
 
 
 		// No need to set vertex/index buffer (see 2D quad vertex shader), just indicate that the quad will be created as a triangle strip
-		gD3DContext->IASetInputLayout(NULL); // No vertex data
-		gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+		gRenderDevice->IASetInputLayout(NULL); // No vertex data
+		gRenderDevice->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+		gGeometryArena.InvalidateBindings(); // Next mesh render must set its vertex data again
 
 
 		// Select shader and textures needed for the required post-processes (helper function above)
@@ -299,15 +379,15 @@ void FullScreenPostProcess(PostProcess postProcess)
 
 		// Pass over the above post-processing settings (also the per-process settings prepared in UpdateScene function below)
 		UpdateConstantBuffer(gPostProcessingConstantBuffer, gPostProcessingConstants);
-		gD3DContext->VSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
-		gD3DContext->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
+		gRenderDevice->VSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
+		gRenderDevice->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
 
 		
-		gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
+		gRenderDevice->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
 
 
 		// Draw a quad
-		gD3DContext->Draw(4, 0);
+		gRenderDevice->Draw(4, 0);
 
 
 }
@@ -317,33 +397,48 @@ void FullScreenPostProcess(PostProcess postProcess)
 // Then it renders the main scene using the portal texture on a model.
 void RenderScene()
 {
+	PROFILE_ZONE("RenderScene");
+	++gFrameNumber;
+	gGeometryArena.InvalidateBindings(); // Don't rely on vertex data set during the last frame
+	gInstanceBuffer.Clear();             // Instances are rebuilt each frame
+	ModelCreator->UpdateModelTree();     // Refit the model bounds moved since last frame, used for culling below
+	ModelCreator->gPassScheduler.BeginFrame();
 
     // Set up the light information in the constant buffer 
     // Don't send to the GPU yet, the function RenderSceneFromCamera will do that
-	//Basic information for lighting passed to GPU to calculate Diffuse Lighting, Specular Lighting and Light attenuation
-	gPerFrameConstants.light1Colour = ModelCreator->gLights[0].colour * ModelCreator->gLights[0].strength;
-	gPerFrameConstants.light1Position = ModelCreator->gLights[0].model->Position();
-	gPerFrameConstants.light2Colour = ModelCreator->gLights[1].colour * ModelCreator->gLights[1].strength;
-	gPerFrameConstants.light2Position = ModelCreator->gLights[1].model->Position();
-	gPerFrameConstants.light3Colour = ModelCreator->gLights[2].colour * ModelCreator->gLights[2].strength;
-	gPerFrameConstants.light3Position = ModelCreator->gLights[2].model->Position();
-	gPerFrameConstants.light4Colour = ModelCreator->gLights[3].colour * ModelCreator->gLights[3].strength;
-	gPerFrameConstants.light4Position = ModelCreator->gLights[3].model->Position();
+	//Basic information for lighting passed to GPU to calculate Diffuse Lighting, Specular Lighting and Light attenuation.
+	//All the lights go in the light buffer, which lists the lights reaching each part of the view for each camera
+	gLightBuffer.Clear();
+	float spotlightHalfAngle = ToRadians(ModelCreator->gSpotlightConeAngle / 2);
+	for (auto& light : ModelCreator->gLights)
+	{
+		CVector3 colour = light.colour * light.strength;
+		float range = light.strength / ModelCreator->gLightCutoff;
+		if (light.spotlight)
+		{
+			CVector3 facing = Normalise(light.model->WorldMatrix().GetZAxis());
+			gLightBuffer.AddSpotLight(light.model->Position(), colour, range, facing, spotlightHalfAngle, light.shadowMap, light.lightSets);
+		}
+		else
+		{
+			gLightBuffer.AddPointLight(light.model->Position(), colour, range, light.lightSets);
+		}
+	}
 
    //Lights information that cast shadowing 
-	gPerFrameConstants.light5Colour = ModelCreator->gLights[4].colour * ModelCreator->gLights[4].strength;
-	gPerFrameConstants.light5Position = ModelCreator->gLights[4].model->Position();
-	gPerFrameConstants.light5Facing = Normalise(ModelCreator->gLights[4].model->WorldMatrix().GetZAxis());  
-	gPerFrameConstants.light5CosHalfAngle = cos(ToRadians(ModelCreator->gSpotlightConeAngle / 2));//It used for the size of the cone that the light creates
-	gPerFrameConstants.light5ProjectionMatrix = CalculateLightProjectionMatrix(ModelCreator->gLights[4].model);
-	gPerFrameConstants.light5ViewMatrix = CalculateLightViewMatrix(ModelCreator->gLights[4].model);
-
-	gPerFrameConstants.light6Colour = ModelCreator->gLights[5].colour * ModelCreator->gLights[5].strength;
-	gPerFrameConstants.light6Position = ModelCreator->gLights[5].model->Position();
-	gPerFrameConstants.light6Facing = Normalise(ModelCreator->gLights[5].model->WorldMatrix().GetZAxis());
-	gPerFrameConstants.light6CosHalfAngle = cos(ToRadians(ModelCreator->gSpotlightConeAngle / 2));//It used for the size of the cone that the light creates
-	gPerFrameConstants.light6ViewMatrix = CalculateLightViewMatrix(ModelCreator->gLights[5].model);
-	gPerFrameConstants.light6ProjectionMatrix = CalculateLightProjectionMatrix(ModelCreator->gLights[5].model);
+	gPerFrameConstants.shadowLight1Colour = ModelCreator->gLights[4].colour * ModelCreator->gLights[4].strength;
+	gPerFrameConstants.shadowLight1Position = ModelCreator->gLights[4].model->Position();
+	gPerFrameConstants.shadowLight1Facing = Normalise(ModelCreator->gLights[4].model->WorldMatrix().GetZAxis());  
+	gPerFrameConstants.shadowLight1CosHalfAngle = cos(spotlightHalfAngle);//It used for the size of the cone that the light creates
+	gPerFrameConstants.shadowLight1ProjectionMatrix = CalculateLightProjectionMatrix(ModelCreator->gLights[4].model);
+	gPerFrameConstants.shadowLight1ViewMatrix = CalculateLightViewMatrix(ModelCreator->gLights[4].model);
+
+	gPerFrameConstants.shadowLight2Colour = ModelCreator->gLights[5].colour * ModelCreator->gLights[5].strength;
+	gPerFrameConstants.shadowLight2Position = ModelCreator->gLights[5].model->Position();
+	gPerFrameConstants.shadowLight2Facing = Normalise(ModelCreator->gLights[5].model->WorldMatrix().GetZAxis());
+	gPerFrameConstants.shadowLight2CosHalfAngle = cos(spotlightHalfAngle);//It used for the size of the cone that the light creates
+	gPerFrameConstants.shadowLight2ViewMatrix = CalculateLightViewMatrix(ModelCreator->gLights[5].model);
+	gPerFrameConstants.shadowLight2ProjectionMatrix = CalculateLightProjectionMatrix(ModelCreator->gLights[5].model);
 
 	gPerFrameConstants.ambientColour = gAmbientColour;//Background lighting as static  
 	gPerFrameConstants.specularPower = gSpecularPower;
@@ -357,26 +452,30 @@ void RenderScene()
 	D3D11_VIEWPORT vp;
     // Portal scene rendering ////
 
-    // Set the portal texture and portal depth buffer as the targets for rendering
-    // The portal texture will later be used on models in the main scene
-   gD3DContext->OMSetRenderTargets(1, &TextureCreator->gPortalRenderTarget, TextureCreator->gPortalDepthStencilView);
-
-    // Clear the portal texture to a fixed colour and the portal depth buffer to the far distance
-    gD3DContext->ClearRenderTargetView(TextureCreator->gPortalRenderTarget, &gBackgroundColor.r);
-    gD3DContext->ClearDepthStencilView(TextureCreator->gPortalDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-    // Setup the viewport for the portal texture size
-   
-    vp.Width  = static_cast<FLOAT>(TextureCreator->gPortalWidth);
-    vp.Height = static_cast<FLOAT>(TextureCreator->gPortalHeight);
-    vp.MinDepth = 0.0f;
-    vp.MaxDepth = 1.0f;
-    vp.TopLeftX = 0;
-    vp.TopLeftY = 0;
-    gD3DContext->RSSetViewports(1, &vp);
-
-    // Render the scene for the portal
-    RenderSceneFromCamera(ModelCreator->gPortalCamera);
+    // Only needed if a portal can be seen, directly or in the water reflection (see PassScheduler.h)
+    if (ModelCreator->gPassScheduler.Schedule("Portal scene", ModelCreator->PortalVisible(ModelCreator->gCamera)))
+    {
+        PROFILE_ZONE("Portal scene");
+        // Set the portal texture and portal depth buffer as the targets for rendering
+        // The portal texture will later be used on models in the main scene
+        gRenderDevice->OMSetRenderTargets(1, &TextureCreator->gPortalRenderTarget, TextureCreator->gPortalDepthStencilView);
+
+        // Clear the portal texture to a fixed colour and the portal depth buffer to the far distance
+        gRenderDevice->ClearRenderTargetView(TextureCreator->gPortalRenderTarget, &gBackgroundColor.r);
+        gRenderDevice->ClearDepthStencilView(TextureCreator->gPortalDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+        // Setup the viewport for the portal texture size
+        vp.Width  = static_cast<FLOAT>(TextureCreator->gPortalWidth);
+        vp.Height = static_cast<FLOAT>(TextureCreator->gPortalHeight);
+        vp.MinDepth = 0.0f;
+        vp.MaxDepth = 1.0f;
+        vp.TopLeftX = 0;
+        vp.TopLeftY = 0;
+        gRenderDevice->RSSetViewports(1, &vp);
+
+        // Render the scene for the portal
+        RenderSceneFromCamera(ModelCreator->gPortalCamera);
+    }
 
 
 
@@ -394,18 +493,19 @@ void RenderScene()
 	vp.MaxDepth = 1.0f;
 	vp.TopLeftX = 0;
 	vp.TopLeftY = 0;
-	gD3DContext->RSSetViewports(1, &vp);
-
-	//
-	gD3DContext->OMSetRenderTargets(0, nullptr, TextureCreator->gShadowMap1DepthStencil);
-	gD3DContext->ClearDepthStencilView(TextureCreator->gShadowMap1DepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
-	RenderDepthBufferFromLight(ModelCreator->gLights[4].model);
+	gRenderDevice->RSSetViewports(1, &vp);
 
-	//// Render the scene from the point of view of light 2 (only depth values written)
+	// The shadow maps are still selected as textures from the last frame, detach them before they are written to
+	ID3D11ShaderResourceView* nullShadowMaps[2] = { nullptr, nullptr };
+	gRenderDevice->PSSetShaderResources(7, 2, nullShadowMaps);
 
-	gD3DContext->OMSetRenderTargets(0, nullptr, TextureCreator->gShadowMap2DepthStencil);
-	gD3DContext->ClearDepthStencilView(TextureCreator->gShadowMap2DepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
-	RenderDepthBufferFromLight(ModelCreator->gLights[5].model);
+	//// Render the scene from the point of view of light 1 and light 2 (only depth values written)
+	RenderDepthBufferFromLight("Shadow 1", 0, ModelCreator->gLights[4].model,
+	                           TextureCreator->gShadowMap1Texture, TextureCreator->gShadowMap1DepthStencil,
+	                           TextureCreator->gShadowMap1StaticTexture, TextureCreator->gShadowMap1StaticDepthStencil);
+	RenderDepthBufferFromLight("Shadow 2", 1, ModelCreator->gLights[5].model,
+	                           TextureCreator->gShadowMap2Texture, TextureCreator->gShadowMap2DepthStencil,
+	                           TextureCreator->gShadowMap2StaticTexture, TextureCreator->gShadowMap2StaticDepthStencil);
 
 
 	//**************************//
@@ -418,18 +518,18 @@ void RenderScene()
 
 	if (gCurrentPostProcess != PostProcess::None)
 	{
-		gD3DContext->OMSetRenderTargets(1, &TextureCreator->gSceneRenderTarget, gDepthStencil);
-		gD3DContext->ClearRenderTargetView(TextureCreator->gSceneRenderTarget, &gBackgroundColor.r);
+		gRenderDevice->OMSetRenderTargets(1, &TextureCreator->gSceneRenderTarget, gDepthStencil);
+		gRenderDevice->ClearRenderTargetView(TextureCreator->gSceneRenderTarget, &gBackgroundColor.r);
 
 
 	}
 	else
 	{
-		gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
-		gD3DContext->ClearRenderTargetView(gBackBufferRenderTarget, &gBackgroundColor.r);
+		gRenderDevice->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
+		gRenderDevice->ClearRenderTargetView(gBackBufferRenderTarget, &gBackgroundColor.r);
 	}
 
-	gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	gRenderDevice->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
 	// Setup the viewport to the size of the main window
 	vp.Width = static_cast<FLOAT>(gViewportWidth);
@@ -438,7 +538,7 @@ void RenderScene()
 	vp.MaxDepth = 1.0f;
 	vp.TopLeftX = 0;
 	vp.TopLeftY = 0;
-	gD3DContext->RSSetViewports(1, &vp);
+	gRenderDevice->RSSetViewports(1, &vp);
 
 	
     
@@ -447,7 +547,7 @@ void RenderScene()
     RenderSceneFromCamera(ModelCreator->gCamera);
 
 	
-	gD3DContext->PSSetShaderResources(1, 1, &nullView);
+	gRenderDevice->PSSetShaderResources(1, 1, &nullView);
     //-------------------------------------------------------------------------
 	
 
@@ -457,7 +557,8 @@ void RenderScene()
 		FullScreenPostProcess(gCurrentPostProcess);
 	}
     // When drawing to the off-screen back buffer is complete, we "present" the image to the front buffer (the screen)
-    gSwapChain->Present(0, 0);
+    PROFILE_ZONE("Present");
+    gRenderDevice->Present(0);
 }
 
 
@@ -468,10 +569,14 @@ void RenderScene()
 // Update models and camera. frameTime is the time passed since the last frame
 void UpdateScene(float frameTime)
 {
+	PROFILE_ZONE("UpdateScene");
 
 	if (KeyHit(Key_1))gCurrentPostProcess = PostProcess::Bloom;
 	if (KeyHit(Key_0))gCurrentPostProcess = PostProcess::None;
 
+	// Write a Chrome trace of the next few frames' profile zones (see Profiler.h)
+	if (KeyHit(Key_F3))  gProfiler.CaptureFrames(gProfileCaptureFrames, "ProfileTrace.json");
+
 	ModelCreator->UpdateModels(frameTime);
     // Show frame time / FPS in the window title //
     const float fpsUpdateTime = 0.5f; // How long between updates (in seconds)
@@ -487,9 +592,65 @@ void UpdateScene(float frameTime)
         frameTimeMs.precision(2);
         frameTimeMs << std::fixed << avgFrameTime * 1000;
         std::string windowTitle = "Ivaylo Ivanov Project Double: Frame Time: " + frameTimeMs.str() +
-                                  "ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f));
+                                  "ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f)) +
+                                  ", Model transforms recalculated/reused per frame: " +
+                                  std::to_string(gTransformCacheStats.recalculated / frameCount) + "/" +
+                                  std::to_string(gTransformCacheStats.skipped / frameCount) +
+                                  ", Constant buffer KB/uploads per frame: " +
+                                  std::to_string(gConstantBufferStats.bytesUploaded / 1024 / frameCount) + "/" +
+                                  std::to_string(gConstantBufferStats.uploads / frameCount) +
+                                  ", Models visible/culled/occluded per frame: " +
+                                  std::to_string(ModelCreator->gRenderQueue.TotalVisible() / frameCount) + "/" +
+                                  std::to_string(ModelCreator->gRenderQueue.TotalCulled() / frameCount) + "/" +
+                                  std::to_string(ModelCreator->gRenderQueue.TotalOccluded() / frameCount) +
+                                  ", Render state changes per frame: " +
+                                  std::to_string(ModelCreator->gRenderQueue.TotalStateChanges() / frameCount) +
+                                  ", Instanced batches/models per frame: " +
+                                  std::to_string(gInstanceBuffer.NumBatches() / frameCount) + "/" +
+                                  std::to_string(gInstanceBuffer.NumInstanced() / frameCount) +
+                                  ", Binds issued/elided per frame: " +
+                                  std::to_string(gRenderStateCacheStats.issued / frameCount) + "/" +
+                                  std::to_string(gRenderStateCacheStats.elided / frameCount) +
+                                  ", Auxiliary " + ModelCreator->gPassScheduler.FrameReport();
         SetWindowTextA(gHWnd, windowTitle.c_str());
+
+        // Break down of the render queue state changes for each pass, shown in the debugger output window
+        std::string passReport = "Render queue passes:\n" + ModelCreator->gRenderQueue.StatsReport(frameCount);
+        const COcclusionBuffer::Stats& occlusionStats = ModelCreator->gOcclusionBuffer.GetStats();
+        passReport += "Occlusion buffer: " + std::to_string(occlusionStats.triangles / frameCount) + " occluder triangles, " +
+                      std::to_string(occlusionStats.rasterised / frameCount) + " rasterised, " +
+                      std::to_string(occlusionStats.tiles / frameCount) + " tiles, " +
+                      std::to_string(occlusionStats.occluded / frameCount) + "/" +
+                      std::to_string(occlusionStats.tests / frameCount) + " boxes occluded per frame\n";
+        passReport += "Auxiliary passes:\n" + ModelCreator->gPassScheduler.StatsReport(frameCount);
+        const ShadowCache::Stats& shadowStats = ModelCreator->gShadowCache.GetStats();
+        passReport += "Shadow cache: " + std::to_string(shadowStats.staticRenders) + " static maps rendered, " +
+                      std::to_string(shadowStats.reuses) + " reused, " +
+                      std::to_string(shadowStats.directRenders) + " rendered without the cache, " +
+                      std::to_string(shadowStats.skippedDraws / frameCount) + " caster draws skipped per frame, " +
+                      std::to_string(shadowStats.outsideFrustum / frameCount) + "/" +
+                      std::to_string(shadowStats.outsideCone / frameCount) + " of " +
+                      std::to_string(shadowStats.casterTests / frameCount) +
+                      " casters culled by light frustums/cones per frame\n";
+        const CLightClusters::Stats& clusterStats = gLightBuffer.Clusters().GetStats();
+        passReport += "Light clusters: " + std::to_string(clusterStats.lightsInView / frameCount) + "/" +
+                      std::to_string(clusterStats.lights / frameCount) + " lights in view, " +
+                      std::to_string(clusterStats.indices / frameCount) + " indices, " +
+                      std::to_string(clusterStats.maxPerCluster) + " most in a cluster, " +
+                      std::to_string(clusterStats.assigns / frameCount) + " assigned, " +
+                      std::to_string(gLightBuffer.NumReuses() / frameCount) + " reused per frame\n";
+        passReport += gProfiler.SummaryReport();
+        OutputDebugStringA(passReport.c_str());
         totalFrameTime = 0;
         frameCount = 0;
+        gTransformCacheStats = {};
+        gConstantBufferStats = {};
+        gRenderStateCacheStats = {};
+        ModelCreator->gRenderQueue.ResetStats();
+        ModelCreator->gOcclusionBuffer.ResetStats();
+        ModelCreator->gPassScheduler.ResetStats();
+        ModelCreator->gShadowCache.ResetStats();
+        gInstanceBuffer.ResetStats();
+        gLightBuffer.ResetStats();
     }
 }
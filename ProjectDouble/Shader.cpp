@@ -4,6 +4,7 @@
 //--------------------------------------------------------------------------------------
 
 #include "Shader.h"
+#include "Profiler.h"
 #include <fstream>
 #include <vector>
 #include <d3dcompiler.h>
@@ -19,6 +20,9 @@ ID3D11VertexShader* gPixelLightingVertexShader = nullptr;
 ID3D11PixelShader*  gPixelLightingPixelShader  = nullptr;
 ID3D11VertexShader* gLightModelVertexShader = nullptr;
 ID3D11PixelShader*  gLightModelPixelShader  = nullptr;
+ID3D11VertexShader* gPixelLightingInstancedVertexShader = nullptr; // Instanced versions, see InstanceBuffer.h
+ID3D11VertexShader* gLightModelInstancedVertexShader    = nullptr;
+ID3D11PixelShader*  gTintedTextureInstancedPixelShader  = nullptr;
 ID3D11VertexShader* gLerpVertexShader = nullptr;
 ID3D11PixelShader* gLerpPixelShader = nullptr;
 ID3D11PixelShader* gShadowMappingPixelShader = nullptr;
@@ -49,6 +53,8 @@ ID3D11PixelShader* gRefractedTintedTexturePixelShader = nullptr;
 // Load shaders required for this app, returns true on success
 bool LoadShaders()
 {
+    PROFILE_ZONE("LoadShaders");
+
     // Shaders must be added to the Visual Studio project to be compiled, they use the extension ".hlsl".
     // To load them for use, include them here without the extension. Use the correct function for each.
     // Ensure you release the shaders in the ShutdownDirect3D function below
@@ -56,6 +62,9 @@ bool LoadShaders()
     gPixelLightingPixelShader  = LoadPixelShader (".\\Shaders\\PixelLighting_ps");
     gLightModelVertexShader = LoadVertexShader(".\\Shaders\\LightModel_vs");
     gLightModelPixelShader  = LoadPixelShader (".\\Shaders\\LightModel_ps");
+    gPixelLightingInstancedVertexShader = LoadVertexShader(".\\Shaders\\PixelLightingInstanced_vs");
+    gLightModelInstancedVertexShader    = LoadVertexShader(".\\Shaders\\LightModelInstanced_vs");
+    gTintedTextureInstancedPixelShader  = LoadPixelShader (".\\Shaders\\TintedTextureInstanced_ps");
 	gLerpVertexShader = LoadVertexShader(".\\Shaders\\LerpShader_vs");
 	gLerpPixelShader = LoadPixelShader(".\\Shaders\\LerpShader_ps");
 	gShadowMappingPixelShader = LoadPixelShader(".\\Shaders\\ShadowMapping_ps");
@@ -71,6 +80,8 @@ bool LoadShaders()
   
 	if (gPixelLightingVertexShader == nullptr || gPixelLightingPixelShader == nullptr ||
 		gLightModelVertexShader == nullptr || gLightModelPixelShader == nullptr ||
+		gPixelLightingInstancedVertexShader == nullptr || gLightModelInstancedVertexShader == nullptr ||
+		gTintedTextureInstancedPixelShader == nullptr ||
 		gLerpPixelShader == nullptr || gLerpVertexShader == nullptr ||
 		 gShadowMappingPixelShader == nullptr ||
 		gBasicTransformVertexShader == nullptr || gDepthOnlyPixelShader == nullptr ||
@@ -101,6 +112,9 @@ void ReleaseShaders()
     if (gTreePixelShader) gTreePixelShader->Release();
     if (gLightModelVertexShader)     gLightModelVertexShader->Release();
     if (gLightModelPixelShader)      gLightModelPixelShader->Release();
+    if (gPixelLightingInstancedVertexShader)  gPixelLightingInstancedVertexShader->Release();
+    if (gLightModelInstancedVertexShader)     gLightModelInstancedVertexShader->Release();
+    if (gTintedTextureInstancedPixelShader)   gTintedTextureInstancedPixelShader->Release();
     if (gPixelLightingVertexShader)  gPixelLightingVertexShader->Release();
     if (gPixelLightingPixelShader)   gPixelLightingPixelShader->Release();
 	if (gLerpVertexShader)gLerpVertexShader->Release();
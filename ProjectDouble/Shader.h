@@ -19,6 +19,9 @@ extern ID3D11VertexShader* gPixelLightingVertexShader;
 extern ID3D11PixelShader*  gPixelLightingPixelShader;
 extern ID3D11VertexShader* gLightModelVertexShader;
 extern ID3D11PixelShader*  gLightModelPixelShader;
+extern ID3D11VertexShader* gPixelLightingInstancedVertexShader; // Instanced versions, see InstanceBuffer.h
+extern ID3D11VertexShader* gLightModelInstancedVertexShader;
+extern ID3D11PixelShader*  gTintedTextureInstancedPixelShader;
 
 extern ID3D11PixelShader* gTintedTexturePixelShader;
 extern ID3D11VertexShader* gLerpVertexShader;
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// Clustered lights - the scene's lights and the lists of lights reaching each cluster
+//--------------------------------------------------------------------------------------
+// The camera's view is split into a grid of clusters: tiles across the screen and slices in depth. The C++ code lists
+// the lights that reach each cluster (see LightBuffer.h), so a pixel only loops over the lights of its own cluster
+
+#ifndef _CLUSTERED_LIGHTS_HLSLI_DEFINED_
+#define _CLUSTERED_LIGHTS_HLSLI_DEFINED_
+
+#include "Common.hlsli"
+
+// These variables must match exactly the LightData and ClusterConstants structures in LightBuffer.h
+struct LightData
+{
+    float3 position;
+    float  range;        // Light fades to nothing at this distance
+    float3 colour;       // Colour multiplied by strength
+    float  cosHalfAngle; // Cosine of a spotlight's cone half angle, below -1 for point lights
+    float3 facing;       // Spotlights only
+    uint   shadowMap;    // 1 or 2 for spotlights lit with a shadow map where there is one, else 0
+    uint   lightSets;    // The LIGHT_SET_ values below for the shaders this light is used by
+    float3 paddingL;
+};
+
+// Sets of lights, for shaders that are only lit by some of the lights. Must match the kLightSet values in LightBuffer.h
+#define LIGHT_SET_GENERAL            1 // The shaders that use all the scene's lights
+#define LIGHT_SET_WATER_SPECULAR     2 // Reflected as highlights on the water surface
+#define LIGHT_SET_TRANSFORM_LIGHTING 4 // TransformLighting_ps
+StructuredBuffer<LightData> gLights       : register(t16);
+StructuredBuffer<uint2>     gClusters     : register(t17); // Offset and count of each cluster's part of the index list
+StructuredBuffer<uint>      gLightIndices : register(t18);
+
+cbuffer ClusterConstants : register(b4)
+{
+    uint   gClusterTilesX;
+    uint   gClusterTilesY;
+    uint   gClusterSlices;
+    float  gClusterFirstSliceDepth; // Slice 0 is nearer than this, the other slices are spread exponentially beyond it
+    float  gClusterDepthScale;
+    float  gClusterDepthBias;
+    float2 paddingK;
+}
+
+
+// Offset and count in gLightIndices of the lights for the cluster holding a world position, as seen by the current
+// camera. Must find clusters in the same way as CLightClusters::Slice and the tile calculations in CLightClusters.cpp
+uint2 ClusterLights(float3 worldPosition)
+{
+    float4 clipPosition = mul(gViewProjectionMatrix, float4(worldPosition, 1.0f));
+    float2 screenPosition = clipPosition.xy / clipPosition.w;
+    float  viewDepth = clipPosition.w;
+
+    uint tileX = (uint)clamp(floor((screenPosition.x + 1) * 0.5f * gClusterTilesX), 0, gClusterTilesX - 1);
+    uint tileY = (uint)clamp(floor((1 - screenPosition.y) * 0.5f * gClusterTilesY), 0, gClusterTilesY - 1); // Rows count down from the top
+    uint slice = 0;
+    if (viewDepth >= gClusterFirstSliceDepth)
+    {
+        float depthSlice = max(log(viewDepth) * gClusterDepthScale + gClusterDepthBias, 0);
+        slice = (depthSlice < gClusterSlices - 2) ? 1 + (uint)depthSlice : gClusterSlices - 1;
+    }
+    return gClusters[(slice * gClusterTilesY + tileY) * gClusterTilesX + tileX];
+}
+
+
+// Colour of a light reaching a world position and the direction from the position to the light. Light falls off with
+// distance as in the rest of the shaders, but is faded out to nothing at the light's range so it needn't be listed
+// for clusters beyond it. Spotlights give no light outside their cone, unless useCone is false
+float3 LightReaching(LightData light, float3 worldPosition, out float3 lightDirection, bool useCone = true)
+{
+    float3 lightVector = light.position - worldPosition;
+    float  lightDist = length(lightVector);
+    lightDirection = lightVector / lightDist;
+
+    float fade = saturate(1 - pow(lightDist / light.range, 4));
+    float3 colour = light.colour * fade * fade / lightDist;
+    return (!useCone || dot(light.facing, -lightDirection) > light.cosHalfAngle) ? colour : 0;
+}
+
+
+// Add the diffuse and specular light from the lights in a world position's cluster that are in the given light set,
+// using the same lighting equations as the shaders used for each light before. Spotlights with shadow maps are left out
+// if skipShadowMapped is true, for shaders that light them with their shadow maps. Otherwise they light in all
+// directions, as they did in the shaders without shadow maps before the lights were clustered
+void ClusteredLighting(float3 worldPosition, float3 worldNormal, float3 cameraDirection, uint lightSet, bool skipShadowMapped,
+                       inout float3 diffuseLight, inout float3 specularLight)
+{
+    uint2 lights = ClusterLights(worldPosition);
+    for (uint i = 0; i < lights.y; ++i)
+    {
+        LightData light = gLights[gLightIndices[lights.x + i]];
+        if ((light.lightSets & lightSet) == 0)  continue;
+        if (skipShadowMapped && light.shadowMap != 0)  continue;
+
+        float3 lightDirection;
+        float3 lightColour = LightReaching(light, worldPosition, lightDirection, light.shadowMap == 0);
+        float3 diffuse = lightColour * max(dot(worldNormal, lightDirection), 0);
+
+        float3 halfway = normalize(lightDirection + cameraDirection);
+        diffuseLight += diffuse;
+        specularLight += diffuse * pow(max(dot(worldNormal, halfway), 0), gSpecularPower); // Multiplying by diffuse light instead of light colour as before
+    }
+}
+
+#endif // _CLUSTERED_LIGHTS_HLSLI_DEFINED_
@@ -102,6 +102,15 @@ struct SimplePixelShaderInput
     float2 uv : uv;
 };
 
+// As above but with the tint colour of each instance for instanced light models. The extra value is last so pixel
+// shaders taking the structure above (e.g. the depth-only shader) can still be used
+struct InstancedSimplePixelShaderInput
+{
+    float4 projectedPosition : SV_Position;
+    float2 uv : uv;
+    float3 objectColour : objectColour;
+};
+
 // Data sent to pixel shaders that need world position, but not the world normal (some of the water shaders)
 struct WorldPositionPixelShaderInput
 {
@@ -159,21 +168,10 @@ cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer th
     float4x4 gProjectionMatrix;
     float4x4 gViewProjectionMatrix; // The above two matrices multiplied together to combine their effects
 
-    float3   gLight1Position; 
-    float    gViewportWidth;        
-                              
-                              
-    float3   gLight1Colour;
+    float    gViewportWidth;
     float    gViewportHeight;
-
-
-
-    float3   gLight2Position;
     float    gAlphaValue;
-
-    float3   gLight2Colour;
-    float  gBlurIncerement;
-
+    float    gBlurIncerement;
 
     float3   gAmbientColour;
     float    gSpecularPower;  // In this case we actually have a useful float variable that we can use to pad to a float4
@@ -181,41 +179,29 @@ cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer th
     float3   gCameraPosition;
     float    padding5;
 
-	float3	gLight3Position;
-	float	padding7;
-	float3  gLight3Colour;
-	float   padding8;
-
-	float3   gLight4Position;
-	float	 padding9;
-	float3   gLight4Colour;
-	float	 padding10;
-
-	
-
-	float3   gLight5Position;
+	// The scene's lights are in ClusteredLights.hlsli, these are the spotlights that have shadow maps
+	float3   gShadowLight1Position;
 	float    padding11;
 
-
-	float3   gLight5Colour;
+	float3   gShadowLight1Colour;
 	float    padding12;
 
-	float3   gLight5Facing;
-	float    gLight5CosHalfAngle;
-	float4x4 gLight5ViewMatrix;
-	float4x4 gLight5ProjectionMatrix;
+	float3   gShadowLight1Facing;
+	float    gShadowLight1CosHalfAngle;
+	float4x4 gShadowLight1ViewMatrix;
+	float4x4 gShadowLight1ProjectionMatrix;
 
-	float3   gLight6Position;
+	float3   gShadowLight2Position;
 	float    padding13;
 
-	float3   gLight6Colour;
+	float3   gShadowLight2Colour;
 	float    padding14;
 
-	float3   gLight6Facing;
-	float    gLight6CosHalfAngle;
+	float3   gShadowLight2Facing;
+	float    gShadowLight2CosHalfAngle;
 	
-	float4x4 gLight6ViewMatrix;
-	float4x4 gLight6ProjectionMatrix;
+	float4x4 gShadowLight2ViewMatrix;
+	float4x4 gShadowLight2ProjectionMatrix;
 
 	float wiggle;
 	float lerpCount;
@@ -231,7 +217,6 @@ cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer th
 }
 // Note constant buffers are not structs: we don't use the name of the constant buffer, these are really just a collection of global variables (hence the 'g')
 
-static const int MAX_BONES = 64;
 // If we have multiple models then we need to update the world matrix from C++ to GPU multiple times per frame because we
 // only have one world matrix here. Because this data is updated more frequently it is kept in a different buffer for better performance.
 // We also keep other data that changes per-model here
@@ -242,8 +227,32 @@ cbuffer PerModelConstants : register(b1) // The b1 gives this constant buffer th
 
     float3   gObjectColour;
     float    padding6;  // See notes on padding in structure above
+}
+
+static const int MAX_BONES = 64;
+// Bone matrices for skinned models. Kept apart from the per-model constants above so rigid models don't send them
+// These variables must match exactly the gPerSkeletonConstants structure in Scene.cpp
+cbuffer PerSkeletonConstants : register(b2) // The b2 gives this constant buffer the number 2 - used in the C++ code
+{
+    float4x4 gBoneMatrices[MAX_BONES]; // Only the matrices for the bones of the current mesh are valid
+}
+
+// Instanced rendering: all instances of a draw use the same geometry, the vertex shader picks up the world matrix and
+// colour of each one from this buffer using SV_InstanceID. SV_InstanceID starts at 0 for each draw, so the C++ code
+// passes the position of the draw's first instance in the buffer in a constant buffer
+// These variables must match exactly the InstanceData and BatchConstants structures in InstanceBuffer.h
+struct InstanceData
+{
+    float4x4 worldMatrix;
+    float3   objectColour;
+    float    paddingI;
+};
+StructuredBuffer<InstanceData> gInstances : register(t15); // Vertex shader slot, the pixel shader slots are separate
 
-    float4x4 gBoneMatrices[MAX_BONES];
+cbuffer PerBatchConstants : register(b3)
+{
+    uint  gFirstInstance;
+    uint3 paddingJ;
 }
 
 cbuffer PostProcessingConstants : register(b1)
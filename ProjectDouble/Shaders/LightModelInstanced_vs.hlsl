@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// Light Model Vertex Shader - instanced
+//--------------------------------------------------------------------------------------
+// As LightModel_vs, but each instance gets its world matrix and tint colour from the instance buffer. Also used
+// for instanced models in the depth-only shadow passes, which ignore the colour
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+InstancedSimplePixelShaderInput main(BasicVertex modelVertex, uint instanceID : SV_InstanceID)
+{
+    InstancedSimplePixelShaderInput output; // This is the data the pixel shader requires from this vertex shader
+
+    InstanceData instance = gInstances[gFirstInstance + instanceID];
+
+    // Transform model position into world space, then view space and projection space as usual
+    float4 modelPosition     = float4(modelVertex.position, 1);
+    float4 worldPosition     = mul(instance.worldMatrix, modelPosition);
+    float4 viewPosition      = mul(gViewMatrix,          worldPosition);
+    output.projectedPosition = mul(gProjectionMatrix,    viewPosition);
+
+    output.uv = modelVertex.uv;
+    output.objectColour = instance.objectColour; // Tint for each light, replaces gObjectColour in the pixel shader
+
+    return output; // Ouput data sent down the pipeline (to the pixel shader)
+}
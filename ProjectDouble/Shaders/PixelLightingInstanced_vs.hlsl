@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Per-Pixel Lighting Vertex Shader - instanced
+//--------------------------------------------------------------------------------------
+// As PixelLighting_vs, but each instance gets its world matrix from the instance buffer rather than the
+// per-model constant buffer, so many copies of a mesh can be rendered in a single draw call
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+LightingPixelShaderInput main(BasicVertex modelVertex, uint instanceID : SV_InstanceID)
+{
+	LightingPixelShaderInput output; // This is the data the pixel shader requires from this vertex shader
+
+	float4x4 worldMatrix = gInstances[gFirstInstance + instanceID].worldMatrix;
+
+	// Transform model position into world space, then view space and projection space as usual
+	float4 modelPosition = float4(modelVertex.position, 1);
+	float4 worldPosition = mul(worldMatrix, modelPosition);
+	float4 viewPosition = mul(gViewMatrix, worldPosition);
+	output.projectedPosition = mul(gProjectionMatrix, viewPosition);
+
+	// World normal and position for per-pixel lighting
+	float4 modelNormal = float4(modelVertex.normal, 0);
+	output.worldNormal = mul(worldMatrix, modelNormal).xyz;
+	output.worldPosition = worldPosition.xyz;
+
+	output.uv = modelVertex.uv;
+
+	return output; // Ouput data sent down the pipeline (to the pixel shader)
+}
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------------------------------
+// Tinted Texture Pixel Shader - instanced
+//--------------------------------------------------------------------------------------
+// As TintedTexture_ps, but the tint colour comes from the instance (see LightModelInstanced_vs) rather than the
+// per-model constant buffer, so all the light models can be rendered in one draw call
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+Texture2D    DiffuseMap : register(t0); // A diffuse map is the main texture for a model.
+SamplerState StandardFilter : register(s0); // Filtering used on most textures (trilinear or anisotropic - chosen on the C++ side)
+
+
+float4 main(InstancedSimplePixelShaderInput input) : SV_Target
+{
+    float3 diffuseMapColour = DiffuseMap.Sample(StandardFilter, input.uv).rgb;
+    float3 finalColour = (input.objectColour * diffuseMapColour)*gDayCycle;
+
+    return float4(finalColour, 1.0f); // Always use 1.0f for alpha - no alpha blending in this lab
+}
@@ -1,4 +1,4 @@
-#include "Common.hlsli" // Shaders can also use include files - note the extension
+#include "ClusteredLights.hlsli" // Shaders can also use include files - note the extension
 
 Texture2D    DiffuseMap : register(t0); 
 SamplerState TexSampler : register(s0); 
@@ -12,20 +12,16 @@ float4 main(LightingPixelShaderInput input) : SV_Target
 	float3 cameraDirection = normalize(gCameraPosition - input.worldPosition);
 	
 
-	// Light 3
-	float3 light4Vector = gLight4Position - input.worldPosition;
-	float3 light4Dist = length(light4Vector);
-	float3 light4Direction = light4Vector / light4Dist;
-	float3 diffuseLight4 = gLight4Colour * max(dot(input.worldNormal, light4Direction), 0) / light4Dist;
-
-	float3 halfway = normalize(light4Direction + cameraDirection);
-	float3 specularLight4 = diffuseLight4 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower);
+	// This shader's light (the fourth light) if it is in this pixel's cluster
+	float3 diffuseLight = 0;
+	float3 specularLight = 0;
+	ClusteredLighting(input.worldPosition, input.worldNormal, cameraDirection, LIGHT_SET_TRANSFORM_LIGHTING, false, diffuseLight, specularLight);
 
 	float4 textureColour = DiffuseMap.Sample(TexSampler, input.uv);
 	float tintColour = 0.2f;
 	float3 diffuseMaterialColour = textureColour.g - tintColour; //Tinting to fixed single colour
 	float specularMaterialColour = textureColour.a;
-	float3 finalColour = gObjectColour *  (gAmbientColour + diffuseLight4 * diffuseMaterialColour + specularLight4 * diffuseMaterialColour );
+	float3 finalColour = gObjectColour *  (gAmbientColour + diffuseLight * diffuseMaterialColour + specularLight * diffuseMaterialColour );
 
 	return float4(finalColour, 1.0f); 
 }
\ No newline at end of file
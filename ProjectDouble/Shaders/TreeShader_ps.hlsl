@@ -1,7 +1,7 @@
 
 
 
-#include "Common.hlsli" // Shaders can also use include files - note the extension
+#include "ClusteredLights.hlsli" // Shaders can also use include files - note the extension
 
 
 //--------------------------------------------------------------------------------------
@@ -45,48 +45,10 @@ float4 main(LightingPixelShaderInput input) : SV_Target
 
 	///////////////////////
 	// Calculate lighting
-	 // Light 1
-    float3 light1Vector = gLight1Position - input.worldPosition;
-    float3 light1Dist = length(light1Vector);
-    float3 light1Direction = light1Vector / light1Dist;
-    float3 diffuseLight1 = gLight1Colour * max(dot(input.worldNormal, light1Direction), 0) / light1Dist; // Equations from lighting lecture
-
-    float3 halfway = normalize(light1Direction + cameraDirection);
-    float3 specularLight1 = diffuseLight1 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower); // Multiplying by diffuseLight instead of light colour - my own personal preference
-
-
-	// Light 2
-    float3 light2Vector = gLight2Position - input.worldPosition;
-    float3 light2Dist = length(light2Vector);
-    float3 light2Direction = light2Vector / light2Dist;
-    float3 diffuseLight2 = gLight2Colour * max(dot(input.worldNormal, light2Direction), 0) / light2Dist;
-
-    halfway = normalize(light2Direction + cameraDirection);
-    float3 specularLight2 = diffuseLight2 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower);
-
-
-
-
-
-	//Teapot's light
-	// Light 3
-    float3 light3Vector = gLight3Position - input.worldPosition;
-    float3 light3Dist = length(light3Vector);
-    float3 light3Direction = light3Vector / light3Dist;
-    float3 diffuseLight3 = gLight3Colour * max(dot(input.worldNormal, light3Direction), 0) / light3Dist;
-
-    halfway = normalize(light3Direction + cameraDirection);
-    float3 specularLight3 = diffuseLight3 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower);
-	// Light 4
-    float3 light4Vector = gLight4Position - input.worldPosition;
-    float3 light4Dist = length(light4Vector);
-    float3 light4Direction = light4Vector / light4Dist;
-    float3 diffuseLight4 = gLight4Colour * max(dot(input.worldNormal, light4Direction), 0) / light4Dist; // Equations from lighting lecture
-
-    halfway = normalize(light4Direction + cameraDirection);
-    float3 specularLight4 = diffuseLight4 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower);
-
-	
+    // The lights without shadow maps, from the list for this pixel's cluster
+    float3 clusteredDiffuseLight = 0;
+    float3 clusteredSpecularLight = 0;
+    ClusteredLighting(input.worldPosition, input.worldNormal, cameraDirection, LIGHT_SET_GENERAL, true, clusteredDiffuseLight, clusteredSpecularLight);
 
 	//----------
 	// LIGHT 5
@@ -95,17 +57,17 @@ float4 main(LightingPixelShaderInput input) : SV_Target
     float3 specularLight5 = 0;
 
 	// Direction from pixel to light
-    float3 light5Direction = normalize(gLight5Position - input.worldPosition);
+    float3 light5Direction = normalize(gShadowLight1Position - input.worldPosition);
 
 	// Check if pixel is within light cone
-    if (dot(gLight5Facing, -light5Direction) > cos(gLight5CosHalfAngle)) //**** TODO: This condition needs to be written as the first exercise to get spotlights working
+    if (dot(gShadowLight1Facing, -light5Direction) > cos(gShadowLight1CosHalfAngle)) //**** TODO: This condition needs to be written as the first exercise to get spotlights working
 		   //           As well as the variables above, you also will need values from the constant buffers in "common.hlsli"
     {
 		// Using the world position of the current pixel and the matrices of the light (as a camera), find the 2D position of the
 		// pixel *as seen from the light*. Will use this to find which part of the shadow map to look at.
 		// These are the same as the view / projection matrix multiplies in a vertex shader (can improve performance by putting these lines in vertex shader)
-        float4 light5ViewPosition = mul(gLight5ViewMatrix, float4(input.worldPosition, 1.0f));
-        float4 light5Projection = mul(gLight5ProjectionMatrix, light5ViewPosition);
+        float4 light5ViewPosition = mul(gShadowLight1ViewMatrix, float4(input.worldPosition, 1.0f));
+        float4 light5Projection = mul(gShadowLight1ProjectionMatrix, light5ViewPosition);
 
 		// Convert 2D pixel position as viewed from light into texture coordinates for shadow map - an advanced topic related to the projection step
 		// Detail: 2D position x & y get perspective divide, then converted from range -1->1 to UV range 0->1. Also flip V axis
@@ -119,8 +81,8 @@ float4 main(LightingPixelShaderInput input) : SV_Target
 		// to the light than this pixel - so the pixel gets no effect from this light
         if (depthFromLight < ShadowMapLight1.Sample(PointClamp, shadowMapUV).r)
         {
-            float3 light5Dist = length(gLight5Position - input.worldPosition);
-            diffuseLight5 = gLight5Colour * max(dot(input.worldNormal, light5Direction), 0) / light5Dist; // Equations from lighting lecture
+            float3 light5Dist = length(gShadowLight1Position - input.worldPosition);
+            diffuseLight5 = gShadowLight1Colour * max(dot(input.worldNormal, light5Direction), 0) / light5Dist; // Equations from lighting lecture
             float3 halfway = normalize(light5Direction + cameraDirection);
             specularLight5 = diffuseLight5 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower); // Multiplying by diffuseLight instead of light colour - my own personal preference
         }
@@ -131,16 +93,16 @@ float4 main(LightingPixelShaderInput input) : SV_Target
     float3 specularLight6 = 0;
 
 	// Direction from pixel to light
-    float3 light6Direction = normalize(gLight6Position - input.worldPosition);
+    float3 light6Direction = normalize(gShadowLight2Position - input.worldPosition);
 
-    if (dot(gLight6Facing, -light6Direction) > cos(gLight6CosHalfAngle)) //**** TODO: This condition needs to be written as the first exercise to get spotlights working
+    if (dot(gShadowLight2Facing, -light6Direction) > cos(gShadowLight2CosHalfAngle)) //**** TODO: This condition needs to be written as the first exercise to get spotlights working
 																	   //           As well as the variables above, you also will need values from the constant buffers in "common.hlsli"
     {
 		// Using the world position of the current pixel and the matrices of the light (as a camera), find the 2D position of the
 		// pixel *as seen from the light*. Will use this to find which part of the shadow map to look at.
 		// These are the same as the view / projection matrix multiplies in a vertex shader (can improve performance by putting these lines in vertex shader)
-        float4 light6ViewPosition = mul(gLight6ViewMatrix, float4(input.worldPosition, 1.0f));
-        float4 light6Projection = mul(gLight6ProjectionMatrix, light6ViewPosition);
+        float4 light6ViewPosition = mul(gShadowLight2ViewMatrix, float4(input.worldPosition, 1.0f));
+        float4 light6Projection = mul(gShadowLight2ProjectionMatrix, light6ViewPosition);
 
 		// Convert 2D pixel position as viewed from light into texture coordinates for shadow map - an advanced topic related to the projection step
 		// Detail: 2D position x & y get perspective divide, then converted from range -2->2 to UV range 0->2. Also flip V axis
@@ -154,16 +116,16 @@ float4 main(LightingPixelShaderInput input) : SV_Target
 																					  // to the light than this pixel - so the pixel gets no effect from this light
         if (depthFromLight < ShadowMapLight2.Sample(PointClamp, shadowMapUV).r)
         {
-            float3 light6Dist = length(gLight6Position - input.worldPosition);
-            diffuseLight6 = gLight6Colour * max(dot(input.worldNormal, light6Direction), 0) / light6Dist; // Equations from lighting lecture
+            float3 light6Dist = length(gShadowLight2Position - input.worldPosition);
+            diffuseLight6 = gShadowLight2Colour * max(dot(input.worldNormal, light6Direction), 0) / light6Dist; // Equations from lighting lecture
             float3 halfway = normalize(light6Direction + cameraDirection);
             specularLight6 = diffuseLight6 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower); // Multiplying by diffuseLight instead of light colour - my own personal preference
         }
     }
 
 	// Sum the effect of the lights - add the ambient at this stage rather than for each light (or we will get too much ambient)
-    float3 diffuseLight = gAmbientColour + diffuseLight1 + diffuseLight2 + diffuseLight3 + diffuseLight4 + diffuseLight5 + diffuseLight6;
-    float3 specularLight = specularLight1 + specularLight2 + specularLight3 + specularLight4 + specularLight5 + specularLight6;
+    float3 diffuseLight = gAmbientColour + clusteredDiffuseLight + diffuseLight5 + diffuseLight6;
+    float3 specularLight = clusteredSpecularLight + specularLight5 + specularLight6;
 
 
 	////////////////////
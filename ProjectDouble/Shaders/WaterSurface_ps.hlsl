@@ -3,7 +3,7 @@
 //--------------------------------------------------------------------------------------
 // Water surface pixel shader, combines refraction, reflection and specular lighting
 
-#include "Common.hlsli"
+#include "ClusteredLights.hlsli"
 
 
 //--------------------------------------------------------------------------------------
@@ -85,20 +85,22 @@ float4 main(WorldPositionPixelShaderInput input) : SV_Target
 	// dynamic range) the reflected lights are quite dim, so use the specular lighting equations to get a stronger effect.
 	float3 normalToCamera = normalize(gCameraPosition - input.worldPosition);
 
-	// Light 1
-	float3 vectorToLight = gLight1Position - input.worldPosition; 
-	float3 normalToLight = normalize(vectorToLight);
-	float3 halfwayVector = normalize(normalToLight + normalToCamera);
-	float3 specularLight1 = gLight1Colour * pow( max( dot(waterNormal, halfwayVector), 0 ), gSpecularPower ) / length(vectorToLight);
-
-	// Light 2
-	vectorToLight = gLight2Position - input.worldPosition;
-	normalToLight = normalize(vectorToLight);
-	halfwayVector = normalize(normalToLight + normalToCamera);
-	float3 specularLight2 = gLight2Colour * pow( max( dot(waterNormal, halfwayVector), 0 ), gSpecularPower ) / length(vectorToLight);
-
-	// Add the effect of the two lights into the reflected colour
-	reflectColour.rgb += SpecularStrength * (specularLight1 + specularLight2);
+	// Specular light from each of the water's lights (the first two lights) in this pixel's cluster
+	float3 specularLight = 0;
+	uint2 lights = ClusterLights(input.worldPosition);
+	for (uint i = 0; i < lights.y; ++i)
+	{
+		LightData light = gLights[gLightIndices[lights.x + i]];
+		if ((light.lightSets & LIGHT_SET_WATER_SPECULAR) == 0)  continue;
+
+		float3 normalToLight;
+		float3 lightColour = LightReaching(light, input.worldPosition, normalToLight);
+		float3 halfwayVector = normalize(normalToLight + normalToCamera);
+		specularLight += lightColour * pow( max( dot(waterNormal, halfwayVector), 0 ), gSpecularPower );
+	}
+
+	// Add the effect of the lights into the reflected colour
+	reflectColour.rgb += SpecularStrength * specularLight;
 
 	// Fresnel effect: the reflected and refracted light is blended based on angle of viewer to surface normal. A glancing angle
 	// gives more reflection, straight down into water gives more refraction  
@@ -0,0 +1,137 @@
+//--------------------------------------------------------------------------------------
+// Shadow cache - keeps the depth of the static shadow casters between frames
+//--------------------------------------------------------------------------------------
+
+#include "ShadowCache.h"
+#include "Model.h"
+
+
+// Add a shadow caster, static casters are rendered into the cached maps
+void ShadowCache::AddCaster(Model* model, bool isStatic, bool meshTextures /*= false*/)
+{
+	Caster caster;
+	caster.model = model;
+	caster.meshTextures = meshTextures;
+	(isStatic ? mStaticCasters : mDynamicCasters).push_back(caster);
+}
+
+
+// Cull the static or dynamic casters against a light's frustum and cone. Both are tested in batches on the casters'
+// bounding spheres
+void ShadowCache::CullCasters(bool staticCasters, const CFrustum& frustum, const CCone& cone)
+{
+	std::vector<Caster>& casters = staticCasters ? mStaticCasters : mDynamicCasters;
+	mSpheres.clear();
+	for (auto& caster : casters)  mSpheres.push_back(caster.model->WorldSphere());
+
+	mInFrustum.resize(mSpheres.size());
+	mInCone.resize(mSpheres.size());
+	std::size_t numInFrustum = frustum.TestSpheres(mSpheres.data(), mInFrustum.data(), mSpheres.size());
+	cone.TestSpheres(mSpheres.data(), mInCone.data(), mSpheres.size());
+
+	unsigned int numVisible = 0;
+	for (std::size_t i = 0; i < casters.size(); ++i)
+	{
+		casters[i].visible = mInFrustum[i] && mInCone[i];
+		if (casters[i].visible)  ++numVisible;
+	}
+
+	mStats.casterTests += static_cast<unsigned int>(casters.size());
+	mStats.outsideFrustum += static_cast<unsigned int>(casters.size() - numInFrustum);
+	mStats.outsideCone += static_cast<unsigned int>(numInFrustum) - numVisible;
+}
+
+
+// Queue the static or dynamic casters in a shadow pass, leaving out those culled
+void ShadowCache::SubmitCasters(RenderQueue& queue, bool staticCasters, const RenderState& state) const
+{
+	for (auto& caster : staticCasters ? mStaticCasters : mDynamicCasters)
+	{
+		if (!caster.visible)  continue;
+		if (caster.meshTextures)  queue.SubmitWithMeshTextures(caster.model, RenderLayer::Opaque, state);
+		else                      queue.Submit(caster.model, RenderLayer::Opaque, state);
+	}
+}
+
+
+// Whether two light matrices are exactly the same, a light that has moved at all needs its static casters rendered again
+static bool SameMatrix(const CMatrix4x4& a, const CMatrix4x4& b)
+{
+	const float* aElements = &a.e00;
+	const float* bElements = &b.e00;
+	for (int i = 0; i < 16; ++i)
+	{
+		if (aElements[i] != bElements[i])  return false;
+	}
+	return true;
+}
+
+
+// Choose how to render a shadow map's static casters. The cached depth is reused if it was rendered with the same
+// matrix and not invalidated since. Otherwise it is rendered again, unless it was also out of date on the previous
+// frame and the light or a static caster has changed since - then it would likely be out of date again next frame
+ShadowCache::StaticMapUse ShadowCache::UseStaticMap(unsigned int shadowMap, const CMatrix4x4& viewProjection)
+{
+	if (shadowMap >= mMaps.size())  mMaps.resize(shadowMap + 1);
+
+	CachedMap& cached = mMaps[shadowMap];
+	bool unchanged = cached.used && !cached.invalidated && SameMatrix(cached.lastViewProjection, viewProjection);
+	bool wasOutOfDate = cached.outOfDate;
+	cached.lastViewProjection = viewProjection;
+	cached.used = true;
+	cached.invalidated = false;
+
+	if (cached.valid && SameMatrix(cached.viewProjection, viewProjection))
+	{
+		cached.outOfDate = false;
+		++mStats.reuses;
+		mStats.skippedDraws += cached.draws;
+		return StaticMapUse::Reuse;
+	}
+
+	cached.outOfDate = true;
+	if (wasOutOfDate && !unchanged)
+	{
+		++mStats.directRenders;
+		return StaticMapUse::Direct;
+	}
+	return StaticMapUse::Render;
+}
+
+
+// Record that the static casters have been rendered into a shadow map's cached depth
+void ShadowCache::StaticMapRendered(unsigned int shadowMap, const CMatrix4x4& viewProjection, unsigned int draws)
+{
+	if (shadowMap >= mMaps.size())  mMaps.resize(shadowMap + 1);
+
+	CachedMap& cached = mMaps[shadowMap];
+	cached.viewProjection = viewProjection;
+	cached.valid = true;
+	cached.draws = draws;
+	++mStats.staticRenders;
+}
+
+
+// Re-render all the cached maps next frame
+void ShadowCache::Invalidate()
+{
+	for (auto& cached : mMaps)
+	{
+		cached.valid = false;
+		cached.invalidated = true;
+	}
+}
+
+
+// Re-render the cached maps if a static caster has moved. Dynamic casters are rendered every frame anyway
+void ShadowCache::InvalidateModel(const Model* model)
+{
+	for (auto& caster : mStaticCasters)
+	{
+		if (caster.model == model)
+		{
+			Invalidate();
+			return;
+		}
+	}
+}
@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// Shadow cache - keeps the depth of the static shadow casters between frames
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Most shadow casters never move, yet the shadow maps were re-rendered with every caster each frame. Casters are now
+// split into static and dynamic ones. The static casters are rendered into a cached depth map for each shadow map,
+// which is only re-rendered when its light's view-projection matrix changes or a static caster is moved (see
+// Invalidate). Each frame the cached map is copied into the shadow map and only the dynamic casters are rendered over
+// it, using the depth test as normal.
+//
+// A map that goes out of date frame after frame (e.g. its light orbits, or a static caster is being dragged) would pay
+// for a static pass, a copy and a dynamic pass every frame and never be reused. So once a map was out of date on the
+// previous frame and has changed again, all its casters are rendered straight into the shadow map instead, leaving
+// the cache alone. The cache is rendered again on the first frame the light and static casters are unchanged.
+//
+// Before a shadow map is rendered, the casters it needs are culled against the light's frustum and its spotlight cone
+// (see CCone.h), so only those that can shadow something the light reaches are submitted to the render queue.
+//
+// The cache only does the bookkeeping, the depth maps themselves are in TextureManager and rendered in Scene.cpp.
+// Anything that moves a static caster must call InvalidateModel (the level builder does), otherwise its old shadow
+// stays until the light moves
+
+#ifndef _SHADOW_CACHE_H_INCLUDED_
+#define _SHADOW_CACHE_H_INCLUDED_
+
+#include "RenderQueue.h"
+#include "CMatrix4x4.h"
+#include "CFrustum.h"
+#include "CCone.h"
+#include <vector>
+#include <string>
+
+class Model;
+
+
+class ShadowCache
+{
+public:
+	// Add a shadow caster. Static casters are rendered into the cached maps, dynamic ones every frame. Casters whose
+	// mesh sets its own textures are submitted as such, see RenderQueue::SubmitWithMeshTextures
+	void AddCaster(Model* model, bool isStatic, bool meshTextures = false);
+
+	// Cull the static or dynamic casters against a light's frustum and cone. Casters outside either are left out by
+	// SubmitCasters until they are culled again
+	void CullCasters(bool staticCasters, const CFrustum& frustum, const CCone& cone);
+
+	// Queue the static or dynamic casters in a shadow pass, leaving out those culled by the last CullCasters
+	void SubmitCasters(RenderQueue& queue, bool staticCasters, const RenderState& state) const;
+
+	// How a shadow map's static casters are rendered this frame
+	enum class StaticMapUse
+	{
+		Reuse,  // Copy the cached depth into the shadow map
+		Render, // Render the static casters into the cached depth, then copy it
+		Direct, // Render the static casters straight into the shadow map with the dynamic ones, no copy
+	};
+
+	// Choose how to render a shadow map's static casters with the given light view-projection matrix. Call once per
+	// map each frame. For Reuse, the draws the static casters took when the map was rendered are counted as skipped
+	StaticMapUse UseStaticMap(unsigned int shadowMap, const CMatrix4x4& viewProjection);
+
+	// Record that the static casters have been rendered into a shadow map's cached depth with the given matrix, taking
+	// the given number of draws
+	void StaticMapRendered(unsigned int shadowMap, const CMatrix4x4& viewProjection, unsigned int draws);
+
+	// Re-render all the cached maps next frame
+	void Invalidate();
+
+	// Call when a model has been moved, re-renders the cached maps if it is a static caster
+	void InvalidateModel(const Model* model);
+
+
+	// Counts since the last ResetStats
+	struct Stats
+	{
+		unsigned int staticRenders  = 0; // Cached maps re-rendered
+		unsigned int reuses         = 0; // Cached maps used as they were
+		unsigned int directRenders  = 0; // Maps rendered without the cache as they keep going out of date
+		unsigned int skippedDraws   = 0; // Static caster draws saved by the reuses
+		unsigned int casterTests    = 0; // Casters culled against a light
+		unsigned int outsideFrustum = 0; // Casters outside a light's frustum
+		unsigned int outsideCone    = 0; // Casters inside the frustum but outside the spotlight cone
+	};
+	const Stats& GetStats() const  { return mStats; }
+	void         ResetStats()      { mStats = {}; }
+
+
+private:
+	struct Caster
+	{
+		Model* model;
+		bool   meshTextures;
+		bool   visible = true; // Result of the last CullCasters
+	};
+	std::vector<Caster> mStaticCasters;
+	std::vector<Caster> mDynamicCasters;
+
+	// Working space for culling, kept between frames to avoid allocations
+	std::vector<CBoundingSphere> mSpheres;
+	std::vector<uint8_t>         mInFrustum;
+	std::vector<uint8_t>         mInCone;
+
+	// Light matrix each cached map was rendered with and the draws it took, indexed by shadow map. Also the matrix the
+	// map was used with on the previous frame, whether the cache was out of date then and whether Invalidate has been
+	// called since, to spot maps that keep going out of date
+	struct CachedMap
+	{
+		CMatrix4x4   viewProjection;
+		bool         valid = false;
+		unsigned int draws = 0;
+
+		CMatrix4x4   lastViewProjection;
+		bool         used        = false;
+		bool         outOfDate   = false;
+		bool         invalidated = false;
+	};
+	std::vector<CachedMap> mMaps;
+
+	Stats mStats;
+};
+
+
+#endif //_SHADOW_CACHE_H_INCLUDED_
@@ -0,0 +1,339 @@
+//--------------------------------------------------------------------------------------
+// State cache render device - drops state changes that would set what is already set
+//--------------------------------------------------------------------------------------
+
+#include "StateCacheRenderDevice.h"
+#include "Common.h"
+
+#include <cstring>
+
+
+StateCacheRenderDevice::~StateCacheRenderDevice()
+{
+	delete mDevice;
+}
+
+
+// Forget all cached state, so the next bind of each kind is passed on whatever its value
+void StateCacheRenderDevice::Invalidate()
+{
+	mInputLayout.known = false;
+	mTopology.known = false;
+	for (auto& vertexBuffer : mVertexBuffers)  vertexBuffer.known = false;
+	mIndexBuffer.known = false;
+
+	StageBindings* stages[] = { &mVertexStage, &mGeometryStage, &mPixelStage };
+	for (auto stage : stages)
+	{
+		stage->shader.known = false;
+		for (auto& constantBuffer : stage->constantBuffers)  constantBuffer.known = false;
+		for (auto& sampler : stage->samplers)  sampler.known = false;
+	}
+	ForgetResources();
+
+	mRasterizerState.known = false;
+	mNumViewports.known = false;
+	for (auto& viewport : mViewports)  viewport.known = false;
+	ForgetRenderTargets();
+	mBlendState.known = false;
+	mDepthStencilState.known = false;
+}
+
+// DirectX may have unbound shader resources that are now render targets
+void StateCacheRenderDevice::ForgetResources()
+{
+	StageBindings* stages[] = { &mVertexStage, &mGeometryStage, &mPixelStage };
+	for (auto stage : stages)
+	{
+		for (auto& resource : stage->resources)  resource.known = false;
+	}
+}
+
+// DirectX may have unbound render targets that are now shader resources
+void StateCacheRenderDevice::ForgetRenderTargets()
+{
+	mNumRenderTargets.known = false;
+	for (auto& renderTarget : mRenderTargets)  renderTarget.known = false;
+	mDepthStencil.known = false;
+}
+
+
+bool StateCacheRenderDevice::BlendBinding::operator==(const BlendBinding& b) const
+{
+	return state == b.state && sampleMask == b.sampleMask && std::memcmp(factor, b.factor, sizeof(factor)) == 0;
+}
+
+bool StateCacheRenderDevice::ViewportBinding::operator==(const ViewportBinding& b) const
+{
+	return std::memcmp(&viewport, &b.viewport, sizeof(viewport)) == 0;
+}
+
+
+// Update a range of cached slots with new values. Returns true if they all matched already, i.e. the bind can be
+// dropped. Ranges that go past the cached slots are never dropped
+template <class T>
+bool StateCacheRenderDevice::UpdateSlots(Cached<T>* slots, UINT numSlots, UINT startSlot, UINT numValues, T const* values)
+{
+	if (values == nullptr || startSlot + numValues > numSlots)
+	{
+		// Can't track this bind, forget the slots it may have changed
+		for (UINT slot = startSlot; slot < numSlots; ++slot)  slots[slot].known = false;
+		return false;
+	}
+
+	bool alreadySet = true;
+	for (UINT i = 0; i < numValues; ++i)
+	{
+		if (!slots[startSlot + i].Matches(values[i]))
+		{
+			slots[startSlot + i].Set(values[i]);
+			alreadySet = false;
+		}
+	}
+	return alreadySet;
+}
+
+// Cached shader for a stage, shared by the three shader types. Shaders with class instances are always set
+bool StateCacheRenderDevice::UpdateShader(StageBindings& stage, const void* shader, UINT numClassInstances)
+{
+	if (numClassInstances > 0)
+	{
+		stage.shader.known = false;
+		return false;
+	}
+	if (stage.shader.Matches(shader))  return true;
+	stage.shader.Set(shader);
+	return false;
+}
+
+
+// Count a bind that was passed on (returns true) or dropped (returns false)
+bool StateCacheRenderDevice::Issue(bool alreadySet)
+{
+	if (alreadySet)
+	{
+		++gRenderStateCacheStats.elided;
+		return false;
+	}
+	++gRenderStateCacheStats.issued;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Binds - passed on only if they change the cached state
+//--------------------------------------------------------------------------------------
+
+void StateCacheRenderDevice::IASetInputLayout(ID3D11InputLayout* inputLayout)
+{
+	bool alreadySet = mInputLayout.Matches(inputLayout);
+	mInputLayout.Set(inputLayout);
+	if (Issue(alreadySet))  mDevice->IASetInputLayout(inputLayout);
+}
+
+void StateCacheRenderDevice::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	bool alreadySet = mTopology.Matches(topology);
+	mTopology.Set(topology);
+	if (Issue(alreadySet))  mDevice->IASetPrimitiveTopology(topology);
+}
+
+void StateCacheRenderDevice::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* vertexBuffers,
+                                                const UINT* strides, const UINT* offsets)
+{
+	bool alreadySet = false;
+	if (vertexBuffers != nullptr && strides != nullptr && offsets != nullptr && numBuffers <= kNumVertexBufferSlots)
+	{
+		BufferBinding bindings[kNumVertexBufferSlots];
+		for (UINT i = 0; i < numBuffers; ++i)  bindings[i] = { vertexBuffers[i], strides[i], offsets[i] };
+		alreadySet = UpdateSlots(mVertexBuffers, kNumVertexBufferSlots, startSlot, numBuffers, static_cast<const BufferBinding*>(bindings));
+	}
+	else
+	{
+		UpdateSlots(mVertexBuffers, kNumVertexBufferSlots, startSlot, numBuffers, static_cast<const BufferBinding*>(nullptr));
+	}
+	if (Issue(alreadySet))  mDevice->IASetVertexBuffers(startSlot, numBuffers, vertexBuffers, strides, offsets);
+}
+
+void StateCacheRenderDevice::IASetIndexBuffer(ID3D11Buffer* indexBuffer, DXGI_FORMAT format, UINT offset)
+{
+	BufferBinding binding = { indexBuffer, static_cast<UINT>(format), offset };
+	bool alreadySet = mIndexBuffer.Matches(binding);
+	mIndexBuffer.Set(binding);
+	if (Issue(alreadySet))  mDevice->IASetIndexBuffer(indexBuffer, format, offset);
+}
+
+
+void StateCacheRenderDevice::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	if (Issue(UpdateShader(mVertexStage, shader, numClassInstances)))  mDevice->VSSetShader(shader, classInstances, numClassInstances);
+}
+
+void StateCacheRenderDevice::GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	if (Issue(UpdateShader(mGeometryStage, shader, numClassInstances)))  mDevice->GSSetShader(shader, classInstances, numClassInstances);
+}
+
+void StateCacheRenderDevice::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	if (Issue(UpdateShader(mPixelStage, shader, numClassInstances)))  mDevice->PSSetShader(shader, classInstances, numClassInstances);
+}
+
+
+void StateCacheRenderDevice::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	bool alreadySet = UpdateSlots(mVertexStage.constantBuffers, kNumConstantBufferSlots, startSlot, numBuffers, constantBuffers);
+	if (Issue(alreadySet))  mDevice->VSSetConstantBuffers(startSlot, numBuffers, constantBuffers);
+}
+
+void StateCacheRenderDevice::GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	bool alreadySet = UpdateSlots(mGeometryStage.constantBuffers, kNumConstantBufferSlots, startSlot, numBuffers, constantBuffers);
+	if (Issue(alreadySet))  mDevice->GSSetConstantBuffers(startSlot, numBuffers, constantBuffers);
+}
+
+void StateCacheRenderDevice::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers)
+{
+	bool alreadySet = UpdateSlots(mPixelStage.constantBuffers, kNumConstantBufferSlots, startSlot, numBuffers, constantBuffers);
+	if (Issue(alreadySet))  mDevice->PSSetConstantBuffers(startSlot, numBuffers, constantBuffers);
+}
+
+
+void StateCacheRenderDevice::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews)
+{
+	bool alreadySet = UpdateSlots(mVertexStage.resources, kNumResourceSlots, startSlot, numViews, shaderResourceViews);
+	if (Issue(alreadySet))
+	{
+		mDevice->VSSetShaderResources(startSlot, numViews, shaderResourceViews);
+		ForgetRenderTargets();
+	}
+}
+
+void StateCacheRenderDevice::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews)
+{
+	bool alreadySet = UpdateSlots(mPixelStage.resources, kNumResourceSlots, startSlot, numViews, shaderResourceViews);
+	if (Issue(alreadySet))
+	{
+		mDevice->PSSetShaderResources(startSlot, numViews, shaderResourceViews);
+		ForgetRenderTargets();
+	}
+}
+
+
+void StateCacheRenderDevice::VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	bool alreadySet = UpdateSlots(mVertexStage.samplers, kNumSamplerSlots, startSlot, numSamplers, samplers);
+	if (Issue(alreadySet))  mDevice->VSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+void StateCacheRenderDevice::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	bool alreadySet = UpdateSlots(mPixelStage.samplers, kNumSamplerSlots, startSlot, numSamplers, samplers);
+	if (Issue(alreadySet))  mDevice->PSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+
+void StateCacheRenderDevice::RSSetState(ID3D11RasterizerState* rasterizerState)
+{
+	bool alreadySet = mRasterizerState.Matches(rasterizerState);
+	mRasterizerState.Set(rasterizerState);
+	if (Issue(alreadySet))  mDevice->RSSetState(rasterizerState);
+}
+
+void StateCacheRenderDevice::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports)
+{
+	bool alreadySet = mNumViewports.Matches(numViewports);
+	mNumViewports.Set(numViewports);
+	if (numViewports <= kNumViewports && viewports != nullptr)
+	{
+		// ViewportBinding is just a wrapper so the viewports can be compared in place
+		auto bindings = reinterpret_cast<const ViewportBinding*>(viewports);
+		if (!UpdateSlots(mViewports, kNumViewports, 0, numViewports, bindings))  alreadySet = false;
+	}
+	else
+	{
+		mNumViewports.known = false;
+		alreadySet = false;
+	}
+	if (Issue(alreadySet))  mDevice->RSSetViewports(numViewports, viewports);
+}
+
+void StateCacheRenderDevice::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargetViews,
+                                                ID3D11DepthStencilView* depthStencilView)
+{
+	bool alreadySet = mNumRenderTargets.Matches(numViews) && mDepthStencil.Matches(depthStencilView);
+	mNumRenderTargets.Set(numViews);
+	mDepthStencil.Set(depthStencilView);
+	if (numViews > 0 && !UpdateSlots(mRenderTargets, kNumRenderTargets, 0, numViews, renderTargetViews))  alreadySet = false;
+
+	if (Issue(alreadySet))
+	{
+		mDevice->OMSetRenderTargets(numViews, renderTargetViews, depthStencilView);
+		ForgetResources();
+	}
+}
+
+void StateCacheRenderDevice::OMSetBlendState(ID3D11BlendState* blendState, const FLOAT blendFactor[4], UINT sampleMask)
+{
+	// A null blend factor means all 1s
+	BlendBinding binding = { blendState, { 1, 1, 1, 1 }, sampleMask };
+	if (blendFactor != nullptr)  std::memcpy(binding.factor, blendFactor, sizeof(binding.factor));
+
+	bool alreadySet = mBlendState.Matches(binding);
+	mBlendState.Set(binding);
+	if (Issue(alreadySet))  mDevice->OMSetBlendState(blendState, blendFactor, sampleMask);
+}
+
+void StateCacheRenderDevice::OMSetDepthStencilState(ID3D11DepthStencilState* depthStencilState, UINT stencilRef)
+{
+	DepthBinding binding = { depthStencilState, stencilRef };
+	bool alreadySet = mDepthStencilState.Matches(binding);
+	mDepthStencilState.Set(binding);
+	if (Issue(alreadySet))  mDevice->OMSetDepthStencilState(depthStencilState, stencilRef);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Other commands - always passed on
+//--------------------------------------------------------------------------------------
+
+void StateCacheRenderDevice::ClearRenderTargetView(ID3D11RenderTargetView* renderTargetView, const FLOAT colour[4])
+{
+	mDevice->ClearRenderTargetView(renderTargetView, colour);
+}
+
+void StateCacheRenderDevice::ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil)
+{
+	mDevice->ClearDepthStencilView(depthStencilView, clearFlags, depth, stencil);
+}
+
+void StateCacheRenderDevice::CopyResource(ID3D11Resource* destination, ID3D11Resource* source)
+{
+	mDevice->CopyResource(destination, source);
+}
+
+void StateCacheRenderDevice::Draw(UINT vertexCount, UINT startVertex)
+{
+	mDevice->Draw(vertexCount, startVertex);
+}
+
+void StateCacheRenderDevice::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	mDevice->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void StateCacheRenderDevice::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex,
+                                                  UINT startInstance)
+{
+	mDevice->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+void StateCacheRenderDevice::UpdateBuffer(ID3D11Buffer* buffer, const void* data, size_t size)
+{
+	mDevice->UpdateBuffer(buffer, data, size);
+}
+
+void StateCacheRenderDevice::Present(UINT syncInterval)
+{
+	mDevice->Present(syncInterval);
+}
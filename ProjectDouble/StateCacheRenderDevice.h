@@ -0,0 +1,171 @@
+//--------------------------------------------------------------------------------------
+// State cache render device - drops state changes that would set what is already set
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Sits between the rendering code and another render device (normally the D3D11 device). It keeps a "shadow" copy of
+// everything bound to the pipeline - shaders, states, samplers, constant buffers, textures, render targets and so on.
+// A bind that matches the shadow copy is dropped, anything else is passed on and the shadow copy updated. So the
+// rendering code can simply set the state it needs without worrying whether a previous pass already set it, e.g.
+// RenderLights restoring the blend / depth / rasterizer states on every call.
+//
+// Draws, clears, buffer updates and presents are always passed on. The numbers of binds passed on and dropped are
+// counted in gRenderStateCacheStats (see Common.h).
+//
+// DirectX unbinds a texture from the shader inputs when it is set as a render target, and the other way round. The
+// cache can't tell when this happens, so setting render targets forgets the shader resources that are cached and
+// setting shader resources forgets the render targets. Call Invalidate if anything sets state on the DirectX context
+// directly, bypassing this device.
+
+#ifndef _STATE_CACHE_RENDER_DEVICE_H_INCLUDED_
+#define _STATE_CACHE_RENDER_DEVICE_H_INCLUDED_
+
+#include "RenderDevice.h"
+
+class StateCacheRenderDevice : public RenderDevice
+{
+public:
+	// Commands are passed on to the given device, which this object takes ownership of
+	StateCacheRenderDevice(RenderDevice* device)  : mDevice(device) { Invalidate(); }
+	~StateCacheRenderDevice();
+
+	// Forget all cached state, so the next bind of each kind is passed on whatever its value
+	void Invalidate();
+
+
+	void IASetInputLayout(ID3D11InputLayout* inputLayout) override;
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override;
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* vertexBuffers,
+	                        const UINT* strides, const UINT* offsets) override;
+	void IASetIndexBuffer(ID3D11Buffer* indexBuffer, DXGI_FORMAT format, UINT offset) override;
+
+	void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+	void GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+	void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances) override;
+
+	void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+	void GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+	void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* constantBuffers) override;
+
+	void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews) override;
+	void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* shaderResourceViews) override;
+
+	void VSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) override;
+	void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers) override;
+
+	void RSSetState(ID3D11RasterizerState* rasterizerState) override;
+	void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* viewports) override;
+	void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* renderTargetViews,
+	                        ID3D11DepthStencilView* depthStencilView) override;
+	void OMSetBlendState(ID3D11BlendState* blendState, const FLOAT blendFactor[4], UINT sampleMask) override;
+	void OMSetDepthStencilState(ID3D11DepthStencilState* depthStencilState, UINT stencilRef) override;
+
+	void ClearRenderTargetView(ID3D11RenderTargetView* renderTargetView, const FLOAT colour[4]) override;
+	void ClearDepthStencilView(ID3D11DepthStencilView* depthStencilView, UINT clearFlags, FLOAT depth, UINT8 stencil) override;
+	void CopyResource(ID3D11Resource* destination, ID3D11Resource* source) override;
+	void Draw(UINT vertexCount, UINT startVertex) override;
+	void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) override;
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex,
+	                          UINT startInstance) override;
+
+	void UpdateBuffer(ID3D11Buffer* buffer, const void* data, size_t size) override;
+
+	void Present(UINT syncInterval) override;
+
+private:
+	// Number of slots cached for each kind of binding. Binds outside these slots are always passed on
+	static const UINT kNumVertexBufferSlots = 4;
+	static const UINT kNumConstantBufferSlots = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	static const UINT kNumResourceSlots = 16; // Of the 128 available, this app uses fewer than 10
+	static const UINT kNumSamplerSlots = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	static const UINT kNumViewports = 4;
+	static const UINT kNumRenderTargets = D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT;
+
+	// A cached value, which is unknown until it is first set
+	template <class T>
+	struct Cached
+	{
+		T    value;
+		bool known;
+
+		bool Matches(const T& newValue) const  { return known && value == newValue; }
+		void Set(const T& newValue)  { value = newValue; known = true; }
+	};
+
+	// Bindings for a vertex buffer slot or the index buffer
+	struct BufferBinding
+	{
+		ID3D11Buffer* buffer;
+		UINT          strideOrFormat;
+		UINT          offset;
+		bool operator==(const BufferBinding& b) const  { return buffer == b.buffer && strideOrFormat == b.strideOrFormat && offset == b.offset; }
+	};
+
+	// Output merger blend / depth state with their extra parameters
+	struct BlendBinding
+	{
+		ID3D11BlendState* state;
+		FLOAT             factor[4];
+		UINT              sampleMask;
+		bool operator==(const BlendBinding& b) const;
+	};
+	struct DepthBinding
+	{
+		ID3D11DepthStencilState* state;
+		UINT                     stencilRef;
+		bool operator==(const DepthBinding& b) const  { return state == b.state && stencilRef == b.stencilRef; }
+	};
+
+	// Viewports are compared by value
+	struct ViewportBinding
+	{
+		D3D11_VIEWPORT viewport;
+		bool operator==(const ViewportBinding& b) const;
+	};
+
+	// Resources and states bound to a shader stage
+	struct StageBindings
+	{
+		Cached<const void*>                shader;
+		Cached<ID3D11Buffer*>              constantBuffers[kNumConstantBufferSlots];
+		Cached<ID3D11ShaderResourceView*>  resources[kNumResourceSlots];
+		Cached<ID3D11SamplerState*>        samplers[kNumSamplerSlots];
+	};
+
+	// Update a range of cached slots with new values. Returns true if they all matched already, i.e. the bind can be
+	// dropped. Ranges that go past the cached slots are never dropped
+	template <class T>
+	static bool UpdateSlots(Cached<T>* slots, UINT numSlots, UINT startSlot, UINT numValues, T const* values);
+
+	// Cached shader for a stage, shared by the three shader types
+	bool UpdateShader(StageBindings& stage, const void* shader, UINT numClassInstances);
+
+	// Count a bind that was passed on (returns true) or dropped (returns false)
+	bool Issue(bool alreadySet);
+
+	void ForgetResources();
+	void ForgetRenderTargets();
+
+
+	RenderDevice* mDevice;
+
+	Cached<ID3D11InputLayout*>        mInputLayout;
+	Cached<D3D11_PRIMITIVE_TOPOLOGY>  mTopology;
+	Cached<BufferBinding>             mVertexBuffers[kNumVertexBufferSlots];
+	Cached<BufferBinding>             mIndexBuffer;
+
+	StageBindings mVertexStage;
+	StageBindings mGeometryStage;
+	StageBindings mPixelStage;
+
+	Cached<ID3D11RasterizerState*>    mRasterizerState;
+	Cached<UINT>                      mNumViewports;
+	Cached<ViewportBinding>           mViewports[kNumViewports];
+	Cached<UINT>                      mNumRenderTargets;
+	Cached<ID3D11RenderTargetView*>   mRenderTargets[kNumRenderTargets];
+	Cached<ID3D11DepthStencilView*>   mDepthStencil;
+	Cached<BlendBinding>              mBlendState;
+	Cached<DepthBinding>              mDepthStencilState;
+};
+
+
+#endif //_STATE_CACHE_RENDER_DEVICE_H_INCLUDED_
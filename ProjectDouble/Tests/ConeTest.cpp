@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------------------
+// Sphere culling test for CCone - runs without a GPU, see CMakeLists.txt in this folder
+//--------------------------------------------------------------------------------------
+// A 30 degree spotlight cone is tested against spheres inside it, outside it, just touching its side, behind its apex
+// and around its apex, one at a time and with the batch test. Then random spheres (the same ones every run) must get
+// the same result from both, and both are timed. Build the test with and without MATH_NO_SIMD to compare the SIMD and
+// scalar code (CMakeLists.txt builds both). Exits with a non-zero code if any check fails
+
+#include "CCone.h"
+#include "MathSIMD.h"
+#include "TestCommon.h"
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+    struct ConeCase
+    {
+        CBoundingSphere sphere;
+        bool            visible;
+        const char*     description;
+    };
+
+
+    // Sphere of the given radius whose centre is the given distance from the origin, at the given angle from +z
+    // towards +y
+    CBoundingSphere SphereAtAngle(float distance, float degrees, float radius)
+    {
+        float angle = ToRadians(degrees);
+        return { { 0, distance * std::sin(angle), distance * std::cos(angle) }, radius };
+    }
+}
+
+
+int main()
+{
+#if defined(MATH_AVX)
+    const char* path = "AVX";
+#elif defined(MATH_SSE)
+    const char* path = "SSE";
+#else
+    const char* path = "scalar";
+#endif
+    std::printf("CCone, %s code\n", path);
+
+    // Apex at the origin, axis along +z (not unit length, the constructor normalises it), 30 degrees to the sides.
+    // A sphere at distance 10 and 35 degrees is 0.87 outside the side
+    CCone cone({ 0, 0, 0 }, { 0, 0, 2 }, ToRadians(30));
+    Check(std::abs(cone.Axis().z - 1.0f) < 1e-6f, "Axis normalised");
+
+    const ConeCase cases[] =
+    {
+        { { { 0, 0, 10 }, 1 },            true,  "Sphere on the axis is inside" },
+        { SphereAtAngle(10, 25, 0.1f),    true,  "Small sphere within the side is inside" },
+        { SphereAtAngle(10, 35, 1),       true,  "Sphere outside the side but reaching it is visible" },
+        { SphereAtAngle(10, 35, 0.5f),    false, "Sphere outside the side and not reaching it is outside" },
+        { { { 10, 0, 5 }, 1 },            false, "Sphere beside the cone is outside" },
+        { { { 0, 0, -5 }, 1 },            false, "Sphere behind the apex on the axis is outside" },
+        { { { 0, 3, -2 }, 1 },            false, "Sphere behind the apex off the axis is outside" },
+        { { { 0, 0, -0.5f }, 1 },         true,  "Sphere behind the apex but reaching it is visible" },
+        { { { 0, 0, 0 }, 0.5f },          true,  "Sphere around the apex is visible" },
+        { { { 0, 0, -3 }, 4 },            true,  "Large sphere behind the apex containing it is visible" },
+        { { { 0, 0, -5 }, -1 },           true,  "Empty sphere is always visible" },
+    };
+    const std::size_t numCases = sizeof(cases) / sizeof(cases[0]);
+
+    std::vector<CBoundingSphere> caseSpheres;
+    for (auto& coneCase : cases)
+    {
+        Check(cone.IsVisible(coneCase.sphere) == coneCase.visible, coneCase.description);
+        caseSpheres.push_back(coneCase.sphere);
+    }
+
+    // The batch test on the same spheres, which aren't a multiple of four so both the SIMD and remainder loops run
+    std::vector<uint8_t> caseVisible(numCases);
+    std::size_t numCasesVisible = cone.TestSpheres(caseSpheres.data(), caseVisible.data(), numCases);
+    std::size_t expectedVisible = 0;
+    bool batchMatches = true;
+    for (std::size_t i = 0; i < numCases; ++i)
+    {
+        if (cases[i].visible)  ++expectedVisible;
+        if ((caseVisible[i] != 0) != cases[i].visible)
+        {
+            batchMatches = false;
+            std::printf("  Batch test wrong for: %s\n", cases[i].description);
+        }
+    }
+    Check(batchMatches && numCasesVisible == expectedVisible, "Batch test gives the same results and count");
+
+    // Random spheres around a tilted cone, one at a time against the batch test
+    const std::size_t numSpheres = 100003;
+    CCone tilted({ 5, 10, -3 }, { 1, -2, 3 }, ToRadians(40));
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> radius(0.1f, 5.0f);
+    std::vector<CBoundingSphere> spheres(numSpheres);
+    for (auto& sphere : spheres)
+    {
+        sphere = { { position(random), position(random), position(random) }, radius(random) };
+    }
+
+    std::vector<uint8_t> single(numSpheres);
+    std::vector<uint8_t> batch(numSpheres);
+    auto start = std::chrono::steady_clock::now();
+    std::size_t numSingleVisible = 0;
+    for (std::size_t i = 0; i < numSpheres; ++i)
+    {
+        single[i] = tilted.IsVisible(spheres[i]) ? 1 : 0;
+        numSingleVisible += single[i];
+    }
+    auto singleEnd = std::chrono::steady_clock::now();
+    std::size_t numBatchVisible = tilted.TestSpheres(spheres.data(), batch.data(), numSpheres);
+    auto batchEnd = std::chrono::steady_clock::now();
+
+    std::size_t mismatches = 0;
+    for (std::size_t i = 0; i < numSpheres; ++i)
+    {
+        if (single[i] != batch[i])  ++mismatches;
+    }
+    std::printf("%zu of %zu random spheres visible\n", numBatchVisible, numSpheres);
+    std::printf("IsVisible:   %.2f ns per sphere\n", std::chrono::duration<double, std::nano>(singleEnd - start).count() / numSpheres);
+    std::printf("TestSpheres: %.2f ns per sphere\n", std::chrono::duration<double, std::nano>(batchEnd - singleEnd).count() / numSpheres);
+    Check(numBatchVisible > 0 && numBatchVisible < numSpheres, "Random spheres both inside and outside the cone");
+    Check(mismatches == 0 && numBatchVisible == numSingleVisible,
+          "Batch test matches IsVisible on random spheres (" + std::to_string(mismatches) + " differ)");
+
+    return TestExitCode();
+}
@@ -0,0 +1,161 @@
+//--------------------------------------------------------------------------------------
+// Correctness test and benchmark for the hash tables and hashing functions, see CMakeLists.txt in this folder
+//--------------------------------------------------------------------------------------
+// Hashing functions: string keys are inserted into a CHashTable using each function, then looked up again. Every key
+// must be found with its value. The insert and look-up times are printed along with the longest bucket.
+// Tables: CHashTable and CFlatHashTable are given 1k, 100k and 1M integer keys (starting small, so the times include
+// resizing), which are looked up, looked up with keys that aren't present, then removed. Every key must be found and
+// removed and no missing key found. The times are printed for each step. Pass a larger number of keys to add a size.
+// Exits with a non-zero code if any check fails
+
+#include "CHashTable.h"
+#include "CFlatHashTable.h"
+#include "TestCommon.h"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace gen;
+
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Milliseconds since the given time, which is then moved to now
+    double LapTime(Clock::time_point& start)
+    {
+        Clock::time_point now = Clock::now();
+        double time = std::chrono::duration<double, std::milli>(now - start).count();
+        start = now;
+        return time;
+    }
+
+
+    // Insert and look up the string keys with one hashing function, in a table that is not resized
+    void TestHashFunction(const char* name, THashFunction pfHashFunction, const std::vector<std::string>& keys,
+                          TUInt32 tableSize)
+    {
+        CHashTable<std::string, TUInt32> table(tableSize, pfHashFunction, 1.0e6f);
+
+        Clock::time_point start = Clock::now();
+        for (TUInt32 key = 0; key < keys.size(); ++key)
+        {
+            table.SetKeyValue(keys[key], key);
+        }
+        double insertTime = LapTime(start);
+
+        TUInt32 found = 0;
+        for (TUInt32 key = 0; key < keys.size(); ++key)
+        {
+            TUInt32 value;
+            if (table.LookUpKey(keys[key], &value) && value == key)  ++found;
+        }
+        double lookUpTime = LapTime(start);
+
+        // Longest bucket, found by counting the keys in each with the same function as the table
+        std::vector<TUInt32> bucketSizes(tableSize);
+        TUInt32 longest = 0;
+        for (const std::string& key : keys)
+        {
+            TUInt32& size = bucketSizes[CKeyHash<std::string>::Hash(key, pfHashFunction) % tableSize];
+            if (++size > longest)  longest = size;
+        }
+
+        std::printf("%s: insert %.3f ms, look-up %.3f ms, longest bucket %u (%.1f keys per bucket)\n", name, insertTime,
+                    lookUpTime, longest, static_cast<float>(keys.size()) / tableSize);
+        Check(found == keys.size(), std::string(name) + ": every string key found with its value");
+    }
+
+
+    // Insert, find, miss and remove the keys in one type of hash table. Keys with the top bit set are never inserted,
+    // so are used for the misses
+    template <class THashTableType>
+    void TestHashTable(const char* name, const std::vector<TUInt32>& keys)
+    {
+        THashTableType table(16);
+
+        Clock::time_point start = Clock::now();
+        for (TUInt32 key = 0; key < keys.size(); ++key)
+        {
+            table.SetKeyValue(keys[key], key);
+        }
+        double insertTime = LapTime(start);
+
+        TUInt32 found = 0;
+        for (TUInt32 key = 0; key < keys.size(); ++key)
+        {
+            TUInt32 value;
+            if (table.LookUpKey(keys[key], &value) && value == key)  ++found;
+        }
+        double lookUpTime = LapTime(start);
+
+        TUInt32 falseHits = 0;
+        for (TUInt32 key = 0; key < keys.size(); ++key)
+        {
+            TUInt32 value;
+            if (table.LookUpKey(keys[key] | 0x80000000, &value))  ++falseHits;
+        }
+        double missTime = LapTime(start);
+
+        TUInt32 removed = 0;
+        for (TUInt32 key = 0; key < keys.size(); ++key)
+        {
+            if (table.RemoveKey(keys[key]))  ++removed;
+        }
+        double removeTime = LapTime(start);
+
+        TUInt32 leftOver = 0;
+        for (TUInt32 key = 0; key < keys.size(); ++key)
+        {
+            TUInt32 value;
+            if (table.LookUpKey(keys[key], &value))  ++leftOver;
+        }
+
+        std::printf("%s: insert %.3f ms, look-up %.3f ms, miss %.3f ms, remove %.3f ms\n", name, insertTime, lookUpTime,
+                    missTime, removeTime);
+        std::string prefix = std::string(name) + ", " + std::to_string(keys.size()) + " keys: ";
+        Check(found == keys.size(), prefix + "every key found with its value");
+        Check(falseHits == 0, prefix + "no missing key found");
+        Check(removed == keys.size() && leftOver == 0, prefix + "every key removed");
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    // Known xxHash64 values from the reference implementation
+    const TUInt8 abc[] = { 'a', 'b', 'c' };
+    Check(XXHash64(abc, 0) == 0xEF46DB3751D8E999ull, "XXHash64 of no bytes matches the reference");
+    Check(XXHash64(abc, 3) == 0x44BC2CF5AD770999ull, "XXHash64 of \"abc\" matches the reference");
+
+    // Model-style names, as the app would look up
+    std::vector<std::string> names;
+    for (TUInt32 name = 0; name < 20000; ++name)
+    {
+        names.push_back("Media/Meshes/Model_" + std::to_string(name) + ".x");
+    }
+    TestHashFunction("AddUpHash",       AddUpHash,       names, 4099);
+    TestHashFunction("JOneAtATimeHash", JOneAtATimeHash, names, 4099);
+    TestHashFunction("XXHash",          XXHash,          names, 4099);
+
+    std::vector<TUInt32> sizes = { 1000, 100000, 1000000 };
+    if (argc > 1)  sizes.push_back(static_cast<TUInt32>(std::strtoul(argv[1], nullptr, 10)));
+    for (TUInt32 numKeys : sizes)
+    {
+        // Distinct keys scattered over the lower half of the range (odd multiplier modulo 2^31, so no repeats)
+        std::vector<TUInt32> keys(numKeys);
+        for (TUInt32 key = 0; key < numKeys; ++key)
+        {
+            keys[key] = (key * 2654435761u) & 0x7fffffff;
+        }
+
+        std::printf("%u keys\n", numKeys);
+        TestHashTable<CHashTable<TUInt32, TUInt32>>("CHashTable", keys);
+        TestHashTable<CFlatHashTable<TUInt32, TUInt32>>("CFlatHashTable", keys);
+    }
+
+    return TestExitCode();
+}
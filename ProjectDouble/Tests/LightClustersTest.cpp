@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------------------------
+// Correctness test and benchmark for CLightClusters - runs without a GPU, see CMakeLists.txt in this folder
+//--------------------------------------------------------------------------------------
+// 1000 random point lights and spotlights (the same ones every run) are binned into the grid used by LightBuffer, then
+// the lists are checked against a brute-force test of every light against every cluster's view space box:
+// - a light must be listed for every cluster with a point inside both its range and its cone (sampled on a grid)
+// - a light may only be listed for a cluster whose box its sphere reaches, and for spotlights whose bounding sphere
+//   is within reach of its cone's sides (the conservative tests the class is allowed to make)
+// - the lights in each cluster must be in increasing order, and the lists must be the same for any number of threads
+// Then Assign is timed for 1 to N threads. Build the test with and without MATH_NO_SIMD to compare the SIMD and scalar
+// code (CMakeLists.txt builds both). Pass a number of lights and a number of timed runs to change the defaults.
+// Exits with a non-zero code if any check fails
+
+#include "CLightClusters.h"
+#include "CMatrix4x4.h"
+#include "MathSIMD.h"
+#include "TestCommon.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+
+namespace
+{
+    // Grid as used by LightBuffer, with the app's camera settings
+    const uint32_t kTilesX = 16;
+    const uint32_t kTilesY = 9;
+    const uint32_t kSlices = 24;
+    const float    kNearClip = 0.1f;
+    const float    kFarClip = 10000.0f;
+    const float    kFirstSliceDepth = 5.0f;
+
+    // Extent of a cluster, worked out independently of the class: slices split the depth range exponentially after the
+    // first, and a tile's sides are planes through the camera so the cluster is a piece of the view frustum
+    struct ClusterExtent
+    {
+        float left, right, bottom, top; // Screen space, -1 to 1
+        float zNear, zFar;              // View space depth
+    };
+
+    ClusterExtent ClusterExtentOf(const CLightClusters& clusters, uint32_t column, uint32_t row, uint32_t slice)
+    {
+        // Slice s (from 1) starts where 1 + log(depth) * DepthScale + DepthBias = s
+        auto sliceStart = [&](uint32_t s)
+        {
+            if (s == 0)  return kNearClip;
+            if (s == kSlices)  return kFarClip;
+            return std::exp((s - 1 - clusters.DepthBias()) / clusters.DepthScale());
+        };
+        return { -1.0f + 2.0f * column / kTilesX, -1.0f + 2.0f * (column + 1) / kTilesX,
+                 1.0f - 2.0f * (row + 1) / kTilesY, 1.0f - 2.0f * row / kTilesY, sliceStart(slice), sliceStart(slice + 1) };
+    }
+
+    // View space box around a cluster, the frustum piece is widest at one end or the other
+    CBoundingBox ClusterBox(const ClusterExtent& c, const CMatrix4x4& projection)
+    {
+        return { { std::min(c.left * c.zNear, c.left * c.zFar) / projection.e00,
+                   std::min(c.bottom * c.zNear, c.bottom * c.zFar) / projection.e11, c.zNear },
+                 { std::max(c.right * c.zNear, c.right * c.zFar) / projection.e00,
+                   std::max(c.top * c.zNear, c.top * c.zFar) / projection.e11, c.zFar } };
+    }
+
+    float DistanceSquared(const CVector3& point, const CBoundingBox& box)
+    {
+        float dx = std::max(std::max(box.minimum.x - point.x, point.x - box.maximum.x), 0.0f);
+        float dy = std::max(std::max(box.minimum.y - point.y, point.y - box.maximum.y), 0.0f);
+        float dz = std::max(std::max(box.minimum.z - point.z, point.z - box.maximum.z), 0.0f);
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // Cosine of the angle between two vectors
+    float CosAngle(const CVector3& a, const CVector3& b)
+    {
+        return Dot(a, b) / std::sqrt(Dot(a, a) * Dot(b, b));
+    }
+
+    // Whether any of a grid of points through the cluster is inside the light's range and cone, with a small margin so
+    // rounding in the class isn't counted as a miss. If so the light must be listed
+    bool MustReach(const CVector3& position, float range, const CVector3& direction, float halfAngle,
+                   const ClusterExtent& c, const CMatrix4x4& projection)
+    {
+        const int kSamples = 6;
+        for (int i = 0; i < kSamples; ++i)
+        {
+            for (int j = 0; j < kSamples; ++j)
+            {
+                for (int k = 0; k < kSamples; ++k)
+                {
+                    float z = c.zNear + (c.zFar - c.zNear) * k / (kSamples - 1);
+                    CVector3 point = { (c.left + (c.right - c.left) * i / (kSamples - 1)) * z / projection.e00,
+                                       (c.bottom + (c.top - c.bottom) * j / (kSamples - 1)) * z / projection.e11, z };
+                    CVector3 toPoint = point - position;
+                    if (Dot(toPoint, toPoint) > range * range * 0.999f)  continue;
+                    if (halfAngle == 0 || Dot(toPoint, toPoint) < 1e-6f ||
+                        CosAngle(toPoint, direction) > std::cos(halfAngle) + 1e-3f)
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    // Whether the light's sphere reaches the box, and a spotlight's cone may reach the sphere around the box. The cone
+    // test allows spheres within reach of the cone's side lines even near the apex, as CCone does. If not the light
+    // must not be listed
+    bool MayReach(const CVector3& position, float range, const CVector3& direction, float halfAngle, const CBoundingBox& box)
+    {
+        if (DistanceSquared(position, box) > range * range * 1.001f + 1e-4f)  return false;
+        if (halfAngle == 0)  return true;
+
+        CBoundingSphere sphere = SphereFromBox(box);
+        CVector3 toCentre = sphere.centre - position;
+        float alongAxis = Dot(toCentre, direction) / Length(direction);
+        float fromAxis = std::sqrt(std::max(Dot(toCentre, toCentre) - alongAxis * alongAxis, 0.0f));
+        float margin = sphere.radius * 1e-3f + 1e-4f;
+        if (alongAxis < -sphere.radius - margin)  return false;
+        return fromAxis * std::cos(halfAngle) - alongAxis * std::sin(halfAngle) <= sphere.radius + margin;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    uint32_t numLights = (argc > 1) ? static_cast<uint32_t>(std::atoi(argv[1])) : 1000;
+    uint32_t numRuns = (argc > 2) ? static_cast<uint32_t>(std::atoi(argv[2])) : 200;
+#if defined(MATH_AVX)
+    const char* path = "AVX";
+#elif defined(MATH_SSE)
+    const char* path = "SSE";
+#else
+    const char* path = "scalar";
+#endif
+    std::printf("CLightClusters, %s code, %u lights, %ux%ux%u clusters\n", path, numLights, kTilesX, kTilesY, kSlices);
+
+    // Camera in the scene looking down slightly, lights scattered through the space in front of it and around it
+    CMatrix4x4 cameraMatrix = MatrixRotationX(ToRadians(15)) * MatrixRotationY(ToRadians(30)) * MatrixTranslation({ 10, 30, -80 });
+    CMatrix4x4 viewMatrix = InverseAffine(cameraMatrix);
+    CMatrix4x4 projection = ProjectionMatrix(16.0f / 9.0f, ToRadians(60), kNearClip, kFarClip);
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<CLightClusters::Light> lights(numLights);
+    for (auto& light : lights)
+    {
+        light.position = { -200 + 400 * unit(random), 5 + 60 * unit(random), -150 + 400 * unit(random) };
+        light.range = 5 + 45 * unit(random);
+        bool spot = unit(random) < 0.3f;
+        light.direction = { unit(random) - 0.5f, -unit(random), unit(random) - 0.5f };
+        light.spotHalfAngle = spot ? ToRadians(10 + 50 * unit(random)) : 0.0f;
+    }
+
+    CLightClusters clusters;
+    clusters.SetGrid(kTilesX, kTilesY, kSlices, projection, kNearClip, kFarClip, kFirstSliceDepth);
+    clusters.Assign(lights.data(), numLights, viewMatrix, 1);
+
+
+    //-------------------------------------
+    // Correctness
+    //-------------------------------------
+
+    // Lights in view space for the brute-force tests
+    std::vector<CVector3> viewPositions(numLights), viewDirections(numLights);
+    for (uint32_t i = 0; i < numLights; ++i)
+    {
+        CVector4 position = CVector4(lights[i].position, 1) * viewMatrix;
+        CVector4 direction = CVector4(lights[i].direction, 0) * viewMatrix;
+        viewPositions[i] = { position.x, position.y, position.z };
+        viewDirections[i] = { direction.x, direction.y, direction.z };
+    }
+
+    uint32_t missed = 0, extra = 0, unordered = 0, listed = 0;
+    std::vector<uint8_t> isListed(numLights);
+    for (uint32_t slice = 0; slice < kSlices; ++slice)
+    {
+        for (uint32_t row = 0; row < kTilesY; ++row)
+        {
+            for (uint32_t column = 0; column < kTilesX; ++column)
+            {
+                ClusterExtent extent = ClusterExtentOf(clusters, column, row, slice);
+                CBoundingBox box = ClusterBox(extent, projection);
+                const CLightClusters::Cluster& cluster = clusters.Clusters()[clusters.ClusterIndex(column, row, slice)];
+                std::fill(isListed.begin(), isListed.end(), 0);
+                for (uint32_t i = 0; i < cluster.count; ++i)
+                {
+                    uint32_t light = clusters.LightIndices()[cluster.offset + i];
+                    isListed[light] = 1;
+                    if (i > 0 && light <= clusters.LightIndices()[cluster.offset + i - 1])  ++unordered;
+                }
+                listed += cluster.count;
+
+                for (uint32_t light = 0; light < numLights; ++light)
+                {
+                    const CVector3& position = viewPositions[light];
+                    float range = lights[light].range;
+                    float halfAngle = lights[light].spotHalfAngle;
+                    if (isListed[light])
+                    {
+                        if (!MayReach(position, range, viewDirections[light], halfAngle, box))  ++extra;
+                    }
+                    else if (DistanceSquared(position, box) < range * range &&
+                             MustReach(position, range, viewDirections[light], halfAngle, extent, projection))
+                    {
+                        ++missed;
+                    }
+                }
+            }
+        }
+    }
+    std::printf("%u light indices listed, %u lights in view\n", listed, clusters.GetStats().lightsInView);
+    Check(listed > 0, "Some lights are listed");
+    Check(missed == 0, "Every cluster a light reaches lists it");
+    Check(extra == 0, "No cluster lists a light outside the conservative tests");
+    Check(unordered == 0, "Lights are in increasing order in each cluster");
+
+    // The same lists for any number of threads
+    std::vector<CLightClusters::Cluster> singleClusters = clusters.Clusters();
+    std::vector<uint32_t> singleIndices = clusters.LightIndices();
+    uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 2u);
+    bool sameLists = true;
+    for (uint32_t threads = 2; threads <= maxThreads; ++threads)
+    {
+        clusters.Assign(lights.data(), numLights, viewMatrix, threads);
+        sameLists = sameLists && clusters.LightIndices() == singleIndices &&
+                    std::equal(singleClusters.begin(), singleClusters.end(), clusters.Clusters().begin(),
+                               [](const CLightClusters::Cluster& a, const CLightClusters::Cluster& b)
+                               { return a.offset == b.offset && a.count == b.count; });
+    }
+    Check(sameLists, "Lists are the same for any number of threads");
+
+
+    //-------------------------------------
+    // Timing
+    //-------------------------------------
+
+    // Move the camera a little each run so every Assign does the full work
+    for (uint32_t threads = 1; threads <= maxThreads; ++threads)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t run = 0; run < numRuns; ++run)
+        {
+            CMatrix4x4 runView = InverseAffine(MatrixRotationY(ToRadians(0.01f * run)) * cameraMatrix);
+            clusters.Assign(lights.data(), numLights, runView, threads);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double time = std::chrono::duration<double, std::milli>(end - start).count() / numRuns;
+        std::printf("%u thread(s): %.3f ms per Assign\n", threads, time);
+    }
+
+    return TestExitCode();
+}
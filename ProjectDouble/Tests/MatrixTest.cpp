@@ -0,0 +1,301 @@
+//--------------------------------------------------------------------------------------
+// Correctness test and benchmark for CMatrix4x4 - runs without a GPU, see CMakeLists.txt in this folder
+//--------------------------------------------------------------------------------------
+// Matrix-matrix products, vector transforms and affine inverses of random matrices (the same ones every run) are
+// checked against a double precision calculation made here, which doesn't depend on the SIMD setting. CMakeLists.txt
+// builds the test with and without MATH_NO_SIMD, so passing in both builds shows that the SIMD and scalar code give
+// the same results (to within float rounding). The batch transforms (BatchTransform.h) are checked against single
+// transforms. Then each operation is timed, the batch transforms against a loop of single transforms - compare the two
+// builds' times. Pass a number of timed operations to change the default. Exits with a non-zero code if any check fails
+
+#include "CMatrix4x4.h"
+#include "CVector4.h"
+#include "BatchTransform.h"
+#include "MathSIMD.h"
+#include "TestCommon.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+
+namespace
+{
+    const int kNumMatrices = 1000; // At least 512, see the timing
+
+    // Largest difference allowed between a float result and the double calculation, relative to the size of the
+    // values that went into it. Products only round a few times, inverses divide by the determinant
+    const double kProductTolerance = 1e-6;
+    const double kInverseTolerance = 1e-5;
+
+    // Elements of a matrix by index, row by row
+    float Element(const CMatrix4x4& m, int row, int column)  { return (&m.e00)[row * 4 + column]; }
+
+    // Random affine matrix: rotation, non-uniform scale and translation
+    CMatrix4x4 RandomAffine(std::mt19937& random)
+    {
+        std::uniform_real_distribution<float> angle(-3.14f, 3.14f), scale(0.25f, 4.0f), position(-100.0f, 100.0f);
+        return MatrixScaling({ scale(random), scale(random), scale(random) }) * MatrixRotationZ(angle(random)) *
+               MatrixRotationX(angle(random)) * MatrixRotationY(angle(random)) *
+               MatrixTranslation({ position(random), position(random), position(random) });
+    }
+
+    // Random general matrix, e.g. a view-projection matrix
+    CMatrix4x4 RandomGeneral(std::mt19937& random)
+    {
+        std::uniform_real_distribution<float> element(-10.0f, 10.0f);
+        CMatrix4x4 m;
+        for (int i = 0; i < 16; ++i)  (&m.e00)[i] = element(random);
+        return m;
+    }
+
+    // Worst difference between a matrix and a double calculation of it, relative to the given scale for each element
+    double MatrixError(const CMatrix4x4& m, const double expected[16], const double scale[16])
+    {
+        double error = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            error = std::max(error, std::abs((&m.e00)[i] - expected[i]) / std::max(scale[i], 1.0));
+        }
+        return error;
+    }
+
+    // Error of m1 * m2, scaled by the sum of the sizes of the terms making each element
+    double ProductError(const CMatrix4x4& product, const CMatrix4x4& m1, const CMatrix4x4& m2)
+    {
+        double expected[16], scale[16];
+        for (int row = 0; row < 4; ++row)
+        {
+            for (int column = 0; column < 4; ++column)
+            {
+                double sum = 0, size = 0;
+                for (int k = 0; k < 4; ++k)
+                {
+                    double term = static_cast<double>(Element(m1, row, k)) * Element(m2, k, column);
+                    sum += term;
+                    size += std::abs(term);
+                }
+                expected[row * 4 + column] = sum;
+                scale[row * 4 + column] = size;
+            }
+        }
+        return MatrixError(product, expected, scale);
+    }
+
+    // Error of v * m, scaled as above
+    double TransformError(const CVector4& transformed, const CVector4& v, const CMatrix4x4& m)
+    {
+        double error = 0;
+        for (int column = 0; column < 4; ++column)
+        {
+            double sum = 0, size = 0;
+            for (int k = 0; k < 4; ++k)
+            {
+                double term = static_cast<double>((&v.x)[k]) * Element(m, k, column);
+                sum += term;
+                size += std::abs(term);
+            }
+            error = std::max(error, std::abs((&transformed.x)[column] - sum) / std::max(size, 1.0));
+        }
+        return error;
+    }
+
+    // Error of the inverse of an affine matrix, found in double precision from the 3x3 cofactors. Errors are scaled by
+    // the largest element of the 3x3 inverse, and for the translation row also by the size of the translation
+    double InverseError(const CMatrix4x4& inverse, const CMatrix4x4& m)
+    {
+        double a[3][3];
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 3; ++column)  a[row][column] = Element(m, row, column);
+        }
+        double cofactor[3][3];
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 3; ++column)
+            {
+                int r1 = (row + 1) % 3, r2 = (row + 2) % 3, c1 = (column + 1) % 3, c2 = (column + 2) % 3;
+                cofactor[row][column] = a[r1][c1] * a[r2][c2] - a[r1][c2] * a[r2][c1];
+            }
+        }
+        double determinant = a[0][0] * cofactor[0][0] + a[0][1] * cofactor[0][1] + a[0][2] * cofactor[0][2];
+
+        double expected[16], scale[16];
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 3; ++column)  expected[row * 4 + column] = cofactor[column][row] / determinant;
+            expected[row * 4 + 3] = 0;
+        }
+        for (int column = 0; column < 3; ++column)
+        {
+            double sum = 0;
+            for (int k = 0; k < 3; ++k)  sum -= Element(m, 3, k) * expected[k * 4 + column];
+            expected[12 + column] = sum;
+        }
+        expected[15] = 1;
+
+        // The translation row depends on the size of the translation, the rest on the size of the 3x3 inverse
+        double rowSize = 0;
+        for (int i = 0; i < 12; ++i)  rowSize = std::max(rowSize, std::abs(expected[i]));
+        double translationSize = 0;
+        for (int k = 0; k < 3; ++k)  translationSize += std::abs(Element(m, 3, k));
+        for (int i = 0; i < 16; ++i)  scale[i] = (i < 12) ? rowSize : rowSize * translationSize;
+        return MatrixError(inverse, expected, scale);
+    }
+
+    // Time an operation over the given number of runs, printing the time per run. The results are summed into a
+    // value that is printed so the compiler can't remove the work
+    template <class TOperation>
+    void Time(const char* name, int numRuns, TOperation operation)
+    {
+        float total = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < numRuns; ++run)
+        {
+            total += operation(run);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double time = std::chrono::duration<double, std::nano>(end - start).count() / numRuns;
+        std::printf("%s: %.2f ns (checksum %g)\n", name, time, total);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    int numRuns = (argc > 1) ? std::atoi(argv[1]) : 10000000;
+#if defined(MATH_AVX)
+    const char* path = "AVX";
+#elif defined(MATH_SSE)
+    const char* path = "SSE";
+#else
+    const char* path = "scalar";
+#endif
+    std::printf("CMatrix4x4, %s code, %d random matrices\n", path, kNumMatrices);
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> element(-10.0f, 10.0f);
+    std::vector<CMatrix4x4> affine(kNumMatrices), general(kNumMatrices);
+    std::vector<CVector4> vectors(kNumMatrices);
+    for (int i = 0; i < kNumMatrices; ++i)
+    {
+        affine[i] = RandomAffine(random);
+        general[i] = RandomGeneral(random);
+        vectors[i] = { element(random), element(random), element(random), element(random) };
+    }
+
+
+    //-------------------------------------
+    // Correctness
+    //-------------------------------------
+
+    double productError = 0, selfProductError = 0, transformError = 0, inverseError = 0, identityError = 0;
+    bool affineInverses = true;
+    for (int i = 0; i < kNumMatrices; ++i)
+    {
+        const CMatrix4x4& m1 = general[i];
+        const CMatrix4x4& m2 = (i % 2 == 0) ? general[(i + 1) % kNumMatrices] : affine[i];
+        productError = std::max(productError, ProductError(m1 * m2, m1, m2));
+
+        // Multiplying in place, including by itself
+        CMatrix4x4 inPlace = m1;
+        inPlace *= inPlace;
+        selfProductError = std::max(selfProductError, ProductError(inPlace, m1, m1));
+
+        transformError = std::max(transformError, TransformError(vectors[i] * m1, vectors[i], m1));
+        CMatrix4x4 copy = m1;
+        transformError = std::max(transformError, TransformError(copy *= vectors[i], vectors[i], m1));
+
+        CMatrix4x4 inverse = InverseAffine(affine[i]);
+        inverseError = std::max(inverseError, InverseError(inverse, affine[i]));
+        affineInverses = affineInverses && inverse.e03 == 0 && inverse.e13 == 0 && inverse.e23 == 0 && inverse.e33 == 1;
+
+        // The matrix times its inverse is the identity. The scale is at most 4, so the inverse is well conditioned
+        CMatrix4x4 identity = affine[i] * inverse;
+        double scale = std::max(1.0f, std::abs(affine[i].e30) + std::abs(affine[i].e31) + std::abs(affine[i].e32));
+        for (int row = 0; row < 4; ++row)
+        {
+            for (int column = 0; column < 4; ++column)
+            {
+                double difference = std::abs(Element(identity, row, column) - (row == column ? 1.0 : 0.0));
+                identityError = std::max(identityError, difference / (row == 3 ? 4 * scale : 16.0));
+            }
+        }
+    }
+
+    std::printf("Worst relative errors: product %.3g, self product %.3g, transform %.3g, inverse %.3g, identity %.3g\n",
+                productError, selfProductError, transformError, inverseError, identityError);
+    Check(productError <= kProductTolerance, "Products match the double precision calculation");
+    Check(selfProductError <= kProductTolerance, "Multiplying a matrix by itself in place gives its square");
+    Check(transformError <= kProductTolerance, "Vector transforms match the double precision calculation");
+    Check(inverseError <= kInverseTolerance, "Affine inverses match the double precision calculation");
+    Check(affineInverses, "Affine inverses have a last column of 0, 0, 0, 1");
+    Check(identityError <= kInverseTolerance, "A matrix times its affine inverse is the identity");
+
+    CVector4 moved = CVector4(1, 2, 3, 1) * MatrixTranslation({ 10, 20, 30 });
+    Check(moved.x == 11 && moved.y == 22 && moved.z == 33 && moved.w == 1, "Translation moves a point");
+    CVector4 direction = CVector4(1, 2, 3, 0) * MatrixTranslation({ 10, 20, 30 });
+    Check(direction.x == 1 && direction.y == 2 && direction.z == 3 && direction.w == 0, "Translation leaves a vector");
+
+    // Batch transforms of all the vectors' xyz against single transforms. The odd count leaves a few for the scalar tail
+    const int numPoints = kNumMatrices - 3;
+    std::vector<CVector3> points(numPoints), batchPoints(numPoints), batchVectors(numPoints);
+    for (int i = 0; i < numPoints; ++i)  points[i] = { vectors[i].x, vectors[i].y, vectors[i].z };
+    TransformPoints(affine[0], points.data(), batchPoints.data(), numPoints);
+    TransformVectors(affine[0], points.data(), batchVectors.data(), numPoints);
+    double batchError = 0;
+    for (int i = 0; i < numPoints; ++i)
+    {
+        CVector4 point = CVector4(points[i], 1) * affine[0];
+        CVector4 vector = CVector4(points[i], 0) * affine[0];
+        double size = 1 + std::abs(point.x) + std::abs(point.y) + std::abs(point.z);
+        batchError = std::max({ batchError, std::abs(batchPoints[i].x - point.x) / size, std::abs(batchPoints[i].y - point.y) / size,
+                                std::abs(batchPoints[i].z - point.z) / size, std::abs(batchVectors[i].x - vector.x) / size,
+                                std::abs(batchVectors[i].y - vector.y) / size, std::abs(batchVectors[i].z - vector.z) / size });
+    }
+    Check(batchError <= kProductTolerance, "Batch point and vector transforms match single transforms");
+
+
+    //-------------------------------------
+    // Timing
+    //-------------------------------------
+
+    const int mask = 511; // Cycle through the first 512 matrices, which fit in the cache
+    Time("Matrix multiply", numRuns, [&](int run)
+    {
+        return (general[run & mask] * affine[(run + 1) & mask]).e00;
+    });
+    Time("Vector transform", numRuns, [&](int run)
+    {
+        return (vectors[run & mask] * general[(run + 7) & mask]).x;
+    });
+    Time("Affine inverse", numRuns, [&](int run)
+    {
+        return InverseAffine(affine[run & mask]).e30;
+    });
+
+    // The same points through one matrix, as CLightClusters does with the lights each frame
+    int numBatches = std::max(1, numRuns / numPoints);
+    std::string batchName = std::to_string(numPoints) + " point transforms";
+    Time((batchName + ", one at a time").c_str(), numBatches, [&](int run)
+    {
+        const CMatrix4x4& m = affine[run & mask];
+        for (int i = 0; i < numPoints; ++i)
+        {
+            CVector4 point = CVector4(points[i], 1) * m;
+            batchPoints[i] = { point.x, point.y, point.z };
+        }
+        return batchPoints[run % numPoints].x;
+    });
+    Time((batchName + ", TransformPoints").c_str(), numBatches, [&](int run)
+    {
+        TransformPoints(affine[run & mask], points.data(), batchPoints.data(), numPoints);
+        return batchPoints[run % numPoints].x;
+    });
+
+    return TestExitCode();
+}
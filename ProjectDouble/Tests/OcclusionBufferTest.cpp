@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// Visibility test for COcclusionBuffer - runs without a GPU, see CMakeLists.txt in this folder
+//--------------------------------------------------------------------------------------
+// A wall is rendered as the only occluder, then boxes behind, in front of and beside it are tested. Exits with a
+// non-zero code if any box is reported wrongly
+
+#include "COcclusionBuffer.h"
+#include "CTriangleTree.h"
+#include "CMatrix4x4.h"
+#include "TestCommon.h"
+#include <cstdio>
+#include <cmath>
+
+
+int main()
+{
+    // Camera at z = -20 looking along +z, wall 20 wide and 10 high centred on the origin facing the camera
+    CMatrix4x4 cameraMatrix = MatrixTranslation({ 0, 0, -20 });
+    CMatrix4x4 viewProjection = InverseAffine(cameraMatrix) * ProjectionMatrix(16.0f / 9.0f, ToRadians(90), 0.1f, 1000.0f);
+
+    const float wallVertices[] = { -10, -5, 0,   10, -5, 0,   10, 5, 0,   -10, 5, 0 };
+    const uint32_t wallIndices[] = { 0, 2, 1,   0, 3, 2 }; // Clockwise as seen from the camera
+    CTriangleTree wall;
+    wall.Build(wallVertices, sizeof(float) * 3, wallIndices, sizeof(uint32_t), 6);
+
+    COcclusionBuffer buffer;
+    buffer.Resize(256, 144);
+    buffer.Clear(viewProjection);
+    buffer.RenderTriangles(wall, MatrixIdentity());
+    buffer.BuildPyramid();
+
+    Check(buffer.GetStats().rasterised == 2, "Both wall triangles rasterised");
+    Check(std::abs(buffer.Depth(128, 72) - 1.0f / 20.0f) < 1e-4f, "Depth at the centre is 1/w of the wall");
+
+    Check(!buffer.IsVisible({ { -2, -2, 10 }, { 2, 2, 14 } }), "Box fully behind the wall is occluded");
+    Check(!buffer.IsVisible({ { -4, -2, 0.5f }, { 4, 2, 1 } }), "Box just behind the wall is occluded");
+    Check(buffer.IsVisible({ { -2, -2, -8 }, { 2, 2, -4 } }), "Box in front of the wall is visible");
+    Check(buffer.IsVisible({ { -2, -2, -1 }, { 2, 2, 1 } }), "Box through the wall is visible");
+    // Boxes further away project nearer the centre of the screen, the wall's edge at x = 10 is at x = 15 here
+    Check(buffer.IsVisible({ { 22, -2, 10 }, { 26, 2, 14 } }), "Box behind but beside the wall is visible");
+    Check(buffer.IsVisible({ { 10, -2, 10 }, { 20, 2, 14 } }), "Box behind and partly beside the wall is visible");
+    Check(buffer.IsVisible({ { -2, 9, 10 }, { 2, 12, 14 } }), "Box behind but above the wall is visible");
+    Check(buffer.IsVisible({ { -1, -1, -25 }, { 1, 1, 10 } }), "Box crossing the near plane is visible");
+    Check(buffer.IsVisible(CBoundingBox::Empty()), "Empty box is visible");
+
+    // Turn the camera around, the wall is now behind it and hides nothing
+    cameraMatrix = MatrixRotationY(ToRadians(180)) * MatrixTranslation({ 0, 0, -20 });
+    buffer.Clear(InverseAffine(cameraMatrix) * ProjectionMatrix(16.0f / 9.0f, ToRadians(90), 0.1f, 1000.0f));
+    buffer.RenderTriangles(wall, MatrixIdentity());
+    buffer.BuildPyramid();
+    Check(buffer.IsVisible({ { -2, -2, -40 }, { 2, 2, -36 } }), "Occluder behind the camera hides nothing");
+
+    return TestExitCode();
+}
@@ -0,0 +1,144 @@
+//--------------------------------------------------------------------------------------
+// Multi-threaded test for the Profiler - runs without Windows, see CMakeLists.txt in this folder
+//--------------------------------------------------------------------------------------
+// Each frame the main thread times a zone with a nested zone, and worker threads are started (and exit, as the asset
+// loader's do) each timing several zones, before EndFrame collects them. The spin zone takes much longer on a few
+// frames, which must show in its 99th percentile but not its median or 95th. The calls per frame, nesting depths,
+// dropped zones, interned names and a Chrome trace are also checked. Prints the summary and the cost of a zone.
+// Exits with a non-zero code if any check fails
+
+#include "Profiler.h"
+#include "TestCommon.h"
+#include <cstdio>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+    const unsigned int kFrames = 200;         // Fewer than Profiler::kSummaryFrames, so every frame is in the summary
+    const unsigned int kLongFrames = 3;       // Frames with a long spin, 1.5% so only the 99th percentile sees them
+    const unsigned int kWorkers = 4;
+    const unsigned int kZonesPerWorker = 10;
+    const double       kShortSpin = 0.1;      // Milliseconds
+    const double       kLongSpin = 5.0;
+
+    // Busy wait for the given number of milliseconds, sleeping could take much longer
+    void Spin(double milliseconds)
+    {
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < milliseconds) {}
+    }
+
+    // Summary of the zone with the given name, or a summary with no frames if it isn't there
+    Profiler::ZoneSummary FindZone(const std::vector<Profiler::ZoneSummary>& summary, const std::string& name)
+    {
+        for (auto& zone : summary)
+        {
+            if (zone.name == name)  return zone;
+        }
+        Profiler::ZoneSummary missing = {};
+        return missing;
+    }
+}
+
+
+int main()
+{
+    gProfiler.EndFrame(); // The first frame includes start-up and isn't counted
+
+    for (unsigned int frame = 0; frame < kFrames; ++frame)
+    {
+        {
+            PROFILE_ZONE("Spin");
+            {
+                PROFILE_ZONE("Nested");
+            }
+            bool longFrame = frame % 50 == 25 && frame / 50 < kLongFrames; // Spread out, frames 25, 75, 125
+            Spin(longFrame ? kLongSpin : kShortSpin);
+        }
+
+        std::vector<std::thread> workers;
+        for (unsigned int worker = 0; worker < kWorkers; ++worker)
+        {
+            workers.emplace_back([]()
+            {
+                for (unsigned int zone = 0; zone < kZonesPerWorker; ++zone)
+                {
+                    PROFILE_ZONE("Worker");
+                }
+            });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        gProfiler.EndFrame();
+    }
+
+    std::vector<Profiler::ZoneSummary> summary = gProfiler.Summary();
+    std::printf("%s", gProfiler.SummaryReport().c_str());
+
+    Check(!summary.empty() && summary[0].name == "Frame" && summary[0].frames == kFrames,
+          "Frame time comes first and has every frame");
+    Profiler::ZoneSummary spin = FindZone(summary, "Spin");
+    Profiler::ZoneSummary nested = FindZone(summary, "Nested");
+    Profiler::ZoneSummary worker = FindZone(summary, "Worker");
+    Check(spin.frames == kFrames && spin.calls == 1.0f && spin.depth == 0, "Main thread zone used once every frame");
+    Check(nested.frames == kFrames && nested.depth == 1, "Nested zone has depth 1");
+    Check(worker.frames == kFrames && worker.calls == kWorkers * kZonesPerWorker,
+          "Zones from every worker thread collected, counted once per frame with the total calls");
+
+    // The long spins are 1.5% of frames: above the 95th percentile, within the 99th (nearest rank)
+    double midSpin = (kShortSpin + kLongSpin) * 0.5;
+    Check(spin.median >= kShortSpin && spin.median < midSpin, "Spin median is the short spin");
+    Check(spin.p95 < midSpin, "Spin 95th percentile is the short spin");
+    Check(spin.p99 >= kLongSpin && spin.max >= kLongSpin, "Spin 99th percentile and max are the long spin");
+    Check(spin.median <= spin.p95 && spin.p95 <= spin.p99 && spin.p99 <= spin.max, "Percentiles in order");
+    Check(gProfiler.DroppedZones() == 0, "No zones dropped");
+
+    const char* interned = gProfiler.Intern(std::string("Run") + "-time name");
+    Check(interned == gProfiler.Intern("Run-time name") && std::string(interned) == "Run-time name",
+          "Interned names are kept once");
+
+    // A thread that times more zones in a frame than its buffer holds has the rest dropped and counted
+    std::thread([]()
+    {
+        for (unsigned int zone = 0; zone < Profiler::kBufferZones + 100; ++zone)
+        {
+            PROFILE_ZONE("Overflow");
+        }
+    }).join();
+    gProfiler.EndFrame();
+    Check(gProfiler.DroppedZones() == 100, "Zones past a full buffer dropped and counted");
+
+    // Two captured frames written as a Chrome trace, with the worker threads named
+    gProfiler.CaptureFrames(2, "ProfilerTest.json");
+    for (unsigned int frame = 0; frame < 2; ++frame)
+    {
+        std::thread([]() { PROFILE_ZONE("Worker"); }).join();
+        Check(gProfiler.EndFrame(), "Capture frame " + std::to_string(frame + 1) + " collected and written");
+    }
+    std::ifstream traceFile("ProfilerTest.json");
+    std::stringstream trace;
+    trace << traceFile.rdbuf();
+    Check(trace.str().find("\"traceEvents\"") != std::string::npos && trace.str().find("\"name\":\"Worker\"") != std::string::npos &&
+          trace.str().find("\"thread_name\"") != std::string::npos, "Chrome trace has the zones and thread names");
+
+    // Cost of a zone on the main thread, in a frame that fits the buffer
+    const unsigned int numZones = Profiler::kBufferZones / 2;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int zone = 0; zone < numZones; ++zone)
+    {
+        PROFILE_ZONE("Timing");
+    }
+    auto end = std::chrono::steady_clock::now();
+    gProfiler.EndFrame();
+    std::printf("%.1f ns per zone\n", std::chrono::duration<double, std::nano>(end - start).count() / numZones);
+
+    return TestExitCode();
+}
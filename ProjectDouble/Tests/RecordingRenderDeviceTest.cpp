@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// Command counting test for RecordingRenderDevice - runs without DirectX, see CMakeLists.txt in this folder
+//--------------------------------------------------------------------------------------
+// A pass like the app's is sent to the device: states, shaders and resources are set, then a clear, a copy, draws,
+// a buffer update and a present. The counts, the state changes, the bytes uploaded and the logged commands are
+// checked, then the same with logging off, and after a Reset. The DirectX objects are only handles, so made-up
+// pointers are used. Also prints the time per command with logging on and off. Exits with a non-zero code if any
+// check fails
+
+#include "RecordingRenderDevice.h"
+#include "TestCommon.h"
+#include <cstdio>
+#include <chrono>
+#include <cstdint>
+
+
+namespace
+{
+    // A made-up DirectX object, never dereferenced by the device
+    template <class T>
+    T* Handle(uintptr_t id)  { return reinterpret_cast<T*>(id * 16); }
+
+
+    // Send one pass to the device: 13 state changes, then 8 other commands of which 3 draws
+    void RenderPass(RenderDevice& device)
+    {
+        ID3D11Buffer* vertexBuffer = Handle<ID3D11Buffer>(1);
+        ID3D11Buffer* constantBuffers[] = { Handle<ID3D11Buffer>(2), Handle<ID3D11Buffer>(3) };
+        ID3D11ShaderResourceView* texture = Handle<ID3D11ShaderResourceView>(4);
+        ID3D11RenderTargetView* renderTarget = Handle<ID3D11RenderTargetView>(6);
+        ID3D11DepthStencilView* depthStencil = Handle<ID3D11DepthStencilView>(7);
+        UINT stride = 32;
+        UINT offset = 0;
+        D3D11_VIEWPORT viewport = { 0, 0, 1280, 720, 0, 1 };
+        const FLOAT colour[4] = { 0, 0, 0, 1 };
+
+        device.OMSetRenderTargets(1, &renderTarget, depthStencil);
+        device.RSSetViewports(1, &viewport);
+        device.OMSetBlendState(Handle<ID3D11BlendState>(8), nullptr, 0xffffffff);
+        device.OMSetDepthStencilState(Handle<ID3D11DepthStencilState>(9), 0);
+        device.RSSetState(Handle<ID3D11RasterizerState>(10));
+        device.IASetInputLayout(Handle<ID3D11InputLayout>(11));
+        device.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        device.IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+        device.IASetIndexBuffer(Handle<ID3D11Buffer>(12), DXGI_FORMAT_R32_UINT, 0);
+        device.VSSetShader(Handle<ID3D11VertexShader>(13), nullptr, 0);
+        device.PSSetShader(Handle<ID3D11PixelShader>(14), nullptr, 0);
+        device.VSSetConstantBuffers(1, 2, constantBuffers);
+        device.PSSetShaderResources(0, 1, &texture);
+
+        device.ClearRenderTargetView(renderTarget, colour);
+        device.ClearDepthStencilView(depthStencil, 1, 1.0f, 0);
+        device.CopyResource(Handle<ID3D11Resource>(15), Handle<ID3D11Resource>(16));
+        device.UpdateBuffer(constantBuffers[0], nullptr, 256);
+        device.Draw(3, 0);
+        device.DrawIndexed(36, 6, 100);
+        device.DrawIndexedInstanced(36, 50, 0, 0, 0);
+        device.Present(0);
+    }
+    const unsigned int kPassStateChanges = 13;
+    const unsigned int kPassCommands = 21;
+
+
+    // Time per command, in nanoseconds, of sending the pass many times, resetting between passes as the app does frames
+    double TimePerCommand(RecordingRenderDevice& device, unsigned int numPasses)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int pass = 0; pass < numPasses; ++pass)
+        {
+            device.Reset();
+            RenderPass(device);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / (numPasses * kPassCommands);
+    }
+}
+
+
+int main()
+{
+    RecordingRenderDevice device;
+    RenderPass(device);
+
+    Check(device.Commands().size() == kPassCommands, "Every command logged");
+    Check(device.NumStateChanges() == kPassStateChanges, "State changes are the Set... commands only");
+    Check(device.NumDrawCalls() == 3, "Draw, DrawIndexed and DrawIndexedInstanced counted as draw calls");
+    Check(device.NumCommands(RenderCommandType::ClearRenderTarget) == 1 &&
+          device.NumCommands(RenderCommandType::ClearDepthStencil) == 1 &&
+          device.NumCommands(RenderCommandType::CopyResource) == 1 &&
+          device.NumCommands(RenderCommandType::Present) == 1, "Clears, copy and present counted by type");
+    Check(device.BytesUploaded() == 256, "Buffer update size counted as bytes uploaded");
+
+    // The log is in call order, with the values described in RecordingRenderDevice.h
+    const std::vector<RenderCommand>& commands = device.Commands();
+    Check(commands[0].type == RenderCommandType::SetRenderTargets &&
+          commands[0].object == Handle<ID3D11RenderTargetView>(6) && commands[0].count == 1,
+          "SetRenderTargets logs the first render target");
+    Check(commands[6].type == RenderCommandType::SetPrimitiveTopology &&
+          commands[6].value == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST, "SetPrimitiveTopology logs the topology");
+    Check(commands[11].type == RenderCommandType::SetConstantBuffers && commands[11].stage == RenderShaderStage::Vertex &&
+          commands[11].object == Handle<ID3D11Buffer>(2) && commands[11].slot == 1 && commands[11].count == 2,
+          "SetConstantBuffers logs the stage, first buffer and slot range");
+    Check(commands[18].type == RenderCommandType::DrawIndexed && commands[18].count == 36 && commands[18].slot == 6 &&
+          commands[18].baseVertex == 100, "DrawIndexed logs the index count, start index and base vertex");
+    Check(commands[19].type == RenderCommandType::DrawIndexedInstanced && commands[19].value == 50,
+          "DrawIndexedInstanced logs the number of instances");
+
+    device.Reset();
+    Check(device.Commands().empty() && device.NumStateChanges() == 0 && device.NumDrawCalls() == 0 &&
+          device.BytesUploaded() == 0, "Reset clears the log and the counts");
+
+    // A null device counts the same commands without logging them
+    RecordingRenderDevice nullDevice(false);
+    RenderPass(nullDevice);
+    Check(nullDevice.Commands().empty(), "Nothing logged with logging off");
+    Check(nullDevice.NumStateChanges() == kPassStateChanges && nullDevice.NumDrawCalls() == 3,
+          "Commands still counted with logging off");
+
+    const unsigned int numPasses = 1000000;
+    std::printf("Logging on:  %.2f ns per command\n", TimePerCommand(device, numPasses));
+    std::printf("Logging off: %.2f ns per command\n", TimePerCommand(nullDevice, numPasses));
+
+    return TestExitCode();
+}
@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// Helpers shared by the tests - checks, failure count and the app's projection matrix
+//--------------------------------------------------------------------------------------
+// Header only, so each test is still a single .cpp file (see CMakeLists.txt in this folder). Also used by the tests
+// run from the app (e.g. InstancingTest.cpp), which send the check lines to their results file with SetTestOutput.
+// The failure count and output are function statics rather than inline variables so the header builds as C++14 too
+
+#ifndef _TEST_COMMON_H_INCLUDED_
+#define _TEST_COMMON_H_INCLUDED_
+
+#include "CMatrix4x4.h"
+#include <cmath>
+#include <iostream>
+#include <string>
+
+
+// Where check lines are written, standard output unless changed with SetTestOutput
+inline std::ostream*& TestOutput()
+{
+    static std::ostream* output = &std::cout;
+    return output;
+}
+inline void SetTestOutput(std::ostream& output)  { TestOutput() = &output; }
+
+// Number of checks failed so far
+inline int& TestFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+// Write one line for a check, "Pass: ..." or "FAIL: ...", counting failures
+inline void Check(bool passed, const std::string& description)
+{
+    *TestOutput() << (passed ? "Pass: " : "FAIL: ") << description << std::endl;
+    if (!passed)  ++TestFailures();
+}
+
+// Write the number of failures and return the exit code for main, non-zero if any check failed
+inline int TestExitCode()
+{
+    *TestOutput() << TestFailures() << " failure(s)" << std::endl;
+    return TestFailures() == 0 ? 0 : 1;
+}
+
+
+// Perspective projection as used by the app (DirectX conventions, see MakeProjectionMatrix in GraphicsHelpers.h)
+inline CMatrix4x4 ProjectionMatrix(float aspectRatio, float fovX, float nearClip, float farClip)
+{
+    float scaleX = 1.0f / std::tan(fovX * 0.5f);
+    float scaleY = aspectRatio * scaleX;
+    float scaleZa = farClip / (farClip - nearClip);
+    float scaleZb = -nearClip * scaleZa;
+
+    CMatrix4x4 m = MatrixIdentity();
+    m.e00 = scaleX;
+    m.e11 = scaleY;
+    m.e22 = scaleZa;
+    m.e23 = 1.0f;
+    m.e32 = scaleZb;
+    m.e33 = 0.0f;
+    return m;
+}
+
+
+#endif //_TEST_COMMON_H_INCLUDED_
@@ -1,4 +1,6 @@
 #include "TextureManager.h"
+#include "AssetLoader.h"
+#include "Profiler.h"
 TextureManager::TextureManager()
 {
 	gPortalWidth = 2000;
@@ -8,25 +10,64 @@ TextureManager::TextureManager()
 }
 bool TextureManager::LoadTextures()// Load all textures from image
 {
-	if (!LoadTexture(TextureMediaFolder + "CubeMapA.jpg", &gSkyDiffuseSpecularMap, &gSkyDiffuseSpecularMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "StoneDiffuseSpecular.dds", &gStoneDiffuseSpecularMap, &gStoneDiffuseSpecularMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "Moogle.png", &gDecalDiffuseSpecularMap, &gDecalDiffuseSpecularMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "CargoA.dds", &gCrateDiffuseSpecularMap, &gCrateDiffuseSpecularMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "Brick1.jpg", &gBrickDiffuseSpecularMap, &gBrickDiffuseSpecularMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "MountGrassTexture2.jpg", &gGroundDiffuseSpecularMap, &gGroundDiffuseSpecularMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "Flare.jpg", &gLightDiffuseMap, &gLightDiffuseMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "StoneDiffuseSpecular.dds", &gTeapotSpecularDiffuseMap, &gTeapotSpecularDiffuseMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "WoodDiffuseSpecular.dds", &gWoodSpecularDiffuseMap, &gWoodSpecularDiffuseMapSRV)||
-		!LoadTexture(TextureMediaFolder + "BarrackTexture.png", &gTrollSpecularDiffuseMap,&gTrollSpecularDiffuseMapSRV)||
-		!LoadTexture(TextureMediaFolder + "tv.dds", &gTVDiffuseSpecularMap,&gTVDiffuseSpecularMapSRV) ||
-		!LoadTexture(TextureMediaFolder + "greyTexture.jpg", &gGreyDiffuseSpecularMap, &gGreyDiffuseSpecularMapSRV)||
-		!LoadTexture(TextureMediaFolder + "WaterNormalHeight.png", &gWaterNormalMap, &gWaterNormalMapSRV))
-	{
-		gLastError = "Error loading textures";
+	PROFILE_ZONE("LoadTextures");
+
+	// Files are read on worker threads, each texture is created here as soon as its file is in memory
+	struct TextureFile
+	{
+		const char*                file;
+		ID3D11Resource**           texture;
+		ID3D11ShaderResourceView** textureSRV;
+	};
+	const TextureFile textureFiles[] =
+	{
+		{ "CubeMapA.jpg",              &gSkyDiffuseSpecularMap,       &gSkyDiffuseSpecularMapSRV },
+		{ "StoneDiffuseSpecular.dds",  &gStoneDiffuseSpecularMap,     &gStoneDiffuseSpecularMapSRV },
+		{ "Moogle.png",                &gDecalDiffuseSpecularMap,     &gDecalDiffuseSpecularMapSRV },
+		{ "CargoA.dds",                &gCrateDiffuseSpecularMap,     &gCrateDiffuseSpecularMapSRV },
+		{ "Brick1.jpg",                &gBrickDiffuseSpecularMap,     &gBrickDiffuseSpecularMapSRV },
+		{ "MountGrassTexture2.jpg",    &gGroundDiffuseSpecularMap,    &gGroundDiffuseSpecularMapSRV },
+		{ "Flare.jpg",                 &gLightDiffuseMap,             &gLightDiffuseMapSRV },
+		{ "StoneDiffuseSpecular.dds",  &gTeapotSpecularDiffuseMap,    &gTeapotSpecularDiffuseMapSRV },
+		{ "WoodDiffuseSpecular.dds",   &gWoodSpecularDiffuseMap,      &gWoodSpecularDiffuseMapSRV },
+		{ "BarrackTexture.png",        &gTrollSpecularDiffuseMap,     &gTrollSpecularDiffuseMapSRV },
+		{ "tv.dds",                    &gTVDiffuseSpecularMap,        &gTVDiffuseSpecularMapSRV },
+		{ "greyTexture.jpg",           &gGreyDiffuseSpecularMap,      &gGreyDiffuseSpecularMapSRV },
+		{ "WaterNormalHeight.png",     &gWaterNormalMap,              &gWaterNormalMapSRV },
+	};
+	const unsigned int numTextures = sizeof(textureFiles) / sizeof(textureFiles[0]);
+
+	std::vector<uint8_t> fileData[numTextures]; // File contents, passed from the workers to this thread
+	AssetLoader loader;
+	for (unsigned int i = 0; i < numTextures; ++i)
+	{
+		std::string fileName = TextureMediaFolder + textureFiles[i].file;
+		const TextureFile& textureFile = textureFiles[i];
+		std::vector<uint8_t>& data = fileData[i];
+		loader.Add(textureFile.file,
+			[fileName, &data]()
+			{
+				if (!ReadTextureFile(fileName, data))  throw std::runtime_error("Error loading texture " + fileName);
+			},
+			[fileName, &data, &textureFile]()
+			{
+				if (!CreateTextureFromMemory(fileName, data, textureFile.texture, textureFile.textureSRV))
+				{
+					throw std::runtime_error("Error loading texture " + fileName);
+				}
+				data.clear(); data.shrink_to_fit(); // No longer needed, free memory early
+			});
+	}
+
+	std::string error;
+	bool success = loader.Run(error);
+	ReportLoadTimes(loader.TimingReport("Textures"));
+	if (!success)
+	{
+		gLastError = error;
 		return false;
 	}
 	return true;
-
 }
 
 bool TextureManager::CreateTextures()//Create all textures that are not laoded from image file
@@ -58,6 +99,14 @@ bool TextureManager::CreateTextures()//Create all textures that are not laoded f
 		gLastError = "Error creating shadow map texture";
 		return false;
 	}
+	// The cached static shadow maps are only copied from, so aren't seen by shaders
+	ShadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	if (FAILED(gD3DDevice->CreateTexture2D(&ShadowDesc, NULL, &gShadowMap1StaticTexture)) ||
+	    FAILED(gD3DDevice->CreateTexture2D(&ShadowDesc, NULL, &gShadowMap2StaticTexture)))
+	{
+		gLastError = "Error creating static shadow map texture";
+		return false;
+	}
 	dsvDesc = {};
 	// Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
 	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT; // See "tech gotcha" above. The depth buffer sees each pixel as a "depth" float
@@ -76,6 +125,12 @@ bool TextureManager::CreateTextures()//Create all textures that are not laoded f
 		gLastError = "Error creating shadow map depth stencil view";
 		return false;
 	}
+	if (FAILED(gD3DDevice->CreateDepthStencilView(gShadowMap1StaticTexture, &dsvDesc, &gShadowMap1StaticDepthStencil)) ||
+	    FAILED(gD3DDevice->CreateDepthStencilView(gShadowMap2StaticTexture, &dsvDesc, &gShadowMap2StaticDepthStencil)))
+	{
+		gLastError = "Error creating static shadow map depth stencil view";
+		return false;
+	}
 
 	srvDesc = {};
 	// We also need to send this texture (resource) to the shaders. To do that we must create a shader-resource "view"
@@ -404,6 +459,11 @@ void TextureManager::ReleaseTextures()//Release all texture and prepare for use
 	if (gShadowMap2SRV)					gShadowMap2SRV->Release();
 	if (gShadowMap2Texture)			    gShadowMap2Texture->Release();
 
+	if (gShadowMap1StaticDepthStencil)	gShadowMap1StaticDepthStencil->Release();
+	if (gShadowMap1StaticTexture)		gShadowMap1StaticTexture->Release();
+	if (gShadowMap2StaticDepthStencil)	gShadowMap2StaticDepthStencil->Release();
+	if (gShadowMap2StaticTexture)		gShadowMap2StaticTexture->Release();
+
 	if (gTrollSpecularDiffuseMap)		gTrollSpecularDiffuseMap->Release();
 	if (gTrollSpecularDiffuseMapSRV)     gTrollSpecularDiffuseMapSRV->Release();
 
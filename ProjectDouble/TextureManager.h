@@ -56,6 +56,12 @@ public:
 	ID3D11DepthStencilView*   gShadowMap2DepthStencil = nullptr;
 	ID3D11ShaderResourceView* gShadowMap2SRV = nullptr;
 
+	// Depth of the static shadow casters alone, copied into the shadow maps above each frame (see ShadowCache.h)
+	ID3D11Texture2D*          gShadowMap1StaticTexture = nullptr;
+	ID3D11DepthStencilView*   gShadowMap1StaticDepthStencil = nullptr;
+	ID3D11Texture2D*          gShadowMap2StaticTexture = nullptr;
+	ID3D11DepthStencilView*   gShadowMap2StaticDepthStencil = nullptr;
+
 	ID3D11Texture2D* gATexture;
 	ID3D11RenderTargetView* gATextureRenderTarget;
 	ID3D11ShaderResourceView* gATextureSRV;
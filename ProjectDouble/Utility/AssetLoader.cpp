@@ -0,0 +1,177 @@
+//--------------------------------------------------------------------------------------
+// Asset loader - loads a set of independent assets on worker threads
+//--------------------------------------------------------------------------------------
+
+#include "AssetLoader.h"
+#include "Timer.h"
+#include "Profiler.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+
+// Add an asset to load. Either function may be empty: an asset with no load function is just created on the
+// calling thread, an asset with no create function is only loaded. The name is used for errors and timings
+void AssetLoader::Add(const std::string& name, std::function<void()> load, std::function<void()> create)
+{
+	mAssets.push_back({ name, std::move(load), std::move(create) });
+}
+
+
+// Run a load or create function, returning the error message if it throws, or an empty string on success
+static std::string RunAssetFunction(const std::function<void()>& function, const std::string& assetName)
+{
+	try
+	{
+		if (function)  function();
+	}
+	catch (const std::exception& e)
+	{
+		return e.what();
+	}
+	catch (...)
+	{
+		return "Unknown error loading " + assetName;
+	}
+	return "";
+}
+
+
+// Load and create all the assets added, using the given number of worker threads (0 for one per processor core,
+// less one for the calling thread). Returns when all assets are done. Returns false if any load or create function
+// threw an exception, with the message of the first one in error. The other assets are still loaded and created
+bool AssetLoader::Run(std::string& error, unsigned int numThreads /*= 0*/)
+{
+	Timer totalTimer;
+	error.clear();
+
+	unsigned int numAssets = static_cast<unsigned int>(mAssets.size());
+	mTimings.resize(numAssets);
+	std::vector<std::string> loadErrors(numAssets);
+
+	// Assets finished loading, waiting to be created on this thread
+	std::deque<unsigned int> loaded;
+	std::mutex               loadedMutex;
+	std::condition_variable  loadedCondition;
+
+	// Assets without a load function are ready to create straight away, the others are shared out to the workers.
+	// Each asset's load and create functions are profiled as zones named after the asset
+	std::vector<unsigned int> toLoad;
+	std::vector<const char*>  loadZones(numAssets);
+	std::vector<const char*>  createZones(numAssets);
+	for (unsigned int i = 0; i < numAssets; ++i)
+	{
+		mTimings[i] = { mAssets[i].name, 0.0f, 0.0f };
+		loadZones[i] = gProfiler.Intern("Load " + mAssets[i].name);
+		createZones[i] = gProfiler.Intern("Create " + mAssets[i].name);
+		if (mAssets[i].load)  toLoad.push_back(i);
+		else                  loaded.push_back(i);
+	}
+
+	// Each worker takes the next asset to load until there are none left
+	std::atomic<unsigned int> nextToLoad(0);
+	auto worker = [&]()
+	{
+		Timer timer;
+		for (unsigned int next = nextToLoad++; next < toLoad.size(); next = nextToLoad++)
+		{
+			unsigned int asset = toLoad[next];
+			timer.GetLapTime();
+			{
+				PROFILE_ZONE(loadZones[asset]);
+				loadErrors[asset] = RunAssetFunction(mAssets[asset].load, mAssets[asset].name);
+			}
+			mTimings[asset].loadTime = timer.GetLapTime();
+
+			std::lock_guard<std::mutex> lock(loadedMutex);
+			loaded.push_back(asset);
+			loadedCondition.notify_one();
+		}
+	};
+
+	if (numThreads == 0)
+	{
+		unsigned int numCores = std::thread::hardware_concurrency(); // May be 0 if unknown
+		numThreads = (numCores > 1) ? numCores - 1 : 1;
+	}
+	if (numThreads > toLoad.size())  numThreads = static_cast<unsigned int>(toLoad.size());
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < numThreads; ++i)
+	{
+		workers.emplace_back(worker);
+	}
+
+	// Create each asset as it becomes ready. Keep going after an error so no worker is left using data that is freed
+	Timer createTimer;
+	for (unsigned int numCreated = 0; numCreated < numAssets; ++numCreated)
+	{
+		unsigned int asset;
+		{
+			std::unique_lock<std::mutex> lock(loadedMutex);
+			loadedCondition.wait(lock, [&]() { return !loaded.empty(); });
+			asset = loaded.front();
+			loaded.pop_front();
+		}
+
+		std::string assetError = loadErrors[asset];
+		if (assetError.empty())
+		{
+			createTimer.GetLapTime();
+			{
+				PROFILE_ZONE(createZones[asset]);
+				assetError = RunAssetFunction(mAssets[asset].create, mAssets[asset].name);
+			}
+			mTimings[asset].createTime = createTimer.GetLapTime();
+		}
+		if (!assetError.empty() && error.empty())
+		{
+			error = assetError;
+		}
+	}
+
+	for (auto& thread : workers)
+	{
+		thread.join();
+	}
+
+	mAssets.clear();
+	mTotalTime = totalTimer.GetTime();
+	return error.empty();
+}
+
+
+// Return the timings above as text, one asset per line, with the given title
+std::string AssetLoader::TimingReport(const std::string& title) const
+{
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(1);
+	report << title << ": " << mTimings.size() << " assets in " << mTotalTime * 1000.0f << "ms\n";
+	for (auto& timing : mTimings)
+	{
+		report << "  " << std::left << std::setw(40) << timing.name << std::right
+		       << " load " << std::setw(8) << timing.loadTime * 1000.0f << "ms"
+		       << "  create " << std::setw(8) << timing.createTime * 1000.0f << "ms\n";
+	}
+	return report.str();
+}
+
+
+// Write a timing report to the debugger output and append it to the load times file (LoadTimes.txt), which is
+// cleared the first time it is written each run. Used to track start-up times
+void ReportLoadTimes(const std::string& report)
+{
+	OutputDebugStringA(report.c_str());
+
+	static bool firstReport = true;
+	std::ofstream file("LoadTimes.txt", firstReport ? std::ios::trunc : std::ios::app);
+	file << report;
+	firstReport = false;
+}
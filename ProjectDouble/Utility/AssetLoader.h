@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------------------
+// Asset loader - loads a set of independent assets on worker threads
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Each asset is given two functions. The load function does the file reading and CPU-side processing (e.g. the
+// assimp import of a mesh) and is run on a pool of worker threads. It must not use DirectX. The create function
+// creates the GPU resources from the loaded data and is run on the thread that called Run, one asset at a time,
+// as soon as that asset's load function has finished. So GPU resource creation overlaps with the loading of
+// other assets, but the DirectX device and context are only ever used from one thread.
+//
+// Exceptions thrown by either function are caught and reported by Run, so the usual error handling (a
+// std::runtime_error message put in gLastError) still works.
+
+#ifndef _ASSET_LOADER_H_INCLUDED_
+#define _ASSET_LOADER_H_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <functional>
+
+class AssetLoader
+{
+public:
+	// Add an asset to load. Either function may be empty: an asset with no load function is just created on the
+	// calling thread, an asset with no create function is only loaded. The name is used for errors and timings
+	void Add(const std::string& name, std::function<void()> load, std::function<void()> create);
+
+	// Load and create all the assets added, using the given number of worker threads (0 for one per processor core,
+	// less one for the calling thread). Returns when all assets are done. Returns false if any load or create function
+	// threw an exception, with the message of the first one in error. The other assets are still loaded and created
+	bool Run(std::string& error, unsigned int numThreads = 0);
+
+
+	// Timings from the last call to Run, in seconds
+	struct AssetTiming
+	{
+		std::string name;
+		float       loadTime;   // Time in the load function (on a worker thread)
+		float       createTime; // Time in the create function (on the calling thread)
+	};
+	const std::vector<AssetTiming>& Timings() const  { return mTimings; }
+	float TotalTime() const  { return mTotalTime; } // Wall-clock time for the whole of Run
+
+	// Return the timings above as text, one asset per line, with the given title
+	std::string TimingReport(const std::string& title) const;
+
+
+private:
+	struct Asset
+	{
+		std::string           name;
+		std::function<void()> load;
+		std::function<void()> create;
+	};
+
+	std::vector<Asset>       mAssets;
+	std::vector<AssetTiming> mTimings;
+	float                    mTotalTime = 0;
+};
+
+
+// Write a timing report to the debugger output and append it to the load times file (LoadTimes.txt), which is
+// cleared the first time it is written each run. Used to track start-up times
+void ReportLoadTimes(const std::string& report);
+
+
+#endif //_ASSET_LOADER_H_INCLUDED_
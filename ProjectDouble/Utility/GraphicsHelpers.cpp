@@ -4,10 +4,28 @@
 
 #include "GraphicsHelpers.h"
 #include "../Shader.h"
+#include "../RenderDevice.h"
 #include <cmath>
 #include <cctype>
+#include <fstream>
 #include <atlbase.h> // C-string to unicode conversion function CA2CT
 
+//--------------------------------------------------------------------------------------
+// Constant buffers
+//--------------------------------------------------------------------------------------
+
+// Update a constant buffer with the given number of bytes from the start of the data. The rest of the buffer has
+// undefined contents afterwards, so use this only when the shaders won't read past the data given (e.g. bone matrices
+// for a mesh with fewer than MAX_BONES bones). The bytes sent are counted in gConstantBufferStats
+void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* bufferData, size_t size)
+{
+    gRenderDevice->UpdateBuffer(buffer, bufferData, size);
+
+    gConstantBufferStats.bytesUploaded += size;
+    ++gConstantBufferStats.uploads;
+}
+
+
 //--------------------------------------------------------------------------------------
 // Texture Loading
 //--------------------------------------------------------------------------------------
@@ -16,12 +34,17 @@
 // This function requires you to pass a ID3D11Resource* (e.g. &gTilesDiffuseMap), which manages the GPU memory for the
 // texture and also a ID3D11ShaderResourceView* (e.g. &gTilesDiffuseMapSRV), which allows us to use the texture in shaders
 // The function will fill in these pointers with usable data. Returns false on failure
+// DDS files need a different function from other files, so check the filename extension (case insensitive)
+static bool IsDDSFile(const std::string& filename)
+{
+    std::string dds = ".dds";
+    return filename.size() >= 4 &&
+           std::equal(dds.rbegin(), dds.rend(), filename.rbegin(), [](unsigned char a, unsigned char b) { return std::tolower(a) == std::tolower(b); });
+}
+
 bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
 {
-    // DDS files need a different function from other files
-    std::string dds = ".dds"; // So check the filename extension (case insensitive)
-    if (filename.size() >= 4 &&
-        std::equal(dds.rbegin(), dds.rend(), filename.rbegin(), [](unsigned char a, unsigned char b) { return std::tolower(a) == std::tolower(b); }))
+    if (IsDDSFile(filename))
     {
         return SUCCEEDED(DirectX::CreateDDSTextureFromFile(gD3DDevice, CA2CT(filename.c_str()), texture, textureSRV));
     }
@@ -32,6 +55,35 @@ bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderRes
 }
 
 
+// Two stage version of LoadTexture, for loading textures on worker threads. ReadTextureFile reads the file into memory
+// and can be used on any thread. CreateTextureFromMemory decodes the data and creates the texture, it must be used on
+// the main thread because it uses the DirectX context (to create mip-maps). Both return false on failure
+bool ReadTextureFile(const std::string& filename, std::vector<uint8_t>& fileData)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file)  return false;
+
+    std::streamoff size = file.tellg();
+    if (size <= 0)  return false;
+    fileData.resize(static_cast<size_t>(size));
+    file.seekg(0);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(fileData.data()), size));
+}
+
+bool CreateTextureFromMemory(const std::string& filename, const std::vector<uint8_t>& fileData,
+                             ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
+{
+    if (IsDDSFile(filename))
+    {
+        return SUCCEEDED(DirectX::CreateDDSTextureFromMemory(gD3DDevice, fileData.data(), fileData.size(), texture, textureSRV));
+    }
+    else
+    {
+        return SUCCEEDED(DirectX::CreateWICTextureFromMemory(gD3DDevice, gD3DContext, fileData.data(), fileData.size(), texture, textureSRV));
+    }
+}
+
+
 //--------------------------------------------------------------------------------------
 // Camera Helpers
 //--------------------------------------------------------------------------------------
@@ -8,6 +8,8 @@
 
 #include <WICTextureLoader.h>
 #include <DDSTextureLoader.h>
+#include <string>
+#include <vector>
 
 #include "CMatrix4x4.h"
 #include "../Common.h"
@@ -17,16 +19,18 @@
 // Constant buffers
 //--------------------------------------------------------------------------------------
 
+// Update a constant buffer with the given number of bytes from the start of the data. The rest of the buffer has
+// undefined contents afterwards, so use this only when the shaders won't read past the data given (e.g. bone matrices
+// for a mesh with fewer than MAX_BONES bones). The bytes sent are counted in gConstantBufferStats
+void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* bufferData, size_t size);
+
 // Template function to update a constant buffer. Pass the DirectX constant buffer object and the C++ data structure
 // you want to update it with. The structure will be copied in full over to the GPU constant buffer, where it will
 // be available to shaders. This is used to update model and camera positions, lighting data etc.
 template <class T>
 void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
 {
-    D3D11_MAPPED_SUBRESOURCE cb;
-    gD3DContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &cb);
-    memcpy(cb.pData, &bufferData, sizeof(T));
-    gD3DContext->Unmap(buffer, 0);
+    UpdateConstantBuffer(buffer, &bufferData, sizeof(T));
 }
 
 
@@ -40,6 +44,13 @@ void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
 // The function will fill in these pointers with usable data. Returns false on failure
 bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV);
 
+// Two stage version of LoadTexture, for loading textures on worker threads. ReadTextureFile reads the file into memory
+// and can be used on any thread. CreateTextureFromMemory decodes the data and creates the texture, it must be used on
+// the main thread because it uses the DirectX context (to create mip-maps). Both return false on failure
+bool ReadTextureFile(const std::string& filename, std::vector<uint8_t>& fileData);
+bool CreateTextureFromMemory(const std::string& filename, const std::vector<uint8_t>& fileData,
+                             ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV);
+
 
 //--------------------------------------------------------------------------------------
 // Camera helpers
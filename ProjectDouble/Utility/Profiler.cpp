@@ -0,0 +1,387 @@
+//--------------------------------------------------------------------------------------
+// Profiler - times named zones of the CPU work in each frame
+//--------------------------------------------------------------------------------------
+
+#include "Profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+
+namespace
+{
+	// Zero time for the profiler. Defined before gProfiler so it is set up first
+	const std::chrono::steady_clock::time_point sEpoch = std::chrono::steady_clock::now();
+
+	// Name of the pseudo zone holding the time between calls to EndFrame
+	const char* const kFrameZone = "Frame";
+
+	// Value at the given fraction through a sorted list of times (nearest rank)
+	float Percentile(const std::vector<float>& sortedTimes, float fraction)
+	{
+		size_t rank = static_cast<size_t>(std::ceil(fraction * sortedTimes.size()));
+		return sortedTimes[rank > 0 ? rank - 1 : 0];
+	}
+
+	// Write a string as a JSON string literal
+	void WriteJSONString(std::ostream& out, const std::string& text)
+	{
+		out << '"';
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')  out << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20)  out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+			else out << c;
+		}
+		out << '"';
+	}
+}
+
+const unsigned int Profiler::kSummaryFrames;
+const unsigned int Profiler::kBufferZones;
+
+
+// The profiler used throughout the app
+Profiler gProfiler;
+
+
+//--------------------------------------------------------------------------------------
+// Thread buffers
+//--------------------------------------------------------------------------------------
+
+// Zones are written by the owning thread and read by EndFrame. Each side only moves its own index, so no lock is needed.
+// The write index is released after a zone is stored and the read index after zones are read, so neither side sees a
+// slot the other is still using
+struct Profiler::ThreadBuffer
+{
+	ZoneEvent                 zones[kBufferZones];
+	std::atomic<unsigned int> write{ 0 };
+	std::atomic<unsigned int> read{ 0 };
+	std::atomic<unsigned int> dropped{ 0 };      // Zones lost because the buffer was full
+	std::atomic<bool>         finished{ false }; // The thread has exited, delete the buffer once it is drained
+	unsigned int              depth = 0;         // Zones open on the thread, only used by the thread
+	unsigned int              id = 0;
+	std::string               name;
+};
+
+// Thread local holding a thread's buffer. Worker threads come and go (e.g. the asset loader's), so a buffer is marked
+// finished when its thread exits and deleted by the next EndFrame
+struct Profiler::ThreadOwner
+{
+	ThreadBuffer* buffer = nullptr;
+	~ThreadOwner()  { if (buffer)  buffer->finished.store(true, std::memory_order_release); }
+};
+
+
+// The calling thread's buffer, registered on first use
+Profiler::ThreadBuffer* Profiler::CurrentThread()
+{
+	static thread_local ThreadOwner owner;
+	if (owner.buffer == nullptr)  owner.buffer = gProfiler.AddThread();
+	return owner.buffer;
+}
+
+// Register the calling thread, returning its buffer
+Profiler::ThreadBuffer* Profiler::AddThread()
+{
+	ThreadBuffer* buffer = new ThreadBuffer;
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	buffer->id = mNextThreadId++;
+	buffer->name = (std::this_thread::get_id() == mMainThread) ? "Main" : "Thread " + std::to_string(buffer->id);
+	mThreads.push_back(buffer);
+	return buffer;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction
+//--------------------------------------------------------------------------------------
+
+// The profiler is created during static initialisation, so on the main thread
+Profiler::Profiler()
+{
+	mMainThread = std::this_thread::get_id();
+}
+
+Profiler::~Profiler()
+{
+	for (auto buffer : mThreads)  delete buffer;
+}
+
+
+// Time in nanoseconds since the profiler was created
+int64_t Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sEpoch).count();
+}
+
+
+// Return a copy of the given name that lasts as long as the profiler, for zones named at run time
+const char* Profiler::Intern(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	return mNames.insert(name).first->c_str(); // Set elements don't move
+}
+
+
+//--------------------------------------------------------------------------------------
+// Zones
+//--------------------------------------------------------------------------------------
+
+void Profiler::BeginZone()
+{
+	++CurrentThread()->depth;
+}
+
+// Store a finished zone in the thread's buffer, or count it as dropped if the buffer is full
+void Profiler::EndZone(const char* name, int64_t start)
+{
+	int64_t end = Now();
+	ThreadBuffer* buffer = CurrentThread();
+	--buffer->depth;
+
+	unsigned int write = buffer->write.load(std::memory_order_relaxed);
+	if (write - buffer->read.load(std::memory_order_acquire) >= kBufferZones)
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	buffer->zones[write % kBufferZones] = { name, start, end, buffer->depth };
+	buffer->write.store(write + 1, std::memory_order_release);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Collection
+//--------------------------------------------------------------------------------------
+
+// Collect the zones recorded since the last call and update the summary. Call once per frame on the main thread
+bool Profiler::EndFrame()
+{
+	int64_t now = Now();
+	++mFrame;
+	ThreadBuffer* mainThread = CurrentThread(); // Before taking the lock, as this may register the thread
+
+	// Collect each thread's zones. Finished threads are removed once their last zones are in
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for (size_t i = 0; i < mThreads.size();)
+		{
+			ThreadBuffer* buffer = mThreads[i];
+			bool finished = buffer->finished.load(std::memory_order_acquire);
+			Drain(*buffer);
+			if (finished)
+			{
+				delete buffer;
+				mThreads.erase(mThreads.begin() + i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+	}
+
+	// Time since the last frame. The first frame includes start-up so isn't counted
+	if (mFrame > 1)
+	{
+		AddZoneTime(Zone(kFrameZone, 0, std::numeric_limits<int64_t>::min()), now - mLastEndFrame);
+		if (mCaptureFrames > 0)
+		{
+			CaptureThread(*mainThread);
+			mCapture.push_back({ { kFrameZone, mLastEndFrame, now, 0 }, mainThread->id });
+		}
+	}
+	mLastEndFrame = now;
+
+	// Move the frame totals into the summary
+	for (auto index : mFrameZones)
+	{
+		ZoneStats& zone = mZones[index];
+		zone.times[zone.nextTime] = zone.frameTime * 1e-6f;
+		zone.calls[zone.nextTime] = zone.frameCalls;
+		zone.nextTime = (zone.nextTime + 1) % kSummaryFrames;
+		if (zone.numTimes < kSummaryFrames)  ++zone.numTimes;
+		zone.lastFrame = mFrame;
+		zone.frameTime = 0;
+		zone.frameCalls = 0;
+	}
+	mFrameZones.clear();
+
+	// Write the capture when it is complete
+	if (mCaptureFrames > 0 && --mCaptureFrames == 0)
+	{
+		bool written = WriteChromeTrace(mCaptureFile);
+		mCapture.clear();
+		mCaptureThreads.clear();
+		return written;
+	}
+	return true;
+}
+
+
+// Add a ring buffer's new zones to the frame totals (and the capture if there is one)
+void Profiler::Drain(ThreadBuffer& buffer)
+{
+	unsigned int write = buffer.write.load(std::memory_order_acquire);
+	unsigned int read = buffer.read.load(std::memory_order_relaxed);
+	if (read != write && mCaptureFrames > 0)  CaptureThread(buffer);
+
+	for (; read != write; ++read)
+	{
+		const ZoneEvent& event = buffer.zones[read % kBufferZones];
+		AddZoneTime(Zone(event.name, event.depth, event.start), event.end - event.start);
+		if (mCaptureFrames > 0)  mCapture.push_back({ event, buffer.id });
+	}
+	buffer.read.store(write, std::memory_order_release);
+	mDroppedZones += buffer.dropped.exchange(0, std::memory_order_relaxed);
+}
+
+
+// Find or add the stats for a zone name, returning its index in mZones. Names are usually found by pointer, equal names
+// at different addresses (e.g. the same literal in two files) share stats
+unsigned int Profiler::Zone(const char* name, unsigned int depth, int64_t start)
+{
+	auto foundPointer = mZoneByPointer.find(name);
+	if (foundPointer != mZoneByPointer.end())  return foundPointer->second;
+
+	unsigned int index;
+	auto foundName = mZoneByName.find(name);
+	if (foundName != mZoneByName.end())
+	{
+		index = foundName->second;
+	}
+	else
+	{
+		index = static_cast<unsigned int>(mZones.size());
+		mZones.emplace_back();
+		mZones.back().name = name;
+		mZones.back().depth = depth;
+		mZones.back().firstStart = start;
+		mZoneByName[name] = index;
+	}
+	mZoneByPointer[name] = index;
+	return index;
+}
+
+// Add a zone's time to its total for the frame being collected
+void Profiler::AddZoneTime(unsigned int zone, int64_t time)
+{
+	ZoneStats& stats = mZones[zone];
+	if (stats.frameCalls == 0)  mFrameZones.push_back(zone);
+	stats.frameTime += time;
+	++stats.frameCalls;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Results
+//--------------------------------------------------------------------------------------
+
+// Summary of the zones used in any of the last kSummaryFrames frames, in the order they were first started
+std::vector<Profiler::ZoneSummary> Profiler::Summary() const
+{
+	std::vector<const ZoneStats*> zones;
+	for (auto& zone : mZones)
+	{
+		if (zone.numTimes > 0 && mFrame - zone.lastFrame < kSummaryFrames)  zones.push_back(&zone);
+	}
+	std::stable_sort(zones.begin(), zones.end(), [](const ZoneStats* a, const ZoneStats* b) { return a->firstStart < b->firstStart; });
+
+	std::vector<ZoneSummary> summary;
+	std::vector<float> times;
+	for (auto zone : zones)
+	{
+		times.assign(zone->times, zone->times + zone->numTimes);
+		std::sort(times.begin(), times.end());
+		unsigned int totalCalls = 0;
+		for (unsigned int i = 0; i < zone->numTimes; ++i)  totalCalls += zone->calls[i];
+
+		ZoneSummary zoneSummary;
+		zoneSummary.name = zone->name;
+		zoneSummary.depth = zone->depth;
+		zoneSummary.frames = zone->numTimes;
+		zoneSummary.calls = static_cast<float>(totalCalls) / zone->numTimes;
+		zoneSummary.median = Percentile(times, 0.5f);
+		zoneSummary.p95 = Percentile(times, 0.95f);
+		zoneSummary.p99 = Percentile(times, 0.99f);
+		zoneSummary.max = times.back();
+		summary.push_back(zoneSummary);
+	}
+	return summary;
+}
+
+// Return the summary as text, one zone per line indented by depth
+std::string Profiler::SummaryReport() const
+{
+	std::ostringstream report;
+	report << "CPU zones, ms per frame median / p95 / p99 / max over the last " << kSummaryFrames << " frames:\n";
+	report << std::fixed << std::setprecision(2);
+	for (auto& zone : Summary())
+	{
+		report << "  " << std::string(zone.depth * 2, ' ') << zone.name << ": " << zone.median << " / " << zone.p95 << " / "
+		       << zone.p99 << " / " << zone.max << " (" << std::setprecision(1) << zone.calls << " calls)\n"
+		       << std::setprecision(2);
+	}
+	if (mDroppedZones > 0)  report << "  " << mDroppedZones << " zones dropped, thread buffers full\n";
+	return report.str();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Chrome trace
+//--------------------------------------------------------------------------------------
+
+// Keep every zone of the given number of frames from the next EndFrame on, then write them to the given file
+void Profiler::CaptureFrames(unsigned int numFrames, const std::string& fileName)
+{
+	mCapture.clear();
+	mCaptureThreads.clear();
+	mCaptureFrames = numFrames;
+	mCaptureFile = fileName;
+}
+
+// Add a thread's name to the capture if it isn't there yet
+void Profiler::CaptureThread(const ThreadBuffer& buffer)
+{
+	for (auto& thread : mCaptureThreads)
+	{
+		if (thread.first == buffer.id)  return;
+	}
+	mCaptureThreads.push_back({ buffer.id, buffer.name });
+}
+
+// Write the zones captured so far as a Chrome trace: complete ("X") events with times in microseconds, and the thread
+// names as metadata events. Returns false if the file can't be written
+bool Profiler::WriteChromeTrace(const std::string& fileName) const
+{
+	std::ofstream file(fileName);
+	if (!file)  return false;
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << std::fixed << std::setprecision(3);
+	bool first = true;
+	for (auto& thread : mCaptureThreads)
+	{
+		file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << thread.first << ",\"args\":{\"name\":";
+		WriteJSONString(file, thread.second);
+		file << "}}";
+		first = false;
+	}
+	for (auto& captured : mCapture)
+	{
+		file << (first ? "" : ",\n") << "{\"ph\":\"X\",\"name\":";
+		WriteJSONString(file, captured.zone.name);
+		file << ",\"pid\":1,\"tid\":" << captured.threadId << ",\"ts\":" << captured.zone.start * 1e-3
+		     << ",\"dur\":" << (captured.zone.end - captured.zone.start) * 1e-3 << "}";
+		first = false;
+	}
+	file << "\n]}\n";
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,201 @@
+//--------------------------------------------------------------------------------------
+// Profiler - times named zones of the CPU work in each frame
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Put PROFILE_ZONE("Name") at the start of a block to time the rest of the block. Zones can nest and can be used on
+// any thread. The name must be a string that lasts for the whole run - normally a string literal, see Intern for names
+// made at run time.
+//
+// Each thread writes its zones into its own ring buffer, with no locks. Call EndFrame once per frame on the main
+// thread: it collects the zones from every thread's buffer, adds up each zone's time for the frame and keeps the
+// totals of the last kSummaryFrames frames that used the zone, from which Summary gives the median, 95th and 99th
+// percentile times. A zone used several times in a frame (e.g. a pass run for both the portal camera and the main
+// camera) is counted once with the total time. A pseudo zone "Frame" holds the time between calls to EndFrame.
+//
+// CaptureFrames keeps every zone of the next few frames and writes them as a Chrome trace (JSON trace event format),
+// which can be viewed in chrome://tracing or ui.perfetto.dev to see how the zones nest and overlap on each thread.
+//
+// Define PROFILER_DISABLED to compile out the zones, EndFrame then only times the frame
+
+#ifndef _PROFILER_H_INCLUDED_
+#define _PROFILER_H_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+
+class Profiler
+{
+public:
+	// Number of frames kept for the summary
+	static const unsigned int kSummaryFrames = 240;
+
+	// Zones each thread can hold between calls to EndFrame. Zones are dropped (and counted) if a buffer is full
+	static const unsigned int kBufferZones = 8192;
+
+
+	Profiler();
+	~Profiler();
+
+	// Time in nanoseconds since the profiler was created
+	static int64_t Now();
+
+
+	// Collect the zones recorded since the last call and update the summary. Call once per frame on the main thread,
+	// after rendering. Returns false if a capture finished this frame but couldn't be written
+	bool EndFrame();
+
+	// Keep every zone of the given number of frames from the next EndFrame on, then write them to the given file as a
+	// Chrome trace. Replaces any capture in progress
+	void CaptureFrames(unsigned int numFrames, const std::string& fileName);
+
+	// Write the zones captured so far as a Chrome trace. Returns false if the file can't be written
+	bool WriteChromeTrace(const std::string& fileName) const;
+
+
+	// Times of a zone over the frames kept for the summary, in milliseconds per frame
+	struct ZoneSummary
+	{
+		std::string  name;
+		unsigned int depth;   // Nesting depth of the zone when it was first seen, 0 for outermost zones
+		unsigned int frames;  // Frames in the summary that used the zone
+		float        calls;   // Average times used in those frames
+		float        median;
+		float        p95;
+		float        p99;
+		float        max;
+	};
+
+	// Summary of the zones used in any of the last kSummaryFrames frames, in the order they were first started (so
+	// nested zones follow their parents). The frame time comes first
+	std::vector<ZoneSummary> Summary() const;
+
+	// Return the summary as text, one zone per line indented by depth
+	std::string SummaryReport() const;
+
+	// Zones dropped because a thread's buffer was full, since the profiler was created
+	unsigned int DroppedZones() const  { return mDroppedZones; }
+
+
+	// Return a copy of the given name that lasts as long as the profiler, for zones named at run time. The same
+	// pointer is returned for equal names. Takes a lock, so call before a zone rather than in a tight loop
+	const char* Intern(const std::string& name);
+
+
+	// Used by ProfileZone
+	static void BeginZone();
+	static void EndZone(const char* name, int64_t start);
+
+
+private:
+	// A completed zone, times in nanoseconds
+	struct ZoneEvent
+	{
+		const char*  name;
+		int64_t      start;
+		int64_t      end;
+		unsigned int depth;
+	};
+
+	// Ring buffer of zones written by one thread and read by EndFrame, and the thread local that marks the buffer as
+	// finished when its thread exits
+	struct ThreadBuffer;
+	struct ThreadOwner;
+
+	// The calling thread's buffer, registered on first use
+	static ThreadBuffer* CurrentThread();
+
+	// Totals of one zone for the summary
+	struct ZoneStats
+	{
+		std::string  name;
+		unsigned int depth = 0;
+		int64_t      firstStart = 0;     // When the zone was first seen, for ordering the summary
+		int64_t      frameTime = 0;      // Total time and count in the frame being collected
+		unsigned int frameCalls = 0;
+		uint64_t     lastFrame = 0;      // Last frame the zone was used in
+		float        times[kSummaryFrames];
+		unsigned int calls[kSummaryFrames];
+		unsigned int numTimes = 0;
+		unsigned int nextTime = 0;
+	};
+
+	// Register the calling thread, returning its buffer
+	ThreadBuffer* AddThread();
+
+	// Find or add the stats for a zone name, returning its index in mZones
+	unsigned int Zone(const char* name, unsigned int depth, int64_t start);
+
+	// Add a zone's time to its total for the frame being collected
+	void AddZoneTime(unsigned int zone, int64_t time);
+
+	// Add a ring buffer's new zones to the frame totals (and the capture if there is one)
+	void Drain(ThreadBuffer& buffer);
+
+	// Add a thread's name to the capture if it isn't there yet
+	void CaptureThread(const ThreadBuffer& buffer);
+
+
+	// Threads with a buffer and the interned names. The lock is only taken by a zone when its thread is registered
+	std::mutex                      mThreadsMutex;
+	std::vector<ThreadBuffer*>      mThreads;
+	unsigned int                    mNextThreadId = 1;
+	std::thread::id                 mMainThread;
+	std::unordered_set<std::string> mNames;
+
+	std::vector<ZoneStats>                        mZones;
+	std::unordered_map<const char*, unsigned int> mZoneByPointer; // Zone names seen before, by pointer then by name
+	std::unordered_map<std::string, unsigned int> mZoneByName;
+	std::vector<unsigned int>                     mFrameZones;    // Zones used in the frame being collected
+	uint64_t     mFrame = 0;
+	int64_t      mLastEndFrame = 0;
+	unsigned int mDroppedZones = 0;
+
+	// Chrome trace capture
+	struct CapturedZone
+	{
+		ZoneEvent    zone;
+		unsigned int threadId;
+	};
+	std::vector<CapturedZone> mCapture;
+	std::vector<std::pair<unsigned int, std::string>> mCaptureThreads; // Id and name of each thread in the capture
+	unsigned int mCaptureFrames = 0;
+	std::string  mCaptureFile;
+};
+
+
+// Times the rest of the block it is created in, see PROFILE_ZONE
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char* name) : mName(name)  { Profiler::BeginZone(); mStart = Profiler::Now(); }
+	~ProfileZone()  { Profiler::EndZone(mName, mStart); }
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* mName;
+	int64_t     mStart;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifndef PROFILER_DISABLED
+	#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+	#define PROFILE_ZONE(name) ((void)0)
+#endif
+
+
+// The profiler used throughout the app
+extern Profiler gProfiler;
+
+
+#endif //_PROFILER_H_INCLUDED_